@@ -2,6 +2,7 @@
 #include "utils.h"
 
 #include "renderer/image.h"
+#include "renderer/gpu_memory.h"
 
 #include <vulkan/vulkan.h>
 
@@ -172,9 +173,25 @@ void imgui_frame(ImGuiIO* io, Renderer* renderer)
         ImGui_SliderFloat("Dir y", &renderer->scene_data.sunlight_direction[1], -5, 5);
         ImGui_SliderFloat("Dir z", &renderer->scene_data.sunlight_direction[2], -5, 5);
         ImGui_SliderFloat("fov", &renderer->fov, 0, 180);
+        ImGui_SliderFloat("LOD error (px)", &renderer->lod_error_pixels, 0, 16);
+        ImGui_Checkbox("Meshlet culling", &renderer->culler.enabled);
+        ImGui_Checkbox("Frustum culling", &renderer->frustum_culling);
+        ImGui_Text("%u of %u surfaces culled", renderer->surfaces_culled, renderer->surfaces_tested);
+
+        IndirectDrawer* indirect = &renderer->indirect;
+        if (indirect->supported)
+        {
+            ImGui_Checkbox("GPU-driven draws", &indirect->enabled);
+            ImGui_Text("%u objects in %u materials", indirect->n_objects, indirect->n_buckets);
+        }
+
+        if (renderer->timestamp_period != 0)
+            ImGui_Text("GPU frame %.2f ms", renderer->gpu_frame_ms);
     }
     ImGui_End();
 
+    imgui_memory_panel(renderer);
+
     ImGui_Render();
 
     // Update and Render additional Platform Windows
@@ -184,3 +201,78 @@ void imgui_frame(ImGuiIO* io, Renderer* renderer)
         ImGui_RenderPlatformWindowsDefault();
     }
 }
+
+void imgui_memory_panel(Renderer* renderer)
+{
+    if (ImGui_Begin("Memory", NULL, 0))
+    {
+        MemoryReport report;
+        gpu_memory_report(renderer, &report);
+
+        if (!renderer->memory_budget_supported)
+            ImGui_Text("No VK_EXT_memory_budget, budgets are estimated");
+
+        for (uint32_t i = 0; i < report.n_heaps; ++i)
+        {
+            MemoryHeapReport* heap = &report.heaps[i];
+            float fraction = heap->budget == 0 ? 0 : (float) heap->usage / heap->budget;
+
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", heap->usage / 1e6,
+                    heap->budget / 1e6);
+
+            ImGui_Text("Heap %u%s, %.1f MB", i, heap->device_local ? " (device local)" : "",
+                    heap->size / 1e6);
+            ImGui_ProgressBar(fraction, (ImVec2) { -1, 0 }, overlay);
+        }
+
+        ImGui_Separator();
+
+        for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+            ImGui_Text("%-16s %8.1f MB in %u", gpu_memory_category_name(i),
+                    report.category_bytes[i] / 1e6, report.category_allocations[i]);
+
+        ImGui_Separator();
+
+        // last frame's graph, this frame's hasn't been declared yet
+        RenderGraph* graph = &renderer->graph;
+        ImGui_Text("Render graph %u passes, %u culled", graph->n_passes, graph->n_culled);
+        ImGui_Text("Transient images %u in %u slots, %.1f MB (%.1f MB unaliased)", graph->n_images,
+                graph->n_slots, graph->transient_bytes / 1e6, graph->unaliased_bytes / 1e6);
+
+        ImGui_Separator();
+
+        Defragmenter* defrag = &renderer->defrag;
+        ImGui_Text("Defragmentation %s, %u runs", defrag->running ? "running" : "idle",
+                defrag->runs);
+        ImGui_Text("Textures moved %.1f MB, reclaimed %.1f MB in %u blocks",
+                defrag->texture_bytes_moved / 1e6, defrag->texture_bytes_freed / 1e6,
+                defrag->texture_blocks_freed);
+        ImGui_Text("Geometry moved %.1f MB", defrag->geometry_bytes_moved / 1e6);
+
+        if (ImGui_Button("Defragment"))
+            defrag->requested = true;
+
+        ImGui_Separator();
+
+        TextureStreamer* streamer = &renderer->streaming;
+        float pool_fraction = streamer->budget == 0 ? 0
+            : (float) streamer->resident_bytes / streamer->budget;
+
+        char pool_overlay[64];
+        snprintf(pool_overlay, sizeof(pool_overlay), "%.1f / %.1f MB",
+                streamer->resident_bytes / 1e6, streamer->budget / 1e6);
+
+        ImGui_Text("Streamed textures %u, %.1f MB wanted, %u requests in flight",
+                streamer->n_textures, streamer->wanted_bytes / 1e6, streamer->n_in_flight);
+        ImGui_ProgressBar(pool_fraction, (ImVec2) { -1, 0 }, pool_overlay);
+        ImGui_Text("Streamed in %u (%.1f MB), evicted %u", streamer->streamed_in,
+                streamer->bytes_streamed / 1e6, streamer->evicted);
+
+        // in whole megabytes, the scheduler picks the change up next frame
+        int budget_mb = (int) (streamer->budget >> 20);
+        if (ImGui_SliderInt("Texture pool (MB)", &budget_mb, 16, 2048))
+            streamer->budget = (VkDeviceSize) budget_mb << 20;
+    }
+    ImGui_End();
+}
@@ -9,3 +9,6 @@ void imgui_cleanup(Renderer* renderer);
 void imgui_draw(Renderer* renderer, VkCommandBuffer cmd_buf, VkImageView target_image_view);
 void imgui_frame(ImGuiIO* io, Renderer* renderer);
 
+// internal
+void imgui_memory_panel(Renderer* renderer);
+
@@ -1,7 +1,7 @@
 #include "engine.h"
 #include "utils.h"
 #include "renderer/swapchain.h"
-#include "scene/loader.h"
+#include "scene/cooked.h"
 
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
@@ -13,23 +13,28 @@
 
 void engine_initialise(Engine* engine)
 {
+    job_pool_initialise(&engine->jobs, 0);
     window_initialise(&engine->window);
     renderer_initialise(&engine->renderer, engine->window.window);
     imgui_initialise(&engine->renderer, engine->window.window, &engine->io);
 
+    asset_loader_initialise(&engine->assets, &engine->renderer, &engine->jobs);
+
     ecs_intitialise(&engine->ecs);
+    engine->context = (DrawContext) {0};
     // renderer->mesh = upload_mesh(renderer, indices, n_indices, vertices, n_vertices);
-    uint8_t n_meshes;
-    engine->renderer.meshes = load_glft_meshes(&engine->renderer, "basicmesh.glb",
-            &engine->renderer.n_meshes);
-    // Mesh* meshes = load_glft_meshes(&engine->renderer, "basicmesh.glb", &n_meshes);
-    Mesh* meshes = engine->renderer.meshes;
+    // prefer the cooked scene when `make cook` has produced an up to date one that lost nothing.
+    // it loads in the background and the entities show up once it is ready
+    bool cooked = cooked_is_current("basicmesh.nagm", "basicmesh.glb");
+    AssetHandle scene = asset_loader_load(&engine->assets,
+            cooked ? "basicmesh.nagm" : "basicmesh.glb");
+
     mat4 transform = GLM_MAT4_IDENTITY_INIT;
-    ecs_add_renderable(&engine->ecs, &meshes[0], transform);
+    ecs_add_renderable_asset(&engine->ecs, scene, 0, transform);
     glm_translate(transform, (vec4){ 4, 0, 0, 0 });
-    ecs_add_renderable(&engine->ecs, &meshes[1], transform);
+    ecs_add_renderable_asset(&engine->ecs, scene, 1, transform);
     glm_translate(transform, (vec4){ -8, 0, 2, 0 });
-    ecs_add_renderable(&engine->ecs, &meshes[2], transform);
+    ecs_add_renderable_asset(&engine->ecs, scene, 2, transform);
     // renderer->mesh = meshes[0].mesh_buffers;
 }
 
@@ -60,10 +65,14 @@ void engine_run(Engine* engine)
 
         imgui_frame(engine->io, &engine->renderer);
 
-        RenderObject opaque_surfaces[10] = {0};
-        DrawContext context = {opaque_surfaces, 0};
-        ecs_renderable_collect(&engine->ecs, &engine->renderer, &context);
-        renderer_draw(&engine->renderer, &context);
+        renderer_update_camera(&engine->renderer);
+
+        AssetHandle loaded;
+        while (asset_loader_poll(&engine->assets, &loaded))
+            ecs_resolve_asset(&engine->ecs, loaded, asset_loader_get(&engine->assets, loaded));
+
+        ecs_renderable_collect(&engine->ecs, &engine->renderer, &engine->context);
+        renderer_draw(&engine->renderer, &engine->context);
     }
 }
 
@@ -73,7 +82,10 @@ void engine_cleanup(Engine* engine)
 
     vkDeviceWaitIdle(engine->renderer.device);
     imgui_cleanup(&engine->renderer);
+    asset_loader_cleanup(&engine->assets);
     renderer_cleanup(&engine->renderer);
+    draw_context_cleanup(&engine->context);
+    job_pool_cleanup(&engine->jobs);
 }
 
 void process_inputs(Engine* engine)
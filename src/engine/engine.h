@@ -1,14 +1,20 @@
 #pragma once
 
 #include "window.h"
+#include "jobs.h"
 #include "renderer/renderer.h"
 #include "scene/scene.h"
+#include "scene/asset_loader.h"
 #include <imgui/dcimgui.h>
 
 typedef struct {
     Renderer renderer;
     Window window;
     ECS ecs;
+    JobPool jobs;
+    AssetLoader assets;
+    // the frame's draws, filled in again every frame
+    DrawContext context;
     ImGuiIO* io;
 } Engine;
 
@@ -0,0 +1,175 @@
+#include "jobs.h"
+#include "utils.h"
+
+#include <unistd.h>
+
+void job_pool_initialise(JobPool* pool, uint32_t n_threads)
+{
+    // the waiting thread works too, so one less worker than cores
+    if (n_threads == 0)
+        n_threads = job_pool_core_count() - 1;
+
+    pool->n_threads = n_threads;
+    pool->threads = malloc(sizeof(pthread_t) * (n_threads + 1));
+
+    pool->queue_capacity = 64;
+    pool->queue = malloc(sizeof(Job) * pool->queue_capacity);
+    pool->queue_head = 0;
+    pool->n_queued = 0;
+    pool->stopping = false;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (uint32_t i = 0; i < n_threads; ++i)
+    {
+        if (pthread_create(&pool->threads[i], NULL, job_pool_worker, pool) != 0)
+            FATAL("Could not create worker thread %d\n", i);
+    }
+
+    LOG_V("Job pool running with %d workers\n", n_threads);
+}
+
+void job_pool_cleanup(JobPool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->n_threads; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->mutex);
+
+    free(pool->queue);
+    free(pool->threads);
+}
+
+void job_pool_submit(JobPool* pool, JobFunc func, void* data, uint32_t count, JobCounter* counter)
+{
+    if (count == 0)
+        return;
+
+    // a few batches per thread keeps everyone busy without paying for a job per index
+    uint32_t n_batches = (pool->n_threads + 1) * 4;
+    uint32_t batch_size = (count + n_batches - 1) / n_batches;
+    n_batches = (count + batch_size - 1) / batch_size;
+
+    atomic_fetch_add(&counter->remaining, n_batches);
+
+    pthread_mutex_lock(&pool->mutex);
+    for (uint32_t i = 0; i < n_batches; ++i)
+    {
+        uint32_t first = i * batch_size;
+        uint32_t last = first + batch_size < count ? first + batch_size : count;
+
+        Job job = { func, data, first, last, counter };
+        job_pool_push(pool, job);
+    }
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void job_pool_wait(JobPool* pool, JobCounter* counter)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (atomic_load(&counter->remaining) != 0)
+    {
+        // help with whatever is queued rather than sleeping, this also means waiting from
+        // inside a job can't deadlock the pool
+        if (pool->n_queued != 0)
+        {
+            Job job = job_pool_pop(pool);
+            pthread_mutex_unlock(&pool->mutex);
+            job_pool_run(pool, job);
+            pthread_mutex_lock(&pool->mutex);
+            continue;
+        }
+
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void job_pool_parallel_for(JobPool* pool, JobFunc func, void* data, uint32_t count)
+{
+    JobCounter counter = {0};
+    job_pool_submit(pool, func, data, count, &counter);
+    job_pool_wait(pool, &counter);
+}
+
+uint32_t job_pool_core_count()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : n;
+}
+
+void* job_pool_worker(void* arg)
+{
+    JobPool* pool = arg;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true)
+    {
+        while (pool->n_queued == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+
+        if (pool->n_queued == 0)
+            break;
+
+        Job job = job_pool_pop(pool);
+        pthread_mutex_unlock(&pool->mutex);
+        job_pool_run(pool, job);
+        pthread_mutex_lock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+// needs the mutex held
+void job_pool_push(JobPool* pool, Job job)
+{
+    if (pool->n_queued == pool->queue_capacity)
+    {
+        // unwrap the ring into a bigger one
+        Job* new_queue = malloc(sizeof(Job) * pool->queue_capacity * 2);
+        for (uint32_t i = 0; i < pool->n_queued; ++i)
+            new_queue[i] = pool->queue[(pool->queue_head + i) % pool->queue_capacity];
+
+        free(pool->queue);
+        pool->queue = new_queue;
+        pool->queue_head = 0;
+        pool->queue_capacity *= 2;
+    }
+
+    pool->queue[(pool->queue_head + pool->n_queued) % pool->queue_capacity] = job;
+    pool->n_queued += 1;
+}
+
+// needs the mutex held and at least one job queued
+Job job_pool_pop(JobPool* pool)
+{
+    Job job = pool->queue[pool->queue_head];
+    pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
+    pool->n_queued -= 1;
+
+    return job;
+}
+
+void job_pool_run(JobPool* pool, Job job)
+{
+    for (uint32_t i = job.first; i < job.last; ++i)
+        job.func(job.data, i);
+
+    if (atomic_fetch_sub(&job.counter->remaining, 1) == 1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_broadcast(&pool->work_done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
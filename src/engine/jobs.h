@@ -0,0 +1,54 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// called once for every index in [0, count) given at submission
+typedef void (*JobFunc)(void* data, uint32_t index);
+
+typedef struct JobCounter {
+    atomic_uint remaining;
+} JobCounter;
+
+typedef struct Job {
+    JobFunc func;
+    void* data;
+    uint32_t first;
+    uint32_t last;
+    JobCounter* counter;
+} Job;
+
+typedef struct JobPool {
+    pthread_t* threads;
+    uint32_t n_threads;
+
+    // ring buffer of queued jobs, grows when it fills up
+    Job* queue;
+    uint32_t queue_capacity;
+    uint32_t queue_head;
+    uint32_t n_queued;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+
+    bool stopping;
+} JobPool;
+
+// n_threads of 0 uses every core, the thread that waits always helps out
+void job_pool_initialise(JobPool* pool, uint32_t n_threads);
+void job_pool_cleanup(JobPool* pool);
+
+void job_pool_submit(JobPool* pool, JobFunc func, void* data, uint32_t count, JobCounter* counter);
+void job_pool_wait(JobPool* pool, JobCounter* counter);
+void job_pool_parallel_for(JobPool* pool, JobFunc func, void* data, uint32_t count);
+
+uint32_t job_pool_core_count();
+
+// internal
+void* job_pool_worker(void* arg);
+void job_pool_push(JobPool* pool, Job job);
+Job job_pool_pop(JobPool* pool);
+void job_pool_run(JobPool* pool, Job job);
@@ -0,0 +1,193 @@
+#include "barriers.h"
+#include "../utils.h"
+
+// sampled images are only ever read by fragment shaders
+static const ImageState IMAGE_ACCESS_STATES[IMAGE_ACCESS_COUNT] = {
+    [IMAGE_ACCESS_NONE] = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE },
+    [IMAGE_ACCESS_TRANSFER_SRC] = {
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        VK_ACCESS_2_TRANSFER_READ_BIT,
+    },
+    [IMAGE_ACCESS_TRANSFER_DST] = {
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT,
+    },
+    [IMAGE_ACCESS_COLOUR_ATTACHMENT] = {
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+    },
+    [IMAGE_ACCESS_DEPTH_ATTACHMENT] = {
+        VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+            | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+    },
+    [IMAGE_ACCESS_SAMPLED] = {
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+    },
+    // presenting is ordered by the semaphore, the barrier only has to change the layout
+    [IMAGE_ACCESS_PRESENT] = {
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        VK_PIPELINE_STAGE_2_NONE,
+        VK_ACCESS_2_NONE,
+    },
+};
+
+BarrierBatch barrier_batch(Renderer* renderer, VkCommandBuffer cmd_buf)
+{
+    return (BarrierBatch) {
+        .pipeline_barrier = renderer->cmd_pipeline_barrier2,
+        .cmd_buf = cmd_buf,
+        .memory = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 },
+        .src_family = VK_QUEUE_FAMILY_IGNORED,
+        .dst_family = VK_QUEUE_FAMILY_IGNORED,
+    };
+}
+
+BarrierBatch barrier_batch_transfer(Renderer* renderer, VkCommandBuffer cmd_buf,
+        uint32_t src_family, uint32_t dst_family)
+{
+    BarrierBatch batch = barrier_batch(renderer, cmd_buf);
+    batch.src_family = src_family;
+    batch.dst_family = dst_family;
+
+    return batch;
+}
+
+void barrier_image(BarrierBatch* batch, Image* image, enum ImageAccess access)
+{
+    VkImageSubresourceRange range = {
+        .aspectMask = barrier_aspect(image->format),
+        .levelCount = VK_REMAINING_MIP_LEVELS,
+        .layerCount = VK_REMAINING_ARRAY_LAYERS,
+    };
+
+    barrier_image_range(batch, image->image, range, &image->state, access, false);
+}
+
+void barrier_image_discard(BarrierBatch* batch, Image* image, enum ImageAccess access)
+{
+    VkImageSubresourceRange range = {
+        .aspectMask = barrier_aspect(image->format),
+        .levelCount = VK_REMAINING_MIP_LEVELS,
+        .layerCount = VK_REMAINING_ARRAY_LAYERS,
+    };
+
+    barrier_image_range(batch, image->image, range, &image->state, access, true);
+}
+
+void barrier_image_range(BarrierBatch* batch, VkImage image, VkImageSubresourceRange range,
+        ImageState* state, enum ImageAccess access, bool discard)
+{
+    const ImageState* next = &IMAGE_ACCESS_STATES[access];
+
+    bool wrote = state->access & BARRIER_WRITE_ACCESS;
+    bool writes = next->access & BARRIER_WRITE_ACCESS;
+
+    if (!discard && !wrote && !writes && state->layout == next->layout)
+    {
+        state->stages |= next->stages;
+        state->access |= next->access;
+        return;
+    }
+
+    if (batch->n_images == BARRIER_BATCH_IMAGES)
+        barrier_flush(batch);
+
+    // only writes need making available, a read before a write just needs its stages waited on
+    batch->images[batch->n_images++] = (VkImageMemoryBarrier2) {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = state->stages,
+        .srcAccessMask = state->access & BARRIER_WRITE_ACCESS,
+        .dstStageMask = next->stages,
+        .dstAccessMask = next->access,
+        .oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state->layout,
+        .newLayout = next->layout,
+        .srcQueueFamilyIndex = batch->src_family,
+        .dstQueueFamilyIndex = batch->dst_family,
+        .image = image,
+        .subresourceRange = range,
+    };
+
+    *state = *next;
+}
+
+void barrier_memory(BarrierBatch* batch, VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+        VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access)
+{
+    batch->memory.srcStageMask |= src_stages;
+    batch->memory.srcAccessMask |= src_access;
+    batch->memory.dstStageMask |= dst_stages;
+    batch->memory.dstAccessMask |= dst_access;
+}
+
+void barrier_buffer(BarrierBatch* batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+        VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+        VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access)
+{
+    if (batch->n_buffers == BARRIER_BATCH_BUFFERS)
+        barrier_flush(batch);
+
+    batch->buffers[batch->n_buffers++] = (VkBufferMemoryBarrier2) {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = src_stages,
+        .srcAccessMask = src_access,
+        .dstStageMask = dst_stages,
+        .dstAccessMask = dst_access,
+        .srcQueueFamilyIndex = batch->src_family,
+        .dstQueueFamilyIndex = batch->dst_family,
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+    };
+}
+
+void barrier_flush(BarrierBatch* batch)
+{
+    bool has_memory = batch->memory.srcStageMask != 0 || batch->memory.dstStageMask != 0;
+    if (batch->n_images == 0 && batch->n_buffers == 0 && !has_memory)
+        return;
+
+    VkDependencyInfo dependency = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = has_memory ? 1 : 0,
+        .pMemoryBarriers = &batch->memory,
+        .bufferMemoryBarrierCount = batch->n_buffers,
+        .pBufferMemoryBarriers = batch->buffers,
+        .imageMemoryBarrierCount = batch->n_images,
+        .pImageMemoryBarriers = batch->images,
+    };
+
+    batch->pipeline_barrier(batch->cmd_buf, &dependency);
+
+    batch->n_images = 0;
+    batch->n_buffers = 0;
+    batch->memory = (VkMemoryBarrier2) { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+}
+
+ImageState barrier_state(enum ImageAccess access)
+{
+    return IMAGE_ACCESS_STATES[access];
+}
+
+VkImageAspectFlags barrier_aspect(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "renderer.h"
+
+// write access that has to be made available before anything else touches the memory
+#define BARRIER_WRITE_ACCESS (VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT \
+        | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT \
+        | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT)
+
+// nothing is recorded until the batch is flushed, or fills up
+BarrierBatch barrier_batch(Renderer* renderer, VkCommandBuffer cmd_buf);
+// the same, for one half of a queue family ownership transfer. the release and the acquire are
+// each a batch like this with the same families, recorded on their own queue
+BarrierBatch barrier_batch_transfer(Renderer* renderer, VkCommandBuffer cmd_buf,
+        uint32_t src_family, uint32_t dst_family);
+// moves a tracked image on to access, waiting on only what its last use did. reads that follow
+// reads in the same layout need no barrier at all, they just join the ones already there
+void barrier_image(BarrierBatch* batch, Image* image, enum ImageAccess access);
+// the same, but the contents are thrown away, which saves the layout transition reading them
+void barrier_image_discard(BarrierBatch* batch, Image* image, enum ImageAccess access);
+// for images without an Image, or parts of one. state is updated the same way
+void barrier_image_range(BarrierBatch* batch, VkImage image, VkImageSubresourceRange range,
+        ImageState* state, enum ImageAccess access, bool discard);
+void barrier_memory(BarrierBatch* batch, VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+        VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access);
+// a range of a buffer, only needed when it changes queue family
+void barrier_buffer(BarrierBatch* batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+        VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+        VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access);
+// records whatever the batch holds, nothing when it's empty
+void barrier_flush(BarrierBatch* batch);
+
+// the state an image is in once access is done with it
+ImageState barrier_state(enum ImageAccess access);
+VkImageAspectFlags barrier_aspect(VkFormat format);
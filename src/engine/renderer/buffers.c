@@ -1,8 +1,13 @@
 #include "buffers.h"
+#include "uploads.h"
+#include "geometry.h"
+#include "deletion.h"
+#include "gpu_memory.h"
 #include "../utils.h"
+#include "../scene/vertex_packing.h"
 
 Buffer buffer_create(VmaAllocator allocator, size_t alloc_size, VkBufferUsageFlags usage,
-        VmaMemoryUsage memory_usage)
+        VmaMemoryUsage memory_usage, enum MemoryCategory category)
 {
     VkBufferCreateInfo buffer_info = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -14,82 +19,194 @@ Buffer buffer_create(VmaAllocator allocator, size_t alloc_size, VkBufferUsageFla
     VmaAllocationCreateInfo vma_alloc_info = {
         .usage = memory_usage,
         .flags = 0,
+        .pUserData = MEMORY_CATEGORY_TAG(category),
     };
 
     Buffer buffer;
     VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &vma_alloc_info, &buffer.buffer,
                 &buffer.allocation, &buffer.info));
+    gpu_memory_track_allocation(allocator, buffer.allocation);
 
     return buffer;
 }
 
 void buffer_destroy(Buffer* buffer, VmaAllocator allocator)
 {
+    gpu_memory_track_free(allocator, buffer->allocation);
     vmaDestroyBuffer(allocator, buffer->buffer, buffer->allocation);
 }
 
+VkDeviceAddress buffer_get_address(VkDevice device, Buffer* buffer)
+{
+    VkBufferDeviceAddressInfo device_address_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer->buffer,
+    };
+
+    return vkGetBufferDeviceAddress(device, &device_address_info);
+}
+
 MeshBuffers upload_mesh(Renderer* renderer, uint32_t* indices, int n_indices,
-        Vertex* vertices, int n_vertices)
+        Vertex* vertices, int n_vertices, enum VertexFormat format)
 {
-    const size_t vertex_buffer_size = n_vertices * sizeof(Vertex);
-    const size_t index_buffer_size = n_indices * sizeof(uint32_t);
+    UploadBatch batch = upload_batch_create(renderer, mesh_staging_size(n_indices,
+                n_vertices * vertex_format_size(format), 0), false);
 
     MeshBuffers new_mesh;
+    if (!stage_mesh(renderer, &batch, indices, n_indices, vertices, n_vertices, format, &new_mesh))
+        FATAL("Could not upload a mesh of %d indices\n", n_indices);
+    upload_batch_submit(renderer, &batch);
 
-    new_mesh.vertex_buffer = buffer_create(renderer->allocator, vertex_buffer_size,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-            | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    return new_mesh;
+}
 
-    VkBufferDeviceAddressInfo device_address_info = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-        .buffer = new_mesh.vertex_buffer.buffer,
-    };
+// vertex data is already in its gpu layout, the caller fills in the format
+MeshBuffers upload_mesh_data(Renderer* renderer, const uint32_t* indices, int n_indices,
+        const void* vertex_data, size_t vertex_buffer_size)
+{
+    UploadBatch batch = upload_batch_create(renderer, mesh_staging_size(n_indices,
+                vertex_buffer_size, 0), false);
 
-    new_mesh.vertex_buffer_address = vkGetBufferDeviceAddress(renderer->device, &device_address_info);
+    MeshBuffers new_mesh;
+    if (!stage_mesh_data(renderer, &batch, indices, n_indices, vertex_data, vertex_buffer_size,
+                &new_mesh))
+        FATAL("Could not upload a mesh of %d indices\n", n_indices);
+    upload_batch_submit(renderer, &batch);
 
-    new_mesh.index_buffer = buffer_create(renderer->allocator, index_buffer_size,
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_GPU_ONLY);
+    return new_mesh;
+}
 
+void upload_meshlets(Renderer* renderer, MeshBuffers* mesh_buffers, const Meshlet* meshlets,
+        uint32_t n_meshlets)
+{
+    UploadBatch batch = upload_batch_create(renderer, mesh_staging_size(0, 0, n_meshlets), false);
 
-    Buffer staging_buffer = buffer_create(renderer->allocator, vertex_buffer_size + index_buffer_size,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    if (!stage_meshlets(renderer, &batch, mesh_buffers, meshlets, n_meshlets))
+        FATAL("Could not upload %d meshlets\n", n_meshlets);
+    upload_batch_submit(renderer, &batch);
+}
 
-    void* data;
+bool stage_mesh(Renderer* renderer, UploadBatch* batch, uint32_t* indices, int n_indices,
+        Vertex* vertices, int n_vertices, enum VertexFormat format, MeshBuffers* out_mesh)
+{
+    if (format == VERTEX_FORMAT_FULL)
+    {
+        if (!stage_mesh_data(renderer, batch, indices, n_indices, vertices,
+                    n_vertices * sizeof(Vertex), out_mesh))
+            return false;
 
-    vmaMapMemory(renderer->allocator, staging_buffer.allocation, &data);
-    // copy vertex buffer
-    memcpy(data, vertices, vertex_buffer_size);
-    // copy index buffer
-    memcpy((char*)data + vertex_buffer_size, indices, index_buffer_size);
-    vmaUnmapMemory(renderer->allocator, staging_buffer.allocation);
+        out_mesh->vertex_format = VERTEX_FORMAT_FULL;
+        glm_vec4_zero(out_mesh->position_offset);
+        glm_vec4_one(out_mesh->position_scale);
 
-    // submit the command in immediate mode
+        return true;
+    }
 
-    immediate_begin(renderer);
+    PackedVertex* packed = malloc(sizeof(PackedVertex) * n_vertices);
+    vec4 position_offset, position_scale;
+    vertices_pack(vertices, n_vertices, packed, position_offset, position_scale);
 
-    VkBufferCopy vertex_copy = {
-        .dstOffset = 0,
-        .srcOffset = 0,
-        .size = vertex_buffer_size,
-    };
+    bool staged = stage_mesh_data(renderer, batch, indices, n_indices, packed,
+            n_vertices * sizeof(PackedVertex), out_mesh);
+    free(packed);
+
+    if (!staged)
+        return false;
+
+    out_mesh->vertex_format = VERTEX_FORMAT_PACKED;
+    glm_vec4_copy(position_offset, out_mesh->position_offset);
+    glm_vec4_copy(position_scale, out_mesh->position_scale);
+
+    return true;
+}
 
-    vkCmdCopyBuffer(renderer->imm_cmd_buf, staging_buffer.buffer, new_mesh.vertex_buffer.buffer,
-            1, &vertex_copy);
+// taking arena ranges and filling staging is safe off the main thread, the copies wait in the
+// batch until it gets recorded. when either arena is full nothing is kept
+bool stage_mesh_data(Renderer* renderer, UploadBatch* batch, const uint32_t* indices,
+        int n_indices, const void* vertex_data, size_t vertex_buffer_size, MeshBuffers* out_mesh)
+{
+    const size_t index_buffer_size = (size_t) n_indices * sizeof(uint32_t);
 
-    VkBufferCopy index_copy = {
-        .dstOffset = 0,
-        .srcOffset = vertex_buffer_size,
-        .size = index_buffer_size,
+    MeshBuffers new_mesh = {
+        .vertex_size = vertex_buffer_size,
+        .index_size = index_buffer_size,
     };
 
-    vkCmdCopyBuffer(renderer->imm_cmd_buf, staging_buffer.buffer, new_mesh.index_buffer.buffer,
-            1, &index_copy);
+    if (!mesh_arena_allocate(&renderer->vertex_arena, vertex_buffer_size, &new_mesh.vertex_offset))
+        return false;
 
-    immediate_end(renderer);
+    if (!mesh_arena_allocate(&renderer->index_arena, index_buffer_size, &new_mesh.index_offset))
+    {
+        geometry_arena_free(&renderer->vertex_arena, new_mesh.vertex_offset, vertex_buffer_size);
+        return false;
+    }
 
-    buffer_destroy(&staging_buffer, renderer->allocator);
+    new_mesh.vertex_buffer_address = renderer->vertex_arena.address + new_mesh.vertex_offset;
+    new_mesh.index_buffer_address = renderer->index_arena.address + new_mesh.index_offset;
+    new_mesh.first_index = new_mesh.index_offset / sizeof(uint32_t);
 
-    return new_mesh;
+    upload_batch_buffer(batch, renderer->vertex_arena.buffer.buffer, new_mesh.vertex_offset,
+            vertex_data, vertex_buffer_size);
+    upload_batch_buffer(batch, renderer->index_arena.buffer.buffer, new_mesh.index_offset,
+            indices, index_buffer_size);
+
+    *out_mesh = new_mesh;
+    return true;
+}
+
+bool stage_meshlets(Renderer* renderer, UploadBatch* batch, MeshBuffers* mesh_buffers,
+        const Meshlet* meshlets, uint32_t n_meshlets)
+{
+    const size_t size = sizeof(Meshlet) * n_meshlets;
+
+    if (!mesh_arena_allocate(&renderer->vertex_arena, size, &mesh_buffers->meshlet_offset))
+        return false;
+
+    mesh_buffers->meshlet_size = size;
+    mesh_buffers->meshlet_buffer_address = renderer->vertex_arena.address + mesh_buffers->meshlet_offset;
+
+    upload_batch_buffer(batch, renderer->vertex_arena.buffer.buffer, mesh_buffers->meshlet_offset,
+            meshlets, size);
+
+    return true;
 }
 
+// the ranges go back once the frames that could still be drawing the mesh have finished
+void mesh_buffers_free(Renderer* renderer, MeshBuffers* mesh_buffers)
+{
+    deletion_queue_arena_range(renderer, &renderer->vertex_arena, mesh_buffers->vertex_offset,
+            mesh_buffers->vertex_size);
+    deletion_queue_arena_range(renderer, &renderer->index_arena, mesh_buffers->index_offset,
+            mesh_buffers->index_size);
+    deletion_queue_arena_range(renderer, &renderer->vertex_arena, mesh_buffers->meshlet_offset,
+            mesh_buffers->meshlet_size);
+}
+
+// for meshes that were staged but never recorded, nothing can be reading the ranges so they go back
+// straight away. safe off the main thread
+void mesh_buffers_release(Renderer* renderer, MeshBuffers* mesh_buffers)
+{
+    geometry_arena_free(&renderer->vertex_arena, mesh_buffers->vertex_offset,
+            mesh_buffers->vertex_size);
+    geometry_arena_free(&renderer->index_arena, mesh_buffers->index_offset,
+            mesh_buffers->index_size);
+    geometry_arena_free(&renderer->vertex_arena, mesh_buffers->meshlet_offset,
+            mesh_buffers->meshlet_size);
+}
+
+// how much of a batch a mesh of this size takes up
+size_t mesh_staging_size(int n_indices, size_t vertex_buffer_size, uint32_t n_meshlets)
+{
+    return upload_batch_aligned(vertex_buffer_size) + upload_batch_aligned(n_indices * sizeof(uint32_t))
+        + upload_batch_aligned(sizeof(Meshlet) * n_meshlets);
+}
+
+bool mesh_arena_allocate(GeometryArena* arena, VkDeviceSize size, VkDeviceSize* out_offset)
+{
+    if (geometry_arena_allocate(arena, size, out_offset))
+        return true;
+
+    LOG_E("Geometry arena is out of space, %.1lf MB of %.1lf MB used and %.1lf MB more needed\n",
+            arena->used / 1e6, arena->size / 1e6, size / 1e6);
+    return false;
+}
@@ -3,10 +3,33 @@
 #include "renderer.h"
 
 Buffer buffer_create(VmaAllocator allocator, size_t alloc_size, VkBufferUsageFlags usage,
-        VmaMemoryUsage memory_usage);
+        VmaMemoryUsage memory_usage, enum MemoryCategory category);
 
 MeshBuffers upload_mesh(Renderer* renderer, uint32_t* indices, int n_indices,
-        Vertex* vertices, int n_vertices);
+        Vertex* vertices, int n_vertices, enum VertexFormat format);
+MeshBuffers upload_mesh_data(Renderer* renderer, const uint32_t* indices, int n_indices,
+        const void* vertex_data, size_t vertex_buffer_size);
+
+void upload_meshlets(Renderer* renderer, MeshBuffers* mesh_buffers, const Meshlet* meshlets,
+        uint32_t n_meshlets);
+
+// the same without waiting, the copies go into the batch for whoever records it. false when the
+// geometry arenas have no room left, the reason has been logged
+bool stage_mesh(Renderer* renderer, UploadBatch* batch, uint32_t* indices, int n_indices,
+        Vertex* vertices, int n_vertices, enum VertexFormat format, MeshBuffers* out_mesh);
+bool stage_mesh_data(Renderer* renderer, UploadBatch* batch, const uint32_t* indices,
+        int n_indices, const void* vertex_data, size_t vertex_buffer_size, MeshBuffers* out_mesh);
+bool stage_meshlets(Renderer* renderer, UploadBatch* batch, MeshBuffers* mesh_buffers,
+        const Meshlet* meshlets, uint32_t n_meshlets);
+size_t mesh_staging_size(int n_indices, size_t vertex_buffer_size, uint32_t n_meshlets);
+// hands the mesh's ranges back to the geometry arenas
+void mesh_buffers_free(Renderer* renderer, MeshBuffers* mesh_buffers);
+// the same for a mesh whose batch was never recorded, without waiting on any frames
+void mesh_buffers_release(Renderer* renderer, MeshBuffers* mesh_buffers);
 
 void buffer_destroy(Buffer* buffer, VmaAllocator allocator);
+VkDeviceAddress buffer_get_address(VkDevice device, Buffer* buffer);
+
 
+// internal
+bool mesh_arena_allocate(GeometryArena* arena, VkDeviceSize size, VkDeviceSize* out_offset);
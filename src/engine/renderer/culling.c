@@ -0,0 +1,232 @@
+#include "culling.h"
+#include "buffers.h"
+#include "barriers.h"
+#include "frame_ring.h"
+#include "shaders.h"
+#include "../utils.h"
+
+#include <math.h>
+
+void culling_initialise(Renderer* renderer)
+{
+    MeshletCuller* culler = &renderer->culler;
+
+    culling_create_pipeline(renderer);
+
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        culling_reserve(renderer, i, 64, 1 << 20);
+
+    culler->enabled = true;
+    culler->overflow_logged = false;
+}
+
+void culling_cleanup(Renderer* renderer)
+{
+    MeshletCuller* culler = &renderer->culler;
+
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        buffer_destroy(&culler->indices[i], renderer->allocator);
+        buffer_destroy(&culler->draw_commands[i], renderer->allocator);
+    }
+
+    vkDestroyPipeline(renderer->device, culler->pipeline, NULL);
+    vkDestroyPipelineLayout(renderer->device, culler->layout, NULL);
+}
+
+void culling_record(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* context)
+{
+    MeshletCuller* culler = &renderer->culler;
+    int frame = renderer->frame_in_flight;
+
+    culler->n_draws[frame] = 0;
+    if (!culler->enabled || context->n == 0)
+        return;
+
+    // the frame data has to fit in what the ring has left, with room kept for the rest of the
+    // frame. draws past what fits are drawn whole
+    size_t available = frame_ring_available(&renderer->frame_ring);
+    size_t needed = sizeof(CullFrameData) + CULLING_RING_HEADROOM;
+    size_t room = available > needed ? (available - needed) / sizeof(CullDraw) : 0;
+    uint32_t n_draws = (size_t) context->n < room ? (uint32_t) context->n : (uint32_t) room;
+
+    if (n_draws < context->n && !culler->overflow_logged)
+    {
+        LOG_W("Only the first %u of %d draws fit in the frame ring, the rest go unculled\n",
+                n_draws, context->n);
+        culler->overflow_logged = true;
+    }
+
+    culler->n_draws[frame] = n_draws;
+
+    // every draw gets room for all of its triangles, culling only ever shrinks that
+    uint32_t n_indices = 0;
+    for (uint32_t i = 0; i < n_draws; ++i)
+    {
+        if (culling_applies(renderer, &context->opaque_surfaces[i], i))
+            n_indices += context->opaque_surfaces[i].index_count;
+    }
+
+    if (n_indices == 0)
+    {
+        culler->n_draws[frame] = 0;
+        return;
+    }
+
+    culling_reserve(renderer, frame, n_draws, n_indices);
+
+    // written straight into the ring's mapping, the gpu reads it this frame only
+    uint32_t frame_data_offset;
+    CullFrameData* frame_data = frame_ring_allocate(&renderer->frame_ring,
+            sizeof(CullFrameData) + sizeof(CullDraw) * n_draws, &frame_data_offset);
+
+    mat4 view_projection;
+    glm_mat4_mul(renderer->projection, renderer->view, view_projection);
+    glm_frustum_planes(view_projection, frame_data->frustum);
+
+    glm_vec3_copy(renderer->camera_position, frame_data->camera_position);
+    frame_data->output_indices = buffer_get_address(renderer->device, &culler->indices[frame]);
+    frame_data->draw_commands = buffer_get_address(renderer->device, &culler->draw_commands[frame]);
+
+    uint32_t output_offset = 0;
+    for (uint32_t i = 0; i < n_draws; ++i)
+    {
+        RenderObject* render_object = &context->opaque_surfaces[i];
+        CullDraw* draw = &frame_data->draws[i];
+
+        glm_mat4_copy(render_object->transform, draw->transform);
+        draw->meshlets = render_object->meshlet_buffer_address;
+        draw->indices = render_object->index_buffer_address;
+        draw->first_meshlet = render_object->first_meshlet;
+        draw->n_meshlets = culling_applies(renderer, render_object, i) ? render_object->n_meshlets
+            : 0;
+        draw->output_offset = output_offset;
+        draw->scale = fmaxf(glm_vec3_norm(draw->transform[0]), fmaxf(glm_vec3_norm(draw->transform[1]),
+                    glm_vec3_norm(draw->transform[2])));
+
+        output_offset += draw->n_meshlets != 0 ? render_object->index_count : 0;
+    }
+
+    // the shader only ever adds to the counts, a draw with nothing left keeps 0 instances
+    vkCmdFillBuffer(cmd_buf, culler->draw_commands[frame].buffer, 0,
+            sizeof(VkDrawIndexedIndirectCommand) * n_draws, 0);
+
+    // the counts get added to atomically, so read as well as written
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    barrier_flush(&barriers);
+
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, culler->pipeline);
+
+    CullPushConstants push_constants = {
+        .frame_data = frame_ring_address(&renderer->frame_ring, frame_data_offset),
+    };
+
+    // a workgroup per meshlet, the first thread tests it and they all copy the triangles
+    for (uint32_t i = 0; i < n_draws; ++i)
+    {
+        if (!culling_applies(renderer, &context->opaque_surfaces[i], i))
+            continue;
+
+        push_constants.draw_index = i;
+        vkCmdPushConstants(cmd_buf, culler->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                sizeof(CullPushConstants), &push_constants);
+        vkCmdDispatch(cmd_buf, context->opaque_surfaces[i].n_meshlets, 1, 1);
+    }
+
+    // the commands are read by the indirect draws and the surviving triangles as their indices
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+            VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT);
+    barrier_flush(&barriers);
+}
+
+bool culling_applies(Renderer* renderer, RenderObject* render_object, uint32_t draw_index)
+{
+    MeshletCuller* culler = &renderer->culler;
+    return culler->enabled && render_object->n_meshlets != 0
+        && draw_index < culler->n_draws[renderer->frame_in_flight];
+}
+
+// only called once the frame's fence has been waited on, so the old buffers are free to go
+void culling_reserve(Renderer* renderer, int frame, uint32_t n_draws, uint32_t n_indices)
+{
+    MeshletCuller* culler = &renderer->culler;
+
+    if (n_draws > culler->draw_capacity[frame])
+    {
+        uint32_t capacity = culler->draw_capacity[frame] == 0 ? n_draws : culler->draw_capacity[frame];
+        while (capacity < n_draws)
+            capacity *= 2;
+
+        if (culler->draw_capacity[frame] != 0)
+            buffer_destroy(&culler->draw_commands[frame], renderer->allocator);
+
+        culler->draw_commands[frame] = buffer_create(renderer->allocator,
+                sizeof(VkDrawIndexedIndirectCommand) * capacity,
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_OTHER);
+
+        culler->draw_capacity[frame] = capacity;
+    }
+
+    if (n_indices > culler->index_capacity[frame])
+    {
+        uint32_t capacity = culler->index_capacity[frame] == 0 ? n_indices : culler->index_capacity[frame];
+        while (capacity < n_indices)
+            capacity *= 2;
+
+        if (culler->index_capacity[frame] != 0)
+            buffer_destroy(&culler->indices[frame], renderer->allocator);
+
+        culler->indices[frame] = buffer_create(renderer->allocator, sizeof(uint32_t) * capacity,
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY,
+                MEMORY_OTHER);
+
+        culler->index_capacity[frame] = capacity;
+    }
+}
+
+void culling_create_pipeline(Renderer* renderer)
+{
+    MeshletCuller* culler = &renderer->culler;
+
+    VkPushConstantRange push_constant = {
+        .offset = 0,
+        .size = sizeof(CullPushConstants),
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+
+    // everything is reached through buffer addresses, so no descriptor sets
+    VkPipelineLayoutCreateInfo pipeline_layout = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .setLayoutCount = 0,
+
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant,
+    };
+
+    VK_CHECK(vkCreatePipelineLayout(renderer->device, &pipeline_layout, NULL, &culler->layout));
+
+    VkPipelineShaderStageCreateInfo stage_info = make_shader_info(renderer->device, "cull.comp.spv",
+            VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkComputePipelineCreateInfo pipeline_create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+
+        .layout = culler->layout,
+        .stage = stage_info,
+    };
+
+    VK_CHECK(vkCreateComputePipelines(renderer->device, VK_NULL_HANDLE, 1, &pipeline_create_info,
+                NULL, &culler->pipeline));
+
+    vkDestroyShaderModule(renderer->device, stage_info.module, NULL);
+}
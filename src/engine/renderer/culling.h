@@ -0,0 +1,19 @@
+#pragma once
+
+#include "renderer.h"
+
+// left in the frame ring for what gets allocated after the cull, the scene data and the like
+#define CULLING_RING_HEADROOM (64 << 10)
+
+void culling_initialise(Renderer* renderer);
+void culling_cleanup(Renderer* renderer);
+
+// records the culling dispatches, has to happen outside of rendering
+void culling_record(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* context);
+// whether draw_geometry should draw this object, the context's draw_index'th, from the culled
+// buffers
+bool culling_applies(Renderer* renderer, RenderObject* render_object, uint32_t draw_index);
+
+// internal
+void culling_reserve(Renderer* renderer, int frame, uint32_t n_draws, uint32_t n_indices);
+void culling_create_pipeline(Renderer* renderer);
@@ -0,0 +1,556 @@
+#include "defrag.h"
+#include "image.h"
+#include "materials.h"
+#include "uploads.h"
+#include "geometry.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "barriers.h"
+#include "indirect.h"
+#include "../utils.h"
+
+void defrag_initialise(Renderer* renderer)
+{
+    renderer->defrag = (Defragmenter) {0};
+}
+
+void defrag_cleanup(Renderer* renderer)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    if (defrag->pass_open)
+        defrag_end_pass(renderer);
+    if (defrag->running)
+        defrag_finish(renderer);
+
+    free(defrag->moves);
+    free(defrag->images);
+    free(defrag->materials);
+    free(defrag->meshes);
+    free(defrag->ranges);
+    *defrag = (Defragmenter) {0};
+}
+
+void defrag_retire(Renderer* renderer)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    // this slot's fence was the frame that recorded the pass's copies
+    if (defrag->pass_open && renderer->frame >= defrag->pass_frame + FRAMES_IN_FLIGHT)
+        defrag_end_pass(renderer);
+}
+
+void defrag_update(Renderer* renderer, VkCommandBuffer cmd_buf)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    // the frame's uploads can still be landing on the transfer queue when its commands start, so
+    // nothing gets copied out from under them
+    if (renderer->n_frame_uploads[renderer->frame_in_flight] > 0)
+        return;
+
+    // from the memory panel, everything gets another go whether it looks fragmented or not
+    bool requested = defrag->requested;
+    if (requested)
+    {
+        defrag->requested = false;
+        defrag->vertex_stalled_generation = UINT64_MAX;
+        defrag->index_stalled_generation = UINT64_MAX;
+    }
+
+    if (!defrag->pass_open && !defrag_images_pending_deletion(renderer))
+    {
+        if (!defrag->running && defrag_should_start(renderer, requested))
+        {
+            VmaDefragmentationInfo info = {
+                .flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+                .pool = gpu_memory_pool(MEMORY_TEXTURES),
+                .maxBytesPerPass = DEFRAG_BYTES_PER_FRAME,
+                .maxAllocationsPerPass = DEFRAG_MOVES_PER_PASS,
+            };
+
+            VK_CHECK(vmaBeginDefragmentation(renderer->allocator, &info, &defrag->context));
+            defrag->running = true;
+            defrag->runs += 1;
+        }
+
+        if (defrag->running)
+            defrag_begin_pass(renderer, cmd_buf);
+    }
+
+    VkDeviceSize moved = defrag_compact_arena(renderer, cmd_buf, &renderer->vertex_arena,
+            &defrag->vertex_stalled_generation, DEFRAG_BYTES_PER_FRAME);
+    defrag_compact_arena(renderer, cmd_buf, &renderer->index_arena,
+            &defrag->index_stalled_generation, DEFRAG_BYTES_PER_FRAME - moved);
+}
+
+void defrag_track_images(Renderer* renderer, Image* images, uint32_t n)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        // failed to decode, there's nothing to move
+        if (images[i].image == VK_NULL_HANDLE)
+            continue;
+
+        if (defrag->n_images == defrag->image_capacity)
+        {
+            defrag->image_capacity = defrag->image_capacity == 0 ? 64 : defrag->image_capacity * 2;
+            defrag->images = realloc(defrag->images, sizeof(Image*) * defrag->image_capacity);
+        }
+
+        defrag->images[defrag->n_images++] = &images[i];
+    }
+}
+
+void defrag_untrack_images(Renderer* renderer, Image* images, uint32_t n)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < defrag->n_images;)
+    {
+        if (defrag->images[i] >= images && defrag->images[i] < images + n)
+            defrag->images[i] = defrag->images[--defrag->n_images];
+        else
+            i++;
+    }
+}
+
+void defrag_track_material(Renderer* renderer, MaterialInstance* instance,
+        const MaterialMetallicResources* resources)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    if (defrag->n_materials == defrag->material_capacity)
+    {
+        defrag->material_capacity = defrag->material_capacity == 0 ? 64
+            : defrag->material_capacity * 2;
+        defrag->materials = realloc(defrag->materials,
+                sizeof(DefragMaterial) * defrag->material_capacity);
+    }
+
+    defrag->materials[defrag->n_materials++] = (DefragMaterial) { instance, *resources,
+        VK_NULL_HANDLE, false };
+}
+
+void defrag_untrack_materials(Renderer* renderer, MaterialInstance* instances, uint32_t n)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < defrag->n_materials;)
+    {
+        DefragMaterial* material = &defrag->materials[i];
+        MaterialInstance* instance = material->instance;
+        if (instance >= instances && instance < instances + n)
+        {
+            // frames in flight can still have it bound
+            if (material->pool != VK_NULL_HANDLE)
+                deletion_queue_descriptor_set(renderer, material->pool, instance->material_set);
+            defrag->materials[i] = defrag->materials[--defrag->n_materials];
+        }
+        else
+            i++;
+    }
+}
+
+void defrag_replace_image(Renderer* renderer, Image* image, Image replacement)
+{
+    VkImage old_image = image->image;
+    *image = replacement;
+    defrag_rewrite_materials(renderer, old_image, image);
+}
+
+void defrag_track_meshes(Renderer* renderer, Mesh* meshes, uint32_t n)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (defrag->n_meshes == defrag->mesh_capacity)
+        {
+            defrag->mesh_capacity = defrag->mesh_capacity == 0 ? 64 : defrag->mesh_capacity * 2;
+            defrag->meshes = realloc(defrag->meshes, sizeof(MeshBuffers*) * defrag->mesh_capacity);
+        }
+
+        defrag->meshes[defrag->n_meshes++] = &meshes[i].mesh_buffers;
+    }
+}
+
+void defrag_untrack_meshes(Renderer* renderer, Mesh* meshes, uint32_t n)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < defrag->n_meshes;)
+    {
+        Mesh* mesh = (Mesh*) ((uint8_t*) defrag->meshes[i] - offsetof(Mesh, mesh_buffers));
+        if (mesh >= meshes && mesh < meshes + n)
+            defrag->meshes[i] = defrag->meshes[--defrag->n_meshes];
+        else
+            i++;
+    }
+}
+
+// every so often, when enough of the texture pool is empty space inside its blocks
+bool defrag_should_start(Renderer* renderer, bool requested)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    VmaPool pool = gpu_memory_pool(MEMORY_TEXTURES);
+    if (pool == VK_NULL_HANDLE)
+        return false;
+
+    if (requested)
+        return true;
+
+    if (renderer->frame - defrag->last_check_frame < DEFRAG_CHECK_FRAMES)
+        return false;
+    defrag->last_check_frame = renderer->frame;
+
+    VmaStatistics stats;
+    vmaGetPoolStatistics(renderer->allocator, pool, &stats);
+
+    VkDeviceSize wasted = stats.blockBytes - stats.allocationBytes;
+    return wasted > DEFRAG_MIN_WASTED_BYTES
+        && wasted > stats.blockBytes * DEFRAG_MIN_WASTED_FRACTION;
+}
+
+// an allocation can't be freed while a pass is moving it, so a pass only starts when no image is
+// going to be destroyed before it ends. this frame's deletions only run after that
+bool defrag_images_pending_deletion(Renderer* renderer)
+{
+    DeletionQueue* queue = &renderer->deletion_queue;
+    for (uint32_t i = 0; i < queue->n_deletions; ++i)
+    {
+        Deletion* deletion = &queue->deletions[i];
+        if (deletion->frame < renderer->frame && deletion->type == DELETE_IMAGE
+                && deletion->image.allocation != VK_NULL_HANDLE)
+            return true;
+    }
+
+    return false;
+}
+
+void defrag_begin_pass(Renderer* renderer, VkCommandBuffer cmd_buf)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    // VK_SUCCESS means there's nothing left worth moving
+    VkResult result = vmaBeginDefragmentationPass(renderer->allocator, defrag->context, &defrag->pass);
+    if (result == VK_SUCCESS)
+    {
+        defrag_finish(renderer);
+        return;
+    }
+
+    // the moved images all go to sampled together once every copy is recorded
+    BarrierBatch copied = barrier_batch(renderer, cmd_buf);
+    for (uint32_t i = 0; i < defrag->pass.moveCount; ++i)
+    {
+        VmaDefragmentationMove* move = &defrag->pass.pMoves[i];
+        if (!defrag_move_image(renderer, cmd_buf, move, &copied))
+            move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+    }
+    barrier_flush(&copied);
+
+    defrag->pass_open = true;
+    defrag->pass_frame = renderer->frame;
+
+    // nothing got copied, so there's nothing to wait for either
+    if (defrag->n_moves == 0)
+        defrag_end_pass(renderer);
+}
+
+void defrag_end_pass(Renderer* renderer)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < defrag->n_moves; ++i)
+    {
+        vkDestroyImageView(renderer->device, defrag->moves[i].old_view, NULL);
+        vkDestroyImage(renderer->device, defrag->moves[i].old_image, NULL);
+    }
+    defrag->n_moves = 0;
+    defrag->pass_open = false;
+
+    // from here the moved allocations are where they were copied to, and their old memory is free
+    if (vmaEndDefragmentationPass(renderer->allocator, defrag->context, &defrag->pass) == VK_SUCCESS)
+        defrag_finish(renderer);
+}
+
+void defrag_finish(Renderer* renderer)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    VmaDefragmentationStats stats;
+    vmaEndDefragmentation(renderer->allocator, defrag->context, &stats);
+    defrag->running = false;
+
+    defrag->texture_bytes_moved += stats.bytesMoved;
+    defrag->texture_bytes_freed += stats.bytesFreed;
+    defrag->texture_blocks_freed += stats.deviceMemoryBlocksFreed;
+
+    LOG_V("Texture defragmentation moved %u images, %.1lf MB, and freed %.1lf MB in %u blocks\n",
+            stats.allocationsMoved, stats.bytesMoved / 1e6, stats.bytesFreed / 1e6,
+            stats.deviceMemoryBlocksFreed);
+}
+
+// a new image on the move's destination memory with the old one's contents, the tracked image
+// points at it from here on and the old one stays alive until the pass ends
+bool defrag_move_image(Renderer* renderer, VkCommandBuffer cmd_buf, VmaDefragmentationMove* move,
+        BarrierBatch* copied)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    Image* image = NULL;
+    for (uint32_t i = 0; i < defrag->n_images; ++i)
+    {
+        if (defrag->images[i]->allocation == move->srcAllocation)
+        {
+            image = defrag->images[i];
+            break;
+        }
+    }
+
+    // nothing would know where an untracked image went
+    if (image == NULL)
+        return false;
+
+    Image moved = *image;
+    moved.state = (ImageState) {0};
+
+    VkImageCreateInfo image_info = get_image_create_info(image->format, image->usage, image->extent);
+    image_info.mipLevels = image->mip_levels;
+    VK_CHECK(vkCreateImage(renderer->device, &image_info, NULL, &moved.image));
+    VK_CHECK(vmaBindImageMemory(renderer->allocator, move->dstTmpAllocation, moved.image));
+
+    VkImageViewCreateInfo view_info = get_image_view_create_info(image->format, moved.image,
+            VK_IMAGE_ASPECT_COLOR_BIT);
+    view_info.subresourceRange.levelCount = image->mip_levels;
+    VK_CHECK(vkCreateImageView(renderer->device, &view_info, NULL, &moved.view));
+
+    VkImageCopy regions[16];
+    uint32_t n_regions = image->mip_levels < 16 ? image->mip_levels : 16;
+    for (uint32_t i = 0; i < n_regions; ++i)
+    {
+        VkImageSubresourceLayers subresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = i,
+            .layerCount = 1,
+        };
+
+        regions[i] = (VkImageCopy) {
+            .srcSubresource = subresource,
+            .dstSubresource = subresource,
+            .extent = {
+                max(image->extent.width >> i, 1),
+                max(image->extent.height >> i, 1),
+                max(image->extent.depth >> i, 1),
+            },
+        };
+    }
+
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    barrier_image(&barriers, image, IMAGE_ACCESS_TRANSFER_SRC);
+    barrier_image_discard(&barriers, &moved, IMAGE_ACCESS_TRANSFER_DST);
+    barrier_flush(&barriers);
+
+    vkCmdCopyImage(cmd_buf, image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, moved.image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, n_regions, regions);
+
+    barrier_image(copied, &moved, IMAGE_ACCESS_SAMPLED);
+
+    if (defrag->n_moves == defrag->move_capacity)
+    {
+        defrag->move_capacity = defrag->move_capacity == 0 ? DEFRAG_MOVES_PER_PASS
+            : defrag->move_capacity * 2;
+        defrag->moves = realloc(defrag->moves, sizeof(DefragMove) * defrag->move_capacity);
+    }
+    defrag->moves[defrag->n_moves++] = (DefragMove) { image->image, image->view };
+
+    VkImage old_image = image->image;
+    *image = moved;
+    defrag_rewrite_materials(renderer, old_image, image);
+
+    return true;
+}
+
+// only marks them, a material whose images move and stream in the same frame still gets one set
+void defrag_rewrite_materials(Renderer* renderer, VkImage old_image, Image* image)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < defrag->n_materials; ++i)
+    {
+        DefragMaterial* material = &defrag->materials[i];
+        bool uses_image = false;
+
+        if (material->resources.colour_image.image == old_image)
+        {
+            material->resources.colour_image = *image;
+            uses_image = true;
+        }
+        if (material->resources.metal_rough_image.image == old_image)
+        {
+            material->resources.metal_rough_image = *image;
+            uses_image = true;
+        }
+
+        if (uses_image)
+            material->dirty = true;
+    }
+}
+
+// frames in flight can have a material's set bound, so rather than writing it again each one gets
+// a new set. the old one is freed once those frames retire, unless it's the set it was loaded with
+void defrag_write_materials(Renderer* renderer)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    for (uint32_t i = 0; i < defrag->n_materials; ++i)
+    {
+        DefragMaterial* material = &defrag->materials[i];
+        if (!material->dirty)
+            continue;
+
+        if (material->pool != VK_NULL_HANDLE)
+        {
+            deletion_queue_descriptor_set(renderer, material->pool,
+                    material->instance->material_set);
+        }
+
+        material->instance->material_set = descriptor_allocator_freeable_allocate(
+                &renderer->material_descriptors, renderer->device,
+                renderer->metalic_material.material_layout, &material->pool);
+        material_metallic_write_set(renderer->device, material->instance->material_set,
+                &material->resources);
+        material->dirty = false;
+    }
+}
+
+// moves the arena's highest ranges down into holes below them, until the budget is spent. the old
+// ranges go back through the deletion queue, frames in flight still draw out of them
+VkDeviceSize defrag_compact_arena(Renderer* renderer, VkCommandBuffer cmd_buf, GeometryArena* arena,
+        uint64_t* stalled_generation, VkDeviceSize budget)
+{
+    Defragmenter* defrag = &renderer->defrag;
+
+    // holes only ever open up when something gets freed
+    if (arena->generation == *stalled_generation || budget == 0)
+        return 0;
+
+    if (defrag->range_capacity < defrag->n_meshes * 2)
+    {
+        defrag->range_capacity = defrag->n_meshes * 2;
+        defrag->ranges = realloc(defrag->ranges, sizeof(DefragRange) * defrag->range_capacity);
+    }
+
+    uint32_t n_ranges = 0;
+    for (uint32_t i = 0; i < defrag->n_meshes; ++i)
+    {
+        MeshBuffers* mesh = defrag->meshes[i];
+
+        if (arena == &renderer->index_arena)
+        {
+            defrag->ranges[n_ranges++] = (DefragRange) { mesh, &mesh->index_offset,
+                mesh->index_size };
+            continue;
+        }
+
+        defrag->ranges[n_ranges++] = (DefragRange) { mesh, &mesh->vertex_offset, mesh->vertex_size };
+        if (mesh->meshlet_size != 0)
+        {
+            defrag->ranges[n_ranges++] = (DefragRange) { mesh, &mesh->meshlet_offset,
+                mesh->meshlet_size };
+        }
+    }
+
+    qsort(defrag->ranges, n_ranges, sizeof(DefragRange), defrag_range_compare);
+
+    VkBufferCopy copies[DEFRAG_RANGES_PER_FRAME];
+    uint32_t n_copies = 0;
+    VkDeviceSize moved = 0;
+
+    for (uint32_t i = 0; i < n_ranges && n_copies < DEFRAG_RANGES_PER_FRAME; ++i)
+    {
+        DefragRange* range = &defrag->ranges[i];
+
+        // a range bigger than the whole budget still goes, just on a frame of its own
+        if (range->size == 0 || (moved != 0 && moved + range->size > budget))
+            continue;
+
+        VkDeviceSize offset;
+        if (!geometry_arena_allocate_below(arena, range->size, *range->offset, &offset))
+            continue;
+
+        copies[n_copies++] = (VkBufferCopy) {
+            .srcOffset = *range->offset,
+            .dstOffset = offset,
+            .size = range->size,
+        };
+
+        deletion_queue_arena_range(renderer, arena, *range->offset, range->size);
+        *range->offset = offset;
+        defrag_range_moved(renderer, range);
+
+        moved += range->size;
+    }
+
+    if (n_copies == 0)
+    {
+        *stalled_generation = arena->generation;
+        return 0;
+    }
+
+    // only copies ever write the arenas, uploads and earlier moves, and the acquire of a transfer
+    // queue upload ends on the consumer stages. readers are only waited on, the holes being
+    // written were last read by frames that have retired
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_COPY_BIT | UPLOAD_CONSUMER_STAGES,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+            VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    barrier_flush(&barriers);
+
+    vkCmdCopyBuffer(cmd_buf, arena->buffer.buffer, arena->buffer.buffer, n_copies, copies);
+
+    // indices as indices and by the culling pass, vertices and meshlets by address
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+            | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+    barrier_flush(&barriers);
+
+    defrag->geometry_bytes_moved += moved;
+    return moved;
+}
+
+// draws are built from these every frame, so the next one already reads the new range
+void defrag_range_moved(Renderer* renderer, DefragRange* range)
+{
+    MeshBuffers* mesh = range->mesh;
+
+    if (range->offset == &mesh->vertex_offset)
+    {
+        mesh->vertex_buffer_address = renderer->vertex_arena.address + mesh->vertex_offset;
+    }
+    else if (range->offset == &mesh->meshlet_offset)
+    {
+        mesh->meshlet_buffer_address = renderer->vertex_arena.address + mesh->meshlet_offset;
+    }
+    else
+    {
+        mesh->index_buffer_address = renderer->index_arena.address + mesh->index_offset;
+        mesh->first_index = mesh->index_offset / sizeof(uint32_t);
+    }
+
+    indirect_mesh_moved(renderer, mesh);
+}
+
+// highest offset first
+int defrag_range_compare(const void* a, const void* b)
+{
+    VkDeviceSize offset_a = *((const DefragRange*) a)->offset;
+    VkDeviceSize offset_b = *((const DefragRange*) b)->offset;
+
+    return (offset_a < offset_b) - (offset_a > offset_b);
+}
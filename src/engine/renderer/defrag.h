@@ -0,0 +1,52 @@
+#pragma once
+
+#include "renderer.h"
+
+// how often the texture pool gets looked at for fragmentation
+#define DEFRAG_CHECK_FRAMES 600
+// a run starts once this much of the pool's blocks is empty space, and it's a fair share of them
+#define DEFRAG_MIN_WASTED_BYTES (32 << 20)
+#define DEFRAG_MIN_WASTED_FRACTION 0.25
+// what a frame copies at most, textures and geometry each, so a run never shows up as a spike
+#define DEFRAG_BYTES_PER_FRAME (8 << 20)
+#define DEFRAG_MOVES_PER_PASS 16
+#define DEFRAG_RANGES_PER_FRAME 64
+
+void defrag_initialise(Renderer* renderer);
+// the device has to be idle, a run that's still going just stops where it got to
+void defrag_cleanup(Renderer* renderer);
+
+// right after the frame's fence wait, before its deletion queue is flushed
+void defrag_retire(Renderer* renderer);
+// records this frame's share of moves, after the uploads and before anything reads the geometry
+void defrag_update(Renderer* renderer, VkCommandBuffer cmd_buf);
+// new sets for the materials whose images were moved or replaced this frame, before anything binds
+// them
+void defrag_write_materials(Renderer* renderer);
+
+// main thread. tracked images, material sets and mesh ranges are updated in place when they move,
+// untracked ones never move
+void defrag_track_images(Renderer* renderer, Image* images, uint32_t n);
+void defrag_untrack_images(Renderer* renderer, Image* images, uint32_t n);
+void defrag_track_material(Renderer* renderer, MaterialInstance* instance,
+        const MaterialMetallicResources* resources);
+void defrag_untrack_materials(Renderer* renderer, MaterialInstance* instances, uint32_t n);
+// for images something else recreates, every tracked material sampling the old one follows along
+// once defrag_write_materials has run
+void defrag_replace_image(Renderer* renderer, Image* image, Image replacement);
+void defrag_track_meshes(Renderer* renderer, Mesh* meshes, uint32_t n);
+void defrag_untrack_meshes(Renderer* renderer, Mesh* meshes, uint32_t n);
+
+// internal
+bool defrag_should_start(Renderer* renderer, bool requested);
+bool defrag_images_pending_deletion(Renderer* renderer);
+void defrag_begin_pass(Renderer* renderer, VkCommandBuffer cmd_buf);
+void defrag_end_pass(Renderer* renderer);
+void defrag_finish(Renderer* renderer);
+bool defrag_move_image(Renderer* renderer, VkCommandBuffer cmd_buf, VmaDefragmentationMove* move,
+        BarrierBatch* copied);
+void defrag_rewrite_materials(Renderer* renderer, VkImage old_image, Image* image);
+VkDeviceSize defrag_compact_arena(Renderer* renderer, VkCommandBuffer cmd_buf, GeometryArena* arena,
+        uint64_t* stalled_generation, VkDeviceSize budget);
+void defrag_range_moved(Renderer* renderer, DefragRange* range);
+int defrag_range_compare(const void* a, const void* b);
@@ -0,0 +1,159 @@
+#include "deletion.h"
+#include "buffers.h"
+#include "image.h"
+#include "geometry.h"
+#include "gpu_memory.h"
+#include "../utils.h"
+
+void deletion_queue_push(Renderer* renderer, Deletion deletion)
+{
+    DeletionQueue* queue = &renderer->deletion_queue;
+    deletion.frame = renderer->frame;
+
+    if (queue->n_deletions == queue->deletion_capacity)
+    {
+        queue->deletion_capacity = queue->deletion_capacity == 0 ? 64 : queue->deletion_capacity * 2;
+        queue->deletions = realloc(queue->deletions, sizeof(Deletion) * queue->deletion_capacity);
+    }
+
+    queue->deletions[queue->n_deletions++] = deletion;
+}
+
+void deletion_queue_buffer(Renderer* renderer, Buffer buffer)
+{
+    deletion_queue_push(renderer, (Deletion) { .type = DELETE_BUFFER, .buffer = buffer });
+}
+
+void deletion_queue_image(Renderer* renderer, Image image)
+{
+    deletion_queue_push(renderer, (Deletion) { .type = DELETE_IMAGE, .image = image });
+}
+
+void deletion_queue_image_view(Renderer* renderer, VkImageView image_view)
+{
+    deletion_queue_push(renderer, (Deletion) { .type = DELETE_IMAGE_VIEW, .image_view = image_view });
+}
+
+void deletion_queue_sampler(Renderer* renderer, VkSampler sampler)
+{
+    deletion_queue_push(renderer, (Deletion) { .type = DELETE_SAMPLER, .sampler = sampler });
+}
+
+void deletion_queue_pipeline(Renderer* renderer, VkPipeline pipeline)
+{
+    deletion_queue_push(renderer, (Deletion) { .type = DELETE_PIPELINE, .pipeline = pipeline });
+}
+
+void deletion_queue_pipeline_layout(Renderer* renderer, VkPipelineLayout pipeline_layout)
+{
+    deletion_queue_push(renderer, (Deletion) {
+        .type = DELETE_PIPELINE_LAYOUT,
+        .pipeline_layout = pipeline_layout,
+    });
+}
+
+void deletion_queue_descriptor_pool(Renderer* renderer, VkDescriptorPool descriptor_pool)
+{
+    deletion_queue_push(renderer, (Deletion) {
+        .type = DELETE_DESCRIPTOR_POOL,
+        .descriptor_pool = descriptor_pool,
+    });
+}
+
+void deletion_queue_descriptor_set(Renderer* renderer, VkDescriptorPool pool, VkDescriptorSet set)
+{
+    deletion_queue_push(renderer, (Deletion) {
+        .type = DELETE_DESCRIPTOR_SET,
+        .descriptor_set = { pool, set },
+    });
+}
+
+void deletion_queue_allocation(Renderer* renderer, VmaAllocation allocation)
+{
+    deletion_queue_push(renderer, (Deletion) {
+        .type = DELETE_ALLOCATION,
+        .allocation = allocation,
+    });
+}
+
+void deletion_queue_arena_range(Renderer* renderer, GeometryArena* arena, VkDeviceSize offset,
+        VkDeviceSize size)
+{
+    if (size == 0)
+        return;
+
+    deletion_queue_push(renderer, (Deletion) {
+        .type = DELETE_ARENA_RANGE,
+        .arena_range = { arena, offset, size },
+    });
+}
+
+void deletion_queue_flush(Renderer* renderer)
+{
+    DeletionQueue* queue = &renderer->deletion_queue;
+
+    // the fence just waited on is the one of the frame FRAMES_IN_FLIGHT back, and frames only
+    // ever get pushed in order, so what's done is a run at the front
+    uint32_t n_done = 0;
+    while (n_done < queue->n_deletions
+            && queue->deletions[n_done].frame + FRAMES_IN_FLIGHT <= renderer->frame)
+        n_done += 1;
+
+    // newest first, so views go before the images they were made from
+    for (uint32_t i = n_done; i > 0; --i)
+        deletion_destroy(renderer, &queue->deletions[i - 1]);
+
+    queue->n_deletions -= n_done;
+    memmove(queue->deletions, queue->deletions + n_done, sizeof(Deletion) * queue->n_deletions);
+}
+
+void deletion_queue_cleanup(Renderer* renderer)
+{
+    DeletionQueue* queue = &renderer->deletion_queue;
+
+    for (uint32_t i = queue->n_deletions; i > 0; --i)
+        deletion_destroy(renderer, &queue->deletions[i - 1]);
+
+    free(queue->deletions);
+    *queue = (DeletionQueue) {0};
+}
+
+void deletion_destroy(Renderer* renderer, Deletion* deletion)
+{
+    switch (deletion->type)
+    {
+        case DELETE_BUFFER:
+            buffer_destroy(&deletion->buffer, renderer->allocator);
+            break;
+        case DELETE_IMAGE:
+            image_destroy(renderer->device, renderer->allocator, deletion->image);
+            break;
+        case DELETE_IMAGE_VIEW:
+            vkDestroyImageView(renderer->device, deletion->image_view, NULL);
+            break;
+        case DELETE_SAMPLER:
+            vkDestroySampler(renderer->device, deletion->sampler, NULL);
+            break;
+        case DELETE_PIPELINE:
+            vkDestroyPipeline(renderer->device, deletion->pipeline, NULL);
+            break;
+        case DELETE_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(renderer->device, deletion->pipeline_layout, NULL);
+            break;
+        case DELETE_DESCRIPTOR_POOL:
+            vkDestroyDescriptorPool(renderer->device, deletion->descriptor_pool, NULL);
+            break;
+        case DELETE_DESCRIPTOR_SET:
+            vkFreeDescriptorSets(renderer->device, deletion->descriptor_set.pool, 1,
+                    &deletion->descriptor_set.set);
+            break;
+        case DELETE_ARENA_RANGE:
+            geometry_arena_free(deletion->arena_range.arena, deletion->arena_range.offset,
+                    deletion->arena_range.size);
+            break;
+        case DELETE_ALLOCATION:
+            gpu_memory_track_free(renderer->allocator, deletion->allocation);
+            vmaFreeMemory(renderer->allocator, deletion->allocation);
+            break;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "renderer.h"
+
+// main thread only. tagged with the frame being recorded, or the next one between frames, so
+// anything a frame already recorded or is about to record stays alive until that frame has
+// finished, whichever slot it ends up in
+void deletion_queue_push(Renderer* renderer, Deletion deletion);
+
+void deletion_queue_buffer(Renderer* renderer, Buffer buffer);
+// the view and the image together
+void deletion_queue_image(Renderer* renderer, Image image);
+void deletion_queue_image_view(Renderer* renderer, VkImageView image_view);
+void deletion_queue_sampler(Renderer* renderer, VkSampler sampler);
+void deletion_queue_pipeline(Renderer* renderer, VkPipeline pipeline);
+void deletion_queue_pipeline_layout(Renderer* renderer, VkPipelineLayout pipeline_layout);
+void deletion_queue_descriptor_pool(Renderer* renderer, VkDescriptorPool descriptor_pool);
+// the pool has to have been made with FREE_DESCRIPTOR_SET
+void deletion_queue_descriptor_set(Renderer* renderer, VkDescriptorPool pool, VkDescriptorSet set);
+// raw memory, anything bound to it gets queued after so it goes first
+void deletion_queue_allocation(Renderer* renderer, VmaAllocation allocation);
+void deletion_queue_arena_range(Renderer* renderer, GeometryArena* arena, VkDeviceSize offset,
+        VkDeviceSize size);
+
+// only once the current frame slot's fence has been waited on, destroys what frames that have
+// finished let go of
+void deletion_queue_flush(Renderer* renderer);
+// the device has to be idle, destroys everything still queued
+void deletion_queue_cleanup(Renderer* renderer);
+
+// internal
+void deletion_destroy(Renderer* renderer, Deletion* deletion);
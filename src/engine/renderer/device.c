@@ -4,18 +4,20 @@
 
 // macos just needs one extra extension :)
 #ifdef __APPLE__
-    const int DEVICE_EXTENSION_COUNT = 4;
+    const int DEVICE_EXTENSION_COUNT = 5;
     const char* DEVICE_EXTENSIONS[DEVICE_EXTENSION_COUNT] = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+        VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
         "VK_KHR_portability_subset",
         "VK_KHR_push_descriptor",
     };
 #else
-    const int DEVICE_EXTENSION_COUNT = 3;
+    const int DEVICE_EXTENSION_COUNT = 4;
     static const char* DEVICE_EXTENSIONS[DEVICE_EXTENSION_COUNT] = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+        VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
         "VK_KHR_push_descriptor",
     };
 #endif
@@ -73,26 +75,60 @@ void create_device(Renderer* renderer)
 {
     QueueFamilyIndices indices = find_queue_families(&renderer->gpu, &renderer->surface);
 
+    renderer->graphics_family = indices.graphics_family;
+    // without a family of its own the uploads share the graphics queue
+    renderer->transfer_family = indices.transfer_family == INVALID_IDX ? indices.graphics_family
+        : indices.transfer_family;
+
     float queue_priority = 1;
 
-    VkDeviceQueueCreateInfo queue_create_info = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = indices.graphics_family,
-        .pQueuePriorities = &queue_priority,
-        .queueCount = 1,
+    VkDeviceQueueCreateInfo queue_create_infos[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = renderer->graphics_family,
+            .pQueuePriorities = &queue_priority,
+            .queueCount = 1,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = renderer->transfer_family,
+            .pQueuePriorities = &queue_priority,
+            .queueCount = 1,
+        },
     };
 
     VkPhysicalDeviceFeatures device_features = {0};
 
+    // optional, samplers fall back to plain trilinear and compressed textures get skipped
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(renderer->gpu, &supported_features);
+    device_features.samplerAnisotropy = supported_features.samplerAnisotropy;
+    device_features.textureCompressionBC = supported_features.textureCompressionBC;
+    // indirect draws find their object through firstInstance, the cpu draws everything without it
+    device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(renderer->gpu, &properties);
+    renderer->max_anisotropy = supported_features.samplerAnisotropy
+        ? properties.limits.maxSamplerAnisotropy : 1;
+    renderer->timestamp_period = properties.limits.timestampComputeAndGraphics
+        ? properties.limits.timestampPeriod : 0;
+
     // enable the feature
     VkPhysicalDeviceBufferDeviceAddressFeatures buffer_address_feature = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
         .bufferDeviceAddress = VK_TRUE,
     };
 
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2_feature = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+        .pNext = &buffer_address_feature,
+        .synchronization2 = VK_TRUE,
+    };
+
     VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_feature = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
-        .pNext = &buffer_address_feature,
+        .pNext = &synchronization2_feature,
         .dynamicRendering = VK_TRUE,
     };
 
@@ -102,16 +138,32 @@ void create_device(Renderer* renderer)
         .features = device_features,
     };
 
+    // optional, vma estimates the budgets itself without it
+    const char* extensions[DEVICE_EXTENSION_COUNT + 2];
+    memcpy(extensions, DEVICE_EXTENSIONS, sizeof(const char*) * DEVICE_EXTENSION_COUNT);
+    uint32_t n_extensions = DEVICE_EXTENSION_COUNT;
+
+    renderer->memory_budget_supported = device_extension_supported(renderer->gpu,
+            VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (renderer->memory_budget_supported)
+        extensions[n_extensions++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+
+    // optional too, everything gets drawn from the cpu without it
+    bool draw_indirect_count_supported = supported_features.drawIndirectFirstInstance
+        && device_extension_supported(renderer->gpu, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (draw_indirect_count_supported)
+        extensions[n_extensions++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+
     VkDeviceCreateInfo device_create_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &device_features2,
-        .pQueueCreateInfos = &queue_create_info,
-        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos = queue_create_infos,
+        .queueCreateInfoCount = renderer->transfer_family != renderer->graphics_family ? 2 : 1,
 
         // .pEnabledFeatures = &device_features,
 
-        .ppEnabledExtensionNames = DEVICE_EXTENSIONS,
-        .enabledExtensionCount = DEVICE_EXTENSION_COUNT,
+        .ppEnabledExtensionNames = extensions,
+        .enabledExtensionCount = n_extensions,
 
         #ifdef VALIDATION_LAYERS_ENABLED
         .enabledLayerCount = validation_layers_count(),
@@ -124,7 +176,20 @@ void create_device(Renderer* renderer)
             vkCreateDevice(renderer->gpu, &device_create_info, NULL, &renderer->device)
     );
 
-    vkGetDeviceQueue(renderer->device, indices.graphics_family, 0, &renderer->graphics_queue);
+    renderer->cmd_pipeline_barrier2 = (PFN_vkCmdPipelineBarrier2KHR)
+        get_device_proc_adr(renderer->device, "vkCmdPipelineBarrier2KHR");
+    renderer->cmd_draw_indexed_indirect_count = NULL;
+    if (draw_indirect_count_supported)
+        renderer->cmd_draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+            get_device_proc_adr(renderer->device, "vkCmdDrawIndexedIndirectCountKHR");
+
+    vkGetDeviceQueue(renderer->device, renderer->graphics_family, 0, &renderer->graphics_queue);
+    vkGetDeviceQueue(renderer->device, renderer->transfer_family, 0, &renderer->transfer_queue);
+
+    if (renderer->transfer_family != renderer->graphics_family)
+        LOG_V("Uploading on transfer queue family %d\n", renderer->transfer_family);
+    else
+        LOG_V("No transfer queue family, uploading on the graphics queue\n");
 }
 
 int rate_device(VkPhysicalDevice gpu, VkSurfaceKHR* surface)
@@ -188,3 +253,20 @@ bool check_extention_device_support(VkPhysicalDevice gpu)
     return all_found;
 }
 
+
+bool device_extension_supported(VkPhysicalDevice gpu, const char* name)
+{
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(gpu, NULL, &extension_count, NULL);
+
+    VkExtensionProperties available_extensions[extension_count];
+    vkEnumerateDeviceExtensionProperties(gpu, NULL, &extension_count, available_extensions);
+
+    for (int i = 0; i < extension_count; ++i)
+    {
+        if (strcmp(available_extensions[i].extensionName, name) == 0)
+            return true;
+    }
+
+    return false;
+}
@@ -9,5 +9,6 @@ void device_initialise(Renderer* renderer);
 void pick_gpu(Renderer* renderer);
 int rate_device(VkPhysicalDevice gpu, VkSurfaceKHR* surface);
 bool check_extention_device_support(VkPhysicalDevice gpu);
+bool device_extension_supported(VkPhysicalDevice gpu, const char* name);
 void create_device(Renderer* renderer);
 
@@ -0,0 +1,74 @@
+#include "frame_ring.h"
+#include "buffers.h"
+#include "../utils.h"
+
+void frame_ring_initialise(FrameRing* ring, Renderer* renderer, size_t frame_size)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(renderer->gpu, &properties);
+
+    // both limits are powers of two, so the larger one is a multiple of the other
+    size_t alignment = properties.limits.minUniformBufferOffsetAlignment;
+    if (properties.limits.minStorageBufferOffsetAlignment > alignment)
+        alignment = properties.limits.minStorageBufferOffsetAlignment;
+    if (alignment < 16)
+        alignment = 16;
+
+    frame_size = (frame_size + alignment - 1) & ~(alignment - 1);
+
+    *ring = (FrameRing) {
+        .buffer = buffer_create(renderer->allocator, frame_size * FRAMES_IN_FLIGHT,
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+                MEMORY_UNIFORMS),
+        .frame_size = frame_size,
+        .alignment = alignment,
+    };
+
+    ring->address = buffer_get_address(renderer->device, &ring->buffer);
+
+    // mapped for the ring's whole life, writing a frame's constants is just a memcpy
+    VK_CHECK(vmaMapMemory(renderer->allocator, ring->buffer.allocation, (void**) &ring->mapped));
+}
+
+void frame_ring_cleanup(FrameRing* ring, VmaAllocator allocator)
+{
+    vmaUnmapMemory(allocator, ring->buffer.allocation);
+    buffer_destroy(&ring->buffer, allocator);
+}
+
+void frame_ring_begin(FrameRing* ring, int frame)
+{
+    ring->head = ring->frame_size * frame;
+    ring->frame_end = ring->head + ring->frame_size;
+}
+
+void* frame_ring_allocate(FrameRing* ring, size_t size, uint32_t* out_offset)
+{
+    size_t aligned = (size + ring->alignment - 1) & ~(ring->alignment - 1);
+    if (ring->head + aligned > ring->frame_end)
+        FATAL("Frame ring is out of space, %zu bytes a frame\n", ring->frame_size);
+
+    *out_offset = ring->head;
+    ring->head += aligned;
+
+    return ring->mapped + *out_offset;
+}
+
+size_t frame_ring_available(FrameRing* ring)
+{
+    return ring->frame_end - ring->head;
+}
+
+uint32_t frame_ring_push(FrameRing* ring, const void* data, size_t size)
+{
+    uint32_t offset;
+    memcpy(frame_ring_allocate(ring, size, &offset), data, size);
+
+    return offset;
+}
+
+VkDeviceAddress frame_ring_address(FrameRing* ring, uint32_t offset)
+{
+    return ring->address + offset;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "renderer.h"
+
+// each frame slot's share. scene data and the like only take a few hundred bytes a frame, most of
+// it is for the meshlet culler's 96 bytes a draw, which culls what fits and draws the rest whole
+#define FRAME_RING_BYTES (8 << 20)
+
+void frame_ring_initialise(FrameRing* ring, Renderer* renderer, size_t frame_size);
+// the device has to be idle
+void frame_ring_cleanup(FrameRing* ring, VmaAllocator allocator);
+
+// only once the frame's fence has been waited on, everything the slot handed out before is gone
+void frame_ring_begin(FrameRing* ring, int frame);
+// room for size bytes that the gpu reads this frame, out_offset is from the start of the buffer
+// and can be used as a dynamic offset as it is
+void* frame_ring_allocate(FrameRing* ring, size_t size, uint32_t* out_offset);
+// the same, copying data in
+uint32_t frame_ring_push(FrameRing* ring, const void* data, size_t size);
+// what's left of the current frame slot's share, an allocation up to this size always fits
+size_t frame_ring_available(FrameRing* ring);
+VkDeviceAddress frame_ring_address(FrameRing* ring, uint32_t offset);
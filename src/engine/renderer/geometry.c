@@ -0,0 +1,187 @@
+#include "geometry.h"
+#include "buffers.h"
+#include "../utils.h"
+
+void geometry_initialise(Renderer* renderer)
+{
+    geometry_arena_initialise(&renderer->vertex_arena, renderer, GEOMETRY_VERTEX_ARENA_BYTES,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    // the culling pass reads indices through their address too
+    geometry_arena_initialise(&renderer->index_arena, renderer, GEOMETRY_INDEX_ARENA_BYTES,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void geometry_cleanup(Renderer* renderer)
+{
+    geometry_arena_cleanup(&renderer->vertex_arena, renderer->allocator);
+    geometry_arena_cleanup(&renderer->index_arena, renderer->allocator);
+}
+
+void geometry_arena_initialise(GeometryArena* arena, Renderer* renderer, VkDeviceSize size,
+        VkBufferUsageFlags usage)
+{
+    *arena = (GeometryArena) {
+        .buffer = buffer_create(renderer->allocator, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY),
+        .size = size,
+        .alignment = GEOMETRY_ALIGNMENT,
+    };
+
+    arena->address = buffer_get_address(renderer->device, &arena->buffer);
+
+    // the whole thing starts out as one free block
+    geometry_arena_insert_block(arena, 0, (ArenaBlock) { 0, size });
+
+    pthread_mutex_init(&arena->mutex, NULL);
+}
+
+void geometry_arena_cleanup(GeometryArena* arena, VmaAllocator allocator)
+{
+    if (arena->used != 0)
+        LOG_W("Geometry arena destroyed with %.1lf MB still allocated\n", arena->used / 1e6);
+
+    buffer_destroy(&arena->buffer, allocator);
+    pthread_mutex_destroy(&arena->mutex);
+    free(arena->free_blocks);
+}
+
+// best fit, so big holes stay big for as long as possible
+bool geometry_arena_allocate(GeometryArena* arena, VkDeviceSize size, VkDeviceSize* out_offset)
+{
+    *out_offset = 0;
+    if (size == 0)
+        return true;
+
+    size = (size + arena->alignment - 1) & ~(arena->alignment - 1);
+
+    pthread_mutex_lock(&arena->mutex);
+
+    uint32_t best = UINT32_MAX;
+    for (uint32_t i = 0; i < arena->n_free_blocks; ++i)
+    {
+        ArenaBlock* block = &arena->free_blocks[i];
+        if (block->size >= size && (best == UINT32_MAX || block->size < arena->free_blocks[best].size))
+            best = i;
+    }
+
+    if (best == UINT32_MAX)
+    {
+        pthread_mutex_unlock(&arena->mutex);
+        return false;
+    }
+
+    // block offsets and sizes stay aligned, so taking the front keeps the rest aligned too
+    ArenaBlock* block = &arena->free_blocks[best];
+    *out_offset = block->offset;
+    block->offset += size;
+    block->size -= size;
+
+    if (block->size == 0)
+        geometry_arena_remove_block(arena, best);
+
+    arena->used += size;
+
+    pthread_mutex_unlock(&arena->mutex);
+    return true;
+}
+
+// first fit from the bottom, for moving a range down to somewhere that ends at or before limit
+bool geometry_arena_allocate_below(GeometryArena* arena, VkDeviceSize size, VkDeviceSize limit,
+        VkDeviceSize* out_offset)
+{
+    size = (size + arena->alignment - 1) & ~(arena->alignment - 1);
+
+    pthread_mutex_lock(&arena->mutex);
+
+    for (uint32_t i = 0; i < arena->n_free_blocks; ++i)
+    {
+        ArenaBlock* block = &arena->free_blocks[i];
+        if (block->offset + size > limit)
+            break;
+
+        if (block->size < size)
+            continue;
+
+        *out_offset = block->offset;
+        block->offset += size;
+        block->size -= size;
+
+        if (block->size == 0)
+            geometry_arena_remove_block(arena, i);
+
+        arena->used += size;
+
+        pthread_mutex_unlock(&arena->mutex);
+        return true;
+    }
+
+    pthread_mutex_unlock(&arena->mutex);
+    return false;
+}
+
+void geometry_arena_free(GeometryArena* arena, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (size == 0)
+        return;
+
+    size = (size + arena->alignment - 1) & ~(arena->alignment - 1);
+
+    pthread_mutex_lock(&arena->mutex);
+
+    // first block past the freed range
+    uint32_t next = 0;
+    while (next < arena->n_free_blocks && arena->free_blocks[next].offset < offset)
+        next++;
+
+    bool merges_prev = next > 0
+        && arena->free_blocks[next - 1].offset + arena->free_blocks[next - 1].size == offset;
+    bool merges_next = next < arena->n_free_blocks
+        && offset + size == arena->free_blocks[next].offset;
+
+    if (merges_prev && merges_next)
+    {
+        arena->free_blocks[next - 1].size += size + arena->free_blocks[next].size;
+        geometry_arena_remove_block(arena, next);
+    }
+    else if (merges_prev)
+    {
+        arena->free_blocks[next - 1].size += size;
+    }
+    else if (merges_next)
+    {
+        arena->free_blocks[next].offset = offset;
+        arena->free_blocks[next].size += size;
+    }
+    else
+    {
+        geometry_arena_insert_block(arena, next, (ArenaBlock) { offset, size });
+    }
+
+    arena->used -= size;
+    arena->generation += 1;
+
+    pthread_mutex_unlock(&arena->mutex);
+}
+
+void geometry_arena_insert_block(GeometryArena* arena, uint32_t index, ArenaBlock block)
+{
+    if (arena->n_free_blocks == arena->free_block_capacity)
+    {
+        arena->free_block_capacity = arena->free_block_capacity == 0 ? 64 : arena->free_block_capacity * 2;
+        arena->free_blocks = realloc(arena->free_blocks, sizeof(ArenaBlock) * arena->free_block_capacity);
+    }
+
+    memmove(arena->free_blocks + index + 1, arena->free_blocks + index,
+            sizeof(ArenaBlock) * (arena->n_free_blocks - index));
+    arena->free_blocks[index] = block;
+    arena->n_free_blocks++;
+}
+
+void geometry_arena_remove_block(GeometryArena* arena, uint32_t index)
+{
+    arena->n_free_blocks--;
+    memmove(arena->free_blocks + index, arena->free_blocks + index + 1,
+            sizeof(ArenaBlock) * (arena->n_free_blocks - index));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "renderer.h"
+
+// both arenas are created up front, their addresses can never change once meshes point into them
+#define GEOMETRY_VERTEX_ARENA_BYTES (256 << 20)
+#define GEOMETRY_INDEX_ARENA_BYTES (128 << 20)
+// buffer references default to 16 byte alignment
+#define GEOMETRY_ALIGNMENT 16
+
+void geometry_initialise(Renderer* renderer);
+// every mesh has to have been freed already
+void geometry_cleanup(Renderer* renderer);
+
+void geometry_arena_initialise(GeometryArena* arena, Renderer* renderer, VkDeviceSize size,
+        VkBufferUsageFlags usage);
+void geometry_arena_cleanup(GeometryArena* arena, VmaAllocator allocator);
+// any thread, false when no free range is big enough. a size of 0 always succeeds at offset 0
+bool geometry_arena_allocate(GeometryArena* arena, VkDeviceSize size, VkDeviceSize* out_offset);
+// any thread, the lowest free range that fits and ends at or before limit
+bool geometry_arena_allocate_below(GeometryArena* arena, VkDeviceSize size, VkDeviceSize limit,
+        VkDeviceSize* out_offset);
+// the same size it was allocated with, and nothing on the gpu can still be reading it
+void geometry_arena_free(GeometryArena* arena, VkDeviceSize offset, VkDeviceSize size);
+
+// internal
+void geometry_arena_insert_block(GeometryArena* arena, uint32_t index, ArenaBlock block);
+void geometry_arena_remove_block(GeometryArena* arena, uint32_t index);
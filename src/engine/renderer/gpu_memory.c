@@ -0,0 +1,150 @@
+#include "gpu_memory.h"
+#include "../utils.h"
+
+#include <stdatomic.h>
+
+// allocations come from the loader thread and job pool too
+static atomic_uint_fast64_t category_bytes[MEMORY_CATEGORY_COUNT];
+static atomic_uint category_allocations[MEMORY_CATEGORY_COUNT];
+// null for categories that come out of vma's default pools
+static VmaPool category_pools[MEMORY_CATEGORY_COUNT];
+
+// textures get a pool of their own, nothing else sits in its blocks so it can be defragmented
+// without touching memory that can't move
+void gpu_memory_create_pools(Renderer* renderer)
+{
+    VkImageCreateInfo texture_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = { 1, 1, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+            | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    };
+
+    VmaAllocationCreateInfo alloc_info = {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    };
+
+    uint32_t memory_type;
+    if (vmaFindMemoryTypeIndexForImageInfo(renderer->allocator, &texture_info, &alloc_info,
+                &memory_type) != VK_SUCCESS)
+    {
+        LOG_W("No memory type for a texture pool, textures won't be defragmented\n");
+        return;
+    }
+
+    VmaPoolCreateInfo pool_info = {
+        .memoryTypeIndex = memory_type,
+    };
+    VK_CHECK(vmaCreatePool(renderer->allocator, &pool_info, &category_pools[MEMORY_TEXTURES]));
+}
+
+// everything allocated from them has to be gone
+void gpu_memory_destroy_pools(VmaAllocator allocator)
+{
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+    {
+        if (category_pools[i] != VK_NULL_HANDLE)
+            vmaDestroyPool(allocator, category_pools[i]);
+        category_pools[i] = VK_NULL_HANDLE;
+    }
+}
+
+VmaPool gpu_memory_pool(enum MemoryCategory category)
+{
+    return category_pools[category];
+}
+
+void gpu_memory_track_allocation(VmaAllocator allocator, VmaAllocation allocation)
+{
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator, allocation, &info);
+
+    enum MemoryCategory category = (uintptr_t) info.pUserData;
+    atomic_fetch_add(&category_bytes[category], info.size);
+    atomic_fetch_add(&category_allocations[category], 1);
+}
+
+void gpu_memory_track_free(VmaAllocator allocator, VmaAllocation allocation)
+{
+    if (allocation == VK_NULL_HANDLE)
+        return;
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator, allocation, &info);
+
+    enum MemoryCategory category = (uintptr_t) info.pUserData;
+    atomic_fetch_sub(&category_bytes[category], info.size);
+    atomic_fetch_sub(&category_allocations[category], 1);
+}
+
+void gpu_memory_report(Renderer* renderer, MemoryReport* report)
+{
+    const VkPhysicalDeviceMemoryProperties* properties;
+    vmaGetMemoryProperties(renderer->allocator, &properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(renderer->allocator, budgets);
+
+    report->n_heaps = properties->memoryHeapCount;
+    for (uint32_t i = 0; i < report->n_heaps; ++i)
+    {
+        report->heaps[i] = (MemoryHeapReport) {
+            .size = properties->memoryHeaps[i].size,
+            .budget = budgets[i].budget,
+            .usage = budgets[i].usage,
+            .device_local = properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT,
+        };
+    }
+
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+    {
+        report->category_bytes[i] = atomic_load(&category_bytes[i]);
+        report->category_allocations[i] = atomic_load(&category_allocations[i]);
+    }
+}
+
+void gpu_memory_check_budget(Renderer* renderer)
+{
+    // the budget extension only gets queried again when the frame index moves
+    vmaSetCurrentFrameIndex(renderer->allocator, renderer->frame);
+
+    MemoryReport report;
+    gpu_memory_report(renderer, &report);
+
+    for (uint32_t i = 0; i < report.n_heaps; ++i)
+    {
+        MemoryHeapReport* heap = &report.heaps[i];
+        bool over = heap->usage > heap->budget * MEMORY_BUDGET_WARNING;
+        bool was_over = renderer->heaps_over_budget & (1u << i);
+
+        if (over && !was_over)
+            LOG_W("Memory heap %d is using %.1lf MB of its %.1lf MB budget\n", i, heap->usage / 1e6,
+                    heap->budget / 1e6);
+
+        if (over)
+            renderer->heaps_over_budget |= 1u << i;
+        else
+            renderer->heaps_over_budget &= ~(1u << i);
+    }
+}
+
+const char* gpu_memory_category_name(enum MemoryCategory category)
+{
+    switch (category)
+    {
+        case MEMORY_GEOMETRY: return "Geometry";
+        case MEMORY_TEXTURES: return "Textures";
+        case MEMORY_RENDER_TARGETS: return "Render targets";
+        case MEMORY_STAGING: return "Staging";
+        case MEMORY_UNIFORMS: return "Uniforms";
+        case MEMORY_OTHER: return "Other";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "renderer.h"
+
+// a heap past this much of its budget gets a warning, paging starts not long after
+#define MEMORY_BUDGET_WARNING 0.9
+
+// goes in VmaAllocationCreateInfo.pUserData
+#define MEMORY_CATEGORY_TAG(category) ((void*) (uintptr_t) (category))
+
+// before anything gets allocated, and after everything is freed
+void gpu_memory_create_pools(Renderer* renderer);
+void gpu_memory_destroy_pools(VmaAllocator allocator);
+// what allocations of a category should come out of, null for vma's default pools
+VmaPool gpu_memory_pool(enum MemoryCategory category);
+
+// any thread, right after the allocation was made and right before it gets freed
+void gpu_memory_track_allocation(VmaAllocator allocator, VmaAllocation allocation);
+void gpu_memory_track_free(VmaAllocator allocator, VmaAllocation allocation);
+
+// usage against budget for every heap, and what each category is holding
+void gpu_memory_report(Renderer* renderer, MemoryReport* report);
+// once a frame, refreshes the budgets and warns when a heap gets close to running out
+void gpu_memory_check_budget(Renderer* renderer);
+const char* gpu_memory_category_name(enum MemoryCategory category);
@@ -1,39 +1,12 @@
 #include "image.h"
 #include "renderer.h"
 #include "buffers.h"
+#include "uploads.h"
+#include "gpu_memory.h"
+#include "barriers.h"
+#include "../scene/texture_format.h"
 #include "../utils.h"
 
-void transition_image(VkCommandBuffer cmd_buf, VkDevice device, VkImage image,
-        VkImageLayout current_layout, VkImageLayout new_layout)
-{
-    VkImageAspectFlags aspect_mask = (new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
-        ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-
-    VkImageSubresourceRange sub_image = {
-        .aspectMask = aspect_mask,
-        .levelCount = VK_REMAINING_MIP_LEVELS,
-        .layerCount = VK_REMAINING_ARRAY_LAYERS,
-    };
-
-    VkImageMemoryBarrier barrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .pNext = NULL,
-
-        .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT,
-
-        .oldLayout = current_layout,
-        .newLayout = new_layout,
-
-        .subresourceRange = sub_image,
-        .image = image,
-    };
-
-
-    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-            0, 0, NULL, 0, NULL, 1, &barrier);
-}
-
 VkImageCreateInfo get_image_create_info(
         VkFormat format,
         VkImageUsageFlags usage_flags,
@@ -124,25 +97,37 @@ void copy_image(VkCommandBuffer cmd_buf, VkImage src, VkImage dst,
 }
 
 Image image_create(VmaAllocator allocator, VkDevice device, VkExtent3D size, VkFormat format,
-        VkImageUsageFlags usage, bool mipmapped)
+        VkImageUsageFlags usage, uint32_t mip_levels, enum MemoryCategory category)
 {
     Image image;
     image.format = format;
     image.extent = size;
 
     VkImageCreateInfo image_info = get_image_create_info(format, usage, size);
+    image_info.mipLevels = mip_levels;
 
-    if (mipmapped) {
-		image_info.mipLevels = floorf(log2f(max(size.width, size.height))) + 1;
-	}
+    image.usage = usage;
+    image.mip_levels = image_info.mipLevels;
 
     VmaAllocationCreateInfo alloc_info = {
         .usage = VMA_MEMORY_USAGE_GPU_ONLY,
         .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        .pool = gpu_memory_pool(category),
+        .pUserData = MEMORY_CATEGORY_TAG(category),
     };
 
-    VK_CHECK(vmaCreateImage(allocator, &image_info, &alloc_info, &image.image, &image.allocation,
-                NULL));
+    // the category's pool only has the one memory type, anything that can't live there goes
+    // to the default pools instead
+    VkResult result = vmaCreateImage(allocator, &image_info, &alloc_info, &image.image,
+            &image.allocation, NULL);
+    if (result != VK_SUCCESS && alloc_info.pool != VK_NULL_HANDLE)
+    {
+        alloc_info.pool = VK_NULL_HANDLE;
+        result = vmaCreateImage(allocator, &image_info, &alloc_info, &image.image, &image.allocation,
+                NULL);
+    }
+    VK_CHECK(result);
+    gpu_memory_track_allocation(allocator, image.allocation);
 
     VkImageAspectFlags aspect_flag = VK_IMAGE_ASPECT_COLOR_BIT;
 	if (format == VK_FORMAT_D32_SFLOAT) {
@@ -160,55 +145,199 @@ Image image_create(VmaAllocator allocator, VkDevice device, VkExtent3D size, VkF
 Image image_create_textured(Renderer* renderer, void* data, VkExtent3D size,
         VkFormat format, VkImageUsageFlags usage, bool mipmapped)
 {
-    size_t data_size = size.depth * size.width * size.height * 4;
+    TextureData texture = { data, size, format, 1 };
 
-    Buffer upload_buffer = buffer_create(renderer->allocator, data_size,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    UploadBatch batch = upload_batch_create(renderer, image_staging_size(&texture), false);
+    Image image = image_stage_texture(renderer, &batch, &texture, usage, mipmapped);
+    upload_batch_submit(renderer, &batch);
 
-    // copy it in
-    void* buf_data;
-    vmaMapMemory(renderer->allocator, upload_buffer.allocation, &buf_data);
-    memcpy(buf_data, data, data_size);
-    vmaUnmapMemory(renderer->allocator, upload_buffer.allocation);
+    return image;
+}
 
-    Image image = image_create(renderer->allocator, renderer->device, size, format, usage
-            | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, mipmapped);
+// a submit and a staging region per batch rather than per image
+void images_create_textured(Renderer* renderer, const TextureData* textures, uint32_t n,
+        VkImageUsageFlags usage, bool mipmapped, Image* out_images)
+{
+    uint32_t batch_start = 0;
+    while (batch_start < n)
+    {
+        size_t batch_size = 0;
+        uint32_t batch_end = batch_start;
+        while (batch_end < n)
+        {
+            size_t image_size = upload_batch_aligned(image_staging_size(&textures[batch_end]));
 
-    VkBufferImageCopy copy_region = {
-        .bufferOffset = 0,
-        .bufferRowLength = 0,
-        .bufferImageHeight = 0,
+            if (batch_end != batch_start && batch_size + image_size > IMAGE_UPLOAD_BATCH_BYTES)
+                break;
 
-        .imageExtent = size,
-        .imageSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-    };
+            batch_size += image_size;
+            batch_end += 1;
+        }
 
-    {
-        immediate_begin(renderer);
+        UploadBatch batch = upload_batch_create(renderer, batch_size, false);
 
-        transition_image(renderer->imm_cmd_buf, renderer->device, image.image,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        for (uint32_t i = batch_start; i < batch_end; ++i)
+            out_images[i] = image_stage_texture(renderer, &batch, &textures[i], usage, mipmapped);
 
-        vkCmdCopyBufferToImage(renderer->imm_cmd_buf, upload_buffer.buffer, image.image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+        upload_batch_submit(renderer, &batch);
 
-        transition_image(renderer->imm_cmd_buf, renderer->device, image.image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-        immediate_end(renderer);
+        batch_start = batch_end;
     }
+}
 
-    buffer_destroy(&upload_buffer, renderer->allocator);
+// prebuilt levels are kept as they are, a lone level gets the full chain blitted when it can be
+Image image_stage_texture(Renderer* renderer, UploadBatch* batch, const TextureData* texture,
+        VkImageUsageFlags usage, bool mipmapped)
+{
+    if (texture->data == NULL)
+        return (Image) {0};
+
+    if (!image_format_sampleable(renderer->gpu, texture->format))
+    {
+        LOG_W("Can't sample %s textures on this device, skipping one\n",
+                texture_format_name(texture->format));
+        return (Image) {0};
+    }
+
+    uint32_t mip_levels = texture->n_levels;
+    if (mipmapped && texture->n_levels == 1
+            && image_format_blittable(renderer->gpu, texture->format))
+        mip_levels = texture_mip_count(texture->size.width, texture->size.height);
+
+    Image image = image_create(renderer->allocator, renderer->device, texture->size, texture->format,
+            usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, mip_levels,
+            MEMORY_TEXTURES);
+
+    upload_batch_image(batch, image.image, texture->data, texture->format, texture->size,
+            texture->n_levels, image.mip_levels);
+    // where the batch leaves it once recorded
+    image.state = barrier_state(IMAGE_ACCESS_SAMPLED);
 
     return image;
 }
 
+size_t image_staging_size(const TextureData* texture)
+{
+    if (texture->data == NULL)
+        return 0;
+
+    return texture_chain_size(texture->format, texture->size.width, texture->size.height,
+            texture->n_levels) * texture->size.depth;
+}
+
+bool image_format_sampleable(VkPhysicalDevice gpu, VkFormat format)
+{
+    if (texture_format_block_size(format) == 0)
+        return false;
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(gpu, format, &properties);
+    return properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+bool image_format_blittable(VkPhysicalDevice gpu, VkFormat format)
+{
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(gpu, format, &properties);
+
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+        | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+// each level is blitted from the one above it once that one has gone to transfer src. the images
+// go down their chains side by side, so every step is one barrier however many there are
+void image_generate_mips(Renderer* renderer, VkCommandBuffer cmd_buf, const ImageUpload* uploads,
+        uint32_t n)
+{
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+
+    uint32_t most_levels = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (image_upload_blits(&uploads[i]) && uploads[i].mip_levels > most_levels)
+            most_levels = uploads[i].mip_levels;
+    }
+
+    for (uint32_t level = 0; level < most_levels; ++level)
+    {
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const ImageUpload* upload = &uploads[i];
+            if (!image_upload_blits(upload) || level >= upload->mip_levels)
+                continue;
+
+            VkImageSubresourceRange range = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = level,
+                .levelCount = 1,
+                .layerCount = 1,
+            };
+            ImageState state = barrier_state(IMAGE_ACCESS_TRANSFER_DST);
+            barrier_image_range(&barriers, upload->dst, range, &state, IMAGE_ACCESS_TRANSFER_SRC,
+                    false);
+        }
+        barrier_flush(&barriers);
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const ImageUpload* upload = &uploads[i];
+            if (!image_upload_blits(upload) || level + 1 >= upload->mip_levels)
+                continue;
+
+            VkImageBlit blit = {
+                .srcSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .layerCount = 1,
+                },
+                .srcOffsets[1] = {
+                    texture_mip_dimension(upload->extent.width, level),
+                    texture_mip_dimension(upload->extent.height, level),
+                    1,
+                },
+                .dstSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level + 1,
+                    .layerCount = 1,
+                },
+                .dstOffsets[1] = {
+                    texture_mip_dimension(upload->extent.width, level + 1),
+                    texture_mip_dimension(upload->extent.height, level + 1),
+                    1,
+                },
+            };
+
+            vkCmdBlitImage(cmd_buf, upload->dst, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload->dst,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        }
+    }
+
+    // every level is transfer src by now
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (!image_upload_blits(&uploads[i]))
+            continue;
+
+        VkImageSubresourceRange range = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = uploads[i].mip_levels,
+            .layerCount = 1,
+        };
+        ImageState state = barrier_state(IMAGE_ACCESS_TRANSFER_SRC);
+        barrier_image_range(&barriers, uploads[i].dst, range, &state, IMAGE_ACCESS_SAMPLED, false);
+    }
+    barrier_flush(&barriers);
+}
+
 void image_destroy(VkDevice device, VmaAllocator allocator, Image image)
 {
     vkDestroyImageView(device, image.view, NULL);
+    gpu_memory_track_free(allocator, image.allocation);
     vmaDestroyImage(allocator, image.image, image.allocation);
 }
+
+bool image_upload_blits(const ImageUpload* upload)
+{
+    return upload->mip_levels > upload->n_levels && upload->src == VK_NULL_HANDLE;
+}
@@ -3,8 +3,8 @@
 #include <vulkan/vulkan.h>
 #include "renderer.h"
 
-void transition_image(VkCommandBuffer cmd_buf, VkDevice device, VkImage image,
-        VkImageLayout current_layout, VkImageLayout new_layout);
+// staging for one submit of images_create_textured, larger images get a batch to themselves
+#define IMAGE_UPLOAD_BATCH_BYTES (64 << 20)
 
 VkImageCreateInfo get_image_create_info(VkFormat format, VkImageUsageFlags usage_flags,
         VkExtent3D extent);
@@ -13,8 +13,30 @@ VkImageViewCreateInfo get_image_view_create_info(VkFormat format, VkImage image,
 void copy_image(VkCommandBuffer cmd_buf, VkImage src, VkImage dst,
         VkExtent2D src_size, VkExtent2D dst_size);
 void image_destroy(VkDevice device, VmaAllocator allocator, Image image);
+// mip_levels of 1 for just the one
 Image image_create(VmaAllocator allocator, VkDevice device, VkExtent3D size, VkFormat format,
-        VkImageUsageFlags usage, bool mipmapped);
+        VkImageUsageFlags usage, uint32_t mip_levels, enum MemoryCategory category);
+// with mipmapped the chain gets blitted down from data, unless the format can't be blitted
 Image image_create_textured(Renderer* renderer, void* data, VkExtent3D size,
         VkFormat format, VkImageUsageFlags usage, bool mipmapped);
+// through shared staging buffers, a NULL data or a format the device can't sample leaves its image
+// zeroed. mipmapped only applies to textures that come with a single level
+void images_create_textured(Renderer* renderer, const TextureData* textures, uint32_t n,
+        VkImageUsageFlags usage, bool mipmapped, Image* out_images);
+// creates the image for one texture and stages it in batch, the same rules as above
+Image image_stage_texture(Renderer* renderer, UploadBatch* batch, const TextureData* texture,
+        VkImageUsageFlags usage, bool mipmapped);
+size_t image_staging_size(const TextureData* texture);
+// block compressed formats need the device feature, plain ones are always there
+bool image_format_sampleable(VkPhysicalDevice gpu, VkFormat format);
+// whether mips of the format can be generated with linear blits
+bool image_format_blittable(VkPhysicalDevice gpu, VkFormat format);
+// for the uploads with more mip_levels than n_levels, the rest are skipped. level 0 has to be
+// filled and every level in transfer dst, they all end up sampled
+void image_generate_mips(Renderer* renderer, VkCommandBuffer cmd_buf, const ImageUpload* uploads,
+        uint32_t n);
+
+// internal
+// whether the levels past the staged ones get blitted rather than copied out of another image
+bool image_upload_blits(const ImageUpload* upload);
 
@@ -0,0 +1,453 @@
+#include "indirect.h"
+#include "buffers.h"
+#include "shaders.h"
+#include "barriers.h"
+#include "deletion.h"
+#include "frame_ring.h"
+#include "../utils.h"
+
+#include <math.h>
+
+// threads per workgroup in shader.indirect.comp
+#define INDIRECT_GROUP_SIZE 64
+
+void indirect_initialise(Renderer* renderer)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    indirect->supported = renderer->cmd_draw_indexed_indirect_count != NULL;
+    if (!indirect->supported)
+    {
+        LOG_W("No VK_KHR_draw_indirect_count or drawIndirectFirstInstance, every draw is recorded "
+                "from the cpu\n");
+        return;
+    }
+
+    indirect_create_pipeline(renderer);
+
+    indirect->enabled = true;
+}
+
+void indirect_cleanup(Renderer* renderer)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    if (!indirect->supported)
+        return;
+
+    free(indirect->objects);
+    free(indirect->sources);
+    free(indirect->buckets);
+
+    if (indirect->object_buffer_capacity != 0)
+        buffer_destroy(&indirect->object_buffer, renderer->allocator);
+
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        if (indirect->staging_capacity[i] != 0)
+            buffer_destroy(&indirect->staging[i], renderer->allocator);
+        if (indirect->command_capacity[i] != 0)
+            buffer_destroy(&indirect->draw_commands[i], renderer->allocator);
+        if (indirect->count_capacity[i] != 0)
+            buffer_destroy(&indirect->counts[i], renderer->allocator);
+    }
+
+    vkDestroyPipeline(renderer->device, indirect->pipeline, NULL);
+    vkDestroyPipelineLayout(renderer->device, indirect->layout, NULL);
+}
+
+void indirect_add_surface(Renderer* renderer, Mesh* mesh, GeoSurface* surface, mat4 transform)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    if (!indirect->supported)
+        return;
+
+    if (indirect->n_objects == indirect->object_capacity)
+    {
+        indirect->object_capacity = indirect->object_capacity == 0 ? 64 : indirect->object_capacity * 2;
+        indirect->objects = realloc(indirect->objects,
+                sizeof(IndirectObject) * indirect->object_capacity);
+        indirect->sources = realloc(indirect->sources,
+                sizeof(IndirectSource) * indirect->object_capacity);
+    }
+
+    uint32_t index = indirect->n_objects;
+    indirect->n_objects += 1;
+    indirect->sources[index] = (IndirectSource) { mesh, surface };
+
+    IndirectObject* object = &indirect->objects[index];
+    glm_mat4_copy(transform, object->transform);
+    // the same as ecs_lod_distance, the largest axis so the error never gets underestimated
+    object->scale = fmaxf(glm_vec3_norm(transform[0]), fmaxf(glm_vec3_norm(transform[1]),
+                glm_vec3_norm(transform[2])));
+
+    object->bucket = indirect_bucket(renderer, surface->material == NULL ?
+            &renderer->default_material_instance : surface->material);
+
+    indirect_write_object(renderer, index);
+
+    uint32_t n_commands = indirect_object_commands(object);
+    indirect->buckets[object->bucket].n_objects += 1;
+    indirect->buckets[object->bucket].n_commands += n_commands;
+    indirect->n_commands += n_commands;
+
+    // a bucket's commands start where the ones before it end, only loading ever changes this
+    uint32_t first_command = 0;
+    for (uint32_t i = 0; i < indirect->n_buckets; ++i)
+    {
+        indirect->buckets[i].first_command = first_command;
+        first_command += indirect->buckets[i].n_commands;
+    }
+}
+
+void indirect_mesh_moved(Renderer* renderer, MeshBuffers* mesh_buffers)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    for (uint32_t i = 0; i < indirect->n_objects; ++i)
+    {
+        if (&indirect->sources[i].mesh->mesh_buffers == mesh_buffers)
+            indirect_write_object(renderer, i);
+    }
+}
+
+void indirect_record(Renderer* renderer, VkCommandBuffer cmd_buf)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+    int frame = renderer->frame_in_flight;
+
+    if (!indirect_active(renderer))
+        return;
+
+    indirect_reserve(renderer, frame);
+
+    IndirectFrameData* frame_data;
+    uint32_t frame_data_offset;
+    frame_data = frame_ring_allocate(&renderer->frame_ring,
+            sizeof(IndirectFrameData) + sizeof(uint32_t) * indirect->n_buckets, &frame_data_offset);
+
+    mat4 view_projection;
+    glm_mat4_mul(renderer->projection, renderer->view, view_projection);
+    glm_frustum_planes(view_projection, frame_data->frustum);
+
+    glm_vec3_copy(renderer->camera_position, frame_data->camera_position);
+    frame_data->objects = buffer_get_address(renderer->device, &indirect->object_buffer);
+    frame_data->draw_commands = buffer_get_address(renderer->device, &indirect->draw_commands[frame]);
+    frame_data->counts = buffer_get_address(renderer->device, &indirect->counts[frame]);
+    frame_data->n_objects = indirect->n_objects;
+    frame_data->pixels_per_unit = renderer->swapchain.extent.height
+        / (2 * tanf(glm_rad(renderer->fov) / 2));
+    frame_data->lod_error_pixels = renderer->lod_error_pixels;
+    frame_data->cull_meshlets = renderer->culler.enabled;
+
+    for (uint32_t i = 0; i < indirect->n_buckets; ++i)
+        frame_data->first_command[i] = indirect->buckets[i].first_command;
+
+    // last frame's culling and draws may still be reading the objects
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+            | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, 0,
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    barrier_flush(&barriers);
+
+    indirect_upload(renderer, cmd_buf, frame);
+
+    // the shader only ever adds to the counts
+    vkCmdFillBuffer(cmd_buf, indirect->counts[frame].buffer, 0,
+            sizeof(uint32_t) * indirect->n_buckets, 0);
+
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+            VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+    barrier_flush(&barriers);
+
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, indirect->pipeline);
+
+    VkDeviceAddress frame_address = frame_ring_address(&renderer->frame_ring, frame_data_offset);
+    vkCmdPushConstants(cmd_buf, indirect->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+            sizeof(VkDeviceAddress), &frame_address);
+
+    vkCmdDispatch(cmd_buf, (indirect->n_objects + INDIRECT_GROUP_SIZE - 1) / INDIRECT_GROUP_SIZE,
+            1, 1);
+
+    barrier_memory(&barriers, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+    barrier_flush(&barriers);
+}
+
+bool indirect_active(Renderer* renderer)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+    return indirect->supported && indirect->enabled && indirect->n_objects != 0;
+}
+
+void indirect_draw(Renderer* renderer, VkCommandBuffer cmd_buf, uint32_t scene_data_offset)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+    int frame = renderer->frame_in_flight;
+
+    vkCmdBindIndexBuffer(cmd_buf, renderer->index_arena.buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    IndirectPushConstants push_constants = {
+        .objects = buffer_get_address(renderer->device, &indirect->object_buffer),
+    };
+    glm_mat4_mul(renderer->projection, renderer->view, push_constants.view_projection);
+
+    MaterialPipeline* bound_pipeline = NULL;
+
+    // a bucket draws however many of its objects survived, up to all of them
+    for (uint32_t i = 0; i < indirect->n_buckets; ++i)
+    {
+        IndirectBucket* bucket = &indirect->buckets[i];
+        MaterialInstance* mat = bucket->material;
+
+        if (mat->pipeline != bound_pipeline)
+        {
+            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline->indirect);
+            vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline->layout,
+                    0, 1, &renderer->scene_data_set, 1, &scene_data_offset);
+            vkCmdPushConstants(cmd_buf, mat->pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                    sizeof(IndirectPushConstants), &push_constants);
+            bound_pipeline = mat->pipeline;
+        }
+
+        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline->layout, 1, 1,
+                &mat->material_set, 0, NULL);
+
+        renderer->cmd_draw_indexed_indirect_count(cmd_buf, indirect->draw_commands[frame].buffer,
+                sizeof(VkDrawIndexedIndirectCommand) * bucket->first_command,
+                indirect->counts[frame].buffer, sizeof(uint32_t) * i, bucket->n_commands,
+                sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+// everything that comes from the mesh, so it can be written again when the mesh moves
+void indirect_write_object(Renderer* renderer, uint32_t index)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+    IndirectObject* object = &indirect->objects[index];
+    Mesh* mesh = indirect->sources[index].mesh;
+    GeoSurface* surface = indirect->sources[index].surface;
+    MeshBuffers* buffers = &mesh->mesh_buffers;
+
+    glm_vec4_copy(mesh->bounds, object->sphere);
+    glm_vec4_copy(buffers->position_offset, object->position_offset);
+    glm_vec4_copy(buffers->position_scale, object->position_scale);
+    object->vertex_buffer = buffers->vertex_buffer_address;
+    object->vertex_format = buffers->vertex_format;
+    object->meshlets = buffers->meshlet_buffer_address;
+    object->mesh_first_index = buffers->first_index;
+
+    // a surface without lods is its own only level
+    object->n_lods = surface->n_lods == 0 ? 1 : surface->n_lods;
+    for (uint32_t i = 0; i < object->n_lods; ++i)
+    {
+        GeoLod lod = { surface->start_index, surface->count };
+        if (surface->n_lods != 0)
+            lod = surface->lods[i];
+
+        object->first_index[i] = buffers->first_index + lod.start_index;
+        object->index_count[i] = lod.count;
+        object->lod_error[i] = lod.error;
+        object->first_meshlet[i] = lod.first_meshlet;
+        object->n_meshlets[i] = lod.n_meshlets;
+    }
+
+    if (indirect->dirty_first == indirect->dirty_end)
+    {
+        indirect->dirty_first = index;
+        indirect->dirty_end = index + 1;
+    }
+    else
+    {
+        if (index < indirect->dirty_first)
+            indirect->dirty_first = index;
+        if (index + 1 > indirect->dirty_end)
+            indirect->dirty_end = index + 1;
+    }
+}
+
+// a whole lod is one command, culled meshlets give one per run of visible ones. runs are split by
+// at least one culled meshlet, so there are never more than half of them rounded up
+uint32_t indirect_object_commands(IndirectObject* object)
+{
+    uint32_t n_commands = 1;
+    for (uint32_t i = 0; i < object->n_lods; ++i)
+    {
+        uint32_t n_runs = (object->n_meshlets[i] + 1) / 2;
+        if (n_runs > n_commands)
+            n_commands = n_runs;
+    }
+
+    return n_commands;
+}
+
+uint32_t indirect_bucket(Renderer* renderer, MaterialInstance* material)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    for (uint32_t i = 0; i < indirect->n_buckets; ++i)
+    {
+        if (indirect->buckets[i].material == material)
+            return i;
+    }
+
+    if (indirect->n_buckets == indirect->bucket_capacity)
+    {
+        indirect->bucket_capacity = indirect->bucket_capacity == 0 ? 8 : indirect->bucket_capacity * 2;
+        indirect->buckets = realloc(indirect->buckets,
+                sizeof(IndirectBucket) * indirect->bucket_capacity);
+    }
+
+    indirect->buckets[indirect->n_buckets] = (IndirectBucket) { .material = material };
+    indirect->n_buckets += 1;
+
+    return indirect->n_buckets - 1;
+}
+
+// the dirty range goes through this frame slot's staging, which the slot's fence has freed up
+void indirect_upload(Renderer* renderer, VkCommandBuffer cmd_buf, int frame)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    if (indirect->dirty_first == indirect->dirty_end)
+        return;
+
+    uint32_t n = indirect->dirty_end - indirect->dirty_first;
+    VkDeviceSize size = sizeof(IndirectObject) * n;
+
+    void* data;
+    vmaMapMemory(renderer->allocator, indirect->staging[frame].allocation, &data);
+    memcpy(data, &indirect->objects[indirect->dirty_first], size);
+    vmaUnmapMemory(renderer->allocator, indirect->staging[frame].allocation);
+
+    VkBufferCopy copy = {
+        .srcOffset = 0,
+        .dstOffset = sizeof(IndirectObject) * indirect->dirty_first,
+        .size = size,
+    };
+    vkCmdCopyBuffer(cmd_buf, indirect->staging[frame].buffer, indirect->object_buffer.buffer, 1,
+            &copy);
+
+    indirect->dirty_first = 0;
+    indirect->dirty_end = 0;
+}
+
+uint32_t indirect_grow(uint32_t capacity, uint32_t needed)
+{
+    capacity = capacity == 0 ? needed : capacity;
+    while (capacity < needed)
+        capacity *= 2;
+
+    return capacity;
+}
+
+// only called once the frame's fence has been waited on, so the slot's old buffers are free to go
+void indirect_reserve(Renderer* renderer, int frame)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    // other frames can still be reading the old objects, and all of them go up again
+    if (indirect->n_objects > indirect->object_buffer_capacity)
+    {
+        uint32_t capacity = indirect_grow(indirect->object_buffer_capacity, indirect->n_objects);
+
+        if (indirect->object_buffer_capacity != 0)
+            deletion_queue_buffer(renderer, indirect->object_buffer);
+
+        indirect->object_buffer = buffer_create(renderer->allocator, sizeof(IndirectObject) * capacity,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY,
+                MEMORY_GEOMETRY);
+
+        indirect->object_buffer_capacity = capacity;
+        indirect->dirty_first = 0;
+        indirect->dirty_end = indirect->n_objects;
+    }
+
+    uint32_t n_dirty = indirect->dirty_end - indirect->dirty_first;
+    if (n_dirty > indirect->staging_capacity[frame])
+    {
+        uint32_t capacity = indirect_grow(indirect->staging_capacity[frame], n_dirty);
+
+        if (indirect->staging_capacity[frame] != 0)
+            buffer_destroy(&indirect->staging[frame], renderer->allocator);
+
+        indirect->staging[frame] = buffer_create(renderer->allocator, sizeof(IndirectObject) * capacity,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+
+        indirect->staging_capacity[frame] = capacity;
+    }
+
+    // every object could survive culling with its meshlets split up as much as they can be
+    if (indirect->n_commands > indirect->command_capacity[frame])
+    {
+        uint32_t capacity = indirect_grow(indirect->command_capacity[frame], indirect->n_commands);
+
+        if (indirect->command_capacity[frame] != 0)
+            buffer_destroy(&indirect->draw_commands[frame], renderer->allocator);
+
+        indirect->draw_commands[frame] = buffer_create(renderer->allocator,
+                sizeof(VkDrawIndexedIndirectCommand) * capacity,
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY,
+                MEMORY_OTHER);
+
+        indirect->command_capacity[frame] = capacity;
+    }
+
+    if (indirect->n_buckets > indirect->count_capacity[frame])
+    {
+        uint32_t capacity = indirect_grow(indirect->count_capacity[frame], indirect->n_buckets);
+
+        if (indirect->count_capacity[frame] != 0)
+            buffer_destroy(&indirect->counts[frame], renderer->allocator);
+
+        indirect->counts[frame] = buffer_create(renderer->allocator, sizeof(uint32_t) * capacity,
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_OTHER);
+
+        indirect->count_capacity[frame] = capacity;
+    }
+}
+
+void indirect_create_pipeline(Renderer* renderer)
+{
+    IndirectDrawer* indirect = &renderer->indirect;
+
+    // just the address of the frame's IndirectFrameData
+    VkPushConstantRange push_constant = {
+        .offset = 0,
+        .size = sizeof(VkDeviceAddress),
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+
+    VkPipelineLayoutCreateInfo pipeline_layout = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .setLayoutCount = 0,
+
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant,
+    };
+
+    VK_CHECK(vkCreatePipelineLayout(renderer->device, &pipeline_layout, NULL, &indirect->layout));
+
+    VkPipelineShaderStageCreateInfo stage_info = make_shader_info(renderer->device,
+            "indirect.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkComputePipelineCreateInfo pipeline_create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+
+        .layout = indirect->layout,
+        .stage = stage_info,
+    };
+
+    VK_CHECK(vkCreateComputePipelines(renderer->device, VK_NULL_HANDLE, 1, &pipeline_create_info,
+                NULL, &indirect->pipeline));
+
+    vkDestroyShaderModule(renderer->device, stage_info.module, NULL);
+}
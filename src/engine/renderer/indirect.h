@@ -0,0 +1,28 @@
+#pragma once
+
+#include "renderer.h"
+
+void indirect_initialise(Renderer* renderer);
+// the device has to be idle
+void indirect_cleanup(Renderer* renderer);
+
+// main thread only. the surface stays on the gpu for good and goes up with the next frame
+void indirect_add_surface(Renderer* renderer, Mesh* mesh, GeoSurface* surface, mat4 transform);
+// the mesh's ranges moved, its objects are written again and go up with the next frame
+void indirect_mesh_moved(Renderer* renderer, MeshBuffers* mesh_buffers);
+
+// uploads what changed and records the culling dispatch, has to happen outside of rendering
+void indirect_record(Renderer* renderer, VkCommandBuffer cmd_buf);
+// whether draw_geometry draws from the culled commands instead of the DrawContext
+bool indirect_active(Renderer* renderer);
+// one draw per material, inside the geometry pass's rendering
+void indirect_draw(Renderer* renderer, VkCommandBuffer cmd_buf, uint32_t scene_data_offset);
+
+// internal
+void indirect_write_object(Renderer* renderer, uint32_t index);
+uint32_t indirect_object_commands(IndirectObject* object);
+uint32_t indirect_bucket(Renderer* renderer, MaterialInstance* material);
+void indirect_upload(Renderer* renderer, VkCommandBuffer cmd_buf, int frame);
+uint32_t indirect_grow(uint32_t capacity, uint32_t needed);
+void indirect_reserve(Renderer* renderer, int frame);
+void indirect_create_pipeline(Renderer* renderer);
@@ -14,6 +14,8 @@ void material_metallic_cleanup(MaterialMetallic* mat, Renderer* renderer)
 {
     vkDestroyPipeline(renderer->device, mat->pipeline_opaque.pipeline, NULL);
     vkDestroyPipeline(renderer->device, mat->pipeline_transparent.pipeline, NULL);
+    vkDestroyPipeline(renderer->device, mat->pipeline_opaque.indirect, NULL);
+    vkDestroyPipeline(renderer->device, mat->pipeline_transparent.indirect, NULL);
     vkDestroyPipelineLayout(renderer->device, mat->pipeline_opaque.layout, NULL);
     vkDestroyDescriptorSetLayout(renderer->device, mat->material_layout, NULL);
 }
@@ -89,8 +91,8 @@ void material_metallic_build_pipelines(MaterialMetallic* mat, Renderer* renderer
     // pipeline_builder_enable_blending(&pb, false);
     pipeline_builder_set_depthtest(&pb, true, VK_COMPARE_OP_GREATER_OR_EQUAL);
 
-    pipeline_builder_set_color_attachment_format(&pb, renderer->draw_image.format);
-    pipeline_builder_set_depth_format(&pb, renderer->depth_image.format);
+    pipeline_builder_set_color_attachment_format(&pb, DRAW_FORMAT);
+    pipeline_builder_set_depth_format(&pb, DEPTH_FORMAT);
 
     mat->pipeline_opaque.pipeline = pipeline_builder_build(&pb, renderer->device);
 
@@ -99,8 +101,21 @@ void material_metallic_build_pipelines(MaterialMetallic* mat, Renderer* renderer
 
     mat->pipeline_transparent.pipeline = pipeline_builder_build(&pb, renderer->device);
 
+    // the same two again for indirect draws, only the vertex shader differs
+    VkPipelineShaderStageCreateInfo indirect_shader = make_shader_info(renderer->device,
+            "indirect.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+    pb.shader_stages[0] = indirect_shader;
+
+    mat->pipeline_transparent.indirect = pipeline_builder_build(&pb, renderer->device);
+
+    pipeline_builder_disable_blending(&pb);
+    pipeline_builder_set_depthtest(&pb, true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+
+    mat->pipeline_opaque.indirect = pipeline_builder_build(&pb, renderer->device);
+
     vkDestroyShaderModule(renderer->device, frag_shader.module, NULL);
     vkDestroyShaderModule(renderer->device, vert_shader.module, NULL);
+    vkDestroyShaderModule(renderer->device, indirect_shader.module, NULL);
 }
 
 MaterialInstance material_metallic_write_material(MaterialMetallic* mat, VkDevice device,
@@ -118,7 +133,14 @@ MaterialInstance material_metallic_write_material(MaterialMetallic* mat, VkDevic
 
     instance.material_set = descriptor_allocator_growable_allocate(dag, device, mat->material_layout,
             NULL);
+    material_metallic_write_set(device, instance.material_set, resources);
 
+    return instance;
+}
+
+void material_metallic_write_set(VkDevice device, VkDescriptorSet set,
+        const MaterialMetallicResources* resources)
+{
     VkDescriptorBufferInfo info_buf = descriptor_writer_get_buffer_info(resources->data_buffer,
             sizeof(MaterialMetallicConstants), resources->data_buffer_offset);
     VkDescriptorImageInfo info_image1 = descriptor_writer_get_image_info(resources->colour_image.view,
@@ -133,7 +155,5 @@ MaterialInstance material_metallic_write_material(MaterialMetallic* mat, VkDevic
         descriptor_writer_get_write(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, NULL, &info_image2),
     };
 
-    descriptor_writer_update_set(device, instance.material_set, write_infos, 3);
-
-    return instance;
+    descriptor_writer_update_set(device, set, write_infos, 3);
 }
@@ -5,6 +5,9 @@ void material_metallic_initialise_pipelines(MaterialMetallic* mat, Renderer* ren
 MaterialInstance material_metallic_write_material(MaterialMetallic* mat, VkDevice device,
         enum MaterialPass pass_type, const MaterialMetallicResources* resources,
         DescriptorAllocatorGrowable* dag);
+// writes resources into a set that isn't bound anywhere yet
+void material_metallic_write_set(VkDevice device, VkDescriptorSet set,
+        const MaterialMetallicResources* resources);
 void material_metallic_cleanup(MaterialMetallic* mat, Renderer* renderer);
 
 
@@ -27,6 +27,7 @@ void pipeline_cleanup(Renderer* renderer)
     }
     descriptor_allocator_growable_destroy_pools(&renderer->global_descriptor_allocator, renderer->device);
     descriptor_allocator_growable_free_lists(&renderer->global_descriptor_allocator);
+    descriptor_allocator_freeable_destroy_pools(&renderer->material_descriptors, renderer->device);
 
     destroy_pool(renderer->descriptor_pool, renderer->device);
     vkDestroyDescriptorSetLayout(renderer->device, renderer->draw_image_desc_layout, NULL);
@@ -86,16 +87,25 @@ void descriptors_initialise(Renderer* renderer)
     dag->ratios[1] = (VkDescriptorPoolSize) { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 };
     dag->ratios[2] = (VkDescriptorPoolSize) { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 };
     dag->ratios[3] = (VkDescriptorPoolSize) { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 };
-    dag->n_ratios = 4;
+    dag->ratios[4] = (VkDescriptorPoolSize) { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 };
+    dag->n_ratios = 5;
     dag->sets_per_pool = 100;
 
     descriptor_allocator_growable_init(dag, renderer->device);
 
-    // scene data
+    // pools only get made once a material is written again
+    DescriptorAllocatorFreeable* daf = &renderer->material_descriptors;
+    *daf = (DescriptorAllocatorFreeable) {0};
+    daf->ratios[0] = (VkDescriptorPoolSize) { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 };
+    daf->ratios[1] = (VkDescriptorPoolSize) { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 };
+    daf->n_ratios = 2;
+    daf->sets_per_pool = 64;
+
+    // scene data, out of the frame ring
     VkDescriptorSetLayoutBinding scene_bindings[] = {
         {
             .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             .descriptorCount = 1,
         }
     };
@@ -310,6 +320,83 @@ VkDescriptorSet descriptor_allocator_growable_allocate(DescriptorAllocatorGrowab
     return desc_set;
 }
 
+VkDescriptorSet descriptor_allocator_freeable_allocate(DescriptorAllocatorFreeable* daf,
+        VkDevice device, VkDescriptorSetLayout layout, VkDescriptorPool* out_pool)
+{
+    VkDescriptorSetAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+
+    VkDescriptorSet desc_set;
+
+    // newest first, the older pools only have room where sets were freed
+    for (uint32_t i = daf->n_pools; i > 0; --i)
+    {
+        alloc_info.descriptorPool = daf->pools[i - 1];
+        VkResult e = vkAllocateDescriptorSets(device, &alloc_info, &desc_set);
+
+        if (e == VK_SUCCESS)
+        {
+            *out_pool = daf->pools[i - 1];
+            return desc_set;
+        }
+
+        if (e != VK_ERROR_OUT_OF_POOL_MEMORY && e != VK_ERROR_FRAGMENTED_POOL)
+            VK_CHECK(e);
+    }
+
+    if (daf->n_pools == daf->pool_capacity)
+    {
+        daf->pool_capacity = daf->pool_capacity == 0 ? 4 : daf->pool_capacity * 2;
+        daf->pools = realloc(daf->pools, sizeof(VkDescriptorPool) * daf->pool_capacity);
+    }
+
+    alloc_info.descriptorPool = descriptor_allocator_freeable_create_pool(daf, device);
+    daf->pools[daf->n_pools++] = alloc_info.descriptorPool;
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &desc_set));
+
+    *out_pool = alloc_info.descriptorPool;
+    return desc_set;
+}
+
+VkDescriptorPool descriptor_allocator_freeable_create_pool(DescriptorAllocatorFreeable* daf,
+        VkDevice device)
+{
+    VkDescriptorPoolSize pool_sizes[daf->n_ratios];
+    for (int i = 0; i < daf->n_ratios; ++i)
+    {
+        pool_sizes[i].type = daf->ratios[i].type;
+        pool_sizes[i].descriptorCount = daf->ratios[i].descriptorCount * daf->sets_per_pool;
+    }
+
+    VkDescriptorPoolCreateInfo pool_create_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = daf->sets_per_pool,
+        .poolSizeCount = daf->n_ratios,
+        .pPoolSizes = pool_sizes,
+    };
+
+    VkDescriptorPool new_pool;
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_create_info, NULL, &new_pool));
+
+    return new_pool;
+}
+
+void descriptor_allocator_freeable_destroy_pools(DescriptorAllocatorFreeable* daf, VkDevice device)
+{
+    for (uint32_t i = 0; i < daf->n_pools; ++i)
+        vkDestroyDescriptorPool(device, daf->pools[i], NULL);
+
+    free(daf->pools);
+    daf->pools = NULL;
+    daf->n_pools = 0;
+    daf->pool_capacity = 0;
+}
+
 VkDescriptorBufferInfo descriptor_writer_get_buffer_info(VkBuffer buffer, size_t size, size_t offset)
 {
     VkDescriptorBufferInfo info = {
@@ -406,8 +493,8 @@ void create_pipeline(Renderer* renderer)
     // pipeline_builder_enable_blending(&pb, false);
     pipeline_builder_set_depthtest(&pb, true, VK_COMPARE_OP_GREATER_OR_EQUAL);
 
-    pipeline_builder_set_color_attachment_format(&pb, renderer->draw_image.format);
-    pipeline_builder_set_depth_format(&pb, renderer->depth_image.format);
+    pipeline_builder_set_color_attachment_format(&pb, DRAW_FORMAT);
+    pipeline_builder_set_depth_format(&pb, DEPTH_FORMAT);
 
     renderer->pipeline = pipeline_builder_build(&pb, renderer->device);
 
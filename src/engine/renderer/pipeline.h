@@ -34,6 +34,13 @@ void descriptor_allocator_growable_destroy_pools(DescriptorAllocatorGrowable* da
 VkDescriptorSet descriptor_allocator_growable_allocate(DescriptorAllocatorGrowable* dag,
         VkDevice device, VkDescriptorSetLayout layout, void* pNext);
 
+// descriptor allocator freeable, out_pool is what the set has to be freed back to
+VkDescriptorSet descriptor_allocator_freeable_allocate(DescriptorAllocatorFreeable* daf,
+        VkDevice device, VkDescriptorSetLayout layout, VkDescriptorPool* out_pool);
+VkDescriptorPool descriptor_allocator_freeable_create_pool(DescriptorAllocatorFreeable* daf,
+        VkDevice device);
+void descriptor_allocator_freeable_destroy_pools(DescriptorAllocatorFreeable* daf, VkDevice device);
+
 // descriptor helpers
 VkDescriptorSetLayout create_descriptor_set_layout(VkDescriptorSetLayoutBinding* bindings,
         int n, VkDevice device, VkShaderStageFlags shader_stages,
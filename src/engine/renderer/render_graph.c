@@ -0,0 +1,557 @@
+#include "render_graph.h"
+#include "barriers.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "image.h"
+#include "../utils.h"
+
+// what a transient has to be created with for each way a pass can use it
+static const VkImageUsageFlags ACCESS_USAGE[IMAGE_ACCESS_COUNT] = {
+    [IMAGE_ACCESS_TRANSFER_SRC] = VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    [IMAGE_ACCESS_TRANSFER_DST] = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    [IMAGE_ACCESS_COLOUR_ATTACHMENT] = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+    [IMAGE_ACCESS_DEPTH_ATTACHMENT] = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+    [IMAGE_ACCESS_SAMPLED] = VK_IMAGE_USAGE_SAMPLED_BIT,
+};
+
+void render_graph_cleanup(Renderer* renderer)
+{
+    render_graph_release(renderer, &renderer->graph, true);
+}
+
+void render_graph_begin(RenderGraph* graph)
+{
+    graph->n_passes = 0;
+    graph->n_resources = 0;
+    graph->n_ordered = 0;
+    graph->n_culled = 0;
+}
+
+uint32_t render_graph_create_image(RenderGraph* graph, const char* name, VkFormat format,
+        VkExtent3D extent)
+{
+    if (graph->n_resources == RENDER_GRAPH_RESOURCES)
+        FATAL("Render graph is out of resources at %s\n", name);
+
+    graph->resources[graph->n_resources] = (RenderGraphResource) {
+        .name = name,
+        .format = format,
+        .extent = extent,
+        .final_access = IMAGE_ACCESS_NONE,
+    };
+
+    return graph->n_resources++;
+}
+
+uint32_t render_graph_import_image(RenderGraph* graph, const char* name, Image* image,
+        enum ImageAccess final_access)
+{
+    if (graph->n_resources == RENDER_GRAPH_RESOURCES)
+        FATAL("Render graph is out of resources at %s\n", name);
+
+    graph->resources[graph->n_resources] = (RenderGraphResource) {
+        .name = name,
+        .imported = true,
+        .format = image->format,
+        .extent = image->extent,
+        .final_access = final_access,
+        .image = image,
+    };
+
+    return graph->n_resources++;
+}
+
+uint32_t render_graph_add_pass(RenderGraph* graph, const char* name, RenderGraphRecord record,
+        void* data)
+{
+    if (graph->n_passes == RENDER_GRAPH_PASSES)
+        FATAL("Render graph is out of passes at %s\n", name);
+
+    graph->passes[graph->n_passes] = (RenderGraphPass) {
+        .name = name,
+        .record = record,
+        .data = data,
+    };
+
+    return graph->n_passes++;
+}
+
+void render_graph_side_effects(RenderGraph* graph, uint32_t pass)
+{
+    graph->passes[pass].side_effects = true;
+}
+
+void render_graph_read(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access)
+{
+    render_graph_access(graph, pass, resource, access, true, false);
+}
+
+void render_graph_write(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access)
+{
+    render_graph_access(graph, pass, resource, access, false, true);
+}
+
+void render_graph_modify(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access)
+{
+    render_graph_access(graph, pass, resource, access, true, true);
+}
+
+void render_graph_compile(Renderer* renderer, RenderGraph* graph)
+{
+    render_graph_dependencies(graph);
+    render_graph_cull(graph);
+    render_graph_order(graph);
+    render_graph_lifetimes(graph);
+
+    if (!render_graph_layout_matches(graph))
+        render_graph_allocate(renderer, graph);
+}
+
+void render_graph_execute(Renderer* renderer, RenderGraph* graph, VkCommandBuffer cmd_buf)
+{
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+
+    for (uint32_t i = 0; i < graph->n_ordered; ++i)
+    {
+        RenderGraphPass* pass = &graph->passes[graph->order[i]];
+
+        for (uint32_t j = 0; j < pass->n_accesses; ++j)
+        {
+            RenderGraphAccess* access = &pass->accesses[j];
+            RenderGraphResource* resource = &graph->resources[access->resource];
+
+            // a transient starts out with whatever else was in its memory still to wait on
+            if (!resource->imported && resource->first_use == i)
+            {
+                RenderGraphSlot* slot = &graph->slots[graph->images[resource->transient].slot];
+                resource->image->state = (ImageState) {
+                    .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .stages = slot->state.stages,
+                    .access = slot->state.access,
+                };
+            }
+
+            if (access->reads)
+                barrier_image(&barriers, resource->image, access->access);
+            else
+                barrier_image_discard(&barriers, resource->image, access->access);
+        }
+        barrier_flush(&barriers);
+
+        pass->record(renderer, cmd_buf, pass->data);
+
+        for (uint32_t j = 0; j < pass->n_accesses; ++j)
+        {
+            RenderGraphResource* resource = &graph->resources[pass->accesses[j].resource];
+            if (resource->imported)
+                continue;
+
+            RenderGraphSlot* slot = &graph->slots[graph->images[resource->transient].slot];
+            slot->state = resource->image->state;
+        }
+    }
+
+    for (uint32_t i = 0; i < graph->n_resources; ++i)
+    {
+        RenderGraphResource* resource = &graph->resources[i];
+        if (resource->imported && resource->final_access != IMAGE_ACCESS_NONE)
+            barrier_image(&barriers, resource->image, resource->final_access);
+    }
+    barrier_flush(&barriers);
+}
+
+Image* render_graph_image(RenderGraph* graph, uint32_t resource)
+{
+    return graph->resources[resource].image;
+}
+
+void render_graph_access(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access, bool reads, bool writes)
+{
+    RenderGraphPass* p = &graph->passes[pass];
+
+    // one barrier per resource per pass, a pass can't want it two ways at once
+    for (uint32_t i = 0; i < p->n_accesses; ++i)
+    {
+        if (p->accesses[i].resource == resource)
+            FATAL("Render graph pass %s uses %s twice\n", p->name, graph->resources[resource].name);
+    }
+
+    if (p->n_accesses == RENDER_GRAPH_PASS_ACCESSES)
+        FATAL("Render graph pass %s uses too many resources\n", p->name);
+
+    p->accesses[p->n_accesses++] = (RenderGraphAccess) {
+        .resource = resource,
+        .access = access,
+        .reads = reads,
+        .writes = writes,
+    };
+}
+
+// declaration order decides which write a read sees, so every dependency points backwards
+void render_graph_dependencies(RenderGraph* graph)
+{
+    uint32_t last_writer[RENDER_GRAPH_RESOURCES];
+    // who read the current contents, the next write has to wait for them
+    uint32_t readers[RENDER_GRAPH_RESOURCES] = {0};
+
+    for (uint32_t i = 0; i < graph->n_resources; ++i)
+        last_writer[i] = RENDER_GRAPH_NONE;
+
+    for (uint32_t i = 0; i < graph->n_passes; ++i)
+    {
+        RenderGraphPass* pass = &graph->passes[i];
+        pass->deps = 0;
+        pass->producers = 0;
+
+        for (uint32_t j = 0; j < pass->n_accesses; ++j)
+        {
+            RenderGraphAccess* access = &pass->accesses[j];
+            uint32_t writer = last_writer[access->resource];
+
+            if (access->reads && writer == RENDER_GRAPH_NONE
+                    && !graph->resources[access->resource].imported)
+            {
+                FATAL("Render graph pass %s reads %s before anything wrote it\n", pass->name,
+                        graph->resources[access->resource].name);
+            }
+
+            if (access->reads && writer != RENDER_GRAPH_NONE)
+                pass->producers |= 1u << writer;
+
+            if (access->writes)
+            {
+                if (writer != RENDER_GRAPH_NONE)
+                    pass->deps |= 1u << writer;
+                pass->deps |= readers[access->resource];
+            }
+        }
+
+        pass->deps |= pass->producers;
+        pass->deps &= ~(1u << i);
+
+        for (uint32_t j = 0; j < pass->n_accesses; ++j)
+        {
+            RenderGraphAccess* access = &pass->accesses[j];
+            if (access->writes)
+            {
+                last_writer[access->resource] = i;
+                readers[access->resource] = 0;
+            }
+            else
+            {
+                readers[access->resource] |= 1u << i;
+            }
+        }
+    }
+}
+
+// what ends up in an imported image, or has side effects, is kept along with everything that
+// produced what it reads. the rest never gets recorded
+void render_graph_cull(RenderGraph* graph)
+{
+    uint32_t alive = 0;
+
+    for (uint32_t i = 0; i < graph->n_passes; ++i)
+    {
+        RenderGraphPass* pass = &graph->passes[i];
+        if (pass->side_effects)
+            alive |= 1u << i;
+
+        for (uint32_t j = 0; j < pass->n_accesses; ++j)
+        {
+            if (pass->accesses[j].writes && graph->resources[pass->accesses[j].resource].imported)
+                alive |= 1u << i;
+        }
+    }
+
+    // producers are always declared earlier, so one sweep back finds all of them
+    for (uint32_t i = graph->n_passes; i > 0; --i)
+    {
+        if (alive & (1u << (i - 1)))
+            alive |= graph->passes[i - 1].producers;
+    }
+
+    graph->n_culled = 0;
+    for (uint32_t i = 0; i < graph->n_passes; ++i)
+    {
+        graph->passes[i].culled = !(alive & (1u << i));
+        if (graph->passes[i].culled)
+            graph->n_culled++;
+    }
+}
+
+// any order that keeps the dependencies works. a pass goes right after the producers it waits on
+// when it can, which keeps transients short lived and leaves more of them to share memory
+void render_graph_order(RenderGraph* graph)
+{
+    uint32_t done = 0;
+    uint32_t alive = 0;
+    uint32_t position[RENDER_GRAPH_PASSES];
+
+    for (uint32_t i = 0; i < graph->n_passes; ++i)
+    {
+        if (!graph->passes[i].culled)
+            alive |= 1u << i;
+    }
+
+    graph->n_ordered = 0;
+    while (done != alive)
+    {
+        uint32_t best = RENDER_GRAPH_NONE;
+        int64_t best_score = 0;
+
+        for (uint32_t i = 0; i < graph->n_passes; ++i)
+        {
+            uint32_t deps = graph->passes[i].deps & alive;
+            if (!(alive & (1u << i)) || (done & (1u << i)) || (deps & ~done))
+                continue;
+
+            int64_t score = -1;
+            for (uint32_t j = 0; j < i; ++j)
+            {
+                if ((deps & (1u << j)) && position[j] > score)
+                    score = position[j];
+            }
+
+            // ties keep declaration order
+            if (best == RENDER_GRAPH_NONE || score > best_score)
+            {
+                best = i;
+                best_score = score;
+            }
+        }
+
+        // dependencies only point backwards, so something is always ready
+        position[best] = graph->n_ordered;
+        graph->order[graph->n_ordered++] = best;
+        done |= 1u << best;
+    }
+}
+
+void render_graph_lifetimes(RenderGraph* graph)
+{
+    for (uint32_t i = 0; i < graph->n_resources; ++i)
+    {
+        RenderGraphResource* resource = &graph->resources[i];
+        resource->first_use = RENDER_GRAPH_NONE;
+        resource->last_use = 0;
+        resource->usage = 0;
+        resource->transient = RENDER_GRAPH_NONE;
+        if (!resource->imported)
+            resource->image = NULL;
+    }
+
+    for (uint32_t i = 0; i < graph->n_ordered; ++i)
+    {
+        RenderGraphPass* pass = &graph->passes[graph->order[i]];
+        for (uint32_t j = 0; j < pass->n_accesses; ++j)
+        {
+            RenderGraphResource* resource = &graph->resources[pass->accesses[j].resource];
+            if (resource->first_use == RENDER_GRAPH_NONE)
+                resource->first_use = i;
+            resource->last_use = i;
+            resource->usage |= ACCESS_USAGE[pass->accesses[j].access];
+        }
+    }
+}
+
+// the transients that get used line up with last frame's images one for one, in declaration order
+bool render_graph_layout_matches(RenderGraph* graph)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < graph->n_resources; ++i)
+    {
+        RenderGraphResource* resource = &graph->resources[i];
+        if (resource->imported || resource->first_use == RENDER_GRAPH_NONE)
+            continue;
+
+        if (n == graph->n_images)
+            return false;
+
+        RenderGraphImage* image = &graph->images[n];
+        if (image->image.format != resource->format
+                || image->image.extent.width != resource->extent.width
+                || image->image.extent.height != resource->extent.height
+                || image->image.extent.depth != resource->extent.depth
+                || image->usage != resource->usage
+                || image->first_use != resource->first_use
+                || image->last_use != resource->last_use)
+        {
+            return false;
+        }
+        n++;
+    }
+
+    if (n != graph->n_images)
+        return false;
+
+    n = 0;
+    for (uint32_t i = 0; i < graph->n_resources; ++i)
+    {
+        RenderGraphResource* resource = &graph->resources[i];
+        if (resource->imported || resource->first_use == RENDER_GRAPH_NONE)
+            continue;
+
+        resource->transient = n;
+        resource->image = &graph->images[n++].image;
+    }
+
+    return true;
+}
+
+// every image is created up front, then biggest first each goes into the first slot with a
+// compatible memory type and nobody alive at the same time
+void render_graph_allocate(Renderer* renderer, RenderGraph* graph)
+{
+    render_graph_release(renderer, graph, false);
+
+    VkMemoryRequirements requirements[RENDER_GRAPH_RESOURCES];
+    uint32_t sorted[RENDER_GRAPH_RESOURCES];
+
+    for (uint32_t i = 0; i < graph->n_resources; ++i)
+    {
+        RenderGraphResource* resource = &graph->resources[i];
+        if (resource->imported || resource->first_use == RENDER_GRAPH_NONE)
+            continue;
+
+        uint32_t n = graph->n_images++;
+        RenderGraphImage* image = &graph->images[n];
+        *image = (RenderGraphImage) {
+            .usage = resource->usage,
+            .first_use = resource->first_use,
+            .last_use = resource->last_use,
+            .slot = RENDER_GRAPH_NONE,
+            .image = {
+                .format = resource->format,
+                .extent = resource->extent,
+                .usage = resource->usage,
+                .mip_levels = 1,
+            },
+        };
+
+        VkImageCreateInfo image_info = get_image_create_info(resource->format, resource->usage,
+                resource->extent);
+        VK_CHECK(vkCreateImage(renderer->device, &image_info, NULL, &image->image.image));
+        vkGetImageMemoryRequirements(renderer->device, image->image.image, &requirements[n]);
+
+        resource->transient = n;
+        resource->image = &image->image;
+
+        uint32_t j = n;
+        for (; j > 0 && requirements[sorted[j - 1]].size < requirements[n].size; --j)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = n;
+    }
+
+    for (uint32_t i = 0; i < graph->n_images; ++i)
+    {
+        RenderGraphImage* image = &graph->images[sorted[i]];
+        VkMemoryRequirements* needs = &requirements[sorted[i]];
+        graph->unaliased_bytes += needs->size;
+
+        uint32_t slot = 0;
+        for (; slot < graph->n_slots; ++slot)
+        {
+            VkMemoryRequirements* has = &graph->slots[slot].requirements;
+            if ((has->memoryTypeBits & needs->memoryTypeBits)
+                    && !render_graph_overlaps(graph, slot, image))
+            {
+                break;
+            }
+        }
+
+        if (slot == graph->n_slots)
+        {
+            graph->slots[graph->n_slots++] = (RenderGraphSlot) { .requirements = *needs };
+        }
+        else
+        {
+            VkMemoryRequirements* has = &graph->slots[slot].requirements;
+            has->size = has->size > needs->size ? has->size : needs->size;
+            has->alignment = has->alignment > needs->alignment ? has->alignment : needs->alignment;
+            has->memoryTypeBits &= needs->memoryTypeBits;
+        }
+
+        image->slot = slot;
+    }
+
+    VmaAllocationCreateInfo alloc_info = {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        .pUserData = MEMORY_CATEGORY_TAG(MEMORY_RENDER_TARGETS),
+    };
+
+    for (uint32_t i = 0; i < graph->n_slots; ++i)
+    {
+        RenderGraphSlot* slot = &graph->slots[i];
+        VK_CHECK(vmaAllocateMemory(renderer->allocator, &slot->requirements, &alloc_info,
+                &slot->allocation, NULL));
+        gpu_memory_track_allocation(renderer->allocator, slot->allocation);
+        graph->transient_bytes += slot->requirements.size;
+    }
+
+    for (uint32_t i = 0; i < graph->n_images; ++i)
+    {
+        Image* image = &graph->images[i].image;
+        VmaAllocation memory = graph->slots[graph->images[i].slot].allocation;
+        VK_CHECK(vmaBindImageMemory(renderer->allocator, memory, image->image));
+
+        VkImageViewCreateInfo view_info = get_image_view_create_info(image->format, image->image,
+                barrier_aspect(image->format));
+        VK_CHECK(vkCreateImageView(renderer->device, &view_info, NULL, &image->view));
+    }
+
+    LOG_V("Render graph laid out %u transient images in %u slots, %.1f MB instead of %.1f MB\n",
+            graph->n_images, graph->n_slots, graph->transient_bytes / 1e6,
+            graph->unaliased_bytes / 1e6);
+}
+
+// images hold no allocation of their own, the slots' memory goes separately
+void render_graph_release(Renderer* renderer, RenderGraph* graph, bool now)
+{
+    if (now)
+    {
+        for (uint32_t i = 0; i < graph->n_images; ++i)
+            image_destroy(renderer->device, renderer->allocator, graph->images[i].image);
+
+        for (uint32_t i = 0; i < graph->n_slots; ++i)
+        {
+            gpu_memory_track_free(renderer->allocator, graph->slots[i].allocation);
+            vmaFreeMemory(renderer->allocator, graph->slots[i].allocation);
+        }
+    }
+    else
+    {
+        // the queue runs newest first, so the memory goes in ahead of the images bound to it
+        for (uint32_t i = 0; i < graph->n_slots; ++i)
+            deletion_queue_allocation(renderer, graph->slots[i].allocation);
+
+        for (uint32_t i = 0; i < graph->n_images; ++i)
+            deletion_queue_image(renderer, graph->images[i].image);
+    }
+
+    graph->n_images = 0;
+    graph->n_slots = 0;
+    graph->transient_bytes = 0;
+    graph->unaliased_bytes = 0;
+}
+
+bool render_graph_overlaps(RenderGraph* graph, uint32_t slot, RenderGraphImage* image)
+{
+    for (uint32_t i = 0; i < graph->n_images; ++i)
+    {
+        RenderGraphImage* other = &graph->images[i];
+        if (other == image || other->slot != slot)
+            continue;
+
+        if (other->first_use <= image->last_use && image->first_use <= other->last_use)
+            return true;
+    }
+
+    return false;
+}
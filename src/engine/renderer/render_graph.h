@@ -0,0 +1,48 @@
+#pragma once
+
+#include "renderer.h"
+
+// the device has to be idle
+void render_graph_cleanup(Renderer* renderer);
+
+// starts the frame's declarations over, the transient images from last frame stay around
+void render_graph_begin(RenderGraph* graph);
+// only gets memory if a pass that survives culling uses it
+uint32_t render_graph_create_image(RenderGraph* graph, const char* name, VkFormat format,
+        VkExtent3D extent);
+// the graph keeps image's state up to date. passes writing to it are never culled
+uint32_t render_graph_import_image(RenderGraph* graph, const char* name, Image* image,
+        enum ImageAccess final_access);
+uint32_t render_graph_add_pass(RenderGraph* graph, const char* name, RenderGraphRecord record,
+        void* data);
+void render_graph_side_effects(RenderGraph* graph, uint32_t pass);
+
+// a pass sees what the last pass declared before it that wrote the resource left there
+void render_graph_read(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access);
+// overwrites all of it, so nothing that was there needs keeping
+void render_graph_write(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access);
+// reads what's there and writes on top of it
+void render_graph_modify(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access);
+
+// culls and orders the passes, then lays out the transients. they're only made again when the
+// layout comes out different to last frame's
+void render_graph_compile(Renderer* renderer, RenderGraph* graph);
+// each pass goes behind one batch of barriers, then imported images go to their final access
+void render_graph_execute(Renderer* renderer, RenderGraph* graph, VkCommandBuffer cmd_buf);
+// for passes to find their images while recording
+Image* render_graph_image(RenderGraph* graph, uint32_t resource);
+
+// internal
+void render_graph_access(RenderGraph* graph, uint32_t pass, uint32_t resource,
+        enum ImageAccess access, bool reads, bool writes);
+void render_graph_dependencies(RenderGraph* graph);
+void render_graph_cull(RenderGraph* graph);
+void render_graph_order(RenderGraph* graph);
+void render_graph_lifetimes(RenderGraph* graph);
+bool render_graph_layout_matches(RenderGraph* graph);
+void render_graph_allocate(Renderer* renderer, RenderGraph* graph);
+void render_graph_release(Renderer* renderer, RenderGraph* graph, bool now);
+bool render_graph_overlaps(RenderGraph* graph, uint32_t slot, RenderGraphImage* image);
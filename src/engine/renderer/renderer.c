@@ -9,9 +9,19 @@
 #include "pipeline.h"
 #include "buffers.h"
 #include "materials.h"
+#include "culling.h"
+#include "indirect.h"
+#include "uploads.h"
+#include "geometry.h"
+#include "frame_ring.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "defrag.h"
+#include "streaming.h"
+#include "barriers.h"
+#include "render_graph.h"
 #include "../dearimgui.h"
 #include "../utils.h"
-#include "../scene/loader.h"
 
 // #include <math.h>
 
@@ -44,17 +54,32 @@ void renderer_initialise(Renderer* renderer, GLFWwindow* window)
     device_initialise(renderer);
 
     vma_allocator_initialise(renderer);
+    gpu_memory_create_pools(renderer);
+    defrag_initialise(renderer);
+    staging_ring_initialise(&renderer->staging, renderer->allocator, STAGING_RING_BYTES);
+    streaming_initialise(renderer);
+    geometry_initialise(renderer);
+    frame_ring_initialise(&renderer->frame_ring, renderer, FRAME_RING_BYTES);
 
     swapchain_initialise(renderer, window);
     create_command_buffers(renderer);
     sync_initialise(renderer);
 
     pipeline_initialise(renderer);
+    culling_initialise(renderer);
+    indirect_initialise(renderer);
 
     initialise_data(renderer);
 
-    renderer->scene_data_buffer = buffer_create(renderer->allocator, sizeof(GPUSceneData),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    // written once, draws pick this frame's scene data with the dynamic offset
+    renderer->scene_data_set = descriptor_allocator_growable_allocate(&renderer->global_descriptor_allocator,
+            renderer->device, renderer->scene_data_desc_set_layout, NULL);
+
+    VkDescriptorBufferInfo scene_buffer_info = descriptor_writer_get_buffer_info(
+            renderer->frame_ring.buffer.buffer, sizeof(GPUSceneData), 0);
+    VkWriteDescriptorSet scene_write = descriptor_writer_get_write(0,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &scene_buffer_info, NULL);
+    descriptor_writer_update_set(renderer->device, renderer->scene_data_set, &scene_write, 1);
 
     renderer->frame_in_flight = 0;
     renderer->frame = 0;
@@ -62,28 +87,34 @@ void renderer_initialise(Renderer* renderer, GLFWwindow* window)
 
 void renderer_cleanup(Renderer* renderer)
 {
-    material_metallic_cleanup(&renderer->metalic_material, renderer);
-    buffer_destroy(&renderer->scene_data_buffer, renderer->allocator);
+    // the streaming thread can still be staging into the ring
+    streaming_cleanup(renderer);
+    // a pass still holds on to the images it moved, and nothing can be freed in the middle of one
+    defrag_cleanup(renderer);
 
-    for (int i = 0; i < renderer->n_buf_destroy; ++i)
-    {
-        Buffer* buf = &renderer->buf_destroy[i];
-        vmaUnmapMemory(renderer->allocator, buf->allocation);
-        buffer_destroy(&renderer->buf_destroy[i], renderer->allocator);
-    }
-    free(renderer->buf_destroy);
+    material_metallic_cleanup(&renderer->metalic_material, renderer);
+    buffer_destroy(&renderer->default_material_constants, renderer->allocator);
 
     vkDestroySampler(renderer->device, renderer->sampler_nearest, NULL);
     vkDestroySampler(renderer->device, renderer->sampler_linear, NULL);
     image_destroy(renderer->device, renderer->allocator, renderer->error_image);
-
-    meshes_destroy(renderer->meshes, renderer->n_meshes, renderer->allocator);
-
+    image_destroy(renderer->device, renderer->allocator, renderer->white_image);
+
+    // before the arenas, meshes hand their ranges back through it
+    deletion_queue_cleanup(renderer);
+    uploads_cleanup(renderer);
+    staging_ring_cleanup(&renderer->staging, renderer->allocator);
+    geometry_cleanup(renderer);
+    frame_ring_cleanup(&renderer->frame_ring, renderer->allocator);
+    culling_cleanup(renderer);
+    indirect_cleanup(renderer);
     pipeline_cleanup(renderer);
+    render_graph_cleanup(renderer);
 
     sync_cleanup(renderer);
     cleanup_command_buffers(renderer);
     swapchain_cleanup(renderer);
+    gpu_memory_destroy_pools(renderer->allocator);
     vmaDestroyAllocator(renderer->allocator);
     vkDestroyDevice(renderer->device, NULL);
     vkDestroySurfaceKHR(renderer->instance, renderer->surface, NULL);
@@ -98,7 +129,13 @@ void renderer_draw(Renderer* renderer, DrawContext* context)
     // first we wait
     VK_CHECK(vkWaitForFences(renderer->device, 1, &renderer->fences[frame], true, ONE_SEC));
 
+    renderer_read_timestamps(renderer, frame);
+
     descriptor_allocator_growable_clear_pools(&renderer->frame_descriptors[frame], renderer->device);
+    frame_ring_begin(&renderer->frame_ring, frame);
+    defrag_retire(renderer);
+    deletion_queue_flush(renderer);
+    gpu_memory_check_budget(renderer);
 
 
     VK_CHECK(vkResetFences(renderer->device, 1, &renderer->fences[frame]));
@@ -123,12 +160,26 @@ void renderer_draw(Renderer* renderer, DrawContext* context)
     };
     VK_CHECK(vkBeginCommandBuffer(cmd_buf, &begin_info));
 
-    transition_image(cmd_buf, renderer->device, renderer->draw_image.image,
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-    transition_image(cmd_buf, renderer->device, renderer->depth_image.image,
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+    if (renderer->timestamp_period != 0)
+    {
+        vkCmdResetQueryPool(cmd_buf, renderer->timestamp_pool, frame * 2, 2);
+        vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, renderer->timestamp_pool,
+                frame * 2);
+    }
+
+    // after the acquire, a swapped out image goes on this frame's deletion queue
+    streaming_update(renderer, context);
+
+    bool uploads_transferred = uploads_flush(renderer, cmd_buf);
+    defrag_update(renderer, cmd_buf);
+    defrag_write_materials(renderer);
 
-    draw_geometry(renderer, cmd_buf, context);
+    // after defrag, whatever it moved has been written again by the time the objects go up. the
+    // indirect pass culls meshlets of the objects that survive itself
+    if (indirect_active(renderer))
+        indirect_record(renderer, cmd_buf);
+    else
+        culling_record(renderer, cmd_buf, context);
 
     // vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, renderer->pipeline);
     //
@@ -141,38 +192,66 @@ void renderer_draw(Renderer* renderer, DrawContext* context)
     // vkCmdDispatch(cmd_buf, ceilf(renderer->swapchain.extent.width / 16.0),
     //         ceilf(renderer->swapchain.extent.height / 16.0), 1);
 
+    // the acquire semaphore is waited on at colour output, the first barrier chains onto that
+    Image swapchain_image = {
+        .image = renderer->swapchain.images[image_index],
+        .view = renderer->swapchain.image_views[image_index],
+        .extent = { renderer->swapchain.extent.width, renderer->swapchain.extent.height, 1 },
+        .format = renderer->swapchain.image_format,
+        .mip_levels = 1,
+        .state = {
+            .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        },
+    };
+
+    RenderGraph* graph = &renderer->graph;
+    render_graph_begin(graph);
 
-    transition_image(cmd_buf, renderer->device, renderer->draw_image.image,
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-    transition_image(cmd_buf, renderer->device, renderer->swapchain.images[image_index],
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    // transition_image(cmd_buf, renderer->device, renderer->imgui_image.image,
-    //         VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-    // imgui_draw(renderer, cmd_buf, renderer->imgui_image.view);
+    FramePasses passes = { .context = context };
+    passes.colour = render_graph_create_image(graph, "draw", DRAW_FORMAT, swapchain_image.extent);
+    passes.depth = render_graph_create_image(graph, "depth", DEPTH_FORMAT, swapchain_image.extent);
+    passes.target = render_graph_import_image(graph, "swapchain", &swapchain_image,
+            IMAGE_ACCESS_PRESENT);
 
-    // transition_image(cmd_buf, renderer->device, renderer->imgui_image.image,
-    //         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    uint32_t geometry = render_graph_add_pass(graph, "geometry", renderer_geometry_pass, &passes);
+    render_graph_write(graph, geometry, passes.colour, IMAGE_ACCESS_COLOUR_ATTACHMENT);
+    render_graph_write(graph, geometry, passes.depth, IMAGE_ACCESS_DEPTH_ATTACHMENT);
 
-    VkExtent2D draw_extent = {renderer->draw_image.extent.width, renderer->draw_image.extent.height};
-    copy_image(cmd_buf, renderer->draw_image.image, renderer->swapchain.images[image_index],
-            draw_extent, renderer->swapchain.extent);
-    // copy_image(cmd_buf, renderer->imgui_image.image, renderer->swapchain.images[image_index],
-    //         draw_extent, renderer->swapchain.extent);
-    transition_image(cmd_buf, renderer->device, renderer->swapchain.images[image_index],
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    uint32_t blit = render_graph_add_pass(graph, "blit", renderer_blit_pass, &passes);
+    render_graph_read(graph, blit, passes.colour, IMAGE_ACCESS_TRANSFER_SRC);
+    render_graph_write(graph, blit, passes.target, IMAGE_ACCESS_TRANSFER_DST);
 
-    imgui_draw(renderer, cmd_buf, renderer->swapchain.image_views[image_index]);
+    uint32_t imgui = render_graph_add_pass(graph, "imgui", renderer_imgui_pass, &passes);
+    render_graph_modify(graph, imgui, passes.target, IMAGE_ACCESS_COLOUR_ATTACHMENT);
 
+    render_graph_compile(renderer, graph);
+    render_graph_execute(renderer, graph, cmd_buf);
 
-    transition_image(cmd_buf, renderer->device, renderer->swapchain.images[image_index],
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-    // transition_image(cmd_buf, renderer->device, renderer->swapchain.images[image_index],
-    //         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    if (renderer->timestamp_period != 0)
+    {
+        vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, renderer->timestamp_pool,
+                frame * 2 + 1);
+        renderer->timestamps_written[frame] = true;
+    }
 
     VK_CHECK(vkEndCommandBuffer(cmd_buf));
 
     VkSubmitInfo submit_info = get_submit_info(renderer);
 
+    // nothing reads the frame's uploads before the transfer queue is done with them
+    VkSemaphore wait_semaphores[2] = { renderer->semaphores_swapchain[frame],
+        renderer->semaphores_transfer[frame] };
+    VkPipelineStageFlags wait_stages[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        UPLOAD_CONSUMER_STAGES };
+
+    if (uploads_transferred)
+    {
+        submit_info.waitSemaphoreCount = 2;
+        submit_info.pWaitSemaphores = wait_semaphores;
+        submit_info.pWaitDstStageMask = wait_stages;
+    }
+
     VK_CHECK(vkQueueSubmit(renderer->graphics_queue, 1, &submit_info, renderer->fences[frame]));
 
     // now we need to present
@@ -196,13 +275,55 @@ void renderer_draw(Renderer* renderer, DrawContext* context)
     renderer_inc_frame(renderer);
 }
 
-void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* context)
+void renderer_update_camera(Renderer* renderer)
+{
+    vec3 camera_pos = { 0, -1, -6};
+    vec3 forward_dir = { 0, 0, 1 };
+    vec3 up_dir = { 0, -1, 0 };
+
+    glm_vec3_copy(camera_pos, renderer->camera_position);
+
+    vec3 upped;
+    glm_vec3_add(camera_pos, forward_dir, upped);
+    glm_lookat(camera_pos, upped, up_dir, renderer->view);
+
+    float aspect = 1.0;
+    glm_perspective(glm_rad(renderer->fov), aspect, 0.1, 1000, renderer->projection);
+}
+
+void renderer_geometry_pass(Renderer* renderer, VkCommandBuffer cmd_buf, void* data)
+{
+    FramePasses* passes = data;
+    draw_geometry(renderer, cmd_buf, passes->context,
+            render_graph_image(&renderer->graph, passes->colour),
+            render_graph_image(&renderer->graph, passes->depth));
+}
+
+void renderer_blit_pass(Renderer* renderer, VkCommandBuffer cmd_buf, void* data)
+{
+    FramePasses* passes = data;
+    Image* colour = render_graph_image(&renderer->graph, passes->colour);
+    Image* target = render_graph_image(&renderer->graph, passes->target);
+
+    copy_image(cmd_buf, colour->image, target->image,
+            (VkExtent2D) { colour->extent.width, colour->extent.height },
+            (VkExtent2D) { target->extent.width, target->extent.height });
+}
+
+void renderer_imgui_pass(Renderer* renderer, VkCommandBuffer cmd_buf, void* data)
+{
+    FramePasses* passes = data;
+    imgui_draw(renderer, cmd_buf, render_graph_image(&renderer->graph, passes->target)->view);
+}
+
+void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* context, Image* colour,
+        Image* depth)
 {
     VkClearValue clear_value = { .color = { {0.1f, 0.2f, 0.3f, 1.0f} } };
     VkRenderingAttachmentInfoKHR colour_attachment = {
         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
         .pNext = NULL,
-        .imageView = renderer->draw_image.view,
+        .imageView = colour->view,
         .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
@@ -212,7 +333,7 @@ void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* con
     VkRenderingAttachmentInfo depth_attachment = {
         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
         .pNext = NULL,
-        .imageView = renderer->depth_image.view,
+        .imageView = depth->view,
         .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
@@ -223,7 +344,7 @@ void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* con
         .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
         .renderArea = {
             .offset = {0, 0},
-            .extent = { renderer->draw_image.extent.width, renderer->draw_image.extent.height },
+            .extent = { colour->extent.width, colour->extent.height },
         },
 
         .layerCount = 1,
@@ -233,24 +354,9 @@ void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* con
         .pDepthAttachment = &depth_attachment,
     };
 
-    Buffer scene_data_buffer = renderer->scene_data_buffer;
-
-    // copy data to gpu
-    void* data;
-    vmaMapMemory(renderer->allocator, scene_data_buffer.allocation, &data);
-    memcpy(data, &renderer->scene_data, sizeof(GPUSceneData));
-    vmaUnmapMemory(renderer->allocator, scene_data_buffer.allocation);
-
-    // uniform buffer
-    VkDescriptorSet global_descriptor = descriptor_allocator_growable_allocate(
-            &renderer->frame_descriptors[renderer->frame_in_flight], renderer->device,
-            renderer->scene_data_desc_set_layout, NULL);
-
-    VkDescriptorBufferInfo buffer_info = descriptor_writer_get_buffer_info(scene_data_buffer.buffer,
-            sizeof(GPUSceneData), 0);
-    VkWriteDescriptorSet write_info = descriptor_writer_get_write(0,
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffer_info, NULL);
-    descriptor_writer_update_set(renderer->device, global_descriptor, &write_info, 1);
+    // this frame's own copy, older frames may still be reading theirs
+    uint32_t scene_data_offset = frame_ring_push(&renderer->frame_ring, &renderer->scene_data,
+            sizeof(GPUSceneData));
 
     // image descriptor
     VkDescriptorSet image_set = descriptor_allocator_growable_allocate(
@@ -259,8 +365,8 @@ void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* con
 
     VkDescriptorImageInfo image_info = descriptor_writer_get_image_info(renderer->error_image.view,
             renderer->sampler_nearest, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    write_info = descriptor_writer_get_write(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            NULL, &image_info);
+    VkWriteDescriptorSet write_info = descriptor_writer_get_write(0,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, NULL, &image_info);
     descriptor_writer_update_set(renderer->device, image_set, &write_info, 1);
 
     // begin rendering
@@ -271,8 +377,8 @@ void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* con
     VkViewport viewport = {
         .x = 0,
         .y = 0,
-        .width = (float)renderer->draw_image.extent.width,
-        .height = (float)renderer->draw_image.extent.height,
+        .width = (float)colour->extent.width,
+        .height = (float)colour->extent.height,
 
         .minDepth = 0.f,
         .maxDepth = 1.f,
@@ -282,56 +388,63 @@ void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* con
 
     VkRect2D scissor = {
         .offset = { 0, 0 },
-        .extent = {renderer->draw_image.extent.width, renderer->draw_image.extent.height},
+        .extent = {colour->extent.width, colour->extent.height},
     };
 
     vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
 
+    // the compute pass already culled and picked lods, so the context's draws would be doubles
+    int n_draws = context->n;
+    if (indirect_active(renderer))
+    {
+        indirect_draw(renderer, cmd_buf, scene_data_offset);
+        n_draws = 0;
+    }
 
-    VkExtent3D draw_extent = renderer->draw_image.extent;
-    vec3 translation = {renderer->translation[0], renderer->translation[1], renderer->translation[2]};
-
-    vec3 camera_pos = { 0, -1, -6};
-    vec3 forward_dir = { 0, 0, 1 };
-    vec3 up_dir = { 0, -1, 0 };
-    mat4 view = GLM_MAT4_IDENTITY_INIT;
-
-    vec3 upped;
-    glm_vec3_add(camera_pos, forward_dir, upped);
-    glm_lookat(camera_pos, upped, up_dir, view);
-
-    mat4 proj = GLM_MAT4_IDENTITY_INIT;
-    float aspect = 1.0;
-
-    glm_perspective(glm_rad(renderer->fov), aspect, 0.1, 1000, proj);
-
+    // every mesh draws out of the index arena, only culled draws need something else bound
+    VkBuffer culled_indices = renderer->culler.indices[renderer->frame_in_flight].buffer;
+    VkBuffer bound_indices = VK_NULL_HANDLE;
 
-    for (int i = 0; i < context->n; ++i)
+    for (int i = 0; i < n_draws; ++i)
     {
         RenderObject* render_object = &context->opaque_surfaces[i];
         MaterialInstance* mat = render_object->material;
         vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline->pipeline);
         vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline->layout, 0, 1,
-                &global_descriptor, 0, NULL);
+                &renderer->scene_data_set, 1, &scene_data_offset);
         vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline->layout, 1, 1,
                 &mat->material_set, 0, NULL);
 
-        vkCmdBindIndexBuffer(cmd_buf, render_object->index_buffer, 0, VK_INDEX_TYPE_UINT32);
+        bool culled = culling_applies(renderer, render_object, i);
+        VkBuffer indices = culled ? culled_indices : renderer->index_arena.buffer.buffer;
+        if (indices != bound_indices)
+        {
+            vkCmdBindIndexBuffer(cmd_buf, indices, 0, VK_INDEX_TYPE_UINT32);
+            bound_indices = indices;
+        }
 
 
         mat4 mvp = GLM_MAT4_IDENTITY_INIT;
         mat4* model = &render_object->transform;
-        glm_mat4_mulN((mat4* [3]){&proj, &view, model}, 3, mvp);
+        glm_mat4_mulN((mat4* [3]){&renderer->projection, &renderer->view, model}, 3, mvp);
 
         PushConstants push_constants = {
             .world_matrix = MAT4_UNPACK(mvp),
             .vertex_buffer = render_object->vertex_buffer_address,
+            .vertex_format = render_object->vertex_format,
+            .position_offset = VEC4_UNPACK(render_object->position_offset),
+            .position_scale = VEC4_UNPACK(render_object->position_scale),
         };
 
         vkCmdPushConstants(cmd_buf, mat->pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
                 sizeof(PushConstants), &push_constants);
 
-        vkCmdDrawIndexed(cmd_buf, render_object->index_count, 1, render_object->first_index, 0, 0);
+        // the culling pass wrote this draw's command at the same index
+        if (culled)
+            vkCmdDrawIndexedIndirect(cmd_buf, renderer->culler.draw_commands[renderer->frame_in_flight].buffer,
+                    sizeof(VkDrawIndexedIndirectCommand) * i, 1, sizeof(VkDrawIndexedIndirectCommand));
+        else
+            vkCmdDrawIndexed(cmd_buf, render_object->index_count, 1, render_object->first_index, 0, 0);
     }
 
     func = get_device_proc_adr(renderer->device, "vkCmdEndRenderingKHR");
@@ -395,9 +508,13 @@ void vma_allocator_initialise(Renderer* renderer)
         .physicalDevice = renderer->gpu,
         .device = renderer->device,
         .instance = renderer->instance,
+        .vulkanApiVersion = VK_API_VERSION_1_2,
         .flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
     };
 
+    if (renderer->memory_budget_supported)
+        allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
     vmaCreateAllocator(&allocator_info, &renderer->allocator);
 }
 
@@ -453,6 +570,31 @@ void create_command_buffers(Renderer* renderer)
     };
 
     VK_CHECK(vkAllocateCommandBuffers(renderer->device, &cmd_alloc_info, &renderer->imm_cmd_buf));
+
+    if (renderer->transfer_family == renderer->graphics_family)
+        return;
+
+    VkCommandPoolCreateInfo transfer_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = renderer->transfer_family,
+    };
+
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        VK_CHECK(vkCreateCommandPool(renderer->device, &transfer_pool_info, NULL,
+                    &renderer->transfer_pools[i]));
+
+        VkCommandBufferAllocateInfo transfer_alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = renderer->transfer_pools[i],
+            .commandBufferCount = 1,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        };
+
+        VK_CHECK(vkAllocateCommandBuffers(renderer->device, &transfer_alloc_info,
+                    &renderer->transfer_command_buffers[i]));
+    }
 }
 
 void cleanup_command_buffers(Renderer* renderer)
@@ -460,6 +602,7 @@ void cleanup_command_buffers(Renderer* renderer)
     for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
     {
         vkDestroyCommandPool(renderer->device, renderer->command_pools[i], NULL);
+        vkDestroyCommandPool(renderer->device, renderer->transfer_pools[i], NULL);
     }
 
     vkDestroyCommandPool(renderer->device, renderer->imm_cmd_pool, NULL);
@@ -496,11 +639,24 @@ void sync_initialise(Renderer* renderer)
                 &renderer->semaphores_swapchain[i]
             )
         );
+
+        VK_CHECK(vkCreateSemaphore(renderer->device, &semaphore_info, NULL,
+                    &renderer->semaphores_transfer[i]));
     }
 
 
     // immediate mode
     VK_CHECK(vkCreateFence(renderer->device, &fence_info, NULL, &renderer->imm_fence));
+
+    if (renderer->timestamp_period == 0)
+        return;
+
+    VkQueryPoolCreateInfo query_info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = FRAMES_IN_FLIGHT * 2,
+    };
+    VK_CHECK(vkCreateQueryPool(renderer->device, &query_info, NULL, &renderer->timestamp_pool));
 }
 
 void sync_cleanup(Renderer* renderer)
@@ -509,10 +665,26 @@ void sync_cleanup(Renderer* renderer)
     {
         vkDestroySemaphore(renderer->device, renderer->semaphores_render[i], NULL);
         vkDestroySemaphore(renderer->device, renderer->semaphores_swapchain[i], NULL);
+        vkDestroySemaphore(renderer->device, renderer->semaphores_transfer[i], NULL);
         vkDestroyFence(renderer->device, renderer->fences[i], NULL);
     }
 
     vkDestroyFence(renderer->device, renderer->imm_fence, NULL);
+    vkDestroyQueryPool(renderer->device, renderer->timestamp_pool, NULL);
+}
+
+// the slot's fence has been waited on, so its timestamps are there unless it never wrote any
+void renderer_read_timestamps(Renderer* renderer, int frame)
+{
+    if (!renderer->timestamps_written[frame])
+        return;
+
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(renderer->device, renderer->timestamp_pool, frame * 2, 2,
+            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_SUCCESS)
+        renderer->gpu_frame_ms = (timestamps[1] - timestamps[0]) * renderer->timestamp_period / 1e6;
 }
 
 void initialise_data(Renderer* renderer)
@@ -522,6 +694,8 @@ void initialise_data(Renderer* renderer)
     renderer->translation[1] = 0;
     renderer->translation[1] = 0;
     renderer->fov = 90;
+    renderer->lod_error_pixels = 1;
+    renderer->frustum_culling = true;
 
     uint32_t checkerboard[16*16];
     for (int x = 0; x < 16; ++x)
@@ -534,17 +708,28 @@ void initialise_data(Renderer* renderer)
     renderer->error_image = image_create_textured(renderer, &checkerboard,
             (VkExtent3D) { 16, 16, 1 }, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, false);
 
+    uint32_t white = 0xffffffff;
+    renderer->white_image = image_create_textured(renderer, &white, (VkExtent3D) { 1, 1, 1 },
+            VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, false);
+
     VkSamplerCreateInfo sampler_info = {
         .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = VK_FILTER_NEAREST,
-        .minFilter = VK_FILTER_NEAREST
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .maxLod = VK_LOD_CLAMP_NONE,
     };
     vkCreateSampler(renderer->device, &sampler_info, NULL, &renderer->sampler_nearest);
 
+    // trilinear, and anisotropic on top where the gpu has it
     VkSamplerCreateInfo sampler2_info = {
         .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = VK_FILTER_LINEAR,
-        .minFilter = VK_FILTER_LINEAR
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .maxLod = VK_LOD_CLAMP_NONE,
+        .anisotropyEnable = renderer->max_anisotropy > 1,
+        .maxAnisotropy = fminf(renderer->max_anisotropy, MAX_ANISOTROPY),
     };
     vkCreateSampler(renderer->device, &sampler2_info, NULL, &renderer->sampler_linear);
 
@@ -556,12 +741,8 @@ void initialise_data(Renderer* renderer)
     };
 
     Buffer mat_constants = buffer_create(renderer->allocator, sizeof(MaterialMetallicConstants),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-
-    renderer->buf_destroy = malloc(sizeof(Buffer) * 10);
-    renderer->buf_destroy[renderer->n_buf_destroy] = mat_constants;
-    renderer->n_buf_destroy = 1;
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_UNIFORMS);
+    renderer->default_material_constants = mat_constants;
 
     MaterialMetallicConstants* data;
     vmaMapMemory(renderer->allocator, mat_constants.allocation, (void**) &data);
@@ -574,6 +755,7 @@ void initialise_data(Renderer* renderer)
     data->metal_rough_factors[1] = 0.5;
     data->metal_rough_factors[2] = 0;
     data->metal_rough_factors[3] = 0;
+    vmaUnmapMemory(renderer->allocator, mat_constants.allocation);
 
     mat_resources.data_buffer = mat_constants.buffer;
     mat_resources.data_buffer_offset = 0;
@@ -583,6 +765,11 @@ void initialise_data(Renderer* renderer)
             renderer->device, MAT_PASS_MAIN_COLOUR, &mat_resources,
             &renderer->global_descriptor_allocator);
 
+    // materials fall back on these, so wherever they get moved to the materials have to follow
+    defrag_track_images(renderer, &renderer->error_image, 1);
+    defrag_track_images(renderer, &renderer->white_image, 1);
+    defrag_track_material(renderer, &renderer->default_material_instance, &mat_resources);
+
     vec4 ambient_colour = {0.1, 0.1, 0.1, 1};
     memcpy(renderer->scene_data.ambient_colour, ambient_colour, sizeof(vec4));
     vec4 sunlight_dir = {2, -5, -2, 0.2};
@@ -598,7 +785,8 @@ VkSubmitInfo get_submit_info(Renderer* renderer)
 {
     VkSemaphore* wait_semaphore = &renderer->semaphores_swapchain[renderer->frame_in_flight];
     VkSemaphore* signal_semaphore = &renderer->semaphores_render[renderer->frame_in_flight];
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    // static, the submit info points at it after this returns
+    static const VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
 
     VkSubmitInfo submit_info = {
@@ -4,7 +4,15 @@
 #define CGLM_FORCE_DEPTH_ZERO_TO_ONE
 
 #define FRAMES_IN_FLIGHT 3
+// full resolution plus up to three simplified levels
+#define MAX_LODS 4
+// meshlet limits, 64 / 124 is what the usual mesh shader hardware is happiest with
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// past this the sharpness gained isn't worth the extra taps
+#define MAX_ANISOTROPY 16.0f
 
+#include <pthread.h>
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 #include <cglm/cglm.h>
@@ -18,6 +26,35 @@ typedef struct Vertex {
     vec4 colour;
 } Vertex;
 
+enum VertexFormat {
+    VERTEX_FORMAT_FULL, VERTEX_FORMAT_PACKED
+};
+
+// 20 bytes, decoded in the vertex shader
+typedef struct PackedVertex {
+    // unorm over the mesh's bounding box
+    uint16_t position[3];
+    uint16_t pad;
+    // octahedral, snorm
+    int16_t normal[2];
+    // half floats
+    uint16_t uv[2];
+    uint8_t colour[4];
+} PackedVertex;
+
+// a run of triangles in a mesh's index buffer, small enough to cull as a unit. matches the
+// struct in shader.cull.comp
+typedef struct Meshlet {
+    // bounding sphere in mesh space, centre and radius in w
+    vec4 sphere;
+    // every triangle faces within the cone around xyz, w is the sine of its half angle and 1
+    // when the triangles face too many ways to ever cull
+    vec4 cone;
+    uint32_t first_index;
+    uint32_t n_triangles;
+    uint32_t pad[2];
+} Meshlet;
+
 typedef struct GPUSceneData {
     vec4 ambient_colour;
     vec4 sunlight_direction; // [3] is for sun power
@@ -27,22 +64,386 @@ typedef struct GPUSceneData {
 typedef struct PushConstants {
     mat4 world_matrix;
     VkDeviceAddress vertex_buffer;
+    uint32_t vertex_format;
+    uint32_t pad;
+    // packed positions decode as offset + position * scale
+    vec4 position_offset;
+    vec4 position_scale;
 } PushConstants;
 
+// what an allocation is for, kept in its user data so frees know what to take it off
+enum MemoryCategory {
+    MEMORY_GEOMETRY, MEMORY_TEXTURES, MEMORY_RENDER_TARGETS, MEMORY_STAGING, MEMORY_UNIFORMS,
+    MEMORY_OTHER, MEMORY_CATEGORY_COUNT
+};
+
+typedef struct MemoryHeapReport {
+    VkDeviceSize size;
+    // what the driver says this process can use before things start getting paged out
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    bool device_local;
+} MemoryHeapReport;
+
+typedef struct MemoryReport {
+    MemoryHeapReport heaps[VK_MAX_MEMORY_HEAPS];
+    uint32_t n_heaps;
+
+    VkDeviceSize category_bytes[MEMORY_CATEGORY_COUNT];
+    uint32_t category_allocations[MEMORY_CATEGORY_COUNT];
+} MemoryReport;
+
 typedef struct Buffer {
     VkBuffer buffer;
     VmaAllocation allocation;
     VmaAllocationInfo info;
 } Buffer;
 
+// one draw's worth of meshlets for the culling pass, matches shader.cull.comp
+typedef struct CullDraw {
+    mat4 transform;
+    VkDeviceAddress meshlets;
+    VkDeviceAddress indices;
+    uint32_t first_meshlet;
+    uint32_t n_meshlets;
+    // where this draw's surviving triangles start in the frame's index buffer
+    uint32_t output_offset;
+    // largest axis scale of the transform, for the bounding spheres
+    float scale;
+} CullDraw;
+
+typedef struct CullFrameData {
+    // world space, pointing inwards
+    vec4 frustum[6];
+    vec4 camera_position;
+    VkDeviceAddress output_indices;
+    VkDeviceAddress draw_commands;
+    CullDraw draws[];
+} CullFrameData;
+
+typedef struct CullPushConstants {
+    VkDeviceAddress frame_data;
+    uint32_t draw_index;
+    uint32_t pad;
+} CullPushConstants;
+
+// compute pre-pass that drops meshlets outside the frustum or facing away and packs what is
+// left into an index buffer per frame, drawn with one indirect command per RenderObject
+typedef struct MeshletCuller {
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+
+    // the frame data goes in the frame ring
+    Buffer indices[FRAMES_IN_FLIGHT];
+    Buffer draw_commands[FRAMES_IN_FLIGHT];
+    uint32_t draw_capacity[FRAMES_IN_FLIGHT];
+    uint32_t index_capacity[FRAMES_IN_FLIGHT];
+    // how many draws from the front of the DrawContext the frame's cull covers, what's past the
+    // frame ring's room is drawn whole
+    uint32_t n_draws[FRAMES_IN_FLIGHT];
+
+    bool enabled;
+    bool overflow_logged;
+} MeshletCuller;
+
+// a copy out of an UploadBatch's staging buffer
+typedef struct BufferUpload {
+    VkBuffer dst;
+    VkDeviceSize dst_offset;
+    VkDeviceSize src_offset;
+    VkDeviceSize size;
+} BufferUpload;
+
+// n_levels come out of staging back to back, the rest of mip_levels get blitted down from the top
+// one. the image goes to shader read once they're all there
+typedef struct ImageUpload {
+    VkImage dst;
+    VkDeviceSize src_offset;
+    VkFormat format;
+    VkExtent3D extent;
+    uint32_t n_levels;
+    uint32_t mip_levels;
+    // when set, the rest are copied out of this sampled image from src_level on instead
+    VkImage src;
+    uint32_t src_level;
+} ImageUpload;
+
+// a range of the staging ring that a batch holds until its copies have run
+typedef struct StagingRegion {
+    size_t offset;
+    size_t size;
+    bool retired;
+} StagingRegion;
+
+// one persistently mapped staging buffer shared by every upload. regions get handed out in order
+// and the space is reclaimed in order too, so a region retiring early waits for the ones before it
+typedef struct StagingRing {
+    Buffer buffer;
+    uint8_t* mapped;
+    size_t size;
+
+    // live regions, oldest first
+    StagingRegion* regions;
+    uint32_t n_regions;
+    uint32_t region_capacity;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t space_freed;
+    // nothing is going to retire any more, so waiting would never end
+    bool closed;
+} StagingRing;
+
+// staging memory filled on any thread, the copies out of it are recorded later by whoever owns
+// the queue
+typedef struct UploadBatch {
+    // the ring's buffer, or one of the batch's own when the ring had no room
+    Buffer staging;
+    uint8_t* mapped;
+    bool owns_staging;
+    // the batch's range of staging
+    size_t base;
+    size_t size;
+    size_t used;
+
+    BufferUpload* buffers;
+    uint32_t n_buffers;
+    uint32_t buffer_capacity;
+
+    ImageUpload* images;
+    uint32_t n_images;
+    uint32_t image_capacity;
+} UploadBatch;
+
+// a free range of a GeometryArena
+typedef struct ArenaBlock {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} ArenaBlock;
+
+// one big device local buffer that meshes take ranges of, so every draw can share one index
+// buffer binding and everything is reachable from one base address
+typedef struct GeometryArena {
+    Buffer buffer;
+    VkDeviceAddress address;
+    VkDeviceSize size;
+    VkDeviceSize alignment;
+    VkDeviceSize used;
+    // bumped by every free, compaction only retries an arena it got stuck on once this moves
+    uint64_t generation;
+
+    // sorted by offset, neighbours always get merged
+    ArenaBlock* free_blocks;
+    uint32_t n_free_blocks;
+    uint32_t free_block_capacity;
+
+    // meshes get staged on the loader thread too
+    pthread_mutex_t mutex;
+} GeometryArena;
+
+// per frame constants, each frame slot writes its own share and starts over once its fence has
+// been waited on. read through dynamic offsets or by address
+typedef struct FrameRing {
+    Buffer buffer;
+    uint8_t* mapped;
+    VkDeviceAddress address;
+    size_t frame_size;
+    // covers the uniform and storage offset limits, every offset handed out is a multiple of it
+    size_t alignment;
+
+    // into the whole buffer, within the current frame slot's share
+    size_t head;
+    size_t frame_end;
+} FrameRing;
+
+// what an image is about to be used for, each one has the layout, stages and access it needs
+enum ImageAccess {
+    IMAGE_ACCESS_NONE, IMAGE_ACCESS_TRANSFER_SRC, IMAGE_ACCESS_TRANSFER_DST,
+    IMAGE_ACCESS_COLOUR_ATTACHMENT, IMAGE_ACCESS_DEPTH_ATTACHMENT, IMAGE_ACCESS_SAMPLED,
+    IMAGE_ACCESS_PRESENT, IMAGE_ACCESS_COUNT
+};
+
+// where the last barrier left an image, the next one waits on exactly these. zeroed is an image
+// nothing has touched yet
+typedef struct ImageState {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+} ImageState;
+
 typedef struct Image {
     VkImage image;
     VkImageView view;
     VmaAllocation allocation;
     VkExtent3D extent;
     VkFormat format;
+    // what it was created with, so defragmentation can make an identical one elsewhere
+    VkImageUsageFlags usage;
+    uint32_t mip_levels;
+    // only kept up to date for images the renderer owns, copies of an Image don't follow along
+    ImageState state;
 } Image;
 
+#define BARRIER_BATCH_IMAGES 32
+#define BARRIER_BATCH_BUFFERS 32
+
+// transitions and memory dependencies collected until they go out as one vkCmdPipelineBarrier2
+typedef struct BarrierBatch {
+    PFN_vkCmdPipelineBarrier2KHR pipeline_barrier;
+    VkCommandBuffer cmd_buf;
+
+    VkImageMemoryBarrier2 images[BARRIER_BATCH_IMAGES];
+    uint32_t n_images;
+    // only for ranges changing queue family, anything else folds into memory
+    VkBufferMemoryBarrier2 buffers[BARRIER_BATCH_BUFFERS];
+    uint32_t n_buffers;
+    // everything that isn't an image folds into the one
+    VkMemoryBarrier2 memory;
+
+    // VK_QUEUE_FAMILY_IGNORED unless the batch is one half of an ownership transfer, then every
+    // image and buffer barrier added moves from src_family to dst_family
+    uint32_t src_family;
+    uint32_t dst_family;
+} BarrierBatch;
+
+// what the geometry pass renders into, pipelines are built against these
+#define DRAW_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+#define DEPTH_FORMAT VK_FORMAT_D32_SFLOAT
+
+// dependencies between passes are kept as bitmasks, so no more than 32
+#define RENDER_GRAPH_PASSES 32
+#define RENDER_GRAPH_RESOURCES 32
+#define RENDER_GRAPH_PASS_ACCESSES 8
+#define RENDER_GRAPH_NONE UINT32_MAX
+
+struct Renderer;
+typedef void (*RenderGraphRecord)(struct Renderer* renderer, VkCommandBuffer cmd_buf, void* data);
+
+// one resource a pass touches. a write that doesn't read throws away whatever was there
+typedef struct RenderGraphAccess {
+    uint32_t resource;
+    enum ImageAccess access;
+    bool reads;
+    bool writes;
+} RenderGraphAccess;
+
+typedef struct RenderGraphPass {
+    const char* name;
+    RenderGraphRecord record;
+    void* data;
+
+    RenderGraphAccess accesses[RENDER_GRAPH_PASS_ACCESSES];
+    uint32_t n_accesses;
+    // has to run even when nothing in the graph reads what it wrote
+    bool side_effects;
+
+    // filled in by compiling
+    uint32_t deps;
+    uint32_t producers;
+    bool culled;
+} RenderGraphPass;
+
+typedef struct RenderGraphResource {
+    const char* name;
+    // transient images belong to the graph, imported ones are only transitioned
+    bool imported;
+    VkFormat format;
+    VkExtent3D extent;
+    // imported images are left like this once the graph is done, NONE leaves them as they are
+    enum ImageAccess final_access;
+
+    // filled in by compiling, the image is null for transients nothing alive uses
+    Image* image;
+    uint32_t transient;
+    VkImageUsageFlags usage;
+    uint32_t first_use;
+    uint32_t last_use;
+} RenderGraphResource;
+
+// a transient image as it was laid out, kept for as long as frames keep asking for the same one
+typedef struct RenderGraphImage {
+    VkImageUsageFlags usage;
+    uint32_t first_use;
+    uint32_t last_use;
+    uint32_t slot;
+    Image image;
+} RenderGraphImage;
+
+// memory shared by transients whose lifetimes don't overlap
+typedef struct RenderGraphSlot {
+    VmaAllocation allocation;
+    VkMemoryRequirements requirements;
+    // what the last image in it did, the next one to use the memory waits on that
+    ImageState state;
+} RenderGraphSlot;
+
+// declared again every frame, only the transient images and their memory carry over
+typedef struct RenderGraph {
+    RenderGraphPass passes[RENDER_GRAPH_PASSES];
+    uint32_t n_passes;
+    RenderGraphResource resources[RENDER_GRAPH_RESOURCES];
+    uint32_t n_resources;
+    // passes in the order they get recorded, culled ones left out
+    uint32_t order[RENDER_GRAPH_PASSES];
+    uint32_t n_ordered;
+
+    RenderGraphImage images[RENDER_GRAPH_RESOURCES];
+    uint32_t n_images;
+    RenderGraphSlot slots[RENDER_GRAPH_RESOURCES];
+    uint32_t n_slots;
+
+    // for the memory panel, what the slots hold against what the images would on their own
+    VkDeviceSize transient_bytes;
+    VkDeviceSize unaliased_bytes;
+    uint32_t n_culled;
+} RenderGraph;
+
+// texel data for an image, levels back to back from the largest. block compressed formats too
+typedef struct TextureData {
+    const void* data;
+    VkExtent3D size;
+    VkFormat format;
+    uint32_t n_levels;
+} TextureData;
+
+enum DeletionType {
+    DELETE_BUFFER, DELETE_IMAGE, DELETE_IMAGE_VIEW, DELETE_SAMPLER, DELETE_PIPELINE,
+    DELETE_PIPELINE_LAYOUT, DELETE_DESCRIPTOR_POOL, DELETE_DESCRIPTOR_SET, DELETE_ARENA_RANGE,
+    DELETE_ALLOCATION
+};
+
+typedef struct Deletion {
+    enum DeletionType type;
+    // Renderer.frame when it was let go of, no frame after that one can be using it
+    int frame;
+    union {
+        Buffer buffer;
+        Image image;
+        VkImageView image_view;
+        VkSampler sampler;
+        VkPipeline pipeline;
+        VkPipelineLayout pipeline_layout;
+        VkDescriptorPool descriptor_pool;
+        VmaAllocation allocation;
+        // only out of pools made with FREE_DESCRIPTOR_SET
+        struct {
+            VkDescriptorPool pool;
+            VkDescriptorSet set;
+        } descriptor_set;
+        struct {
+            GeometryArena* arena;
+            VkDeviceSize offset;
+            VkDeviceSize size;
+        } arena_range;
+    };
+} Deletion;
+
+// oldest first, each destroyed once the fence of the frame it was let go of has been waited on
+typedef struct DeletionQueue {
+    Deletion* deletions;
+    uint32_t n_deletions;
+    uint32_t deletion_capacity;
+} DeletionQueue;
+
 typedef struct DescriptorAllocatorGrowable {
     VkDescriptorPoolSize* ratios;
     VkDescriptorPool* full_pools;
@@ -54,6 +455,18 @@ typedef struct DescriptorAllocatorGrowable {
     uint16_t sets_per_pool;
 } DescriptorAllocatorGrowable;
 
+// pools made with FREE_DESCRIPTOR_SET, for sets that get replaced one at a time. every pool is
+// tried before a new one is made, so the room a freed set leaves gets used again
+typedef struct DescriptorAllocatorFreeable {
+    VkDescriptorPoolSize ratios[4];
+    uint16_t n_ratios;
+    uint16_t sets_per_pool;
+
+    VkDescriptorPool* pools;
+    uint32_t n_pools;
+    uint32_t pool_capacity;
+} DescriptorAllocatorFreeable;
+
 
 typedef struct Swapchain {
     VkSwapchainKHR swapchain;
@@ -73,6 +486,8 @@ enum MaterialPass {
 
 typedef struct MaterialPipeline {
     VkPipeline pipeline;
+    // the same, with the vertex shader that reads objects for indirect draws
+    VkPipeline indirect;
     VkPipelineLayout layout;
 } MaterialPipeline;
 
@@ -106,27 +521,84 @@ typedef struct MaterialMetallicResources {
     uint32_t data_buffer_offset;
 } MaterialMetallicResources;
 
+// the textures and material instances loaded with a scene, its surfaces point into instances
+typedef struct MaterialSet {
+    Image* images;
+    uint32_t n_images;
+
+    MaterialInstance* instances;
+    uint32_t n_instances;
+    // the MaterialMetallicConstants of every instance, one after the other
+    Buffer constants;
+} MaterialSet;
+
 typedef struct RenderObject {
     mat4 transform;
 
     MaterialInstance* material;
 
     VkDeviceAddress vertex_buffer_address;
-    VkBuffer index_buffer;
+    enum VertexFormat vertex_format;
+    vec4 position_offset;
+    vec4 position_scale;
+
+    // into the index arena, already past the start of the mesh's own indices
     uint32_t index_count;
     uint32_t first_index;
+
+    // the meshlets covering the same index range, for the culling pre-pass
+    VkDeviceAddress index_buffer_address;
+    VkDeviceAddress meshlet_buffer_address;
+    uint32_t first_meshlet;
+    uint32_t n_meshlets;
+
+    // how many pixels the bounding sphere spans, texture streaming picks mips from it
+    float screen_size;
 } RenderObject;
 
+// a mesh's ranges of the geometry arenas, offsets and sizes in bytes
 typedef struct MeshBuffers {
-    Buffer index_buffer;
-    Buffer vertex_buffer;
+    VkDeviceSize vertex_offset;
+    VkDeviceSize vertex_size;
+    VkDeviceSize index_offset;
+    VkDeviceSize index_size;
+    // meshlets live in the vertex arena, they're only ever read by address too
+    VkDeviceSize meshlet_offset;
+    VkDeviceSize meshlet_size;
+
     VkDeviceAddress vertex_buffer_address;
+    VkDeviceAddress index_buffer_address;
+    VkDeviceAddress meshlet_buffer_address;
+    // index_offset counted in indices, what draws out of the index arena start from
+    uint32_t first_index;
+
+    enum VertexFormat vertex_format;
+    vec4 position_offset;
+    vec4 position_scale;
 } MeshBuffers;
 
+typedef struct GeoLod {
+    uint32_t start_index;
+    uint32_t count;
+    // how far the simplified surface strays from the original, in mesh units
+    float error;
+
+    uint32_t first_meshlet;
+    uint32_t n_meshlets;
+} GeoLod;
+
 typedef struct GeoSurface {
     uint32_t start_index;
     uint32_t count;
     MaterialInstance* material;
+
+    // lods[0] is the range above, coarser levels index the same vertices
+    GeoLod lods[MAX_LODS];
+    uint32_t n_lods;
+
+    // box around the vertices lods[0] uses, in mesh space. coarser levels never leave it
+    vec3 aabb_min;
+    vec3 aabb_max;
 } GeoSurface;
 
 typedef struct Mesh {
@@ -135,13 +607,289 @@ typedef struct Mesh {
     int n_surfaces;
     GeoSurface* surfaces;
     MeshBuffers mesh_buffers;
+
+    // bounding sphere in mesh space, centre and radius in w
+    vec4 bounds;
 } Mesh;
 
+// one surface of one entity, as the object culling pass and indirect draws read it. matches
+// Object in shader.indirect.comp and shader.indirect.vert, 240 bytes
+typedef struct IndirectObject {
+    mat4 transform;
+    // the mesh's bounding sphere, in mesh space
+    vec4 sphere;
+    vec4 position_offset;
+    vec4 position_scale;
+    VkDeviceAddress vertex_buffer;
+    uint32_t vertex_format;
+    uint32_t bucket;
+    // per lod, already into the index arena
+    uint32_t first_index[MAX_LODS];
+    uint32_t index_count[MAX_LODS];
+    float lod_error[MAX_LODS];
+    uint32_t n_lods;
+    // largest axis scale of the transform
+    float scale;
+    VkDeviceAddress meshlets;
+    // per lod, into the mesh's meshlets. none means the lod is drawn whole
+    uint32_t first_meshlet[MAX_LODS];
+    uint32_t n_meshlets[MAX_LODS];
+    // the mesh's first index in the arena, meshlets count from it
+    uint32_t mesh_first_index;
+    uint32_t pad[3];
+} IndirectObject;
+
+// what an object was written from, so it can be written again when its mesh moves
+typedef struct IndirectSource {
+    Mesh* mesh;
+    GeoSurface* surface;
+} IndirectSource;
+
+// every object drawn with one material, their commands sit together from first_command on
+typedef struct IndirectBucket {
+    MaterialInstance* material;
+    uint32_t n_objects;
+    // the most commands its objects can write, see indirect_object_commands
+    uint32_t n_commands;
+    uint32_t first_command;
+} IndirectBucket;
+
+// written into the frame ring each frame, matches IndirectFrame in shader.indirect.comp
+typedef struct IndirectFrameData {
+    // world space, pointing inwards
+    vec4 frustum[6];
+    vec4 camera_position;
+    VkDeviceAddress objects;
+    VkDeviceAddress draw_commands;
+    VkDeviceAddress counts;
+    uint32_t n_objects;
+    // the same lod pick as ecs_renderable_collect makes
+    float pixels_per_unit;
+    float lod_error_pixels;
+    // the meshlet culler's toggle, surviving objects cull their lod's meshlets too
+    uint32_t cull_meshlets;
+    uint32_t first_command[];
+} IndirectFrameData;
+
+// for the indirect vertex shader, which finds its object through gl_InstanceIndex
+typedef struct IndirectPushConstants {
+    mat4 view_projection;
+    VkDeviceAddress objects;
+} IndirectPushConstants;
+
+// objects live on the gpu for good and a compute pass culls them and picks their lods, so a
+// frame records one dispatch and a draw per material however many objects there are. with meshlet
+// culling on, a surviving object's lod is culled per meshlet as well and each run of visible
+// meshlets becomes its own command, straight out of the index arena. that is more, smaller draws
+// than the cpu path's compacted index buffer, but nothing gets copied
+typedef struct IndirectDrawer {
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+
+    // main thread only, the cpu copy of the object buffer. what changed goes up from dirty_first
+    // to dirty_end the next frame
+    IndirectObject* objects;
+    IndirectSource* sources;
+    uint32_t n_objects;
+    uint32_t object_capacity;
+    uint32_t dirty_first;
+    uint32_t dirty_end;
+    Buffer object_buffer;
+    uint32_t object_buffer_capacity;
+
+    IndirectBucket* buckets;
+    uint32_t n_buckets;
+    uint32_t bucket_capacity;
+    // every bucket's n_commands together
+    uint32_t n_commands;
+
+    // per frame slot, the dirty objects go through staging
+    Buffer staging[FRAMES_IN_FLIGHT];
+    uint32_t staging_capacity[FRAMES_IN_FLIGHT];
+    Buffer draw_commands[FRAMES_IN_FLIGHT];
+    uint32_t command_capacity[FRAMES_IN_FLIGHT];
+    Buffer counts[FRAMES_IN_FLIGHT];
+    uint32_t count_capacity[FRAMES_IN_FLIGHT];
+
+    // needs VK_KHR_draw_indirect_count and drawIndirectFirstInstance, the commands carry the object
+    // index in firstInstance. without them draws go through draw_geometry's loop
+    bool supported;
+    bool enabled;
+} IndirectDrawer;
+
+// a material instance and what its descriptor set was written with, so the set can be written
+// again when one of its images moves
+typedef struct DefragMaterial {
+    MaterialInstance* instance;
+    MaterialMetallicResources resources;
+    // where the instance's set came from once defrag has written it, VK_NULL_HANDLE while it is
+    // still the set it was loaded with, which lives as long as the global pools
+    VkDescriptorPool pool;
+    // resources changed since the set was written, it gets a new one before the frame draws
+    bool dirty;
+} DefragMaterial;
+
+// the image an allocation used to be bound to, destroyed once the frame that copied it retires
+typedef struct DefragMove {
+    VkImage old_image;
+    VkImageView old_view;
+} DefragMove;
+
+// a range of a geometry arena some mesh holds, for compaction
+typedef struct DefragRange {
+    MeshBuffers* mesh;
+    VkDeviceSize* offset;
+    VkDeviceSize size;
+} DefragRange;
+
+// moves a few textures and mesh ranges a frame so long sessions don't end up with memory that
+// is free but too scattered to use. only what has been tracked ever moves
+typedef struct Defragmenter {
+    VmaDefragmentationContext context;
+    bool running;
+    // set from the memory panel, picked up by the next frame
+    bool requested;
+    int last_check_frame;
+
+    // a pass's copies are recorded in one frame and it ends once that frame has retired
+    VmaDefragmentationPassMoveInfo pass;
+    bool pass_open;
+    int pass_frame;
+    DefragMove* moves;
+    uint32_t n_moves;
+    uint32_t move_capacity;
+
+    // pointers into MaterialSet and Renderer, their owners untrack them before they go
+    Image** images;
+    uint32_t n_images;
+    uint32_t image_capacity;
+
+    DefragMaterial* materials;
+    uint32_t n_materials;
+    uint32_t material_capacity;
+
+    MeshBuffers** meshes;
+    uint32_t n_meshes;
+    uint32_t mesh_capacity;
+
+    // rebuilt every time an arena gets compacted
+    DefragRange* ranges;
+    uint32_t range_capacity;
+    uint64_t vertex_stalled_generation;
+    uint64_t index_stalled_generation;
+
+    // totals since startup, for the memory panel
+    uint32_t runs;
+    VkDeviceSize texture_bytes_moved;
+    VkDeviceSize texture_bytes_freed;
+    uint32_t texture_blocks_freed;
+    VkDeviceSize geometry_bytes_moved;
+} Defragmenter;
+
+// a texture whose larger levels come and go, the levels from tail_level down are always resident
+// a streamed texture's full chain. with a path, texture.data is NULL and the levels are read out of
+// that ktx2 file when a request needs them, otherwise they're decoded and back to back in data
+typedef struct StreamSource {
+    TextureData texture;
+    char* path;
+} StreamSource;
+
+typedef struct StreamedTexture {
+    // the MaterialSet slot holding the image, it gets swapped whenever the resident levels change
+    Image* image;
+    // the streamer owns it
+    StreamSource source;
+    uint64_t id;
+
+    // first level the image on the gpu holds, and the one the draws want
+    uint32_t resident_level;
+    uint32_t wanted_level;
+    uint32_t tail_level;
+    // what a request is on its way for, STREAMING_NO_LEVEL when there is none
+    uint32_t pending_level;
+    // finest level any of this frame's draws asked for
+    uint32_t frame_level;
+    int last_needed_frame;
+} StreamedTexture;
+
+// which streamed textures a material samples, so draws can report what they need
+typedef struct StreamedMaterial {
+    MaterialInstance* instance;
+    uint32_t textures[2];
+} StreamedMaterial;
+
+// one texture's new set of levels. the worker creates the image and stages the levels that aren't
+// resident yet, the main thread has the rest copied over from the old image and swaps it in
+typedef struct StreamRequest {
+    uint64_t texture_id;
+    uint32_t level;
+    // every level from level on, the first n_staged of them aren't resident yet
+    TextureData levels;
+    uint32_t n_staged;
+    // borrowed from the texture's source, the file they're read out of
+    const char* path;
+
+    Image image;
+    UploadBatch uploads;
+} StreamRequest;
+
+// keeps textures under a memory budget by only holding the levels the draws need, the rest of
+// each chain waits in its file or on the cpu. new levels get staged on a thread of its own
+typedef struct TextureStreamer {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+    bool started;
+    bool stopping;
+
+    StreamRequest* requests;
+    uint32_t n_requests;
+    uint32_t request_capacity;
+
+    StreamRequest* completed;
+    uint32_t n_completed;
+    uint32_t completed_capacity;
+
+    // the request the worker is staging, its source is handed over when the texture goes meanwhile
+    uint64_t working_id;
+    StreamSource orphaned_source;
+
+    // main thread only, materials sorted by instance
+    StreamedTexture* textures;
+    uint32_t n_textures;
+    uint32_t texture_capacity;
+    StreamedMaterial* materials;
+    uint32_t n_materials;
+    uint32_t material_capacity;
+    uint64_t next_id;
+    uint32_t n_in_flight;
+
+    // what the resident levels of every streamed texture may add up to, set from the memory panel
+    VkDeviceSize budget;
+    VkDeviceSize resident_bytes;
+    VkDeviceSize wanted_bytes;
+
+    // totals since startup, for the memory panel
+    uint32_t streamed_in;
+    uint32_t evicted;
+    VkDeviceSize bytes_streamed;
+} TextureStreamer;
+
 typedef struct DrawContext {
     RenderObject* opaque_surfaces;
     int n;
+    // grows to however many surfaces collect could ever emit, kept from frame to frame
+    int capacity;
 } DrawContext;
 
+// what the frame's passes need to record
+typedef struct FramePasses {
+    DrawContext* context;
+    uint32_t colour;
+    uint32_t depth;
+    uint32_t target;
+} FramePasses;
+
 typedef struct Renderer {
     VkInstance instance;
     VkDebugUtilsMessengerEXT debug_messenger;
@@ -149,6 +897,18 @@ typedef struct Renderer {
     VkDevice device;
     VkPhysicalDevice gpu;
     VmaAllocator allocator;
+    // VK_EXT_memory_budget, without it heap budgets are only an estimate
+    bool memory_budget_supported;
+    // 1 when the gpu has no anisotropic filtering
+    float max_anisotropy;
+    // VK_KHR_synchronization2 is required, it's an extension on 1.2
+    PFN_vkCmdPipelineBarrier2KHR cmd_pipeline_barrier2;
+    // null without VK_KHR_draw_indirect_count
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count;
+    // 0 when the graphics queue can't write timestamps
+    float timestamp_period;
+    // one bit per heap, so crossing the warning line only gets logged once
+    uint32_t heaps_over_budget;
 
     VkDescriptorPool descriptor_pool;
     VkPipeline pipeline;
@@ -156,22 +916,36 @@ typedef struct Renderer {
 
     Swapchain swapchain;
     VkQueue graphics_queue;
+    // the same queue as graphics_queue when the gpu has no family just for transfers
+    VkQueue transfer_queue;
+    uint32_t graphics_family;
+    uint32_t transfer_family;
 
-    Image draw_image;
-    Image depth_image;
-    VkExtent2D draw_extent;
+    // owns the draw and depth images, which only live as long as a frame needs them
+    RenderGraph graph;
     VkDescriptorSet draw_image_desc_set;
     VkDescriptorSetLayout draw_image_desc_layout;
 
     VkCommandPool command_pools[FRAMES_IN_FLIGHT];
     VkCommandBuffer command_buffers[FRAMES_IN_FLIGHT];
+    // only created with a separate transfer family
+    VkCommandPool transfer_pools[FRAMES_IN_FLIGHT];
+    VkCommandBuffer transfer_command_buffers[FRAMES_IN_FLIGHT];
 
     VkSemaphore semaphores_swapchain[FRAMES_IN_FLIGHT];
     VkSemaphore semaphores_render[FRAMES_IN_FLIGHT];
+    // a frame's uploads landed, the frame's submit waits on it when there were any
+    VkSemaphore semaphores_transfer[FRAMES_IN_FLIGHT];
     VkFence fences[FRAMES_IN_FLIGHT];
+    // the start and end of each frame slot's command buffer
+    VkQueryPool timestamp_pool;
+    bool timestamps_written[FRAMES_IN_FLIGHT];
+    float gpu_frame_ms;
 
     DescriptorAllocatorGrowable frame_descriptors[FRAMES_IN_FLIGHT];
     DescriptorAllocatorGrowable global_descriptor_allocator;
+    // material sets written again when one of their images moves or streams
+    DescriptorAllocatorFreeable material_descriptors;
 
     VkCommandPool imm_cmd_pool;
     VkCommandBuffer imm_cmd_buf;
@@ -188,19 +962,50 @@ typedef struct Renderer {
     VkSampler sampler_nearest;
     VkSampler sampler_linear;
     Image error_image;
+    // stands in for the textures a material doesn't have
+    Image white_image;
     vec3 translation;
     float fov;
 
-    Buffer scene_data_buffer;
+    vec3 camera_position;
+    mat4 view;
+    mat4 projection;
+    // coarsest lod whose error projects to at most this many pixels gets drawn
+    float lod_error_pixels;
+    // surfaces outside the view are left out of the DrawContext, the counts are last collect's,
+    // which only looks at the streaming slice while the gpu culls
+    bool frustum_culling;
+    uint32_t surfaces_tested;
+    uint32_t surfaces_culled;
+
+    FrameRing frame_ring;
+    // points at the frame ring, each draw binds it with where this frame's scene data went
+    VkDescriptorSet scene_data_set;
+    MeshletCuller culler;
+    IndirectDrawer indirect;
+
+    // every mesh's vertices and meshlets, and every mesh's indices
+    GeometryArena vertex_arena;
+    GeometryArena index_arena;
+
+    StagingRing staging;
+    // queued by the asset loader, recorded at the start of the next frame
+    UploadBatch* pending_uploads;
+    uint32_t n_pending_uploads;
+    uint32_t pending_upload_capacity;
+    // what each frame slot recorded, freed once its fence has been waited on again
+    UploadBatch* frame_uploads[FRAMES_IN_FLIGHT];
+    uint32_t n_frame_uploads[FRAMES_IN_FLIGHT];
+
+    DeletionQueue deletion_queue;
+    Buffer default_material_constants;
 
-    Mesh* meshes;
-    Buffer* buf_destroy;
+    Defragmenter defrag;
+    TextureStreamer streaming;
 
     int frame;
 
-    uint8_t n_meshes;
     uint8_t frame_in_flight;
-    uint8_t n_buf_destroy;
 
     bool resize_requested;
 } Renderer;
@@ -209,6 +1014,8 @@ typedef struct Renderer {
 void renderer_initialise(Renderer* renderer, GLFWwindow* window);
 void renderer_draw(Renderer* renderer, DrawContext* context);
 void renderer_cleanup(Renderer* renderer);
+// call before collecting the frame's draws, they pick lods from the camera
+void renderer_update_camera(Renderer* renderer);
 
 int validation_layers_count();
 const char** validation_layers();
@@ -224,10 +1031,15 @@ void cleanup_command_buffers(Renderer* renderer);
 VkCommandBufferSubmitInfo get_command_buffer_submit_info(VkCommandBuffer cmd);
 VkSubmitInfo get_submit_info(Renderer* renderer);
 void renderer_inc_frame(Renderer* renderer);
+void renderer_read_timestamps(Renderer* renderer, int frame);
 void vma_allocator_initialise(Renderer* renderer);
 void sync_initialise(Renderer* renderer);
 void sync_cleanup(Renderer* renderer);
 
-void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* context);
+void draw_geometry(Renderer* renderer, VkCommandBuffer cmd_buf, DrawContext* context, Image* colour,
+        Image* depth);
+void renderer_geometry_pass(Renderer* renderer, VkCommandBuffer cmd_buf, void* data);
+void renderer_blit_pass(Renderer* renderer, VkCommandBuffer cmd_buf, void* data);
+void renderer_imgui_pass(Renderer* renderer, VkCommandBuffer cmd_buf, void* data);
 void initialise_data(Renderer* renderer);
 
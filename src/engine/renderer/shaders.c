@@ -20,9 +20,13 @@ VkShaderModule create_shader_module(VkDevice device, File* f)
 
 VkShaderModule create_shader(VkDevice device, char file_path[])
 {
-    File f = read_file(file_path);
+    // page aligned, which covers the 4 byte alignment spir-v needs
+    File f = file_map(file_path, FILE_ACCESS_SEQUENTIAL);
+    if (f.buf == NULL)
+        FATAL("Could not open shader %s\n", file_path);
+
     VkShaderModule shader = create_shader_module(device, &f);
-    free(f.buf);
+    file_close(&f);
 
     return shader;
 }
@@ -0,0 +1,661 @@
+#include "streaming.h"
+#include "image.h"
+#include "uploads.h"
+#include "defrag.h"
+#include "deletion.h"
+#include "barriers.h"
+#include "../scene/texture_format.h"
+#include "../scene/ktx2.h"
+#include "../utils.h"
+
+#include <math.h>
+
+void streaming_initialise(Renderer* renderer)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    *streamer = (TextureStreamer) {
+        .budget = STREAMING_DEFAULT_BUDGET,
+        .next_id = 1,
+    };
+
+    pthread_mutex_init(&streamer->mutex, NULL);
+    pthread_cond_init(&streamer->work_available, NULL);
+
+    if (pthread_create(&streamer->thread, NULL, streaming_worker, renderer) != 0)
+        FATAL("Could not create the texture streaming thread\n");
+    streamer->started = true;
+}
+
+void streaming_cleanup(Renderer* renderer)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    if (streamer->started)
+    {
+        pthread_mutex_lock(&streamer->mutex);
+        streamer->stopping = true;
+        pthread_cond_broadcast(&streamer->work_available);
+        pthread_mutex_unlock(&streamer->mutex);
+
+        // a request waiting on staging takes a buffer of its own, no frame is going to free any
+        staging_ring_close(&renderer->staging);
+        pthread_join(streamer->thread, NULL);
+
+        pthread_cond_destroy(&streamer->work_available);
+        pthread_mutex_destroy(&streamer->mutex);
+    }
+
+    // nothing of these was recorded, the images were never seen by a frame
+    for (uint32_t i = 0; i < streamer->n_completed; ++i)
+    {
+        upload_batch_destroy(&streamer->completed[i].uploads, renderer);
+        image_destroy(renderer->device, renderer->allocator, streamer->completed[i].image);
+    }
+    streaming_source_free(&streamer->orphaned_source);
+
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+        streaming_source_free(&streamer->textures[i].source);
+
+    free(streamer->requests);
+    free(streamer->completed);
+    free(streamer->textures);
+    free(streamer->materials);
+    *streamer = (TextureStreamer) {0};
+}
+
+void streaming_update(Renderer* renderer, DrawContext* context)
+{
+    // a pass can be moving the very image a swap would retire, the results wait for it to end
+    if (!renderer->defrag.pass_open)
+        streaming_poll(renderer);
+
+    streaming_feedback(renderer, context);
+    streaming_schedule(renderer);
+}
+
+void streaming_track_image(Renderer* renderer, Image* image, StreamSource source)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    if (streamer->n_textures == streamer->texture_capacity)
+    {
+        streamer->texture_capacity = streamer->texture_capacity == 0 ? 64
+            : streamer->texture_capacity * 2;
+        streamer->textures = realloc(streamer->textures,
+                sizeof(StreamedTexture) * streamer->texture_capacity);
+    }
+
+    uint32_t tail_level = streaming_tail_level(&source.texture);
+
+    streamer->textures[streamer->n_textures++] = (StreamedTexture) {
+        .image = image,
+        .source = source,
+        .id = streamer->next_id++,
+        .resident_level = tail_level,
+        .wanted_level = tail_level,
+        .tail_level = tail_level,
+        .pending_level = STREAMING_NO_LEVEL,
+        .frame_level = STREAMING_NO_LEVEL,
+        .last_needed_frame = renderer->frame,
+    };
+}
+
+// materials still sampling these stop asking for them
+void streaming_untrack_images(Renderer* renderer, Image* images, uint32_t n)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    // where each texture ends up, so the materials can follow
+    uint32_t* remap = malloc(sizeof(uint32_t) * streamer->n_textures);
+
+    pthread_mutex_lock(&streamer->mutex);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+    {
+        StreamedTexture* texture = &streamer->textures[i];
+        if (texture->image < images || texture->image >= images + n)
+        {
+            remap[i] = kept;
+            streamer->textures[kept++] = *texture;
+            continue;
+        }
+
+        remap[i] = STREAMING_NO_TEXTURE;
+
+        // requests that haven't started just go, a finished one gets dropped when it's polled
+        for (uint32_t j = 0; j < streamer->n_requests;)
+        {
+            if (streamer->requests[j].texture_id != texture->id)
+            {
+                j++;
+                continue;
+            }
+
+            streamer->n_requests -= 1;
+            memmove(streamer->requests + j, streamer->requests + j + 1,
+                    sizeof(StreamRequest) * (streamer->n_requests - j));
+            streamer->n_in_flight -= 1;
+        }
+
+        // the worker is reading from the source, it frees it once it's done
+        if (streamer->working_id == texture->id)
+            streamer->orphaned_source = texture->source;
+        else
+            streaming_source_free(&texture->source);
+    }
+    streamer->n_textures = kept;
+
+    pthread_mutex_unlock(&streamer->mutex);
+
+    for (uint32_t i = 0; i < streamer->n_materials; ++i)
+    {
+        StreamedMaterial* material = &streamer->materials[i];
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            if (material->textures[j] != STREAMING_NO_TEXTURE)
+                material->textures[j] = remap[material->textures[j]];
+        }
+    }
+
+    free(remap);
+}
+
+void streaming_track_material(Renderer* renderer, MaterialInstance* instance, Image* colour_image,
+        Image* metal_rough_image)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    StreamedMaterial material = {
+        .instance = instance,
+        .textures = {
+            streaming_image_index(streamer, colour_image),
+            streaming_image_index(streamer, metal_rough_image),
+        },
+    };
+
+    if (material.textures[0] == STREAMING_NO_TEXTURE && material.textures[1] == STREAMING_NO_TEXTURE)
+        return;
+
+    if (streamer->n_materials == streamer->material_capacity)
+    {
+        streamer->material_capacity = streamer->material_capacity == 0 ? 64
+            : streamer->material_capacity * 2;
+        streamer->materials = realloc(streamer->materials,
+                sizeof(StreamedMaterial) * streamer->material_capacity);
+    }
+
+    // a whole set gets tracked at once when it loads, so the sort only happens then
+    streamer->materials[streamer->n_materials++] = material;
+    qsort(streamer->materials, streamer->n_materials, sizeof(StreamedMaterial),
+            streaming_material_compare);
+}
+
+void streaming_untrack_materials(Renderer* renderer, MaterialInstance* instances, uint32_t n)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < streamer->n_materials; ++i)
+    {
+        MaterialInstance* instance = streamer->materials[i].instance;
+        if (instance < instances || instance >= instances + n)
+            streamer->materials[kept++] = streamer->materials[i];
+    }
+    streamer->n_materials = kept;
+}
+
+uint32_t streaming_tail_level(const TextureData* source)
+{
+    uint32_t level = 0;
+    while (texture_mip_dimension(source->size.width, level) > STREAMING_TAIL_SIZE
+            || texture_mip_dimension(source->size.height, level) > STREAMING_TAIL_SIZE)
+        level++;
+
+    // without the levels below it there'd be nothing to fall back on
+    return level < source->n_levels ? level : 0;
+}
+
+void streaming_source_free(StreamSource* source)
+{
+    free((void*) source->texture.data);
+    free(source->path);
+    *source = (StreamSource) {0};
+}
+
+TextureData streaming_levels(const TextureData* source, uint32_t level)
+{
+    size_t offset = texture_chain_size(source->format, source->size.width, source->size.height,
+            level);
+
+    return (TextureData) {
+        .data = source->data == NULL ? NULL : (const uint8_t*) source->data + offset,
+        .size = {
+            texture_mip_dimension(source->size.width, level),
+            texture_mip_dimension(source->size.height, level),
+            1,
+        },
+        .format = source->format,
+        .n_levels = source->n_levels - level,
+    };
+}
+
+void* streaming_worker(void* arg)
+{
+    Renderer* renderer = arg;
+    TextureStreamer* streamer = &renderer->streaming;
+
+    pthread_mutex_lock(&streamer->mutex);
+    while (true)
+    {
+        while (streamer->n_requests == 0 && !streamer->stopping)
+            pthread_cond_wait(&streamer->work_available, &streamer->mutex);
+
+        if (streamer->stopping)
+            break;
+
+        StreamRequest request = streamer->requests[0];
+        streamer->n_requests -= 1;
+        memmove(streamer->requests, streamer->requests + 1,
+                sizeof(StreamRequest) * streamer->n_requests);
+        streamer->working_id = request.texture_id;
+
+        pthread_mutex_unlock(&streamer->mutex);
+
+        // blocks while the ring is full, the asset loader shares it
+        TextureData* levels = &request.levels;
+        request.uploads = upload_batch_create(renderer, texture_chain_size(levels->format,
+                    levels->size.width, levels->size.height, request.n_staged), true);
+        request.image = streaming_stage(renderer, &request);
+
+        pthread_mutex_lock(&streamer->mutex);
+
+        streamer->working_id = 0;
+        streaming_source_free(&streamer->orphaned_source);
+
+        if (streamer->n_completed == streamer->completed_capacity)
+        {
+            streamer->completed_capacity = streamer->completed_capacity == 0 ? 16
+                : streamer->completed_capacity * 2;
+            streamer->completed = realloc(streamer->completed,
+                    sizeof(StreamRequest) * streamer->completed_capacity);
+        }
+
+        streamer->completed[streamer->n_completed++] = request;
+    }
+    pthread_mutex_unlock(&streamer->mutex);
+
+    return NULL;
+}
+
+// the image gets every level from the request's on, only the ones that aren't resident are staged.
+// a ktx2 file is mapped just for as long as that takes
+Image streaming_stage(Renderer* renderer, StreamRequest* request)
+{
+    const TextureData* levels = &request->levels;
+
+    const uint8_t* staged[KTX2_MAX_LEVELS];
+    File file = {0};
+    if (request->path != NULL && request->n_staged != 0)
+    {
+        file = file_map(request->path, FILE_ACCESS_RANDOM);
+
+        Ktx2Texture texture;
+        const uint8_t* file_levels[KTX2_MAX_LEVELS];
+        bool read = file.buf != NULL && ktx2_levels(request->path, (const uint8_t*) file.buf,
+                file.size, &texture, file_levels);
+
+        // the file could have been replaced since it was loaded
+        if (!read || texture.format != levels->format
+                || texture.n_levels != request->level + levels->n_levels
+                || texture_mip_dimension(texture.width, request->level) != levels->size.width
+                || texture_mip_dimension(texture.height, request->level) != levels->size.height)
+        {
+            LOG_W("Could not read levels of %s, it keeps the ones it has\n", request->path);
+            if (file.buf != NULL)
+                file_close(&file);
+            return (Image) {0};
+        }
+
+        for (uint32_t i = 0; i < request->n_staged; ++i)
+            staged[i] = file_levels[request->level + i];
+    }
+    else if (request->path == NULL)
+    {
+        for (uint32_t i = 0; i < request->n_staged; ++i)
+            staged[i] = (const uint8_t*) levels->data + texture_chain_size(levels->format,
+                    levels->size.width, levels->size.height, i);
+    }
+
+    Image image = image_create(renderer->allocator, renderer->device, levels->size, levels->format,
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, levels->n_levels, MEMORY_TEXTURES);
+
+    upload_batch_image_levels(&request->uploads, image.image, staged, levels->format,
+            levels->size, request->n_staged, image.mip_levels);
+    // where the batch leaves it once recorded
+    image.state = barrier_state(IMAGE_ACCESS_SAMPLED);
+
+    if (file.buf != NULL)
+        file_close(&file);
+
+    return image;
+}
+
+// the new image is recorded ahead of this frame's draws, the old one goes once the frames that
+// sampled it have finished
+void streaming_poll(Renderer* renderer)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    while (true)
+    {
+        pthread_mutex_lock(&streamer->mutex);
+        if (streamer->n_completed == 0)
+        {
+            pthread_mutex_unlock(&streamer->mutex);
+            break;
+        }
+
+        StreamRequest request = streamer->completed[0];
+        streamer->n_completed -= 1;
+        memmove(streamer->completed, streamer->completed + 1,
+                sizeof(StreamRequest) * streamer->n_completed);
+        pthread_mutex_unlock(&streamer->mutex);
+
+        streamer->n_in_flight -= 1;
+
+        // the texture can have gone while this was being staged, nothing ever recorded it
+        uint32_t index = streaming_texture_index(streamer, request.texture_id);
+        if (index != STREAMING_NO_TEXTURE)
+            streamer->textures[index].pending_level = STREAMING_NO_LEVEL;
+
+        if (index == STREAMING_NO_TEXTURE || request.image.image == VK_NULL_HANDLE)
+        {
+            // levels that couldn't be read won't be any better next time, it stays where it is
+            if (index != STREAMING_NO_TEXTURE)
+                streamer->textures[index].tail_level = streamer->textures[index].resident_level;
+
+            upload_batch_destroy(&request.uploads, renderer);
+            image_destroy(renderer->device, renderer->allocator, request.image);
+            continue;
+        }
+
+        StreamedTexture* texture = &streamer->textures[index];
+
+        // the levels it already has are copied over on the gpu, wherever defrag has put them by now
+        if (request.n_staged < request.levels.n_levels)
+        {
+            ImageUpload* upload = &request.uploads.images[0];
+            upload->src = texture->image->image;
+            upload->src_level = request.level + request.n_staged - texture->resident_level;
+        }
+
+        uploads_queue(renderer, request.uploads);
+
+        Image old_image = *texture->image;
+        defrag_replace_image(renderer, texture->image, request.image);
+        deletion_queue_image(renderer, old_image);
+
+        if (request.level < texture->resident_level)
+        {
+            streamer->streamed_in += 1;
+            streamer->bytes_streamed += streaming_level_size(texture, request.level)
+                - streaming_level_size(texture, texture->resident_level);
+        }
+        else
+        {
+            streamer->evicted += 1;
+        }
+
+        texture->resident_level = request.level;
+    }
+}
+
+// every draw asks for the level whose texels come closest to one per pixel across its bounds
+void streaming_feedback(Renderer* renderer, DrawContext* context)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+        streamer->textures[i].frame_level = STREAMING_NO_LEVEL;
+
+    for (int i = 0; i < context->n; ++i)
+    {
+        RenderObject* object = &context->opaque_surfaces[i];
+
+        StreamedMaterial key = { .instance = object->material };
+        StreamedMaterial* material = bsearch(&key, streamer->materials, streamer->n_materials,
+                sizeof(StreamedMaterial), streaming_material_compare);
+        if (material == NULL)
+            continue;
+
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            if (material->textures[j] == STREAMING_NO_TEXTURE)
+                continue;
+
+            StreamedTexture* texture = &streamer->textures[material->textures[j]];
+            uint32_t level = streaming_level_for(texture, object->screen_size);
+
+            if (texture->frame_level == STREAMING_NO_LEVEL || level < texture->frame_level)
+                texture->frame_level = level;
+            texture->last_needed_frame = renderer->frame;
+        }
+    }
+
+    // a texture keeps what it had for a while after it goes out of view, so turning around
+    // doesn't stream everything in again
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+    {
+        StreamedTexture* texture = &streamer->textures[i];
+
+        if (texture->frame_level != STREAMING_NO_LEVEL)
+            texture->wanted_level = texture->frame_level;
+        else if (renderer->frame - texture->last_needed_frame > STREAMING_KEEP_FRAMES)
+            texture->wanted_level = texture->tail_level;
+    }
+}
+
+// requests count against the budget as soon as they're made, so an eviction on its way frees its
+// share straight away and a stream-in claims its share up front
+void streaming_schedule(Renderer* renderer)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    VkDeviceSize committed = 0;
+    streamer->resident_bytes = 0;
+    streamer->wanted_bytes = 0;
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+    {
+        StreamedTexture* texture = &streamer->textures[i];
+        uint32_t committed_level = texture->pending_level != STREAMING_NO_LEVEL
+            ? texture->pending_level : texture->resident_level;
+
+        committed += streaming_level_size(texture, committed_level);
+        streamer->resident_bytes += streaming_level_size(texture, texture->resident_level);
+        streamer->wanted_bytes += streaming_level_size(texture, texture->wanted_level);
+    }
+
+    while (streamer->n_in_flight < STREAMING_REQUESTS_IN_FLIGHT)
+    {
+        // with the budget lowered, anything above its tail can lose a level
+        if (committed > streamer->budget)
+        {
+            StreamedTexture* victim = streaming_pick_eviction(streamer, true);
+            if (victim == NULL)
+                break;
+
+            uint32_t level = victim->wanted_level > victim->resident_level
+                ? victim->wanted_level : victim->resident_level + 1;
+            committed -= streaming_level_size(victim, victim->resident_level)
+                - streaming_level_size(victim, level);
+            streaming_request(renderer, victim, level);
+            continue;
+        }
+
+        StreamedTexture* texture = streaming_pick_stream_in(streamer);
+        if (texture == NULL)
+            break;
+
+        // settles for fewer levels than it wants when that's all the room there is
+        VkDeviceSize resident_size = streaming_level_size(texture, texture->resident_level);
+        uint32_t level = texture->wanted_level;
+        while (level < texture->resident_level
+                && committed + streaming_level_size(texture, level) - resident_size
+                    > streamer->budget)
+            level++;
+
+        if (level < texture->resident_level)
+        {
+            committed += streaming_level_size(texture, level) - resident_size;
+            streaming_request(renderer, texture, level);
+            continue;
+        }
+
+        // no room, so levels nothing needs right now make some. the texture tries again once
+        // they're gone
+        StreamedTexture* victim = streaming_pick_eviction(streamer, false);
+        if (victim == NULL || victim->last_needed_frame >= texture->last_needed_frame)
+            break;
+
+        committed -= streaming_level_size(victim, victim->resident_level)
+            - streaming_level_size(victim, victim->wanted_level);
+        streaming_request(renderer, victim, victim->wanted_level);
+    }
+}
+
+void streaming_request(Renderer* renderer, StreamedTexture* texture, uint32_t level)
+{
+    TextureStreamer* streamer = &renderer->streaming;
+
+    texture->pending_level = level;
+    streamer->n_in_flight += 1;
+
+    pthread_mutex_lock(&streamer->mutex);
+
+    if (streamer->n_requests == streamer->request_capacity)
+    {
+        streamer->request_capacity = streamer->request_capacity == 0 ? 16
+            : streamer->request_capacity * 2;
+        streamer->requests = realloc(streamer->requests,
+                sizeof(StreamRequest) * streamer->request_capacity);
+    }
+
+    // a stream-in only stages what's finer than it has, an eviction has it all already
+    uint32_t n_staged = level < texture->resident_level ? texture->resident_level - level : 0;
+
+    streamer->requests[streamer->n_requests++] = (StreamRequest) {
+        .texture_id = texture->id,
+        .level = level,
+        .levels = streaming_levels(&texture->source.texture, level),
+        .n_staged = n_staged,
+        .path = texture->source.path,
+    };
+
+    pthread_cond_signal(&streamer->work_available);
+    pthread_mutex_unlock(&streamer->mutex);
+}
+
+// the most recently needed texture that is missing levels, the one missing the most of them first
+StreamedTexture* streaming_pick_stream_in(TextureStreamer* streamer)
+{
+    StreamedTexture* best = NULL;
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+    {
+        StreamedTexture* texture = &streamer->textures[i];
+        if (texture->pending_level != STREAMING_NO_LEVEL
+                || texture->wanted_level >= texture->resident_level)
+            continue;
+
+        if (best == NULL || texture->last_needed_frame > best->last_needed_frame
+                || (texture->last_needed_frame == best->last_needed_frame
+                    && texture->resident_level - texture->wanted_level
+                        > best->resident_level - best->wanted_level))
+            best = texture;
+    }
+
+    return best;
+}
+
+// the least recently needed texture holding levels it doesn't want. over budget, ones holding
+// exactly what they want count too as long as they're above their tail
+StreamedTexture* streaming_pick_eviction(TextureStreamer* streamer, bool over_budget)
+{
+    StreamedTexture* victim = NULL;
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+    {
+        StreamedTexture* texture = &streamer->textures[i];
+        if (texture->pending_level != STREAMING_NO_LEVEL)
+            continue;
+
+        bool excess = texture->resident_level < texture->wanted_level;
+        bool above_tail = texture->resident_level < texture->tail_level;
+        if (!excess && !(over_budget && above_tail))
+            continue;
+
+        if (victim == NULL || texture->last_needed_frame < victim->last_needed_frame)
+            victim = texture;
+    }
+
+    return victim;
+}
+
+uint32_t streaming_texture_index(TextureStreamer* streamer, uint64_t id)
+{
+    for (uint32_t i = 0; i < streamer->n_textures; ++i)
+    {
+        if (streamer->textures[i].id == id)
+            return i;
+    }
+
+    return STREAMING_NO_TEXTURE;
+}
+
+uint32_t streaming_image_index(TextureStreamer* streamer, Image* image)
+{
+    for (uint32_t i = 0; image != NULL && i < streamer->n_textures; ++i)
+    {
+        if (streamer->textures[i].image == image)
+            return i;
+    }
+
+    return STREAMING_NO_TEXTURE;
+}
+
+// what the image takes up while it holds level and everything below it
+VkDeviceSize streaming_level_size(const StreamedTexture* texture, uint32_t level)
+{
+    const TextureData* source = &texture->source.texture;
+
+    return texture_chain_size(source->format, source->size.width, source->size.height,
+            source->n_levels) - texture_chain_size(source->format, source->size.width,
+            source->size.height, level);
+}
+
+uint32_t streaming_level_for(const StreamedTexture* texture, float screen_size)
+{
+    const TextureData* source = &texture->source.texture;
+    uint32_t largest = source->size.width > source->size.height ? source->size.width
+        : source->size.height;
+
+    if (screen_size < 1)
+        return texture->tail_level;
+
+    float level = floorf(log2f(largest / screen_size));
+    if (level <= 0)
+        return 0;
+    if (level >= texture->tail_level)
+        return texture->tail_level;
+
+    return (uint32_t) level;
+}
+
+int streaming_material_compare(const void* a, const void* b)
+{
+    uintptr_t instance_a = (uintptr_t) ((const StreamedMaterial*) a)->instance;
+    uintptr_t instance_b = (uintptr_t) ((const StreamedMaterial*) b)->instance;
+
+    return (instance_a > instance_b) - (instance_a < instance_b);
+}
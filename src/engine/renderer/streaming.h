@@ -0,0 +1,51 @@
+#pragma once
+
+#include "renderer.h"
+
+// what streamed textures start out allowed, the memory panel can change it
+#define STREAMING_DEFAULT_BUDGET (256 << 20)
+// levels this size and smaller are loaded with the texture and never leave
+#define STREAMING_TAIL_SIZE 64
+// a texture no draw has needed for this long only wants its tail
+#define STREAMING_KEEP_FRAMES 120
+#define STREAMING_REQUESTS_IN_FLIGHT 4
+#define STREAMING_NO_LEVEL UINT32_MAX
+#define STREAMING_NO_TEXTURE UINT32_MAX
+
+void streaming_initialise(Renderer* renderer);
+// the device has to be idle, staging that is still going gets thrown away
+void streaming_cleanup(Renderer* renderer);
+
+// main thread, after the frame's fence wait and before its uploads are flushed. swaps in what the
+// worker finished, reads what the draws need and asks for more or fewer levels to match
+void streaming_update(Renderer* renderer, DrawContext* context);
+
+// main thread. the streamer takes source, image has to hold its levels from the tail down
+void streaming_track_image(Renderer* renderer, Image* image, StreamSource source);
+void streaming_untrack_images(Renderer* renderer, Image* images, uint32_t n);
+// materials sampling no streamed texture are ignored
+void streaming_track_material(Renderer* renderer, MaterialInstance* instance, Image* colour_image,
+        Image* metal_rough_image);
+void streaming_untrack_materials(Renderer* renderer, MaterialInstance* instances, uint32_t n);
+
+// first level that is always resident, 0 when the texture is too small to be worth streaming
+uint32_t streaming_tail_level(const TextureData* source);
+// the part of a chain from level on
+TextureData streaming_levels(const TextureData* source, uint32_t level);
+// frees what a source holds, for the ones that never get tracked
+void streaming_source_free(StreamSource* source);
+
+// internal
+void* streaming_worker(void* arg);
+Image streaming_stage(Renderer* renderer, StreamRequest* request);
+void streaming_poll(Renderer* renderer);
+void streaming_feedback(Renderer* renderer, DrawContext* context);
+void streaming_schedule(Renderer* renderer);
+void streaming_request(Renderer* renderer, StreamedTexture* texture, uint32_t level);
+StreamedTexture* streaming_pick_stream_in(TextureStreamer* streamer);
+StreamedTexture* streaming_pick_eviction(TextureStreamer* streamer, bool over_budget);
+uint32_t streaming_texture_index(TextureStreamer* streamer, uint64_t id);
+uint32_t streaming_image_index(TextureStreamer* streamer, Image* image);
+VkDeviceSize streaming_level_size(const StreamedTexture* texture, uint32_t level);
+uint32_t streaming_level_for(const StreamedTexture* texture, float screen_size);
+int streaming_material_compare(const void* a, const void* b);
@@ -8,20 +8,12 @@ void swapchain_initialise(Renderer* renderer, GLFWwindow* window)
 {
     create_swap_chain(renderer, window);
     create_image_views(renderer);
-    create_drawing_image(renderer);
-    create_depth_image(renderer);
 }
 
 void swapchain_cleanup(Renderer* renderer)
 {
     Swapchain* swapchain = &renderer->swapchain;
 
-    vkDestroyImageView(renderer->device, renderer->draw_image.view, NULL);
-    vmaDestroyImage(renderer->allocator, renderer->draw_image.image, renderer->draw_image.allocation);
-    vkDestroyImageView(renderer->device, renderer->depth_image.view, NULL);
-    vmaDestroyImage(renderer->allocator, renderer->depth_image.image, renderer->depth_image.allocation);
-
-
     for (int i = 0; i < swapchain->image_count; ++i)
         vkDestroyImageView(renderer->device, swapchain->image_views[i], NULL);
 
@@ -128,6 +120,8 @@ void swapchain_resize(Renderer* renderer, Window* window)
     window->height = h;
 
     create_swap_chain(renderer, window->window);
+    // the render graph remakes its images at the new size the next frame
+    create_image_views(renderer);
 
     renderer->resize_requested = false;
 }
@@ -255,65 +249,3 @@ void create_image_views(Renderer* renderer)
         );
     }
 }
-
-void create_drawing_image(Renderer* renderer)
-{
-    Swapchain* sc = &renderer->swapchain;
-    Image* draw_image = &renderer->draw_image;
-
-    VkExtent3D extent = {
-        .width = sc->extent.width,
-        .height = sc->extent.height,
-        .depth = 1,
-    };
-
-    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
-
-    draw_image->format = format;
-    draw_image->extent = extent;
-
-    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-    VkImageCreateInfo image_create_info = get_image_create_info(format, usage, extent);
-
-    VmaAllocationCreateInfo image_alloc_info = {
-        .usage = VMA_MEMORY_USAGE_GPU_ONLY,
-        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    };
-
-    vmaCreateImage(renderer->allocator, &image_create_info, &image_alloc_info,
-            &draw_image->image, &draw_image->allocation, NULL);
-
-    VkImageViewCreateInfo image_view_info = get_image_view_create_info(format,
-            draw_image->image, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    VK_CHECK(vkCreateImageView(renderer->device, &image_view_info, NULL, &draw_image->view));
-
-}
-
-void create_depth_image(Renderer* renderer)
-{
-    renderer->depth_image.format = VK_FORMAT_D32_SFLOAT;
-    renderer->depth_image.extent = renderer->draw_image.extent;
-
-    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-
-    VkImageCreateInfo depth_img_info = get_image_create_info(renderer->depth_image.format, usage,
-            renderer->depth_image.extent);
-
-    VmaAllocationCreateInfo image_alloc_info = {
-        .usage = VMA_MEMORY_USAGE_GPU_ONLY,
-        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    };
-
-    vmaCreateImage(renderer->allocator, &depth_img_info, &image_alloc_info, &renderer->depth_image.image,
-            &renderer->depth_image.allocation, NULL);
-
-    VkImageViewCreateInfo image_view_info = get_image_view_create_info(renderer->depth_image.format,
-            renderer->depth_image.image, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    VK_CHECK(vkCreateImageView(renderer->device, &image_view_info, NULL, &renderer->depth_image.view));
-}
-
@@ -25,7 +25,5 @@ void query_swap_chain_support(Renderer* renderer, SwapChainSupportDetails* detai
 VkSurfaceFormatKHR choose_swap_surface_format(SwapChainSupportDetails* details);
 VkPresentModeKHR choose_swap_present_mode(SwapChainSupportDetails* details);
 VkExtent2D choose_swap_extent(GLFWwindow* window, VkSurfaceCapabilitiesKHR* capabilities);
-void create_drawing_image(Renderer* renderer);
-void create_depth_image(Renderer* renderer);
 void swapchain_resize(Renderer* renderer, Window* window);
 
@@ -0,0 +1,588 @@
+#include "uploads.h"
+#include "barriers.h"
+#include "buffers.h"
+#include "image.h"
+#include "../scene/texture_format.h"
+#include "../utils.h"
+
+void staging_ring_initialise(StagingRing* ring, VmaAllocator allocator, size_t size)
+{
+    *ring = (StagingRing) {
+        .buffer = buffer_create(allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING),
+        .size = size,
+    };
+
+    // coherent and mapped for the ring's whole life, so filling it is just a memcpy
+    VK_CHECK(vmaMapMemory(allocator, ring->buffer.allocation, (void**) &ring->mapped));
+
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->space_freed, NULL);
+}
+
+void staging_ring_cleanup(StagingRing* ring, VmaAllocator allocator)
+{
+    if (ring->n_regions != 0)
+        LOG_W("Staging ring still had %d regions in use\n", ring->n_regions);
+
+    pthread_cond_destroy(&ring->space_freed);
+    pthread_mutex_destroy(&ring->mutex);
+
+    vmaUnmapMemory(allocator, ring->buffer.allocation);
+    buffer_destroy(&ring->buffer, allocator);
+    free(ring->regions);
+}
+
+bool staging_ring_allocate(StagingRing* ring, size_t size, bool wait, size_t* out_offset)
+{
+    size = upload_batch_aligned(size);
+    if (size > ring->size)
+        return false;
+
+    pthread_mutex_lock(&ring->mutex);
+
+    bool found;
+    while (!(found = staging_ring_find_space(ring, size, out_offset)) && wait && !ring->closed)
+        pthread_cond_wait(&ring->space_freed, &ring->mutex);
+
+    if (found)
+    {
+        if (ring->n_regions == ring->region_capacity)
+        {
+            ring->region_capacity = ring->region_capacity == 0 ? 16 : ring->region_capacity * 2;
+            ring->regions = realloc(ring->regions, sizeof(StagingRegion) * ring->region_capacity);
+        }
+
+        ring->regions[ring->n_regions++] = (StagingRegion) { *out_offset, size, false };
+    }
+
+    pthread_mutex_unlock(&ring->mutex);
+
+    return found;
+}
+
+void staging_ring_free(StagingRing* ring, size_t offset)
+{
+    pthread_mutex_lock(&ring->mutex);
+
+    for (uint32_t i = 0; i < ring->n_regions; ++i)
+    {
+        if (ring->regions[i].offset == offset)
+        {
+            ring->regions[i].retired = true;
+            break;
+        }
+    }
+
+    uint32_t n_retired = 0;
+    while (n_retired < ring->n_regions && ring->regions[n_retired].retired)
+        n_retired += 1;
+
+    if (n_retired != 0)
+    {
+        ring->n_regions -= n_retired;
+        memmove(ring->regions, ring->regions + n_retired, sizeof(StagingRegion) * ring->n_regions);
+        pthread_cond_broadcast(&ring->space_freed);
+    }
+
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+void staging_ring_close(StagingRing* ring)
+{
+    pthread_mutex_lock(&ring->mutex);
+    ring->closed = true;
+    pthread_cond_broadcast(&ring->space_freed);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+// the free space is after the newest region and, unless that one has wrapped, before the oldest
+bool staging_ring_find_space(StagingRing* ring, size_t size, size_t* out_offset)
+{
+    if (ring->n_regions == 0)
+    {
+        *out_offset = 0;
+        return true;
+    }
+
+    StagingRegion* oldest = &ring->regions[0];
+    StagingRegion* newest = &ring->regions[ring->n_regions - 1];
+    size_t head = newest->offset + newest->size;
+
+    if (newest->offset < oldest->offset)
+    {
+        *out_offset = head;
+        return oldest->offset - head >= size;
+    }
+
+    if (ring->size - head >= size)
+    {
+        *out_offset = head;
+        return true;
+    }
+
+    *out_offset = 0;
+    return oldest->offset >= size;
+}
+
+UploadBatch upload_batch_create(Renderer* renderer, size_t size, bool wait)
+{
+    UploadBatch batch = {0};
+    if (size == 0)
+        return batch;
+
+    batch.size = size;
+
+    if (staging_ring_allocate(&renderer->staging, size, wait, &batch.base))
+    {
+        batch.staging = renderer->staging.buffer;
+        batch.mapped = renderer->staging.mapped;
+        return batch;
+    }
+
+    LOG_V("Staging ring has no room for %.1lf MB, giving the batch its own buffer\n", size / 1e6);
+
+    batch.base = 0;
+    batch.staging = buffer_create(renderer->allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+    batch.owns_staging = true;
+
+    VK_CHECK(vmaMapMemory(renderer->allocator, batch.staging.allocation, (void**) &batch.mapped));
+
+    return batch;
+}
+
+void upload_batch_destroy(UploadBatch* batch, Renderer* renderer)
+{
+    if (batch->owns_staging)
+    {
+        vmaUnmapMemory(renderer->allocator, batch->staging.allocation);
+        buffer_destroy(&batch->staging, renderer->allocator);
+    }
+    else if (batch->size != 0)
+    {
+        staging_ring_free(&renderer->staging, batch->base);
+    }
+
+    free(batch->buffers);
+    free(batch->images);
+    *batch = (UploadBatch) {0};
+}
+
+size_t upload_batch_aligned(size_t size)
+{
+    return (size + UPLOAD_ALIGNMENT - 1) & ~(size_t) (UPLOAD_ALIGNMENT - 1);
+}
+
+void upload_batch_buffer(UploadBatch* batch, VkBuffer dst, VkDeviceSize dst_offset, const void* data,
+        size_t size)
+{
+    if (size == 0)
+        return;
+
+    size_t offset = upload_batch_take(batch, size);
+    memcpy(batch->mapped + offset, data, size);
+
+    if (batch->n_buffers == batch->buffer_capacity)
+    {
+        batch->buffer_capacity = batch->buffer_capacity == 0 ? 8 : batch->buffer_capacity * 2;
+        batch->buffers = realloc(batch->buffers, sizeof(BufferUpload) * batch->buffer_capacity);
+    }
+
+    batch->buffers[batch->n_buffers++] = (BufferUpload) { dst, dst_offset, offset, size };
+}
+
+void upload_batch_image(UploadBatch* batch, VkImage dst, const void* data, VkFormat format,
+        VkExtent3D extent, uint32_t n_levels, uint32_t mip_levels)
+{
+    size_t size = texture_chain_size(format, extent.width, extent.height, n_levels) * extent.depth;
+
+    size_t offset = upload_batch_take(batch, size);
+    memcpy(batch->mapped + offset, data, size);
+
+    upload_batch_add_image(batch, (ImageUpload) { dst, offset, format, extent, n_levels,
+            mip_levels });
+}
+
+void upload_batch_image_levels(UploadBatch* batch, VkImage dst, const uint8_t* const* levels,
+        VkFormat format, VkExtent3D extent, uint32_t n_levels, uint32_t mip_levels)
+{
+    size_t size = texture_chain_size(format, extent.width, extent.height, n_levels);
+
+    // packed the same as a whole chain would be
+    size_t offset = upload_batch_take(batch, size);
+    size_t level_offset = offset;
+    for (uint32_t level = 0; level < n_levels; ++level)
+    {
+        size_t level_size = texture_level_size(format, texture_mip_dimension(extent.width, level),
+                texture_mip_dimension(extent.height, level));
+        memcpy(batch->mapped + level_offset, levels[level], level_size);
+        level_offset += level_size;
+    }
+
+    upload_batch_add_image(batch, (ImageUpload) { dst, offset, format, extent, n_levels,
+            mip_levels });
+}
+
+void upload_batch_record(UploadBatch* batch, VkCommandBuffer cmd_buf, Renderer* renderer)
+{
+    upload_batch_record_copies(batch, cmd_buf, renderer);
+    image_generate_mips(renderer, cmd_buf, batch->images, batch->n_images);
+    upload_batch_record_level_copies(batch, cmd_buf, renderer);
+
+    // one barrier for everything the batch wrote, images with more levels already went to sampled
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        ImageUpload* upload = &batch->images[i];
+        if (upload->mip_levels > upload->n_levels)
+            continue;
+
+        VkImageSubresourceRange range = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .layerCount = VK_REMAINING_ARRAY_LAYERS,
+        };
+        ImageState state = barrier_state(IMAGE_ACCESS_TRANSFER_DST);
+        barrier_image_range(&barriers, upload->dst, range, &state, IMAGE_ACCESS_SAMPLED, false);
+    }
+
+    // indices get read as indices and by the culling pass, vertices and meshlets by address
+    if (batch->n_buffers != 0)
+        barrier_memory(&barriers, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                UPLOAD_CONSUMER_STAGES, VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT);
+
+    barrier_flush(&barriers);
+}
+
+// resources are exclusive to one family, so each one gets a matching release and acquire. buffers
+// only hand over the range that was written, arenas keep being read everywhere else
+void upload_batch_record_transfer(UploadBatch* batch, VkCommandBuffer transfer_cmd_buf,
+        VkCommandBuffer graphics_cmd_buf, Renderer* renderer)
+{
+    upload_batch_record_copies(batch, transfer_cmd_buf, renderer);
+
+    VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = VK_REMAINING_MIP_LEVELS,
+        .layerCount = VK_REMAINING_ARRAY_LAYERS,
+    };
+
+    // the release only needs the copies done, its destination half is ignored
+    BarrierBatch release = barrier_batch_transfer(renderer, transfer_cmd_buf,
+            renderer->transfer_family, renderer->graphics_family);
+
+    for (uint32_t i = 0; i < batch->n_buffers; ++i)
+    {
+        BufferUpload* upload = &batch->buffers[i];
+        barrier_buffer(&release, upload->dst, upload->dst_offset, upload->size,
+                VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+    }
+
+    // blits and copies out of other images need the graphics queue, images with more levels to
+    // fill go over still in transfer dst
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        bool mipped = batch->images[i].mip_levels > batch->images[i].n_levels;
+        ImageState state = barrier_state(IMAGE_ACCESS_TRANSFER_DST);
+        barrier_image_range(&release, batch->images[i].dst, range, &state,
+                mipped ? IMAGE_ACCESS_TRANSFER_DST : IMAGE_ACCESS_SAMPLED, false);
+    }
+
+    barrier_flush(&release);
+
+    // the acquire is the same barriers with the access flipped, its source half comes from the
+    // semaphore wait on the same stages
+    BarrierBatch acquire = barrier_batch_transfer(renderer, graphics_cmd_buf,
+            renderer->transfer_family, renderer->graphics_family);
+
+    for (uint32_t i = 0; i < batch->n_buffers; ++i)
+    {
+        BufferUpload* upload = &batch->buffers[i];
+        barrier_buffer(&acquire, upload->dst, upload->dst_offset, upload->size,
+                UPLOAD_CONSUMER_STAGES, VK_ACCESS_2_NONE,
+                UPLOAD_CONSUMER_STAGES, VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT);
+    }
+
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        bool mipped = batch->images[i].mip_levels > batch->images[i].n_levels;
+        ImageState state = {
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, UPLOAD_CONSUMER_STAGES, VK_ACCESS_2_NONE
+        };
+        barrier_image_range(&acquire, batch->images[i].dst, range, &state,
+                mipped ? IMAGE_ACCESS_TRANSFER_DST : IMAGE_ACCESS_SAMPLED, false);
+    }
+
+    barrier_flush(&acquire);
+
+    image_generate_mips(renderer, graphics_cmd_buf, batch->images, batch->n_images);
+    upload_batch_record_level_copies(batch, graphics_cmd_buf, renderer);
+}
+
+void upload_batch_submit(Renderer* renderer, UploadBatch* batch)
+{
+    if (batch->n_buffers != 0 || batch->n_images != 0)
+    {
+        immediate_begin(renderer);
+        upload_batch_record(batch, renderer->imm_cmd_buf, renderer);
+        immediate_end(renderer);
+    }
+
+    upload_batch_destroy(batch, renderer);
+}
+
+void uploads_queue(Renderer* renderer, UploadBatch batch)
+{
+    if (renderer->n_pending_uploads == renderer->pending_upload_capacity)
+    {
+        renderer->pending_upload_capacity = renderer->pending_upload_capacity == 0 ? 4
+            : renderer->pending_upload_capacity * 2;
+        renderer->pending_uploads = realloc(renderer->pending_uploads,
+                sizeof(UploadBatch) * renderer->pending_upload_capacity);
+    }
+
+    renderer->pending_uploads[renderer->n_pending_uploads++] = batch;
+}
+
+// only called once the frame's fence has been waited on, which also covers the transfer submit
+// the frame waited on last time round
+bool uploads_flush(Renderer* renderer, VkCommandBuffer cmd_buf)
+{
+    int frame = renderer->frame_in_flight;
+
+    uploads_release(renderer, frame);
+
+    if (renderer->n_pending_uploads == 0)
+        return false;
+
+    bool transfer_queue = renderer->transfer_family != renderer->graphics_family;
+
+    if (transfer_queue)
+    {
+        VkCommandBuffer transfer_cmd_buf = renderer->transfer_command_buffers[frame];
+        VK_CHECK(vkResetCommandBuffer(transfer_cmd_buf, 0));
+
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+        VK_CHECK(vkBeginCommandBuffer(transfer_cmd_buf, &begin_info));
+
+        for (uint32_t i = 0; i < renderer->n_pending_uploads; ++i)
+            upload_batch_record_transfer(&renderer->pending_uploads[i], transfer_cmd_buf, cmd_buf, renderer);
+
+        VK_CHECK(vkEndCommandBuffer(transfer_cmd_buf));
+
+        // goes ahead of the frame's own submit, which waits on the semaphore
+        VkSubmitInfo submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &transfer_cmd_buf,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &renderer->semaphores_transfer[frame],
+        };
+
+        VK_CHECK(vkQueueSubmit(renderer->transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+    }
+    else
+    {
+        for (uint32_t i = 0; i < renderer->n_pending_uploads; ++i)
+            upload_batch_record(&renderer->pending_uploads[i], cmd_buf, renderer);
+    }
+
+    // the pending list becomes this frame's, a fresh one gets allocated on the next queue
+    renderer->frame_uploads[frame] = renderer->pending_uploads;
+    renderer->n_frame_uploads[frame] = renderer->n_pending_uploads;
+
+    renderer->pending_uploads = NULL;
+    renderer->n_pending_uploads = 0;
+    renderer->pending_upload_capacity = 0;
+
+    return transfer_queue;
+}
+
+// the device has to be idle
+void uploads_cleanup(Renderer* renderer)
+{
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        uploads_release(renderer, i);
+
+    for (uint32_t i = 0; i < renderer->n_pending_uploads; ++i)
+        upload_batch_destroy(&renderer->pending_uploads[i], renderer);
+    free(renderer->pending_uploads);
+}
+
+void uploads_release(Renderer* renderer, int frame)
+{
+    for (uint32_t i = 0; i < renderer->n_frame_uploads[frame]; ++i)
+        upload_batch_destroy(&renderer->frame_uploads[frame][i], renderer);
+
+    free(renderer->frame_uploads[frame]);
+    renderer->frame_uploads[frame] = NULL;
+    renderer->n_frame_uploads[frame] = 0;
+}
+
+void upload_batch_add_image(UploadBatch* batch, ImageUpload upload)
+{
+    if (batch->n_images == batch->image_capacity)
+    {
+        batch->image_capacity = batch->image_capacity == 0 ? 8 : batch->image_capacity * 2;
+        batch->images = realloc(batch->images, sizeof(ImageUpload) * batch->image_capacity);
+    }
+
+    batch->images[batch->n_images++] = upload;
+}
+
+// hands out the next aligned range of the batch, as an offset into staging
+size_t upload_batch_take(UploadBatch* batch, size_t size)
+{
+    size_t offset = batch->used;
+    if (offset + size > batch->size)
+        FATAL("Upload batch overflow, %zu bytes into %zu of %zu\n", size, offset, batch->size);
+
+    batch->used = offset + upload_batch_aligned(size);
+
+    return batch->base + offset;
+}
+
+// buffer copies, and images moved to transfer dst and filled, they are left in that layout
+void upload_batch_record_copies(UploadBatch* batch, VkCommandBuffer cmd_buf, Renderer* renderer)
+{
+    for (uint32_t i = 0; i < batch->n_buffers; ++i)
+    {
+        BufferUpload* upload = &batch->buffers[i];
+
+        VkBufferCopy copy = {
+            .srcOffset = upload->src_offset,
+            .dstOffset = upload->dst_offset,
+            .size = upload->size,
+        };
+
+        vkCmdCopyBuffer(cmd_buf, batch->staging.buffer, upload->dst, 1, &copy);
+    }
+
+    // the images are all new, nothing they held needs waiting on
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        VkImageSubresourceRange range = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .layerCount = VK_REMAINING_ARRAY_LAYERS,
+        };
+        ImageState state = {0};
+        barrier_image_range(&barriers, batch->images[i].dst, range, &state,
+                IMAGE_ACCESS_TRANSFER_DST, true);
+    }
+    barrier_flush(&barriers);
+
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        ImageUpload* upload = &batch->images[i];
+
+        // levels are tightly packed, every level size is a whole number of texels or blocks so
+        // each one still starts aligned
+        VkBufferImageCopy regions[UPLOAD_MAX_LEVELS];
+        uint32_t n_regions = upload->n_levels < UPLOAD_MAX_LEVELS ? upload->n_levels
+            : UPLOAD_MAX_LEVELS;
+        VkDeviceSize offset = upload->src_offset;
+        for (uint32_t level = 0; level < n_regions; ++level)
+        {
+            VkExtent3D extent = {
+                texture_mip_dimension(upload->extent.width, level),
+                texture_mip_dimension(upload->extent.height, level),
+                texture_mip_dimension(upload->extent.depth, level),
+            };
+
+            regions[level] = (VkBufferImageCopy) {
+                .bufferOffset = offset,
+                .imageExtent = extent,
+                .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            };
+
+            offset += texture_level_size(upload->format, extent.width, extent.height) * extent.depth;
+        }
+
+        // an image with every level copied out of another has nothing staged
+        if (n_regions != 0)
+            vkCmdCopyBufferToImage(cmd_buf, batch->staging.buffer, upload->dst,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, n_regions, regions);
+    }
+}
+
+// the levels of images with a src, once the staged ones are in. the sources are retired images
+// nothing samples after this, so they're left in transfer src
+void upload_batch_record_level_copies(UploadBatch* batch, VkCommandBuffer cmd_buf,
+        Renderer* renderer)
+{
+    BarrierBatch barriers = barrier_batch(renderer, cmd_buf);
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        ImageUpload* upload = &batch->images[i];
+        if (upload->src == VK_NULL_HANDLE)
+            continue;
+
+        VkImageSubresourceRange range = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = upload->src_level,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .layerCount = VK_REMAINING_ARRAY_LAYERS,
+        };
+        ImageState state = barrier_state(IMAGE_ACCESS_SAMPLED);
+        barrier_image_range(&barriers, upload->src, range, &state, IMAGE_ACCESS_TRANSFER_SRC,
+                false);
+    }
+    barrier_flush(&barriers);
+
+    for (uint32_t i = 0; i < batch->n_images; ++i)
+    {
+        ImageUpload* upload = &batch->images[i];
+        if (upload->src == VK_NULL_HANDLE)
+            continue;
+
+        VkImageCopy regions[UPLOAD_MAX_LEVELS];
+        uint32_t n_regions = 0;
+        for (uint32_t level = upload->n_levels; level < upload->mip_levels
+                && n_regions < UPLOAD_MAX_LEVELS; ++level)
+        {
+            regions[n_regions++] = (VkImageCopy) {
+                .srcSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = upload->src_level + level - upload->n_levels,
+                    .layerCount = 1,
+                },
+                .dstSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .layerCount = 1,
+                },
+                .extent = {
+                    texture_mip_dimension(upload->extent.width, level),
+                    texture_mip_dimension(upload->extent.height, level),
+                    texture_mip_dimension(upload->extent.depth, level),
+                },
+            };
+        }
+
+        vkCmdCopyImage(cmd_buf, upload->src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload->dst,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, n_regions, regions);
+
+        // the staged levels and the copied ones go over together
+        VkImageSubresourceRange range = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .layerCount = VK_REMAINING_ARRAY_LAYERS,
+        };
+        ImageState state = barrier_state(IMAGE_ACCESS_TRANSFER_DST);
+        barrier_image_range(&barriers, upload->dst, range, &state, IMAGE_ACCESS_SAMPLED, false);
+    }
+
+    barrier_flush(&barriers);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "renderer.h"
+
+// every copy starts on this, so image texels and buffer offsets always line up
+#define UPLOAD_ALIGNMENT 16
+// enough for a few scenes in flight at once, bigger batches get a staging buffer of their own
+#define STAGING_RING_BYTES (64 << 20)
+// deeper than any chain a 16k image has
+#define UPLOAD_MAX_LEVELS 16
+// everything that reads uploaded meshes and textures, mip generation blits included
+#define UPLOAD_CONSUMER_STAGES (VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT \
+        | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT \
+        | VK_PIPELINE_STAGE_TRANSFER_BIT)
+
+void staging_ring_initialise(StagingRing* ring, VmaAllocator allocator, size_t size);
+// the device has to be idle
+void staging_ring_cleanup(StagingRing* ring, VmaAllocator allocator);
+// with wait set this blocks until enough older regions retire, false when the size can never fit
+// or the ring has been closed
+bool staging_ring_allocate(StagingRing* ring, size_t size, bool wait, size_t* out_offset);
+// any order, the space comes back once every region before it has retired too
+void staging_ring_free(StagingRing* ring, size_t offset);
+// wakes anything waiting for space and makes later waits give up
+void staging_ring_close(StagingRing* ring);
+
+// a size of 0 makes an empty batch. only wait when something else is going to retire regions,
+// the main thread does that itself and must never wait
+UploadBatch upload_batch_create(Renderer* renderer, size_t size, bool wait);
+void upload_batch_destroy(UploadBatch* batch, Renderer* renderer);
+// how much of a batch's staging a copy of this size takes up
+size_t upload_batch_aligned(size_t size);
+
+// safe from any thread, as long as each batch stays on one
+void upload_batch_buffer(UploadBatch* batch, VkBuffer dst, VkDeviceSize dst_offset, const void* data,
+        size_t size);
+// n_levels back to back from the top, in any format texture_format.h knows. when the image has
+// more mip_levels than that, which needs a single blittable level, the rest get blitted down
+void upload_batch_image(UploadBatch* batch, VkImage dst, const void* data, VkFormat format,
+        VkExtent3D extent, uint32_t n_levels, uint32_t mip_levels);
+// the same with each level wherever it is, they're packed together in staging
+void upload_batch_image_levels(UploadBatch* batch, VkImage dst, const uint8_t* const* levels,
+        VkFormat format, VkExtent3D extent, uint32_t n_levels, uint32_t mip_levels);
+
+// the copies, then a barrier so everything a frame reads them with sees them
+void upload_batch_record(UploadBatch* batch, VkCommandBuffer cmd_buf, Renderer* renderer);
+// the copies on the transfer queue, releasing everything to the graphics family, which acquires
+// it in graphics_cmd_buf. that has to be submitted after waiting on the transfer
+void upload_batch_record_transfer(UploadBatch* batch, VkCommandBuffer transfer_cmd_buf,
+        VkCommandBuffer graphics_cmd_buf, Renderer* renderer);
+// records onto the immediate command buffer, waits, and destroys the batch
+void upload_batch_submit(Renderer* renderer, UploadBatch* batch);
+
+// main thread only, the renderer owns the batch from here and records it ahead of the next frame
+void uploads_queue(Renderer* renderer, UploadBatch batch);
+// frees what this frame slot recorded last time round and records what is pending. true when that
+// went on the transfer queue and the frame's submit has to wait on semaphores_transfer
+bool uploads_flush(Renderer* renderer, VkCommandBuffer cmd_buf);
+void uploads_cleanup(Renderer* renderer);
+
+// internal
+bool staging_ring_find_space(StagingRing* ring, size_t size, size_t* out_offset);
+void upload_batch_add_image(UploadBatch* batch, ImageUpload upload);
+size_t upload_batch_take(UploadBatch* batch, size_t size);
+void upload_batch_record_copies(UploadBatch* batch, VkCommandBuffer cmd_buf, Renderer* renderer);
+void upload_batch_record_level_copies(UploadBatch* batch, VkCommandBuffer cmd_buf,
+        Renderer* renderer);
+void uploads_release(Renderer* renderer, int frame);
@@ -0,0 +1,319 @@
+#include "asset_loader.h"
+#include "loader.h"
+#include "cooked.h"
+#include "image_decode.h"
+#include "../utils.h"
+#include "../renderer/uploads.h"
+#include "../renderer/defrag.h"
+#include "../renderer/streaming.h"
+
+void asset_loader_initialise(AssetLoader* loader, Renderer* renderer, JobPool* jobs)
+{
+    *loader = (AssetLoader) {
+        .renderer = renderer,
+        .jobs = jobs,
+    };
+
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->work_available, NULL);
+
+    if (pthread_create(&loader->thread, NULL, asset_loader_worker, loader) != 0)
+        FATAL("Could not create the asset loader thread\n");
+}
+
+void asset_loader_cleanup(AssetLoader* loader)
+{
+    pthread_mutex_lock(&loader->mutex);
+    loader->stopping = true;
+    pthread_cond_broadcast(&loader->work_available);
+    pthread_mutex_unlock(&loader->mutex);
+
+    // no more frames are going to free up staging, a load waiting on it takes a buffer of its own
+    staging_ring_close(&loader->renderer->staging);
+    pthread_join(loader->thread, NULL);
+
+    pthread_cond_destroy(&loader->work_available);
+    pthread_mutex_destroy(&loader->mutex);
+
+    // requests that never started and loads that were never picked up
+    for (uint32_t i = 0; i < loader->n_requests; ++i)
+        free(loader->requests[i].path);
+    for (uint32_t i = 0; i < loader->n_completed; ++i)
+        asset_load_discard(&loader->completed[i], loader->renderer);
+
+    for (uint32_t i = 0; i < loader->n_assets; ++i)
+    {
+        Asset* asset = &loader->assets[i];
+        if (asset->state == ASSET_READY)
+        {
+            meshes_destroy(asset->meshes, asset->n_meshes, loader->renderer);
+            materials_destroy(&asset->materials, loader->renderer);
+        }
+
+        free(asset->path);
+    }
+
+    free(loader->requests);
+    free(loader->completed);
+    free(loader->assets);
+}
+
+AssetHandle asset_loader_load(AssetLoader* loader, const char* path)
+{
+    if (loader->n_assets == loader->asset_capacity)
+    {
+        loader->asset_capacity = loader->asset_capacity == 0 ? 16 : loader->asset_capacity * 2;
+        loader->assets = realloc(loader->assets, sizeof(Asset) * loader->asset_capacity);
+    }
+
+    AssetHandle handle = loader->n_assets++;
+    loader->assets[handle] = (Asset) {
+        .path = strdup(path),
+        .state = ASSET_LOADING,
+        .request_time = time_now_ns(),
+    };
+
+    pthread_mutex_lock(&loader->mutex);
+
+    if (loader->n_requests == loader->request_capacity)
+    {
+        loader->request_capacity = loader->request_capacity == 0 ? 16 : loader->request_capacity * 2;
+        loader->requests = realloc(loader->requests, sizeof(AssetRequest) * loader->request_capacity);
+    }
+
+    // the thread gets its own copy of the path, assets can move when this grows
+    loader->requests[loader->n_requests++] = (AssetRequest) { handle, strdup(path) };
+
+    pthread_cond_signal(&loader->work_available);
+    pthread_mutex_unlock(&loader->mutex);
+
+    return handle;
+}
+
+bool asset_loader_poll(AssetLoader* loader, AssetHandle* out_handle)
+{
+    pthread_mutex_lock(&loader->mutex);
+    if (loader->n_completed == 0)
+    {
+        pthread_mutex_unlock(&loader->mutex);
+        return false;
+    }
+
+    AssetLoad load = loader->completed[0];
+    loader->n_completed -= 1;
+    memmove(loader->completed, loader->completed + 1, sizeof(AssetLoad) * loader->n_completed);
+    pthread_mutex_unlock(&loader->mutex);
+
+    Renderer* renderer = loader->renderer;
+    Asset* asset = &loader->assets[load.handle];
+
+    // the worker logged why, this just keeps the engine going without it
+    if (load.failed)
+    {
+        asset->state = ASSET_FAILED;
+        LOG_W("%s failed to load, whatever uses it stays hidden\n", asset->path);
+
+        *out_handle = load.handle;
+        return true;
+    }
+
+    // recorded ahead of this frame's draws, so the meshes can be drawn straight away
+    uploads_queue(renderer, load.uploads);
+
+    // before the instances, they look the textures up when they're tracked
+    for (uint32_t i = 0; i < load.materials.n_images; ++i)
+    {
+        StreamSource* source = &load.streamed_textures[i];
+        if (source->texture.data == NULL && source->path == NULL)
+            continue;
+
+        if (load.materials.images[i].image != VK_NULL_HANDLE)
+            streaming_track_image(renderer, &load.materials.images[i], *source);
+        else
+            streaming_source_free(source);
+    }
+    free(load.streamed_textures);
+
+    materials_write_instances(renderer, &load.materials, load.material_datas);
+    free(load.material_datas);
+
+    defrag_track_meshes(renderer, load.meshes, load.n_meshes);
+    defrag_track_images(renderer, load.materials.images, load.materials.n_images);
+
+    asset->meshes = load.meshes;
+    asset->n_meshes = load.n_meshes;
+    asset->materials = load.materials;
+    asset->state = ASSET_READY;
+
+    LOG_V("%s ready %.1lf ms after it was requested\n", asset->path,
+            (time_now_ns() - asset->request_time) / 1e6);
+
+    *out_handle = load.handle;
+    return true;
+}
+
+Asset* asset_loader_get(AssetLoader* loader, AssetHandle handle)
+{
+    return &loader->assets[handle];
+}
+
+void* asset_loader_worker(void* arg)
+{
+    AssetLoader* loader = arg;
+
+    pthread_mutex_lock(&loader->mutex);
+    while (true)
+    {
+        while (loader->n_requests == 0 && !loader->stopping)
+            pthread_cond_wait(&loader->work_available, &loader->mutex);
+
+        if (loader->stopping)
+            break;
+
+        AssetRequest request = loader->requests[0];
+        loader->n_requests -= 1;
+        memmove(loader->requests, loader->requests + 1, sizeof(AssetRequest) * loader->n_requests);
+
+        pthread_mutex_unlock(&loader->mutex);
+        AssetLoad load = asset_load_file(loader, &request);
+        free(request.path);
+        pthread_mutex_lock(&loader->mutex);
+
+        if (loader->n_completed == loader->completed_capacity)
+        {
+            loader->completed_capacity = loader->completed_capacity == 0 ? 16
+                : loader->completed_capacity * 2;
+            loader->completed = realloc(loader->completed, sizeof(AssetLoad) * loader->completed_capacity);
+        }
+
+        loader->completed[loader->n_completed++] = load;
+    }
+    pthread_mutex_unlock(&loader->mutex);
+
+    return NULL;
+}
+
+AssetLoad asset_load_file(AssetLoader* loader, AssetRequest* request)
+{
+    uint64_t start_time = time_now_ns();
+
+    const char* extension = strrchr(request->path, '.');
+    AssetLoad load;
+
+    if (extension != NULL && strcmp(extension, ".nagm") == 0)
+    {
+        load = asset_load_cooked(loader, request->path);
+    }
+    else
+    {
+        uint32_t n = 0;
+        ImportedMaterials imported = {0};
+        MeshData* mesh_datas = extension != NULL && strcmp(extension, ".obj") == 0
+            ? import_obj(loader->jobs, request->path, &n, &imported)
+            : import_gltf(loader->jobs, request->path, &n, &imported);
+
+        if (mesh_datas != NULL)
+            load = asset_load_imported(loader, mesh_datas, n, &imported);
+        else
+            load = (AssetLoad) { .failed = true };
+    }
+
+    load.handle = request->handle;
+    if (load.failed)
+        return load;
+
+    LOG_V("Staged %s in the background in %.1lf ms, %.1lf MB to upload\n", request->path,
+            (time_now_ns() - start_time) / 1e6, load.uploads.used / 1e6);
+
+    return load;
+}
+
+AssetLoad asset_load_cooked(AssetLoader* loader, const char* path)
+{
+    Renderer* renderer = loader->renderer;
+    AssetLoad load = {0};
+
+    CookedFile cooked;
+    if (!cooked_open(path, &cooked))
+    {
+        load.failed = true;
+        return load;
+    }
+
+    load.n_meshes = cooked.header->n_meshes;
+    // blocks while the ring is full, frames keep retiring regions in the meantime
+    load.uploads = upload_batch_create(renderer, cooked_staging_size(&cooked), true);
+    load.meshes = cooked_meshes_stage(renderer, &load.uploads, &cooked);
+
+    cooked_close(&cooked);
+
+    if (load.meshes == NULL)
+    {
+        upload_batch_destroy(&load.uploads, renderer);
+        return (AssetLoad) { .failed = true };
+    }
+
+    return load;
+}
+
+// frees what the importer produced, all but the material descriptions
+AssetLoad asset_load_imported(AssetLoader* loader, MeshData* mesh_datas, uint32_t n,
+        ImportedMaterials* imported)
+{
+    Renderer* renderer = loader->renderer;
+    AssetLoad load = {0};
+
+    // the image sizes are only known once they've decoded, and the batch needs them
+    job_pool_parallel_for(loader->jobs, image_data_decode_job, imported->images, imported->n_images);
+    images_build_chains(loader->jobs, imported);
+
+    load.n_meshes = n;
+    load.uploads = upload_batch_create(renderer, meshes_staging_size(mesh_datas, n)
+            + images_staging_size(imported, true), true);
+    load.meshes = meshes_stage(renderer, &load.uploads, mesh_datas, n);
+
+    // nothing of it is on the gpu yet, so a mesh too big for the arenas just fails the load
+    if (load.meshes == NULL)
+    {
+        upload_batch_destroy(&load.uploads, renderer);
+        imported_materials_free(imported);
+        mesh_datas_free(mesh_datas, n);
+        return (AssetLoad) { .failed = true };
+    }
+
+    load.streamed_textures = malloc(sizeof(StreamSource) * imported->n_images);
+    materials_stage_images(renderer, &load.uploads, imported, &load.materials,
+            load.streamed_textures);
+
+    // the descriptors get written on the main thread, but the surfaces can point at them already
+    load.materials.n_instances = imported->n_materials;
+    load.materials.instances = malloc(sizeof(MaterialInstance) * imported->n_materials);
+    meshes_bind_materials(load.meshes, mesh_datas, n, &load.materials);
+
+    load.material_datas = imported->materials;
+    imported->materials = NULL;
+
+    imported_materials_free(imported);
+    mesh_datas_free(mesh_datas, n);
+
+    return load;
+}
+
+// for loads the main thread never picked up, nothing of theirs has been recorded
+void asset_load_discard(AssetLoad* load, Renderer* renderer)
+{
+    if (load->failed)
+        return;
+
+    upload_batch_destroy(&load->uploads, renderer);
+
+    meshes_destroy(load->meshes, load->n_meshes, renderer);
+
+    // the instances were never written, so there are no constants yet either
+    materials_destroy(&load->materials, renderer);
+    free(load->material_datas);
+
+    for (uint32_t i = 0; load->streamed_textures != NULL && i < load->materials.n_images; ++i)
+        streaming_source_free(&load->streamed_textures[i]);
+    free(load->streamed_textures);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "../renderer/renderer.h"
+#include "../jobs.h"
+#include "import.h"
+
+#define ASSET_HANDLE_NONE UINT32_MAX
+
+// index into the loader's assets, valid for as long as the loader is
+typedef uint32_t AssetHandle;
+
+// a failed asset never gets any meshes, what refers to it stays hidden
+enum AssetState {
+    ASSET_LOADING, ASSET_READY, ASSET_FAILED
+};
+
+typedef struct Asset {
+    char* path;
+    enum AssetState state;
+    uint64_t request_time;
+
+    // only filled in once the asset is ready
+    Mesh* meshes;
+    uint32_t n_meshes;
+    MaterialSet materials;
+} Asset;
+
+typedef struct AssetRequest {
+    AssetHandle handle;
+    char* path;
+} AssetRequest;
+
+// everything the loader thread can do without the queue or the descriptor allocator
+typedef struct AssetLoad {
+    AssetHandle handle;
+    // the file couldn't be read, nothing else is filled in
+    bool failed;
+
+    Mesh* meshes;
+    uint32_t n_meshes;
+    // images created and instances allocated, the surfaces already point into them
+    MaterialSet materials;
+    MaterialData* material_datas;
+    // the full chain of each image that streams, empty for the rest. only their tails are staged
+    StreamSource* streamed_textures;
+
+    // one region of the staging ring for all of it, so a load never waits on space while already
+    // holding some
+    UploadBatch uploads;
+} AssetLoad;
+
+// file io, decoding and staging on a thread of its own, the main thread picks up finished loads
+// between frames and their copies are recorded ahead of the next frame's draws
+typedef struct AssetLoader {
+    Renderer* renderer;
+    JobPool* jobs;
+    pthread_t thread;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+
+    // waiting for the loader thread, first in first out
+    AssetRequest* requests;
+    uint32_t n_requests;
+    uint32_t request_capacity;
+
+    // finished and waiting for the main thread
+    AssetLoad* completed;
+    uint32_t n_completed;
+    uint32_t completed_capacity;
+
+    bool stopping;
+
+    // main thread only
+    Asset* assets;
+    uint32_t n_assets;
+    uint32_t asset_capacity;
+} AssetLoader;
+
+void asset_loader_initialise(AssetLoader* loader, Renderer* renderer, JobPool* jobs);
+// the device has to be idle, a load that is still running gets finished first
+void asset_loader_cleanup(AssetLoader* loader);
+
+// returns straight away, .nagm files load as cooked, .obj through fast_obj and the rest as gltf
+AssetHandle asset_loader_load(AssetLoader* loader, const char* path);
+// finishes one load that the loader thread is done with, failed ones included, false once there
+// are none left. main thread, before the frame's draws are collected
+bool asset_loader_poll(AssetLoader* loader, AssetHandle* out_handle);
+Asset* asset_loader_get(AssetLoader* loader, AssetHandle handle);
+
+// internal
+void* asset_loader_worker(void* arg);
+AssetLoad asset_load_file(AssetLoader* loader, AssetRequest* request);
+AssetLoad asset_load_cooked(AssetLoader* loader, const char* path);
+AssetLoad asset_load_imported(AssetLoader* loader, MeshData* mesh_datas, uint32_t n,
+        ImportedMaterials* imported);
+void asset_load_discard(AssetLoad* load, Renderer* renderer);
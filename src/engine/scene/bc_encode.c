@@ -0,0 +1,488 @@
+#include "bc_encode.h"
+#include "../utils.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+static const uint32_t BC7_WEIGHTS[1 << BC7_WEIGHT_BITS] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+uint8_t* bc_encode_chain(JobPool* jobs, VkFormat format, const uint8_t* pixels, uint32_t width,
+        uint32_t height, uint32_t n_levels)
+{
+    bool srgb = format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK
+        || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK
+        || format == VK_FORMAT_BC7_SRGB_BLOCK;
+
+    uint8_t* out = malloc(texture_chain_size(format, width, height, n_levels));
+
+    // each level is filtered from the one above it, only two are ever alive at once
+    uint8_t* level = (uint8_t*) pixels;
+    uint8_t* next = NULL;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < n_levels; ++i)
+    {
+        uint32_t level_width = texture_mip_dimension(width, i);
+        uint32_t level_height = texture_mip_dimension(height, i);
+
+        if (i != 0)
+        {
+            next = malloc((size_t) level_width * level_height * 4);
+            bc_downsample(level, texture_mip_dimension(width, i - 1),
+                    texture_mip_dimension(height, i - 1), srgb, next);
+            if (level != pixels)
+                free(level);
+            level = next;
+        }
+
+        bc_encode_level(jobs, format, level, level_width, level_height, out + offset);
+        offset += texture_level_size(format, level_width, level_height);
+    }
+
+    if (level != pixels)
+        free(level);
+
+    return out;
+}
+
+void bc_encode_level(JobPool* jobs, VkFormat format, const uint8_t* pixels, uint32_t width,
+        uint32_t height, uint8_t* out)
+{
+    if (!texture_format_compressed(format))
+    {
+        memcpy(out, pixels, (size_t) width * height * 4);
+        return;
+    }
+
+    BcEncodeJob job = {
+        .format = format,
+        .pixels = pixels,
+        .width = width,
+        .height = height,
+        .out = out,
+    };
+
+    uint32_t block_rows = (height + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT;
+    job_pool_parallel_for(jobs, bc_encode_row_job, &job, block_rows);
+}
+
+void bc_downsample(const uint8_t* src, uint32_t width, uint32_t height, bool srgb, uint8_t* dst)
+{
+    uint32_t dst_width = texture_mip_dimension(width, 1);
+    uint32_t dst_height = texture_mip_dimension(height, 1);
+
+    for (uint32_t y = 0; y < dst_height; ++y)
+    {
+        for (uint32_t x = 0; x < dst_width; ++x)
+        {
+            const uint8_t* taps[4] = {
+                &src[((size_t) (2 * y) * width + 2 * x) * 4],
+                &src[((size_t) (2 * y) * width + BC_MIN(2 * x + 1, width - 1)) * 4],
+                &src[((size_t) BC_MIN(2 * y + 1, height - 1) * width + 2 * x) * 4],
+                &src[((size_t) BC_MIN(2 * y + 1, height - 1) * width
+                        + BC_MIN(2 * x + 1, width - 1)) * 4],
+            };
+
+            uint8_t* texel = &dst[((size_t) y * dst_width + x) * 4];
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                // alpha is linear whatever the format
+                if (srgb && c != 3)
+                {
+                    float sum = 0.0f;
+                    for (uint32_t t = 0; t < 4; ++t)
+                        sum += bc_srgb_to_linear(taps[t][c]);
+                    texel[c] = bc_linear_to_srgb(sum * 0.25f);
+                }
+                else
+                    texel[c] = (taps[0][c] + taps[1][c] + taps[2][c] + taps[3][c] + 2) / 4;
+            }
+        }
+    }
+}
+
+void bc_encode_row_job(void* data, uint32_t index)
+{
+    BcEncodeJob* job = data;
+
+    uint32_t blocks_wide = (job->width + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT;
+    size_t block_size = texture_format_block_size(job->format);
+    uint8_t* out = job->out + (size_t) index * blocks_wide * block_size;
+
+    for (uint32_t bx = 0; bx < blocks_wide; ++bx)
+    {
+        // edge blocks repeat the last row and column rather than encode garbage
+        uint8_t texels[16][4];
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t x = BC_MIN(bx * TEXTURE_BLOCK_EXTENT + i % 4, job->width - 1);
+            uint32_t y = BC_MIN(index * TEXTURE_BLOCK_EXTENT + i / 4, job->height - 1);
+            memcpy(texels[i], &job->pixels[((size_t) y * job->width + x) * 4], 4);
+        }
+
+        bc_encode_block(job->format, (const uint8_t (*)[4]) texels, out + bx * block_size);
+    }
+}
+
+void bc_encode_block(VkFormat format, const uint8_t texels[16][4], uint8_t* out)
+{
+    switch (format)
+    {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        bc1_encode(texels, false, out);
+        break;
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        bc1_encode(texels, true, out);
+        break;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+        bc4_encode(texels, 3, out);
+        bc1_encode(texels, false, out + 8);
+        break;
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        bc4_encode(texels, 0, out);
+        break;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        bc4_encode(texels, 0, out);
+        bc4_encode(texels, 1, out + 8);
+        break;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        bc7_encode_mode6(texels, out);
+        break;
+    default:
+        FATAL("Can't encode format %d\n", format);
+    }
+}
+
+void bc1_encode(const uint8_t texels[16][4], bool punch_through, uint8_t* out)
+{
+    // punched through texels take no part in the fit, they get the transparent index
+    float points[16][4];
+    uint32_t n_points = 0;
+    uint32_t transparent = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        if (punch_through && texels[i][3] < 128)
+        {
+            transparent |= 1 << i;
+            continue;
+        }
+
+        for (uint32_t c = 0; c < 3; ++c)
+            points[n_points][c] = texels[i][c];
+        n_points++;
+    }
+
+    float start[4] = {0}, end[4] = {0};
+    if (n_points != 0)
+        bc_fit_endpoints((const float (*)[4]) points, n_points, 3, start, end);
+
+    uint16_t c0 = bc_pack_565(start);
+    uint16_t c1 = bc_pack_565(end);
+
+    // c0 > c1 picks four colours, anything else three and transparent black
+    bool three_colour = transparent != 0;
+    if (three_colour ? c0 > c1 : c0 < c1)
+    {
+        uint16_t swap = c0;
+        c0 = c1;
+        c1 = swap;
+    }
+
+    int32_t palette[4][3];
+    bc_unpack_565(c0, palette[0]);
+    bc_unpack_565(c1, palette[1]);
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        if (three_colour)
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+        else
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    uint32_t n_colours = three_colour ? 3 : (c0 == c1 ? 1 : 4);
+    uint32_t indices = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t best = 3;
+        if (!(transparent & 1 << i))
+        {
+            int32_t best_error = INT32_MAX;
+            for (uint32_t j = 0; j < n_colours; ++j)
+            {
+                int32_t error = 0;
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    int32_t d = texels[i][c] - palette[j][c];
+                    error += d * d;
+                }
+
+                if (error < best_error)
+                {
+                    best_error = error;
+                    best = j;
+                }
+            }
+        }
+
+        indices |= best << (i * 2);
+    }
+
+    memcpy(out, &c0, 2);
+    memcpy(out + 2, &c1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+void bc4_encode(const uint8_t texels[16][4], uint32_t channel, uint8_t* out)
+{
+    uint8_t lo = 255, hi = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        if (texels[i][channel] < lo)
+            lo = texels[i][channel];
+        if (texels[i][channel] > hi)
+            hi = texels[i][channel];
+    }
+
+    // hi > lo is the eight value mode, when they're equal index 0 is exact anyway
+    int32_t palette[8] = { hi, lo };
+    for (uint32_t i = 2; i < 8; ++i)
+        palette[i] = ((8 - i) * hi + (i - 1) * lo) / 7;
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint64_t best = 0;
+        int32_t best_error = INT32_MAX;
+        for (uint32_t j = 0; j < (hi == lo ? 1 : 8); ++j)
+        {
+            int32_t error = abs(texels[i][channel] - palette[j]);
+            if (error < best_error)
+            {
+                best_error = error;
+                best = j;
+            }
+        }
+
+        indices |= best << (i * 3);
+    }
+
+    out[0] = hi;
+    out[1] = lo;
+    for (uint32_t i = 0; i < 6; ++i)
+        out[2 + i] = indices >> (i * 8);
+}
+
+void bc7_encode_mode6(const uint8_t texels[16][4], uint8_t* out)
+{
+    float points[16][4];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+            points[i][c] = texels[i][c];
+    }
+
+    float start[4], end[4];
+    bc_fit_endpoints((const float (*)[4]) points, 16, 4, start, end);
+
+    uint8_t values[2][4];
+    uint32_t p[2];
+    bc7_quantise_endpoint(start, values[0], &p[0]);
+    bc7_quantise_endpoint(end, values[1], &p[1]);
+
+    int32_t palette[1 << BC7_WEIGHT_BITS][4];
+    for (uint32_t i = 0; i < 1 << BC7_WEIGHT_BITS; ++i)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            int32_t e0 = values[0][c] << 1 | p[0];
+            int32_t e1 = values[1][c] << 1 | p[1];
+            palette[i][c] = ((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6;
+        }
+    }
+
+    uint32_t indices[16];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        int32_t best_error = INT32_MAX;
+        for (uint32_t j = 0; j < 1 << BC7_WEIGHT_BITS; ++j)
+        {
+            int32_t error = 0;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                int32_t d = texels[i][c] - palette[j][c];
+                error += d * d;
+            }
+
+            if (error < best_error)
+            {
+                best_error = error;
+                indices[i] = j;
+            }
+        }
+    }
+
+    // the first index drops its top bit, so it has to be in the lower half
+    uint32_t first = 0;
+    if (indices[0] >= 1 << (BC7_WEIGHT_BITS - 1))
+    {
+        first = 1;
+        for (uint32_t i = 0; i < 16; ++i)
+            indices[i] = (1 << BC7_WEIGHT_BITS) - 1 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    uint32_t bit = 0;
+    bc_put_bits(out, &bit, 1 << 6, 7);
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        bc_put_bits(out, &bit, values[first][c], BC7_ENDPOINT_BITS);
+        bc_put_bits(out, &bit, values[1 - first][c], BC7_ENDPOINT_BITS);
+    }
+    bc_put_bits(out, &bit, p[first], 1);
+    bc_put_bits(out, &bit, p[1 - first], 1);
+
+    bc_put_bits(out, &bit, indices[0], BC7_WEIGHT_BITS - 1);
+    for (uint32_t i = 1; i < 16; ++i)
+        bc_put_bits(out, &bit, indices[i], BC7_WEIGHT_BITS);
+}
+
+void bc7_quantise_endpoint(const float endpoint[4], uint8_t out_values[4], uint32_t* out_p)
+{
+    // the shared p bit is the low bit of all four channels, whichever fits better wins
+    float best_error = FLT_MAX;
+    for (uint32_t p = 0; p < 2; ++p)
+    {
+        uint8_t values[4];
+        float error = 0.0f;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            long q = lroundf((endpoint[c] - p) * 0.5f);
+            values[c] = q < 0 ? 0 : (q > 127 ? 127 : q);
+
+            float d = endpoint[c] - (values[c] << 1 | p);
+            error += d * d;
+        }
+
+        if (error < best_error)
+        {
+            best_error = error;
+            memcpy(out_values, values, 4);
+            *out_p = p;
+        }
+    }
+}
+
+void bc_principal_axis(const float points[][4], uint32_t n, uint32_t dims, float* out_mean,
+        float* out_axis)
+{
+    for (uint32_t c = 0; c < dims; ++c)
+    {
+        out_mean[c] = 0.0f;
+        for (uint32_t i = 0; i < n; ++i)
+            out_mean[c] += points[i][c];
+        out_mean[c] /= n;
+    }
+
+    float covariance[4][4] = {0};
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        for (uint32_t a = 0; a < dims; ++a)
+        {
+            for (uint32_t b = 0; b < dims; ++b)
+                covariance[a][b] += (points[i][a] - out_mean[a]) * (points[i][b] - out_mean[b]);
+        }
+    }
+
+    // power iteration, a handful of steps is plenty for sixteen points
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (uint32_t iteration = 0; iteration < BC_AXIS_ITERATIONS; ++iteration)
+    {
+        float next[4] = {0};
+        float length = 0.0f;
+        for (uint32_t a = 0; a < dims; ++a)
+        {
+            for (uint32_t b = 0; b < dims; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+
+        // every point is the same colour
+        if (length < 1e-12f)
+            break;
+
+        length = sqrtf(length);
+        for (uint32_t a = 0; a < dims; ++a)
+            axis[a] = next[a] / length;
+    }
+
+    memcpy(out_axis, axis, sizeof(float) * dims);
+}
+
+void bc_fit_endpoints(const float points[][4], uint32_t n, uint32_t dims, float* out_start,
+        float* out_end)
+{
+    float mean[4], axis[4];
+    bc_principal_axis(points, n, dims, mean, axis);
+
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        float t = 0.0f;
+        for (uint32_t c = 0; c < dims; ++c)
+            t += (points[i][c] - mean[c]) * axis[c];
+
+        lo = fminf(lo, t);
+        hi = fmaxf(hi, t);
+    }
+
+    for (uint32_t c = 0; c < dims; ++c)
+    {
+        out_start[c] = fminf(fmaxf(mean[c] + axis[c] * hi, 0.0f), 255.0f);
+        out_end[c] = fminf(fmaxf(mean[c] + axis[c] * lo, 0.0f), 255.0f);
+    }
+}
+
+uint16_t bc_pack_565(const float colour[3])
+{
+    uint16_t r = lroundf(colour[0] * 31.0f / 255.0f);
+    uint16_t g = lroundf(colour[1] * 63.0f / 255.0f);
+    uint16_t b = lroundf(colour[2] * 31.0f / 255.0f);
+    return r << 11 | g << 5 | b;
+}
+
+void bc_unpack_565(uint16_t packed, int32_t out_colour[3])
+{
+    int32_t r = packed >> 11 & 31;
+    int32_t g = packed >> 5 & 63;
+    int32_t b = packed & 31;
+    out_colour[0] = r << 3 | r >> 2;
+    out_colour[1] = g << 2 | g >> 4;
+    out_colour[2] = b << 3 | b >> 2;
+}
+
+void bc_put_bits(uint8_t* block, uint32_t* bit, uint32_t value, uint32_t n_bits)
+{
+    for (uint32_t i = 0; i < n_bits; ++i, ++*bit)
+        block[*bit / 8] |= (value >> i & 1) << (*bit % 8);
+}
+
+float bc_srgb_to_linear(uint8_t value)
+{
+    float v = value / 255.0f;
+    return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t bc_linear_to_srgb(float value)
+{
+    float v = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+    return lroundf(fminf(fmaxf(v, 0.0f), 1.0f) * 255.0f);
+}
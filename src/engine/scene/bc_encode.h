@@ -0,0 +1,45 @@
+#pragma once
+
+#include "texture_format.h"
+#include "../jobs.h"
+
+// bc7 mode 6 interpolation weights, out of 64
+#define BC7_WEIGHT_BITS 4
+#define BC7_ENDPOINT_BITS 7
+#define BC_AXIS_ITERATIONS 8
+#define BC_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// one row of 4x4 blocks of a level
+typedef struct BcEncodeJob {
+    VkFormat format;
+    const uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    uint8_t* out;
+} BcEncodeJob;
+
+// builds n_levels mips from rgba8 pixels and encodes every one of them into format, levels back to
+// back from the largest the way texture_chain_size lays them out. plain formats are just copied
+uint8_t* bc_encode_chain(JobPool* jobs, VkFormat format, const uint8_t* pixels, uint32_t width,
+        uint32_t height, uint32_t n_levels);
+void bc_encode_level(JobPool* jobs, VkFormat format, const uint8_t* pixels, uint32_t width,
+        uint32_t height, uint8_t* out);
+// 2x2 box filter, in linear space for srgb data. odd sizes clamp at the edge
+void bc_downsample(const uint8_t* src, uint32_t width, uint32_t height, bool srgb, uint8_t* dst);
+
+// internal
+void bc_encode_row_job(void* data, uint32_t index);
+void bc_encode_block(VkFormat format, const uint8_t texels[16][4], uint8_t* out);
+void bc1_encode(const uint8_t texels[16][4], bool punch_through, uint8_t* out);
+void bc4_encode(const uint8_t texels[16][4], uint32_t channel, uint8_t* out);
+void bc7_encode_mode6(const uint8_t texels[16][4], uint8_t* out);
+void bc7_quantise_endpoint(const float endpoint[4], uint8_t out_values[4], uint32_t* out_p);
+void bc_principal_axis(const float points[][4], uint32_t n, uint32_t dims, float* out_mean,
+        float* out_axis);
+void bc_fit_endpoints(const float points[][4], uint32_t n, uint32_t dims, float* out_start,
+        float* out_end);
+uint16_t bc_pack_565(const float colour[3]);
+void bc_unpack_565(uint16_t packed, int32_t out_colour[3]);
+void bc_put_bits(uint8_t* block, uint32_t* bit, uint32_t value, uint32_t n_bits);
+float bc_srgb_to_linear(uint8_t value);
+uint8_t bc_linear_to_srgb(float value);
@@ -0,0 +1,316 @@
+#include "cooked.h"
+#include "../utils.h"
+
+#include <sys/stat.h>
+
+void cooked_write(const char* path, MeshData* meshes, uint32_t n, uint32_t n_source_materials)
+{
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+        FATAL("Could not open %s for writing\n", path);
+
+    CookedHeader header = {
+        .magic = COOKED_MAGIC,
+        .version = COOKED_VERSION,
+        .vertex_size = sizeof(Vertex),
+        .n_meshes = n,
+        .n_source_materials = n_source_materials,
+    };
+
+    CookedMesh* table = calloc(n, sizeof(CookedMesh));
+
+    // header and table go in first as placeholders, they get rewritten once the offsets are known
+    uint64_t offset = 0;
+    cooked_write_blob(fp, &offset, &header, sizeof(CookedHeader));
+    header.meshes_offset = cooked_write_blob(fp, &offset, table, sizeof(CookedMesh) * n);
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        MeshData* mesh = &meshes[i];
+        CookedMesh* cooked_mesh = &table[i];
+
+        // on the heap, a mesh can have no surfaces at all
+        CookedSurface* surfaces = malloc(sizeof(CookedSurface) * mesh->n_surfaces);
+        for (uint32_t j = 0; j < mesh->n_surfaces; ++j)
+        {
+            GeoSurface* surface = &mesh->surfaces[j];
+            surfaces[j] = (CookedSurface) {
+                .start_index = surface->start_index,
+                .count = surface->count,
+                .n_lods = surface->n_lods,
+            };
+            glm_vec3_copy(surface->aabb_min, surfaces[j].aabb_min);
+            glm_vec3_copy(surface->aabb_max, surfaces[j].aabb_max);
+
+            for (uint32_t k = 0; k < surface->n_lods; ++k)
+            {
+                GeoLod* lod = &surface->lods[k];
+                surfaces[j].lods[k] = (CookedLod) { lod->start_index, lod->count, lod->error,
+                    lod->first_meshlet, lod->n_meshlets };
+            }
+        }
+
+        cooked_mesh->n_surfaces = mesh->n_surfaces;
+        cooked_mesh->n_vertices = mesh->n_vertices;
+        cooked_mesh->n_indices = mesh->n_indices;
+        cooked_mesh->n_meshlets = mesh->n_meshlets;
+        cooked_mesh->vertex_format = vertex_format_choose(mesh->vertices, mesh->n_vertices);
+        glm_vec4_copy(mesh->bounds, cooked_mesh->bounds);
+
+        cooked_mesh->name_offset = cooked_write_blob(fp, &offset, mesh->name, strlen(mesh->name) + 1);
+        cooked_mesh->surfaces_offset = cooked_write_blob(fp, &offset, surfaces,
+                sizeof(CookedSurface) * mesh->n_surfaces);
+        free(surfaces);
+
+        if (cooked_mesh->vertex_format == VERTEX_FORMAT_PACKED)
+        {
+            PackedVertex* packed = malloc(sizeof(PackedVertex) * mesh->n_vertices);
+            vertices_pack(mesh->vertices, mesh->n_vertices, packed, cooked_mesh->position_offset,
+                    cooked_mesh->position_scale);
+
+            cooked_mesh->vertices_offset = cooked_write_blob(fp, &offset, packed,
+                    sizeof(PackedVertex) * mesh->n_vertices);
+            free(packed);
+        }
+        else
+        {
+            glm_vec4_one(cooked_mesh->position_scale);
+            cooked_mesh->vertices_offset = cooked_write_blob(fp, &offset, mesh->vertices,
+                    sizeof(Vertex) * mesh->n_vertices);
+        }
+        cooked_mesh->indices_offset = cooked_write_blob(fp, &offset, mesh->indices,
+                sizeof(uint32_t) * mesh->n_indices);
+        cooked_mesh->meshlets_offset = cooked_write_blob(fp, &offset, mesh->meshlets,
+                sizeof(Meshlet) * mesh->n_meshlets);
+    }
+
+    header.file_size = offset;
+
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(CookedHeader), 1, fp);
+    fseek(fp, header.meshes_offset, SEEK_SET);
+    fwrite(table, sizeof(CookedMesh), n, fp);
+
+    if (fclose(fp) != 0)
+        FATAL("Could not finish writing %s\n", path);
+
+    free(table);
+
+    LOG_V("Cooked %d meshes into %s (%.1lf MB)\n", n, path, offset / 1e6);
+}
+
+bool cooked_open(const char* path, CookedFile* out_cooked)
+{
+    // the whole file is read front to back exactly once
+    File file = file_map(path, FILE_ACCESS_SEQUENTIAL);
+    if (file.buf == NULL)
+    {
+        LOG_E("Could not open cooked file %s\n", path);
+        return false;
+    }
+
+    CookedFile cooked = {
+        .file = file,
+        .header = (const CookedHeader*) file.buf,
+        .data = (const uint8_t*) file.buf,
+        .size = file.size,
+    };
+
+    if (!cooked_validate(&cooked, path))
+    {
+        file_close(&cooked.file);
+        return false;
+    }
+
+    *out_cooked = cooked;
+    return true;
+}
+
+bool cooked_is_current(const char* cooked_path, const char* source_path)
+{
+    struct stat cooked_stat;
+    if (stat(cooked_path, &cooked_stat) != 0)
+        return false;
+
+    struct stat source_stat;
+    if (stat(source_path, &source_stat) == 0 && source_stat.st_mtime > cooked_stat.st_mtime)
+    {
+        LOG_V("%s is older than %s, loading the source\n", cooked_path, source_path);
+        return false;
+    }
+
+    // only the header is needed, the rest is checked when the cook is opened
+    CookedHeader header;
+    FILE* fp = fopen(cooked_path, "rb");
+    if (fp == NULL)
+        return false;
+    bool read = fread(&header, sizeof(CookedHeader), 1, fp) == 1;
+    fclose(fp);
+
+    if (!read || header.magic != COOKED_MAGIC || header.version != COOKED_VERSION
+            || header.vertex_size != sizeof(Vertex))
+    {
+        LOG_V("%s is not a cooked file of this version, loading the source\n", cooked_path);
+        return false;
+    }
+    if (header.n_source_materials != 0)
+    {
+        LOG_V("%s leaves out the %u materials of %s, loading the source\n", cooked_path,
+                header.n_source_materials, source_path);
+        return false;
+    }
+
+    return true;
+}
+
+void cooked_close(CookedFile* cooked)
+{
+    file_close(&cooked->file);
+    cooked->data = NULL;
+    cooked->header = NULL;
+}
+
+const CookedMesh* cooked_get_mesh(CookedFile* cooked, uint32_t i)
+{
+    return (const CookedMesh*) (cooked->data + cooked->header->meshes_offset) + i;
+}
+
+const char* cooked_get_name(CookedFile* cooked, const CookedMesh* mesh)
+{
+    return (const char*) (cooked->data + mesh->name_offset);
+}
+
+const CookedSurface* cooked_get_surfaces(CookedFile* cooked, const CookedMesh* mesh)
+{
+    return (const CookedSurface*) (cooked->data + mesh->surfaces_offset);
+}
+
+const void* cooked_get_vertices(CookedFile* cooked, const CookedMesh* mesh)
+{
+    return cooked->data + mesh->vertices_offset;
+}
+
+const void* cooked_get_indices(CookedFile* cooked, const CookedMesh* mesh)
+{
+    return cooked->data + mesh->indices_offset;
+}
+
+const Meshlet* cooked_get_meshlets(CookedFile* cooked, const CookedMesh* mesh)
+{
+    return (const Meshlet*) (cooked->data + mesh->meshlets_offset);
+}
+
+// pads up to the alignment, writes the blob and returns where it starts
+uint64_t cooked_write_blob(FILE* fp, uint64_t* offset, const void* data, size_t size)
+{
+    static const uint8_t zeroes[COOKED_ALIGNMENT] = {0};
+
+    uint64_t padding = (COOKED_ALIGNMENT - *offset % COOKED_ALIGNMENT) % COOKED_ALIGNMENT;
+    fwrite(zeroes, 1, padding, fp);
+    *offset += padding;
+
+    uint64_t start = *offset;
+    if (size != 0 && fwrite(data, size, 1, fp) != 1)
+        FATAL("Could not write %zu bytes to cooked file\n", size);
+    *offset += size;
+
+    return start;
+}
+
+bool cooked_range_valid(CookedFile* cooked, uint64_t offset, uint64_t size)
+{
+    return offset <= cooked->size && size <= cooked->size - offset;
+}
+
+// everything the getters hand out has to be inside the file, the reason goes to the log
+bool cooked_validate(CookedFile* cooked, const char* path)
+{
+    if (cooked->size < sizeof(CookedHeader))
+    {
+        LOG_E("%s is too small to be a cooked file\n", path);
+        return false;
+    }
+
+    const CookedHeader* header = cooked->header;
+    if (header->magic != COOKED_MAGIC)
+    {
+        LOG_E("%s is not a cooked mesh file\n", path);
+        return false;
+    }
+    if (header->version != COOKED_VERSION || header->vertex_size != sizeof(Vertex))
+    {
+        LOG_E("%s was cooked for a different engine version (%d, vertex size %d), re-cook it\n",
+                path, header->version, header->vertex_size);
+        return false;
+    }
+    if (header->file_size != cooked->size
+            || !cooked_range_valid(cooked, header->meshes_offset,
+                sizeof(CookedMesh) * header->n_meshes))
+    {
+        LOG_E("%s is truncated\n", path);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->n_meshes; ++i)
+    {
+        const CookedMesh* mesh = cooked_get_mesh(cooked, i);
+
+        if (mesh->vertex_format != VERTEX_FORMAT_FULL && mesh->vertex_format != VERTEX_FORMAT_PACKED)
+        {
+            LOG_E("Mesh %d of %s has unknown vertex format %d\n", i, path, mesh->vertex_format);
+            return false;
+        }
+
+        uint64_t vertex_size = vertex_format_size(mesh->vertex_format);
+        bool valid = cooked_range_valid(cooked, mesh->name_offset, 1)
+            && cooked_range_valid(cooked, mesh->surfaces_offset,
+                    sizeof(CookedSurface) * mesh->n_surfaces)
+            && cooked_range_valid(cooked, mesh->vertices_offset, vertex_size * mesh->n_vertices)
+            && cooked_range_valid(cooked, mesh->indices_offset,
+                    sizeof(uint32_t) * (uint64_t) mesh->n_indices)
+            && cooked_range_valid(cooked, mesh->meshlets_offset,
+                    sizeof(Meshlet) * (uint64_t) mesh->n_meshlets);
+
+        if (!valid)
+        {
+            LOG_E("Mesh %d of %s points outside the file\n", i, path);
+            return false;
+        }
+
+        // the name is used as a string straight out of the mapping
+        const char* name = cooked_get_name(cooked, mesh);
+        if (memchr(name, '\0', cooked->size - mesh->name_offset) == NULL)
+        {
+            LOG_E("Name of mesh %d of %s runs off the end of the file\n", i, path);
+            return false;
+        }
+
+        const CookedSurface* surfaces = cooked_get_surfaces(cooked, mesh);
+        for (uint32_t j = 0; j < mesh->n_surfaces; ++j)
+        {
+            if ((uint64_t) surfaces[j].start_index + surfaces[j].count > mesh->n_indices)
+            {
+                LOG_E("Surface %d of mesh %d of %s is out of range\n", j, i, path);
+                return false;
+            }
+            if (surfaces[j].n_lods > MAX_LODS)
+            {
+                LOG_E("Surface %d of mesh %d of %s has %d lods\n", j, i, path, surfaces[j].n_lods);
+                return false;
+            }
+
+            for (uint32_t k = 0; k < surfaces[j].n_lods; ++k)
+            {
+                const CookedLod* lod = &surfaces[j].lods[k];
+                if ((uint64_t) lod->start_index + lod->count > mesh->n_indices
+                        || (uint64_t) lod->first_meshlet + lod->n_meshlets > mesh->n_meshlets)
+                {
+                    LOG_E("Lod %d of surface %d of mesh %d of %s is out of range\n", k, j, i, path);
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "import.h"
+#include "vertex_packing.h"
+
+// "NAGM" read as a little endian uint32
+#define COOKED_MAGIC 0x4d47414e
+// bump whenever the layout of the file or of Vertex changes
+#define COOKED_VERSION 6
+// every blob starts on this boundary so it can be copied straight out of the mapping
+#define COOKED_ALIGNMENT 16
+
+// all values are little endian, offsets are from the start of the file
+typedef struct CookedHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_size;
+    uint32_t n_meshes;
+    uint64_t meshes_offset;
+    uint64_t file_size;
+    // materials the source had, which the cook doesn't carry. loading such a cook would draw
+    // everything with the default material
+    uint32_t n_source_materials;
+    uint32_t pad;
+} CookedHeader;
+
+typedef struct CookedMesh {
+    uint64_t name_offset;
+    uint64_t surfaces_offset;
+    uint64_t vertices_offset;
+    uint64_t indices_offset;
+    uint64_t meshlets_offset;
+
+    uint32_t n_surfaces;
+    uint32_t n_vertices;
+    uint32_t n_indices;
+    uint32_t n_meshlets;
+    // enum VertexFormat, picked per mesh when cooking
+    uint32_t vertex_format;
+    uint32_t pad[3];
+
+    float position_offset[4];
+    float position_scale[4];
+    float bounds[4];
+} CookedMesh;
+
+typedef struct CookedLod {
+    uint32_t start_index;
+    uint32_t count;
+    float error;
+    uint32_t first_meshlet;
+    uint32_t n_meshlets;
+} CookedLod;
+
+typedef struct CookedSurface {
+    uint32_t start_index;
+    uint32_t count;
+    uint32_t n_lods;
+    CookedLod lods[MAX_LODS];
+    float aabb_min[3];
+    float aabb_max[3];
+} CookedSurface;
+
+typedef struct CookedFile {
+    File file;
+    const CookedHeader* header;
+    const uint8_t* data;
+    size_t size;
+} CookedFile;
+
+void cooked_write(const char* path, MeshData* meshes, uint32_t n, uint32_t n_source_materials);
+// whether the cook can stand in for the source: newer than it, of this version and not missing
+// any of its materials. false when there is no cook
+bool cooked_is_current(const char* cooked_path, const char* source_path);
+
+// false when the file is missing or anything in it is out of range, the reason has been logged
+bool cooked_open(const char* path, CookedFile* out_cooked);
+void cooked_close(CookedFile* cooked);
+
+const CookedMesh* cooked_get_mesh(CookedFile* cooked, uint32_t i);
+const char* cooked_get_name(CookedFile* cooked, const CookedMesh* mesh);
+const CookedSurface* cooked_get_surfaces(CookedFile* cooked, const CookedMesh* mesh);
+const void* cooked_get_vertices(CookedFile* cooked, const CookedMesh* mesh);
+const void* cooked_get_indices(CookedFile* cooked, const CookedMesh* mesh);
+const Meshlet* cooked_get_meshlets(CookedFile* cooked, const CookedMesh* mesh);
+
+// internal
+uint64_t cooked_write_blob(FILE* fp, uint64_t* offset, const void* data, size_t size);
+bool cooked_range_valid(CookedFile* cooked, uint64_t offset, uint64_t size);
+bool cooked_validate(CookedFile* cooked, const char* path);
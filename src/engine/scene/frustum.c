@@ -0,0 +1,195 @@
+#include "frustum.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef FRUSTUM_SIMD
+#include <immintrin.h>
+#endif
+
+void frustum_boxes_cleanup(FrustumBoxes* boxes)
+{
+    free(boxes->centre_x);
+    free(boxes->centre_y);
+    free(boxes->centre_z);
+    free(boxes->extent_x);
+    free(boxes->extent_y);
+    free(boxes->extent_z);
+    free(boxes->visible);
+
+    *boxes = (FrustumBoxes) {0};
+}
+
+void frustum_boxes_clear(FrustumBoxes* boxes)
+{
+    boxes->n = 0;
+}
+
+void frustum_boxes_push(FrustumBoxes* boxes, mat4 transform, vec3 min, vec3 max)
+{
+    frustum_boxes_reserve(boxes, boxes->n + 1);
+
+    vec3 centre, extent;
+    glm_vec3_center(min, max, centre);
+    glm_vec3_sub(max, centre, extent);
+
+    vec3 world_centre;
+    glm_mat4_mulv3(transform, centre, 1, world_centre);
+
+    // each world axis takes the most every mesh axis can reach along it, columns are mesh axes
+    uint32_t i = boxes->n;
+    boxes->centre_x[i] = world_centre[0];
+    boxes->centre_y[i] = world_centre[1];
+    boxes->centre_z[i] = world_centre[2];
+    boxes->extent_x[i] = fabsf(transform[0][0]) * extent[0] + fabsf(transform[1][0]) * extent[1]
+        + fabsf(transform[2][0]) * extent[2];
+    boxes->extent_y[i] = fabsf(transform[0][1]) * extent[0] + fabsf(transform[1][1]) * extent[1]
+        + fabsf(transform[2][1]) * extent[2];
+    boxes->extent_z[i] = fabsf(transform[0][2]) * extent[0] + fabsf(transform[1][2]) * extent[1]
+        + fabsf(transform[2][2]) * extent[2];
+
+    boxes->n += 1;
+}
+
+uint32_t frustum_test(FrustumBoxes* boxes, vec4 planes[6])
+{
+    uint32_t first = 0;
+
+#ifdef FRUSTUM_SIMD
+    if (__builtin_cpu_supports("avx"))
+        first = frustum_test_avx(boxes, planes);
+    else
+        first = frustum_test_sse(boxes, planes);
+#endif
+
+    frustum_test_scalar(boxes, planes, first);
+
+    uint32_t n_culled = 0;
+    for (uint32_t i = 0; i < boxes->n; ++i)
+        n_culled += !boxes->visible[i];
+
+    return n_culled;
+}
+
+void frustum_boxes_reserve(FrustumBoxes* boxes, uint32_t n)
+{
+    if (n <= boxes->capacity)
+        return;
+
+    boxes->capacity = boxes->capacity == 0 ? 256 : boxes->capacity * 2;
+    boxes->centre_x = realloc(boxes->centre_x, sizeof(float) * boxes->capacity);
+    boxes->centre_y = realloc(boxes->centre_y, sizeof(float) * boxes->capacity);
+    boxes->centre_z = realloc(boxes->centre_z, sizeof(float) * boxes->capacity);
+    boxes->extent_x = realloc(boxes->extent_x, sizeof(float) * boxes->capacity);
+    boxes->extent_y = realloc(boxes->extent_y, sizeof(float) * boxes->capacity);
+    boxes->extent_z = realloc(boxes->extent_z, sizeof(float) * boxes->capacity);
+    boxes->visible = realloc(boxes->visible, sizeof(uint8_t) * boxes->capacity);
+}
+
+// the box's extent projected onto the plane's normal is how far inside the centre has to be
+void frustum_test_scalar(FrustumBoxes* boxes, vec4 planes[6], uint32_t first)
+{
+    for (uint32_t i = first; i < boxes->n; ++i)
+    {
+        bool visible = true;
+        for (int j = 0; j < 6 && visible; ++j)
+        {
+            float* plane = planes[j];
+            float distance = plane[0] * boxes->centre_x[i] + plane[1] * boxes->centre_y[i]
+                + plane[2] * boxes->centre_z[i] + plane[3];
+            float reach = fabsf(plane[0]) * boxes->extent_x[i] + fabsf(plane[1]) * boxes->extent_y[i]
+                + fabsf(plane[2]) * boxes->extent_z[i];
+
+            visible = distance + reach >= 0;
+        }
+
+        boxes->visible[i] = visible;
+    }
+}
+
+#ifdef FRUSTUM_SIMD
+// the same test as frustum_test_scalar, a box per lane
+uint32_t frustum_test_sse(FrustumBoxes* boxes, vec4 planes[6])
+{
+    __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+
+    uint32_t n = boxes->n & ~3u;
+    for (uint32_t i = 0; i < n; i += 4)
+    {
+        __m128 centre_x = _mm_loadu_ps(&boxes->centre_x[i]);
+        __m128 centre_y = _mm_loadu_ps(&boxes->centre_y[i]);
+        __m128 centre_z = _mm_loadu_ps(&boxes->centre_z[i]);
+        __m128 extent_x = _mm_loadu_ps(&boxes->extent_x[i]);
+        __m128 extent_y = _mm_loadu_ps(&boxes->extent_y[i]);
+        __m128 extent_z = _mm_loadu_ps(&boxes->extent_z[i]);
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int j = 0; j < 6; ++j)
+        {
+            __m128 normal_x = _mm_set1_ps(planes[j][0]);
+            __m128 normal_y = _mm_set1_ps(planes[j][1]);
+            __m128 normal_z = _mm_set1_ps(planes[j][2]);
+
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x, centre_x),
+                        _mm_mul_ps(normal_y, centre_y)),
+                    _mm_add_ps(_mm_mul_ps(normal_z, centre_z), _mm_set1_ps(planes[j][3])));
+            __m128 reach = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_x), extent_x),
+                        _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_y), extent_y)),
+                    _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_z), extent_z));
+
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int k = 0; k < 4; ++k)
+            boxes->visible[i + k] = (mask >> k) & 1;
+    }
+
+    return n;
+}
+
+__attribute__((target("avx")))
+uint32_t frustum_test_avx(FrustumBoxes* boxes, vec4 planes[6])
+{
+    __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    __m256 zero = _mm256_setzero_ps();
+
+    uint32_t n = boxes->n & ~7u;
+    for (uint32_t i = 0; i < n; i += 8)
+    {
+        __m256 centre_x = _mm256_loadu_ps(&boxes->centre_x[i]);
+        __m256 centre_y = _mm256_loadu_ps(&boxes->centre_y[i]);
+        __m256 centre_z = _mm256_loadu_ps(&boxes->centre_z[i]);
+        __m256 extent_x = _mm256_loadu_ps(&boxes->extent_x[i]);
+        __m256 extent_y = _mm256_loadu_ps(&boxes->extent_y[i]);
+        __m256 extent_z = _mm256_loadu_ps(&boxes->extent_z[i]);
+
+        __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        for (int j = 0; j < 6; ++j)
+        {
+            __m256 normal_x = _mm256_set1_ps(planes[j][0]);
+            __m256 normal_y = _mm256_set1_ps(planes[j][1]);
+            __m256 normal_z = _mm256_set1_ps(planes[j][2]);
+
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normal_x, centre_x),
+                        _mm256_mul_ps(normal_y, centre_y)),
+                    _mm256_add_ps(_mm256_mul_ps(normal_z, centre_z), _mm256_set1_ps(planes[j][3])));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(_mm256_andnot_ps(sign_mask, normal_x), extent_x),
+                        _mm256_mul_ps(_mm256_andnot_ps(sign_mask, normal_y), extent_y)),
+                    _mm256_mul_ps(_mm256_andnot_ps(sign_mask, normal_z), extent_z));
+
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero,
+                        _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        for (int k = 0; k < 8; ++k)
+            boxes->visible[i + k] = (mask >> k) & 1;
+    }
+
+    return n;
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cglm/cglm.h>
+#include <stdint.h>
+
+// sse2 is always there on x86_64, avx gets picked at run time so the build needs no extra flags
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FRUSTUM_SIMD
+#endif
+
+// world space boxes as centres and half extents, an array per component so the planes can go
+// through several boxes at once
+typedef struct FrustumBoxes {
+    float* centre_x;
+    float* centre_y;
+    float* centre_z;
+    float* extent_x;
+    float* extent_y;
+    float* extent_z;
+    // filled in by frustum_test
+    uint8_t* visible;
+
+    uint32_t n;
+    uint32_t capacity;
+} FrustumBoxes;
+
+void frustum_boxes_cleanup(FrustumBoxes* boxes);
+// starts over, the arrays are kept for the next lot
+void frustum_boxes_clear(FrustumBoxes* boxes);
+// the mesh space box goes through transform, what comes out still holds everything that was in it
+void frustum_boxes_push(FrustumBoxes* boxes, mat4 transform, vec3 min, vec3 max);
+
+// planes as glm_frustum_planes gives them, pointing inwards. a box is only dropped once one plane
+// has all of it outside, returns how many were
+uint32_t frustum_test(FrustumBoxes* boxes, vec4 planes[6]);
+
+// internal
+void frustum_boxes_reserve(FrustumBoxes* boxes, uint32_t n);
+// from first to the end, what the wide versions leave over
+void frustum_test_scalar(FrustumBoxes* boxes, vec4 planes[6], uint32_t first);
+#ifdef FRUSTUM_SIMD
+// these do whole groups of 4 or 8 and return how many boxes that came to
+uint32_t frustum_test_sse(FrustumBoxes* boxes, vec4 planes[6]);
+uint32_t frustum_test_avx(FrustumBoxes* boxes, vec4 planes[6]);
+#endif
@@ -0,0 +1,63 @@
+#include "image_decode.h"
+#include "ktx2.h"
+#include "../utils.h"
+
+#include <stb_image.h>
+
+void image_data_decode(ImageData* image)
+{
+    File file = {0};
+    const uint8_t* encoded = image->encoded;
+    size_t encoded_size = image->encoded_size;
+    if (encoded == NULL && image->path != NULL)
+    {
+        file = file_map(image->path, FILE_ACCESS_SEQUENTIAL);
+        encoded = (const uint8_t*) file.buf;
+        encoded_size = file.size;
+    }
+
+    if (encoded == NULL)
+        LOG_W("Could not decode image %s: no image data\n", image->name);
+    else if (ktx2_is_ktx2(encoded, encoded_size))
+    {
+        // cooked textures come with their format and levels, they go up as they are
+        Ktx2Texture texture;
+        if (ktx2_read(image->name, encoded, encoded_size, &texture))
+        {
+            image->pixels = texture.data;
+            image->width = texture.width;
+            image->height = texture.height;
+            image->format = texture.format;
+            image->n_levels = texture.n_levels;
+            image->ktx2_file = file.buf != NULL;
+        }
+    }
+    else
+    {
+        int width, height, channels;
+        image->pixels = stbi_load_from_memory(encoded, encoded_size, &width, &height, &channels, 4);
+        if (image->pixels == NULL)
+            LOG_W("Could not decode image %s: %s\n", image->name, stbi_failure_reason());
+        else
+        {
+            image->width = width;
+            image->height = height;
+            image->format = VK_FORMAT_R8G8B8A8_UNORM;
+            image->n_levels = 1;
+        }
+    }
+
+    if (file.buf != NULL)
+        file_close(&file);
+
+    if (image->pixels == NULL)
+        return;
+
+    free(image->encoded);
+    image->encoded = NULL;
+}
+
+void image_data_decode_job(void* data, uint32_t index)
+{
+    image_data_decode(&((ImageData*) data)[index]);
+}
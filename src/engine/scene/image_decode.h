@@ -0,0 +1,8 @@
+#pragma once
+
+#include "import.h"
+
+// decodes ktx2 as it is and anything else to rgba8, then drops the encoded copy. failures are
+// logged and leave pixels NULL
+void image_data_decode(ImageData* image);
+void image_data_decode_job(void* data, uint32_t index);
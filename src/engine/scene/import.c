@@ -0,0 +1,837 @@
+#include "import.h"
+#include "mesh_optimise.h"
+#include "mesh_simplify.h"
+#include "meshlets.h"
+#include "vertex_dedup.h"
+#include "../utils.h"
+
+#include <stddef.h>
+#include <cgltf.h>
+#include <fast_obj.h>
+
+static cgltf_result LoadFileGLTFCallback(const struct cgltf_memory_options *memoryOptions, const struct cgltf_file_options *fileOptions, const char *path, cgltf_size *size, void **data)
+{
+    GltfFiles* files = fileOptions->user_data;
+
+    File file = file_map(path, FILE_ACCESS_RANDOM);
+    if (file.buf == NULL) return cgltf_result_io_error;
+
+    if (files->n == files->capacity)
+    {
+        files->capacity = files->capacity == 0 ? 4 : files->capacity * 2;
+        files->files = realloc(files->files, sizeof(File) * files->capacity);
+    }
+    files->files[files->n++] = file;
+
+    *size = file.size;
+    *data = file.buf;
+
+    return cgltf_result_success;
+}
+
+static void ReleaseFileGLTFCallback(const struct cgltf_memory_options *memoryOptions, const struct cgltf_file_options *fileOptions, void *data)
+{
+    GltfFiles* files = fileOptions->user_data;
+
+    for (uint32_t i = 0; i < files->n; ++i)
+    {
+        if (files->files[i].buf != data)
+            continue;
+
+        file_close(&files->files[i]);
+        files->files[i] = files->files[--files->n];
+        return;
+    }
+}
+
+MeshData* import_gltf(JobPool* jobs, char* file_path, uint32_t* out_n,
+        ImportedMaterials* out_materials)
+{
+    LOG_V("Importing GLTF %s\n", file_path);
+    uint64_t start_time = time_now_ns();
+
+    // the json is parsed straight out of the mapping, and a glb's binary chunk is used in place
+    File file = file_map(file_path, FILE_ACCESS_RANDOM);
+    if (file.buf == NULL)
+    {
+        LOG_E("Could not open GLTF file %s\n", file_path);
+        return NULL;
+    }
+
+    GltfFiles files = {0};
+
+    cgltf_options options = { 0 };
+    options.file.read = LoadFileGLTFCallback;
+    options.file.release = ReleaseFileGLTFCallback;
+    options.file.user_data = &files;
+    cgltf_data *data = NULL;
+    cgltf_result result = cgltf_parse(&options, file.buf, file.size, &data);
+
+    if (result != cgltf_result_success)
+    {
+        LOG_E("Could not load GLTF file %s %d\n", file_path, result);
+        file_close(&file);
+        return NULL;
+    }
+
+    result = cgltf_load_buffers(&options, data, file_path);
+
+    // accessors reaching past their buffers and the like, before anything reads them
+    if (result == cgltf_result_success)
+        result = cgltf_validate(data);
+
+    if (result != cgltf_result_success)
+    {
+        LOG_E("Could not load GLTF buffers for %s %d\n", file_path, result);
+        cgltf_free(data);
+        free(files.files);
+        file_close(&file);
+        return NULL;
+    }
+
+    if (out_materials != NULL)
+        gltf_import_materials(data, &options, file_path, out_materials);
+
+    MeshData* meshes = malloc(sizeof(MeshData) * data->meshes_count);
+    *out_n = data->meshes_count;
+
+    size_t n_chunks = 0;
+    for (int i = 0; i < data->meshes_count; ++i)
+    {
+        for (int j = 0; j < data->meshes[i].primitives_count; ++j)
+        {
+            if (gltf_primitive_supported(&data->meshes[i].primitives[j]))
+                n_chunks += gltf_primitive_chunks(&data->meshes[i].primitives[j]);
+        }
+    }
+
+    GltfPrimitiveJob* primitive_jobs = malloc(sizeof(GltfPrimitiveJob) * n_chunks);
+    uint32_t n_primitive_jobs = 0;
+
+    size_t total_vertices = 0;
+    size_t total_indices = 0;
+
+    // size everything exactly from the accessors and hand every primitive a fixed slice, so the
+    // decode can happen in any order and still give the same result
+    for (int i = 0; i < data->meshes_count; ++i)
+    {
+        cgltf_mesh* gltf_mesh = &data->meshes[i];
+        MeshData mesh = {0};
+
+        mesh.name = strdup(gltf_mesh->name != NULL ? gltf_mesh->name : "unnamed");
+        mesh.surfaces = malloc(sizeof(GeoSurface) * gltf_mesh->primitives_count);
+        mesh.surface_materials = malloc(sizeof(int32_t) * gltf_mesh->primitives_count);
+
+        for (int j = 0; j < gltf_mesh->primitives_count; ++j)
+        {
+            cgltf_primitive* primitive = &gltf_mesh->primitives[j];
+            if (!gltf_primitive_supported(primitive))
+                continue;
+
+            mesh.n_vertices += gltf_primitive_vertex_count(primitive);
+            mesh.n_indices += gltf_primitive_index_count(primitive);
+        }
+
+        mesh.indices = malloc(sizeof(uint32_t) * mesh.n_indices);
+        mesh.vertices = malloc(sizeof(Vertex) * mesh.n_vertices);
+
+        uint32_t index_offset = 0;
+        uint32_t vertex_offset = 0;
+
+        for (int j = 0; j < gltf_mesh->primitives_count; ++j)
+        {
+            cgltf_primitive* primitive = &gltf_mesh->primitives[j];
+            if (!gltf_primitive_supported(primitive))
+            {
+                LOG_W("Skipping primitive %d of %s, only indexed or plain triangles are supported\n",
+                        j, mesh.name);
+                continue;
+            }
+
+            GeoSurface new_surface = {
+                .start_index = index_offset,
+                .count = gltf_primitive_index_count(primitive),
+            };
+
+            // every chunk gets an even share of both the vertices and the indices
+            uint32_t n_vertices = gltf_primitive_vertex_count(primitive);
+            uint32_t chunks = gltf_primitive_chunks(primitive);
+            for (uint32_t k = 0; k < chunks; ++k)
+            {
+                uint32_t first_vertex = (uint64_t) n_vertices * k / chunks;
+                uint32_t first_index = (uint64_t) new_surface.count * k / chunks;
+
+                primitive_jobs[n_primitive_jobs] = (GltfPrimitiveJob) {
+                    .primitive = primitive,
+                    .indices = mesh.indices + index_offset,
+                    .vertices = mesh.vertices + vertex_offset,
+                    .base_vertex = vertex_offset,
+                    .first_vertex = first_vertex,
+                    .n_vertices = (uint64_t) n_vertices * (k + 1) / chunks - first_vertex,
+                    .first_index = first_index,
+                    .n_indices = (uint64_t) new_surface.count * (k + 1) / chunks - first_index,
+                };
+                n_primitive_jobs += 1;
+            }
+
+            index_offset += new_surface.count;
+            vertex_offset += n_vertices;
+
+            mesh.surfaces[mesh.n_surfaces] = new_surface;
+            mesh.surface_materials[mesh.n_surfaces] = primitive->material == NULL || out_materials == NULL
+                ? -1 : cgltf_material_index(data, primitive->material);
+            mesh.n_surfaces += 1;
+        }
+
+        meshes[i] = mesh;
+
+        total_vertices += mesh.n_vertices;
+        total_indices += mesh.n_indices;
+    }
+
+    uint64_t decode_start_time = time_now_ns();
+    job_pool_parallel_for(jobs, gltf_decode_primitive_job, primitive_jobs, n_primitive_jobs);
+    double decode_ms = (time_now_ns() - decode_start_time) / 1e6;
+
+    // everything after this indexes the vertices without checking
+    bool indices_valid = true;
+    for (uint32_t i = 0; i < n_primitive_jobs && indices_valid; ++i)
+        indices_valid = gltf_indices_valid(&primitive_jobs[i]);
+
+    free(primitive_jobs);
+
+    if (!indices_valid)
+    {
+        LOG_E("%s has indices past the end of their primitive's vertices\n", file_path);
+        mesh_datas_free(meshes, *out_n);
+        if (out_materials != NULL)
+        {
+            imported_materials_free(out_materials);
+            *out_materials = (ImportedMaterials) {0};
+        }
+        cgltf_free(data);
+        free(files.files);
+        file_close(&file);
+        return NULL;
+    }
+
+    uint64_t optimise_start_time = time_now_ns();
+    meshes_optimise(jobs, meshes, *out_n);
+    job_pool_parallel_for(jobs, mesh_generate_lods_job, meshes, *out_n);
+    meshes_build_meshlets(jobs, meshes, *out_n);
+    double optimise_ms = (time_now_ns() - optimise_start_time) / 1e6;
+
+    cgltf_free(data);
+    free(files.files);
+    // glb binary chunks point into the file, so this has to outlive cgltf_free
+    file_close(&file);
+
+    double elapsed_ms = (time_now_ns() - start_time) / 1e6;
+    LOG_V("Imported %s: %d meshes, %zu vertices, %zu indices in %.1lf ms (%.1lf ms decoding, %.1lf ms "
+            "optimising, building lods and meshlets on %d threads, peak RSS %.1lf MB)\n", file_path,
+            *out_n, total_vertices, total_indices, elapsed_ms, decode_ms, optimise_ms,
+            jobs->n_threads + 1, peak_rss_kb() / 1024.0);
+
+    return meshes;
+}
+
+bool gltf_primitive_supported(cgltf_primitive* primitive)
+{
+    return primitive->type == cgltf_primitive_type_triangles
+        && cgltf_find_accessor(primitive, cgltf_attribute_type_position, 0) != NULL;
+}
+
+uint32_t gltf_primitive_vertex_count(cgltf_primitive* primitive)
+{
+    return cgltf_find_accessor(primitive, cgltf_attribute_type_position, 0)->count;
+}
+
+uint32_t gltf_primitive_index_count(cgltf_primitive* primitive)
+{
+    // non indexed primitives get a generated 0..n index list
+    if (primitive->indices == NULL)
+        return gltf_primitive_vertex_count(primitive);
+
+    return primitive->indices->count;
+}
+
+// enough chunks that none has more than GLTF_DECODE_CHUNK vertices or indices
+uint32_t gltf_primitive_chunks(cgltf_primitive* primitive)
+{
+    uint32_t n_vertices = gltf_primitive_vertex_count(primitive);
+    uint32_t n_indices = gltf_primitive_index_count(primitive);
+    uint32_t n = n_vertices > n_indices ? n_vertices : n_indices;
+
+    return n == 0 ? 1 : (n + GLTF_DECODE_CHUNK - 1) / GLTF_DECODE_CHUNK;
+}
+
+void gltf_decode_primitive_job(void* data, uint32_t index)
+{
+    gltf_decode_primitive(&((GltfPrimitiveJob*) data)[index]);
+}
+
+// whether every index of the chunk stays inside the vertices its primitive decoded
+bool gltf_indices_valid(GltfPrimitiveJob* job)
+{
+    uint32_t n_vertices = gltf_primitive_vertex_count(job->primitive);
+    uint32_t* indices = job->indices + job->first_index;
+
+    for (uint32_t i = 0; i < job->n_indices; ++i)
+    {
+        if (indices[i] - job->base_vertex >= n_vertices)
+            return false;
+    }
+
+    return true;
+}
+
+// decodes one chunk of a primitive straight into its slice of the mesh's final arrays
+void gltf_decode_primitive(GltfPrimitiveJob* job)
+{
+    cgltf_primitive* primitive = job->primitive;
+    uint32_t* indices = job->indices + job->first_index;
+
+    // indices
+    if (primitive->indices == NULL)
+    {
+        for (uint32_t a = 0; a < job->n_indices; ++a)
+            indices[a] = job->first_index + a;
+    }
+    else
+    {
+        gltf_read_indices(primitive->indices, indices, job->first_index, job->n_indices);
+    }
+
+    for (uint32_t a = 0; a < job->n_indices; ++a)
+        indices[a] += job->base_vertex;
+
+    // defaults for anything the primitive doesn't provide
+    for (uint32_t a = job->first_vertex; a < job->first_vertex + job->n_vertices; ++a)
+    {
+        job->vertices[a] = (Vertex) {
+            .colour = { 1, 1, 1, 1 },
+        };
+    }
+
+    // vertices, one pass per accessor
+    const size_t position_offsets[] = {
+        offsetof(Vertex, position[0]), offsetof(Vertex, position[1]), offsetof(Vertex, position[2]),
+    };
+    const size_t normal_offsets[] = {
+        offsetof(Vertex, normal[0]), offsetof(Vertex, normal[1]), offsetof(Vertex, normal[2]),
+    };
+    const size_t uv_offsets[] = {
+        offsetof(Vertex, uv_x), offsetof(Vertex, uv_y),
+    };
+    const size_t colour_offsets[] = {
+        offsetof(Vertex, colour[0]), offsetof(Vertex, colour[1]), offsetof(Vertex, colour[2]),
+        offsetof(Vertex, colour[3]),
+    };
+
+    for (int a = 0; a < primitive->attributes_count; ++a)
+    {
+        cgltf_attribute* attribute = &primitive->attributes[a];
+
+        // only the first uv and colour sets fit in a Vertex
+        if (attribute->index != 0)
+            continue;
+
+        const size_t* offsets = NULL;
+        int n_offsets = 0;
+        switch (attribute->type)
+        {
+            case cgltf_attribute_type_position:
+                offsets = position_offsets;
+                n_offsets = 3;
+                break;
+            case cgltf_attribute_type_normal:
+                offsets = normal_offsets;
+                n_offsets = 3;
+                break;
+            case cgltf_attribute_type_texcoord:
+                offsets = uv_offsets;
+                n_offsets = 2;
+                break;
+            case cgltf_attribute_type_color:
+                offsets = colour_offsets;
+                n_offsets = 4;
+                break;
+            default:
+                break;
+        }
+
+        if (offsets != NULL)
+            gltf_read_attribute(attribute->data, job->vertices, job->first_vertex, job->n_vertices,
+                    offsets, n_offsets);
+    }
+}
+
+// count indices from element first on, tightly described data is read straight out of the buffer
+void gltf_read_indices(cgltf_accessor* accessor, uint32_t* indices, uint32_t first, uint32_t count)
+{
+    const uint8_t* src = NULL;
+    if (!accessor->is_sparse && accessor->buffer_view != NULL)
+        src = cgltf_buffer_view_data(accessor->buffer_view);
+
+    if (src == NULL)
+    {
+        // sparse index accessors have to go element by element
+        for (uint32_t i = 0; i < count; ++i)
+            indices[i] = cgltf_accessor_read_index(accessor, first + i);
+        return;
+    }
+
+    src += accessor->offset + accessor->stride * first;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t* element = src + accessor->stride * i;
+
+        switch (accessor->component_type)
+        {
+            case cgltf_component_type_r_8u:
+                indices[i] = *element;
+                break;
+            case cgltf_component_type_r_16u:
+            {
+                uint16_t index;
+                memcpy(&index, element, sizeof(uint16_t));
+                indices[i] = index;
+                break;
+            }
+            default:
+                memcpy(&indices[i], element, sizeof(uint32_t));
+                break;
+        }
+    }
+}
+
+// scatters elements [first, first + count) of the accessor into the given float fields of the
+// vertices, past the accessor's end the defaults stay
+void gltf_read_attribute(cgltf_accessor* accessor, Vertex* vertices, uint32_t first, uint32_t count,
+        const size_t* offsets, int n_offsets)
+{
+    int n_components = cgltf_num_components(accessor->type);
+    if (n_components > n_offsets)
+        n_components = n_offsets;
+
+    uint32_t end = first + count;
+    if (end > accessor->count)
+        end = accessor->count < first ? first : accessor->count;
+
+    // tightly described float data is copied directly out of the buffer
+    const uint8_t* src = NULL;
+    if (accessor->component_type == cgltf_component_type_r_32f && !accessor->is_sparse
+            && accessor->buffer_view != NULL)
+        src = cgltf_buffer_view_data(accessor->buffer_view);
+
+    if (src != NULL)
+    {
+        src += accessor->offset;
+
+        for (uint32_t i = first; i < end; ++i)
+        {
+            const uint8_t* element = src + i * accessor->stride;
+            char* dst = (char*) &vertices[i];
+
+            for (int c = 0; c < n_components; ++c)
+                memcpy(dst + offsets[c], element + c * sizeof(float), sizeof(float));
+        }
+
+        return;
+    }
+
+    // normalised integers and sparse accessors need converting
+    for (uint32_t i = first; i < end; ++i)
+    {
+        float element[4];
+        cgltf_accessor_read_float(accessor, i, element, n_components);
+
+        char* dst = (char*) &vertices[i];
+        for (int c = 0; c < n_components; ++c)
+            memcpy(dst + offsets[c], &element[c], sizeof(float));
+    }
+}
+
+// only the encoded bytes are copied here, so decoding can carry on after the gltf is freed
+void gltf_import_materials(cgltf_data* data, cgltf_options* options, char* file_path,
+        ImportedMaterials* out_materials)
+{
+    out_materials->n_materials = data->materials_count;
+    out_materials->materials = malloc(sizeof(MaterialData) * data->materials_count);
+    out_materials->n_images = 0;
+    out_materials->images = malloc(sizeof(ImageData) * data->images_count);
+
+    // gltf image index to imported image index, -1 until something uses it
+    int32_t* image_remap = malloc(sizeof(int32_t) * data->images_count);
+    for (size_t i = 0; i < data->images_count; ++i)
+        image_remap[i] = -1;
+
+    for (size_t i = 0; i < data->materials_count; ++i)
+    {
+        cgltf_material* gltf_material = &data->materials[i];
+        MaterialData* material = &out_materials->materials[i];
+
+        *material = (MaterialData) {
+            .colour_factors = { 1, 1, 1, 1 },
+            .metal_rough_factors = { 1, 1, 0, 0 },
+            .colour_image = -1,
+            .metal_rough_image = -1,
+            .pass = gltf_material->alpha_mode == cgltf_alpha_mode_blend
+                ? MAT_PASS_TRANSPARENT : MAT_PASS_MAIN_COLOUR,
+        };
+
+        if (!gltf_material->has_pbr_metallic_roughness)
+            continue;
+
+        cgltf_pbr_metallic_roughness* pbr = &gltf_material->pbr_metallic_roughness;
+        memcpy(material->colour_factors, pbr->base_color_factor, sizeof(vec4));
+        material->metal_rough_factors[0] = pbr->metallic_factor;
+        material->metal_rough_factors[1] = pbr->roughness_factor;
+
+        material->colour_image = gltf_import_image(data, options, file_path,
+                pbr->base_color_texture.texture, image_remap, out_materials);
+        material->metal_rough_image = gltf_import_image(data, options, file_path,
+                pbr->metallic_roughness_texture.texture, image_remap, out_materials);
+    }
+
+    free(image_remap);
+
+    LOG_V("Found %d materials using %d images\n", out_materials->n_materials,
+            out_materials->n_images);
+}
+
+int32_t gltf_import_image(cgltf_data* data, cgltf_options* options, char* file_path,
+        cgltf_texture* texture, int32_t* image_remap, ImportedMaterials* out_materials)
+{
+    if (texture == NULL || texture->image == NULL)
+        return -1;
+
+    cgltf_size gltf_index = cgltf_image_index(data, texture->image);
+    if (image_remap[gltf_index] != -1)
+        return image_remap[gltf_index];
+
+    ImageData* image = &out_materials->images[out_materials->n_images];
+    *image = (ImageData) {
+        .name = strdup(texture->image->name != NULL ? texture->image->name : "unnamed"),
+    };
+
+    // an image with nothing to read is kept anyway, it fails to decode and shows as the error image
+    gltf_read_image(texture->image, options, file_path, image);
+
+    image_remap[gltf_index] = out_materials->n_images;
+    out_materials->n_images += 1;
+
+    return image_remap[gltf_index];
+}
+
+// embedded and data uri images are copied out, anything else is left for the decoder to open
+void gltf_read_image(cgltf_image* gltf_image, cgltf_options* options, char* file_path,
+        ImageData* image)
+{
+    if (gltf_image->buffer_view != NULL)
+    {
+        image->encoded_size = gltf_image->buffer_view->size;
+        image->encoded = malloc(image->encoded_size);
+        memcpy(image->encoded, cgltf_buffer_view_data(gltf_image->buffer_view), image->encoded_size);
+        return;
+    }
+
+    if (gltf_image->uri == NULL)
+        return;
+
+    if (strncmp(gltf_image->uri, "data:", 5) == 0)
+    {
+        const char* base64 = strstr(gltf_image->uri, ";base64,");
+        if (base64 == NULL)
+            return;
+
+        base64 += strlen(";base64,");
+        size_t length = strlen(base64);
+        size_t size = length / 4 * 3;
+        while (length != 0 && base64[--length] == '=')
+            size -= 1;
+
+        void* decoded = NULL;
+        if (cgltf_load_buffer_base64(options, size, base64, &decoded) == cgltf_result_success)
+        {
+            image->encoded = decoded;
+            image->encoded_size = size;
+        }
+        return;
+    }
+
+    // relative to the gltf
+    const char* slash = strrchr(file_path, '/');
+    size_t directory_length = slash == NULL ? 0 : slash - file_path + 1;
+
+    image->path = malloc(directory_length + strlen(gltf_image->uri) + 1);
+    memcpy(image->path, file_path, directory_length);
+    strcpy(image->path + directory_length, gltf_image->uri);
+    cgltf_decode_uri(image->path + directory_length);
+}
+
+// one surface per material. corners sharing a (position, uv, normal) triple become one vertex,
+// polygons are fan triangulated
+MeshData* import_obj(JobPool* jobs, char* file_path, uint32_t* out_n,
+        ImportedMaterials* out_materials)
+{
+    LOG_V("Importing OBJ %s\n", file_path);
+    uint64_t start_time = time_now_ns();
+
+    fastObjMesh* obj_mesh = fast_obj_read(file_path);
+    if (obj_mesh == NULL)
+    {
+        LOG_E("Could not load OBJ file %s\n", file_path);
+        return NULL;
+    }
+
+    // the vertices are built straight from whatever the faces point at
+    if (!obj_indices_valid(obj_mesh))
+    {
+        LOG_E("%s has faces using positions, uvs or normals it doesn't have\n", file_path);
+        fast_obj_destroy(obj_mesh);
+        return NULL;
+    }
+
+    double parse_ms = (time_now_ns() - start_time) / 1e6;
+
+    MeshData* mesh = calloc(1, sizeof(MeshData));
+    *out_n = 1;
+
+    mesh->name = strdup(file_path);
+
+    // fastObjIndex is three packed unsigned ints, so the corners can be deduplicated in place
+    uint64_t dedup_start_time = time_now_ns();
+    uint32_t* corner_vertices = malloc(sizeof(uint32_t) * obj_mesh->index_count);
+    uint32_t* unique_corners = malloc(sizeof(uint32_t) * obj_mesh->index_count);
+    mesh->n_vertices = dedup_triples(jobs, (const uint32_t*) obj_mesh->indices, obj_mesh->index_count,
+            corner_vertices, unique_corners);
+
+    mesh->vertices = malloc(sizeof(Vertex) * mesh->n_vertices);
+    ObjVertexJob vertex_job = { obj_mesh, unique_corners, mesh->vertices };
+    job_pool_parallel_for(jobs, obj_build_vertex_job, &vertex_job, mesh->n_vertices);
+
+    free(unique_corners);
+    double dedup_ms = (time_now_ns() - dedup_start_time) / 1e6;
+
+    // count the indices of every material, then lay the groups out one after the other
+    uint32_t n_groups = obj_mesh->material_count == 0 ? 1 : obj_mesh->material_count;
+    uint32_t* group_starts = calloc(n_groups + 1, sizeof(uint32_t));
+    for (uint32_t i = 0; i < obj_mesh->face_count; ++i)
+    {
+        uint32_t group = obj_face_group(obj_mesh, i, n_groups);
+        group_starts[group + 1] += obj_face_triangle_count(obj_mesh, i) * 3;
+    }
+
+    for (uint32_t g = 0; g < n_groups; ++g)
+        group_starts[g + 1] += group_starts[g];
+
+    mesh->n_indices = group_starts[n_groups];
+    mesh->indices = malloc(sizeof(uint32_t) * mesh->n_indices);
+
+    uint32_t* group_ends = malloc(sizeof(uint32_t) * n_groups);
+    memcpy(group_ends, group_starts, sizeof(uint32_t) * n_groups);
+
+    uint32_t* indices = mesh->indices;
+    uint32_t corner = 0;
+    for (uint32_t i = 0; i < obj_mesh->face_count; ++i)
+    {
+        uint32_t* end = &group_ends[obj_face_group(obj_mesh, i, n_groups)];
+        uint32_t n_corners = obj_mesh->face_vertices[i];
+
+        for (uint32_t j = 1; j + 1 < n_corners; ++j)
+        {
+            indices[(*end)++] = corner_vertices[corner];
+            indices[(*end)++] = corner_vertices[corner + j];
+            indices[(*end)++] = corner_vertices[corner + j + 1];
+        }
+
+        corner += n_corners;
+    }
+
+    free(group_ends);
+    free(corner_vertices);
+
+    bool with_materials = out_materials != NULL && obj_mesh->material_count != 0;
+    if (with_materials)
+        obj_import_materials(obj_mesh, out_materials);
+
+    mesh->surfaces = malloc(sizeof(GeoSurface) * n_groups);
+    mesh->surface_materials = with_materials ? malloc(sizeof(int32_t) * n_groups) : NULL;
+
+    for (uint32_t g = 0; g < n_groups; ++g)
+    {
+        uint32_t count = group_starts[g + 1] - group_starts[g];
+        if (count == 0)
+            continue;
+
+        mesh->surfaces[mesh->n_surfaces] = (GeoSurface) {
+            .start_index = group_starts[g],
+            .count = count,
+        };
+        if (with_materials)
+            mesh->surface_materials[mesh->n_surfaces] = g;
+        mesh->n_surfaces += 1;
+    }
+
+    free(group_starts);
+
+    uint32_t n_faces = obj_mesh->face_count;
+    uint32_t n_corners = obj_mesh->index_count;
+    fast_obj_destroy(obj_mesh);
+
+    uint64_t optimise_start_time = time_now_ns();
+    meshes_optimise(jobs, mesh, 1);
+    mesh_generate_lods(mesh);
+    meshes_build_meshlets(jobs, mesh, 1);
+    double optimise_ms = (time_now_ns() - optimise_start_time) / 1e6;
+
+    LOG_V("Imported %s: %u faces, %u corners into %u vertices and %u surfaces in %.1lf ms (%.1lf ms "
+            "parsing, %.1lf ms deduplicating on %d threads, %.1lf ms optimising)\n", file_path, n_faces,
+            n_corners, mesh->n_vertices, mesh->n_surfaces, (time_now_ns() - start_time) / 1e6, parse_ms,
+            dedup_ms, jobs->n_threads + 1, optimise_ms);
+
+    return mesh;
+}
+
+// index 0 of every fast_obj array is a dummy entry, so missing data reads as zeroes
+void obj_build_vertex_job(void* data, uint32_t index)
+{
+    ObjVertexJob* job = data;
+    fastObjMesh* obj_mesh = job->obj_mesh;
+    fastObjIndex corner = obj_mesh->indices[job->unique_corners[index]];
+
+    Vertex* v = &job->vertices[index];
+    *v = (Vertex) {
+        .position = {
+            obj_mesh->positions[corner.p * 3 + 0],
+            obj_mesh->positions[corner.p * 3 + 1],
+            obj_mesh->positions[corner.p * 3 + 2],
+        },
+        .normal = {
+            obj_mesh->normals[corner.n * 3 + 0],
+            obj_mesh->normals[corner.n * 3 + 1],
+            obj_mesh->normals[corner.n * 3 + 2],
+        },
+        .uv_x = obj_mesh->texcoords[corner.t * 2 + 0],
+        .uv_y = obj_mesh->texcoords[corner.t * 2 + 1],
+        .colour = { 1, 1, 1, 1 },
+    };
+
+    // scans often come with a colour after each position instead of a texture
+    if (obj_mesh->color_count != 0)
+    {
+        v->colour[0] = obj_mesh->colors[corner.p * 3 + 0];
+        v->colour[1] = obj_mesh->colors[corner.p * 3 + 1];
+        v->colour[2] = obj_mesh->colors[corner.p * 3 + 2];
+    }
+}
+
+// fast_obj resolves relative indices but leaves ones past the end alone. the counts include the
+// dummy element at 0 that missing uvs and normals point at
+bool obj_indices_valid(fastObjMesh* obj_mesh)
+{
+    for (uint32_t i = 0; i < obj_mesh->index_count; ++i)
+    {
+        fastObjIndex corner = obj_mesh->indices[i];
+        if (corner.p >= obj_mesh->position_count || corner.t >= obj_mesh->texcoord_count
+                || corner.n >= obj_mesh->normal_count)
+            return false;
+    }
+
+    return true;
+}
+
+uint32_t obj_face_group(fastObjMesh* obj_mesh, uint32_t face, uint32_t n_groups)
+{
+    if (obj_mesh->face_materials == NULL)
+        return 0;
+
+    uint32_t material = obj_mesh->face_materials[face];
+    return material < n_groups ? material : 0;
+}
+
+uint32_t obj_face_triangle_count(fastObjMesh* obj_mesh, uint32_t face)
+{
+    uint32_t n_corners = obj_mesh->face_vertices[face];
+    return n_corners < 3 ? 0 : n_corners - 2;
+}
+
+// diffuse colour and texture only, obj has nothing that maps onto metalness
+void obj_import_materials(fastObjMesh* obj_mesh, ImportedMaterials* out_materials)
+{
+    out_materials->n_materials = obj_mesh->material_count;
+    out_materials->materials = malloc(sizeof(MaterialData) * obj_mesh->material_count);
+    out_materials->n_images = 0;
+    out_materials->images = malloc(sizeof(ImageData) * obj_mesh->texture_count);
+
+    // texture index to imported image index, -1 until something uses it
+    int32_t* image_remap = malloc(sizeof(int32_t) * obj_mesh->texture_count);
+    for (uint32_t i = 0; i < obj_mesh->texture_count; ++i)
+        image_remap[i] = -1;
+
+    for (uint32_t i = 0; i < obj_mesh->material_count; ++i)
+    {
+        fastObjMaterial* obj_material = &obj_mesh->materials[i];
+        MaterialData* material = &out_materials->materials[i];
+
+        *material = (MaterialData) {
+            .colour_factors = { obj_material->Kd[0], obj_material->Kd[1], obj_material->Kd[2],
+                obj_material->d },
+            .metal_rough_factors = { 0, 1, 0, 0 },
+            .colour_image = -1,
+            .metal_rough_image = -1,
+            .pass = obj_material->d < 1 ? MAT_PASS_TRANSPARENT : MAT_PASS_MAIN_COLOUR,
+        };
+
+        uint32_t texture = obj_material->map_Kd;
+        if (texture == 0 || texture >= obj_mesh->texture_count)
+            continue;
+
+        // fast_obj already resolved the path against the mtl file
+        if (image_remap[texture] == -1)
+        {
+            fastObjTexture* obj_texture = &obj_mesh->textures[texture];
+            out_materials->images[out_materials->n_images] = (ImageData) {
+                .name = strdup(obj_texture->name != NULL ? obj_texture->name : "unnamed"),
+                .path = obj_texture->path != NULL ? strdup(obj_texture->path) : NULL,
+            };
+
+            image_remap[texture] = out_materials->n_images;
+            out_materials->n_images += 1;
+        }
+
+        material->colour_image = image_remap[texture];
+    }
+
+    free(image_remap);
+}
+
+void mesh_datas_free(MeshData* meshes, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        free(meshes[i].name);
+        free(meshes[i].surfaces);
+        free(meshes[i].vertices);
+        free(meshes[i].indices);
+        free(meshes[i].meshlets);
+        free(meshes[i].surface_materials);
+    }
+    free(meshes);
+}
+
+void imported_materials_free(ImportedMaterials* materials)
+{
+    for (uint32_t i = 0; i < materials->n_images; ++i)
+    {
+        free(materials->images[i].name);
+        free(materials->images[i].encoded);
+        free(materials->images[i].path);
+        // stb_image allocates with plain malloc
+        free(materials->images[i].pixels);
+    }
+    free(materials->images);
+    free(materials->materials);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../renderer/renderer.h"
+#include "../jobs.h"
+#include "../utils.h"
+#include <cgltf.h>
+#include <fast_obj.h>
+
+// cpu side geometry of a mesh, before it is uploaded or cooked
+typedef struct MeshData {
+    char* name;
+
+    uint32_t n_surfaces;
+    GeoSurface* surfaces;
+
+    Vertex* vertices;
+    uint32_t* indices;
+    uint32_t n_vertices;
+    uint32_t n_indices;
+
+    // bounding sphere, filled in with the lods
+    vec4 bounds;
+
+    // built last, over every lod of every surface
+    Meshlet* meshlets;
+    uint32_t n_meshlets;
+
+    // per surface index into ImportedMaterials.materials, -1 or a NULL array for the default
+    int32_t* surface_materials;
+} MeshData;
+
+// an image used by a material. importing only gathers the encoded bytes, or the file they are in
+// when the image isn't embedded, the pixels are filled in by image_data_decode
+typedef struct ImageData {
+    char* name;
+    uint8_t* encoded;
+    size_t encoded_size;
+    char* path;
+
+    // every level back to back from the largest, NULL until decoded or when decoding failed.
+    // ktx2 files keep their format and prebuilt levels, anything else decodes to one rgba8 level
+    uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    VkFormat format;
+    uint32_t n_levels;
+    // the levels are the ktx2 file at path as it is, so they can be read from there again
+    bool ktx2_file;
+} ImageData;
+
+// images are indices into ImportedMaterials.images, -1 when the material has no texture
+typedef struct MaterialData {
+    vec4 colour_factors;
+    vec4 metal_rough_factors;
+    int32_t colour_image;
+    int32_t metal_rough_image;
+    enum MaterialPass pass;
+} MaterialData;
+
+typedef struct ImportedMaterials {
+    MaterialData* materials;
+    uint32_t n_materials;
+
+    // each image once, however many textures and materials use it
+    ImageData* images;
+    uint32_t n_images;
+} ImportedMaterials;
+
+// the external buffers cgltf asked for. its release callback only gets the pointer back, so the
+// rest of each File is kept here to unmap it
+typedef struct GltfFiles {
+    File* files;
+    uint32_t n;
+    uint32_t capacity;
+} GltfFiles;
+
+// primitives bigger than this are decoded in several jobs, each a share of the vertices and of
+// the indices
+#define GLTF_DECODE_CHUNK (1 << 16)
+
+// one chunk of a primitive and the slice of its mesh's arrays the primitive decodes into
+typedef struct GltfPrimitiveJob {
+    cgltf_primitive* primitive;
+    uint32_t* indices;
+    Vertex* vertices;
+    uint32_t base_vertex;
+
+    // the chunk's share, relative to the primitive
+    uint32_t first_vertex;
+    uint32_t n_vertices;
+    uint32_t first_index;
+    uint32_t n_indices;
+} GltfPrimitiveJob;
+
+// the deduplicated obj vertices, each built from the first corner that used it
+typedef struct ObjVertexJob {
+    fastObjMesh* obj_mesh;
+    const uint32_t* unique_corners;
+    Vertex* vertices;
+} ObjVertexJob;
+
+// out_materials may be NULL when only the geometry is wanted. NULL when the file can't be read,
+// the reason has been logged
+MeshData* import_gltf(JobPool* jobs, char* file_path, uint32_t* out_n,
+        ImportedMaterials* out_materials);
+MeshData* import_obj(JobPool* jobs, char* file_path, uint32_t* out_n,
+        ImportedMaterials* out_materials);
+void mesh_datas_free(MeshData* meshes, uint32_t n);
+void imported_materials_free(ImportedMaterials* materials);
+
+// internal
+bool gltf_primitive_supported(cgltf_primitive* primitive);
+uint32_t gltf_primitive_vertex_count(cgltf_primitive* primitive);
+uint32_t gltf_primitive_index_count(cgltf_primitive* primitive);
+uint32_t gltf_primitive_chunks(cgltf_primitive* primitive);
+void gltf_decode_primitive_job(void* data, uint32_t index);
+bool gltf_indices_valid(GltfPrimitiveJob* job);
+void gltf_decode_primitive(GltfPrimitiveJob* job);
+void gltf_read_indices(cgltf_accessor* accessor, uint32_t* indices, uint32_t first, uint32_t count);
+void gltf_read_attribute(cgltf_accessor* accessor, Vertex* vertices, uint32_t first, uint32_t count,
+        const size_t* offsets, int n_offsets);
+void gltf_import_materials(cgltf_data* data, cgltf_options* options, char* file_path,
+        ImportedMaterials* out_materials);
+int32_t gltf_import_image(cgltf_data* data, cgltf_options* options, char* file_path,
+        cgltf_texture* texture, int32_t* image_remap, ImportedMaterials* out_materials);
+void gltf_read_image(cgltf_image* gltf_image, cgltf_options* options, char* file_path,
+        ImageData* image);
+void obj_build_vertex_job(void* data, uint32_t index);
+bool obj_indices_valid(fastObjMesh* obj_mesh);
+uint32_t obj_face_group(fastObjMesh* obj_mesh, uint32_t face, uint32_t n_groups);
+uint32_t obj_face_triangle_count(fastObjMesh* obj_mesh, uint32_t face);
+void obj_import_materials(fastObjMesh* obj_mesh, ImportedMaterials* out_materials);
@@ -0,0 +1,292 @@
+#include "ktx2.h"
+#include "../utils.h"
+
+#include <string.h>
+
+static const uint8_t KTX2_IDENTIFIER[KTX2_IDENTIFIER_SIZE] = {
+    0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+};
+
+bool ktx2_is_ktx2(const uint8_t* data, size_t size)
+{
+    return size >= sizeof(Ktx2Header) && memcmp(data, KTX2_IDENTIFIER, KTX2_IDENTIFIER_SIZE) == 0;
+}
+
+bool ktx2_read(const char* name, const uint8_t* data, size_t size, Ktx2Texture* out_texture)
+{
+    const uint8_t* levels[KTX2_MAX_LEVELS];
+    if (!ktx2_levels(name, data, size, out_texture, levels))
+        return false;
+
+    uint8_t* texels = malloc(texture_chain_size(out_texture->format, out_texture->width,
+                out_texture->height, out_texture->n_levels));
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < out_texture->n_levels; ++i)
+    {
+        size_t level_size = texture_level_size(out_texture->format,
+                texture_mip_dimension(out_texture->width, i),
+                texture_mip_dimension(out_texture->height, i));
+
+        memcpy(texels + offset, levels[i], level_size);
+        offset += level_size;
+    }
+
+    out_texture->data = texels;
+
+    return true;
+}
+
+bool ktx2_levels(const char* name, const uint8_t* data, size_t size, Ktx2Texture* out_texture,
+        const uint8_t** out_levels)
+{
+    if (!ktx2_is_ktx2(data, size))
+    {
+        LOG_W("%s is not a ktx2 file\n", name);
+        return false;
+    }
+
+    Ktx2Header header;
+    memcpy(&header, data, sizeof(Ktx2Header));
+
+    VkFormat format = header.vk_format;
+    // a level count of 0 asks for the mips to be generated, which the upload does anyway
+    uint32_t n_levels = header.level_count == 0 ? 1 : header.level_count;
+
+    if (texture_format_block_size(format) == 0)
+    {
+        LOG_W("%s has unsupported format %d\n", name, header.vk_format);
+        return false;
+    }
+    if (header.supercompression_scheme != 0)
+    {
+        LOG_W("%s is supercompressed (scheme %d), only plain ktx2 is supported\n", name,
+                header.supercompression_scheme);
+        return false;
+    }
+    if (header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth > 1
+            || header.layer_count > 1 || header.face_count != 1)
+    {
+        LOG_W("%s is not a plain 2d texture\n", name);
+        return false;
+    }
+    if (n_levels > texture_mip_count(header.pixel_width, header.pixel_height))
+    {
+        LOG_W("%s has %d levels, more than its size allows\n", name, n_levels);
+        return false;
+    }
+    if (!ktx2_range_valid(size, sizeof(Ktx2Header), sizeof(Ktx2Level) * (uint64_t) n_levels))
+    {
+        LOG_W("%s is truncated\n", name);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < n_levels; ++i)
+    {
+        Ktx2Level level;
+        memcpy(&level, data + sizeof(Ktx2Header) + sizeof(Ktx2Level) * i, sizeof(Ktx2Level));
+
+        size_t level_size = texture_level_size(format,
+                texture_mip_dimension(header.pixel_width, i),
+                texture_mip_dimension(header.pixel_height, i));
+
+        if (level.byte_length != level_size
+                || !ktx2_range_valid(size, level.byte_offset, level_size))
+        {
+            LOG_W("Level %d of %s is %lu bytes at %lu, expected %zu\n", i, name,
+                    (unsigned long) level.byte_length, (unsigned long) level.byte_offset,
+                    level_size);
+            return false;
+        }
+
+        out_levels[i] = data + level.byte_offset;
+    }
+
+    *out_texture = (Ktx2Texture) {
+        .format = format,
+        .width = header.pixel_width,
+        .height = header.pixel_height,
+        .n_levels = n_levels,
+    };
+
+    return true;
+}
+
+void ktx2_write(const char* path, const Ktx2Texture* texture)
+{
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+        FATAL("Could not open %s for writing\n", path);
+
+    uint32_t dfd[KTX2_DFD_MAX_WORDS];
+    uint32_t dfd_size = ktx2_build_dfd(texture->format, dfd);
+
+    uint64_t index_size = sizeof(Ktx2Level) * (uint64_t) texture->n_levels;
+
+    Ktx2Header header = {
+        .vk_format = texture->format,
+        .type_size = 1,
+        .pixel_width = texture->width,
+        .pixel_height = texture->height,
+        .face_count = 1,
+        .level_count = texture->n_levels,
+        .dfd_byte_offset = sizeof(Ktx2Header) + index_size,
+        .dfd_byte_length = dfd_size,
+    };
+    memcpy(header.identifier, KTX2_IDENTIFIER, KTX2_IDENTIFIER_SIZE);
+
+    // the spec wants the smallest level first in the file, the index still starts at level 0
+    Ktx2Level* levels = calloc(texture->n_levels, sizeof(Ktx2Level));
+    uint64_t offset = header.dfd_byte_offset + dfd_size;
+    for (uint32_t i = texture->n_levels; i-- > 0;)
+    {
+        offset += (KTX2_LEVEL_ALIGNMENT - offset % KTX2_LEVEL_ALIGNMENT) % KTX2_LEVEL_ALIGNMENT;
+
+        levels[i].byte_offset = offset;
+        levels[i].byte_length = texture_level_size(texture->format,
+                texture_mip_dimension(texture->width, i),
+                texture_mip_dimension(texture->height, i));
+        levels[i].uncompressed_byte_length = levels[i].byte_length;
+
+        offset += levels[i].byte_length;
+    }
+
+    bool written = fwrite(&header, sizeof(Ktx2Header), 1, fp) == 1
+        && fwrite(levels, sizeof(Ktx2Level), texture->n_levels, fp) == texture->n_levels
+        && fwrite(dfd, dfd_size, 1, fp) == 1;
+
+    uint64_t position = header.dfd_byte_offset + dfd_size;
+    for (uint32_t i = texture->n_levels; written && i-- > 0;)
+    {
+        ktx2_write_padding(fp, &position, KTX2_LEVEL_ALIGNMENT);
+
+        size_t source = texture_chain_size(texture->format, texture->width, texture->height, i);
+        written = fwrite(texture->data + source, levels[i].byte_length, 1, fp) == 1;
+        position += levels[i].byte_length;
+    }
+
+    if (!written || fclose(fp) != 0)
+        FATAL("Could not finish writing %s\n", path);
+
+    free(levels);
+
+    LOG_V("Wrote %dx%d %s texture with %d levels to %s (%.1lf MB)\n", texture->width,
+            texture->height, texture_format_name(texture->format), texture->n_levels, path,
+            offset / 1e6);
+}
+
+bool ktx2_range_valid(size_t size, uint64_t offset, uint64_t length)
+{
+    return offset <= size && length <= size - offset;
+}
+
+uint32_t ktx2_build_dfd(VkFormat format, uint32_t* out_words)
+{
+    bool srgb = false;
+    uint32_t model = KTX2_DF_MODEL_RGBSDA;
+    uint32_t n_samples = 0;
+    uint32_t* samples = out_words + 7;
+
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        srgb = true;
+        // fallthrough
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        ktx2_dfd_sample(&samples[0], 0, 8, 0, 255);
+        ktx2_dfd_sample(&samples[4], 8, 8, 1, 255);
+        ktx2_dfd_sample(&samples[8], 16, 8, 2, 255);
+        ktx2_dfd_sample(&samples[12], 24, 8, KTX2_DF_CHANNEL_ALPHA, 255);
+        n_samples = 4;
+        break;
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        srgb = true;
+        // fallthrough
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        model = KTX2_DF_MODEL_BC1A;
+        ktx2_dfd_sample(&samples[0], 0, 64, 0, UINT32_MAX);
+        n_samples = 1;
+        break;
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        srgb = true;
+        // fallthrough
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        // bc1a has its own channel for the punch through alpha
+        model = KTX2_DF_MODEL_BC1A;
+        ktx2_dfd_sample(&samples[0], 0, 64, 1, UINT32_MAX);
+        n_samples = 1;
+        break;
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+        srgb = true;
+        // fallthrough
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+        model = KTX2_DF_MODEL_BC3;
+        ktx2_dfd_sample(&samples[0], 0, 64, KTX2_DF_CHANNEL_ALPHA, UINT32_MAX);
+        ktx2_dfd_sample(&samples[4], 64, 64, 0, UINT32_MAX);
+        n_samples = 2;
+        break;
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        model = KTX2_DF_MODEL_BC4;
+        ktx2_dfd_sample(&samples[0], 0, 64, 0, UINT32_MAX);
+        n_samples = 1;
+        break;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        model = KTX2_DF_MODEL_BC5;
+        ktx2_dfd_sample(&samples[0], 0, 64, 0, UINT32_MAX);
+        ktx2_dfd_sample(&samples[4], 64, 64, 1, UINT32_MAX);
+        n_samples = 2;
+        break;
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        srgb = true;
+        // fallthrough
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        model = KTX2_DF_MODEL_BC7;
+        ktx2_dfd_sample(&samples[0], 0, 128, 0, UINT32_MAX);
+        n_samples = 1;
+        break;
+    default:
+        FATAL("No data format descriptor for format %d\n", format);
+    }
+
+    // alpha is never srgb encoded
+    for (uint32_t i = 0; srgb && i < n_samples; ++i)
+    {
+        if ((samples[i * 4] >> 24 & 0xf) == KTX2_DF_CHANNEL_ALPHA)
+            samples[i * 4] |= (uint32_t) KTX2_DF_QUALIFIER_LINEAR << 24;
+    }
+
+    uint32_t block_size = 24 + 16 * n_samples;
+    uint32_t block_extent = texture_format_compressed(format) ? TEXTURE_BLOCK_EXTENT - 1 : 0;
+
+    out_words[0] = 4 + block_size;
+    // vendor and descriptor type are both khronos basic, 0
+    out_words[1] = 0;
+    out_words[2] = 2 | block_size << 16;
+    out_words[3] = model | KTX2_DF_PRIMARIES_BT709 << 8
+        | (srgb ? KTX2_DF_TRANSFER_SRGB : KTX2_DF_TRANSFER_LINEAR) << 16;
+    out_words[4] = block_extent | block_extent << 8;
+    out_words[5] = texture_format_block_size(format);
+    out_words[6] = 0;
+
+    return out_words[0];
+}
+
+void ktx2_dfd_sample(uint32_t* sample, uint32_t bit_offset, uint32_t bit_length, uint32_t channel,
+        uint32_t upper)
+{
+    sample[0] = bit_offset | (bit_length - 1) << 16 | channel << 24;
+    // sample positions are all at the block origin
+    sample[1] = 0;
+    sample[2] = 0;
+    sample[3] = upper;
+}
+
+void ktx2_write_padding(FILE* fp, uint64_t* offset, uint64_t alignment)
+{
+    static const uint8_t zeroes[KTX2_LEVEL_ALIGNMENT] = {0};
+
+    uint64_t padding = (alignment - *offset % alignment) % alignment;
+    if (padding != 0 && fwrite(zeroes, 1, padding, fp) != padding)
+        FATAL("Could not write ktx2 padding\n");
+    *offset += padding;
+}
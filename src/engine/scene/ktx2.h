@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdio.h>
+#include "texture_format.h"
+
+#define KTX2_IDENTIFIER_SIZE 12
+// level data starts on this boundary, a multiple of every block size we write
+#define KTX2_LEVEL_ALIGNMENT 16
+
+// data format descriptor values, from the khronos data format spec
+#define KTX2_DF_MODEL_RGBSDA 1
+#define KTX2_DF_MODEL_BC1A 128
+#define KTX2_DF_MODEL_BC3 130
+#define KTX2_DF_MODEL_BC4 131
+#define KTX2_DF_MODEL_BC5 132
+#define KTX2_DF_MODEL_BC7 134
+#define KTX2_DF_PRIMARIES_BT709 1
+#define KTX2_DF_TRANSFER_LINEAR 1
+#define KTX2_DF_TRANSFER_SRGB 2
+#define KTX2_DF_CHANNEL_ALPHA 15
+#define KTX2_DF_QUALIFIER_LINEAR 0x10
+// the most samples any format here needs
+#define KTX2_DFD_MAX_WORDS (1 + 6 + 4 * 4)
+// a full chain of the largest size a header can hold
+#define KTX2_MAX_LEVELS 32
+
+// all values are little endian, offsets are from the start of the file
+typedef struct Ktx2Header {
+    uint8_t identifier[KTX2_IDENTIFIER_SIZE];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+} Ktx2Header;
+
+// one per level after the header, level 0 first even though the data is stored smallest first
+typedef struct Ktx2Level {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+} Ktx2Level;
+
+// a texture with its levels back to back, largest first
+typedef struct Ktx2Texture {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t n_levels;
+    uint8_t* data;
+} Ktx2Texture;
+
+bool ktx2_is_ktx2(const uint8_t* data, size_t size);
+// plain 2d textures in a format from texture_format.h, no supercompression. anything else is
+// logged and gives false
+bool ktx2_read(const char* name, const uint8_t* data, size_t size, Ktx2Texture* out_texture);
+// the same checks without copying anything, out_levels points each level into data and
+// out_texture has no data
+bool ktx2_levels(const char* name, const uint8_t* data, size_t size, Ktx2Texture* out_texture,
+        const uint8_t** out_levels);
+void ktx2_write(const char* path, const Ktx2Texture* texture);
+
+// internal
+bool ktx2_range_valid(size_t size, uint64_t offset, uint64_t length);
+uint32_t ktx2_build_dfd(VkFormat format, uint32_t* out_words);
+void ktx2_dfd_sample(uint32_t* sample, uint32_t bit_offset, uint32_t bit_length, uint32_t channel,
+        uint32_t upper);
+void ktx2_write_padding(FILE* fp, uint64_t* offset, uint64_t alignment);
@@ -1,226 +1,484 @@
 #include "loader.h"
+#include "import.h"
+#include "cooked.h"
+#include "vertex_packing.h"
+#include "image_decode.h"
+#include "bc_encode.h"
 #include "../utils.h"
 #include "../renderer/buffers.h"
+#include "../renderer/uploads.h"
+#include "../renderer/image.h"
+#include "../renderer/materials.h"
+#include "../renderer/streaming.h"
+#include "../renderer/deletion.h"
+#include "../renderer/defrag.h"
+
+Mesh* load_glft_meshes(Renderer* renderer, JobPool* jobs, char* file_path, uint32_t* out_n,
+        MaterialSet* out_materials)
+{
+    uint64_t start_time = time_now_ns();
+
+    ImportedMaterials imported = {0};
+    MeshData* mesh_datas = import_gltf(jobs, file_path, out_n, &imported);
+    if (mesh_datas == NULL)
+        FATAL("Could not import %s\n", file_path);
+    Mesh* meshes = meshes_load_imported(renderer, jobs, mesh_datas, *out_n, &imported, out_materials);
 
-#include <cgltf.h>
-#include <fast_obj.h>
+    LOG_V("Loaded %s in %.1lf ms\n", file_path, (time_now_ns() - start_time) / 1e6);
+
+    return meshes;
+}
 
-static cgltf_result LoadFileGLTFCallback(const struct cgltf_memory_options *memoryOptions, const struct cgltf_file_options *fileOptions, const char *path, cgltf_size *size, void **data)
+Mesh* load_obj_meshes(Renderer* renderer, JobPool* jobs, char* file_path, uint32_t* out_n,
+        MaterialSet* out_materials)
 {
-    File a = read_file(path);
-    int filesize = a.size;
-    unsigned char *filedata = (unsigned char*)a.buf;
+    uint64_t start_time = time_now_ns();
 
-    if (filedata == NULL) return cgltf_result_io_error;
+    ImportedMaterials imported = {0};
+    MeshData* mesh_datas = import_obj(jobs, file_path, out_n, &imported);
+    if (mesh_datas == NULL)
+        FATAL("Could not import %s\n", file_path);
+    Mesh* meshes = meshes_load_imported(renderer, jobs, mesh_datas, *out_n, &imported, out_materials);
 
-    *size = filesize;
-    *data = filedata;
+    LOG_V("Loaded %s in %.1lf ms\n", file_path, (time_now_ns() - start_time) / 1e6);
 
-    return cgltf_result_success;
+    return meshes;
 }
 
-static void ReleaseFileGLTFCallback(const struct cgltf_memory_options *memoryOptions, const struct cgltf_file_options *fileOptions, void *data)
+// uploads what an importer produced and frees it
+Mesh* meshes_load_imported(Renderer* renderer, JobPool* jobs, MeshData* mesh_datas, uint32_t n,
+        ImportedMaterials* imported, MaterialSet* out_materials)
 {
-    free(data);
+    // the images decode on the pool while the geometry goes up, this thread joins in once it's done
+    JobCounter decoded = {0};
+    job_pool_submit(jobs, image_data_decode_job, imported->images, imported->n_images, &decoded);
+
+    Mesh* meshes = meshes_upload(renderer, mesh_datas, n);
+
+    uint64_t wait_start_time = time_now_ns();
+    job_pool_wait(jobs, &decoded);
+    LOG_V("Waited %.1lf ms for %d images to decode\n", (time_now_ns() - wait_start_time) / 1e6,
+            imported->n_images);
+
+    *out_materials = materials_upload(renderer, imported);
+    meshes_bind_materials(meshes, mesh_datas, n, out_materials);
+
+    imported_materials_free(imported);
+    mesh_datas_free(mesh_datas, n);
+
+    return meshes;
 }
 
-Mesh* load_glft_meshes(Renderer* renderer, char* file_path, uint8_t* out_n)
+// the geometry is already in gpu layout, so it goes from the mapping straight into staging
+Mesh* load_cooked_meshes(Renderer* renderer, char* file_path, uint32_t* out_n)
 {
-    LOG_V("Loading GLTF %s\n", file_path);
+    uint64_t start_time = time_now_ns();
 
-    File file = read_file(file_path);
+    CookedFile cooked;
+    if (!cooked_open(file_path, &cooked))
+        FATAL("Could not load cooked file %s\n", file_path);
+    *out_n = cooked.header->n_meshes;
 
-    cgltf_options options = { 0 };
-    options.file.read = LoadFileGLTFCallback;
-    options.file.release = ReleaseFileGLTFCallback;
-    cgltf_data *data = NULL;
-    cgltf_result result = cgltf_parse(&options, file.buf, file.size, &data);
+    UploadBatch batch = upload_batch_create(renderer, cooked_staging_size(&cooked), false);
+    Mesh* meshes = cooked_meshes_stage(renderer, &batch, &cooked);
+    if (meshes == NULL)
+        FATAL("Could not load cooked file %s\n", file_path);
+    size_t total_bytes = batch.used;
 
-    if (result != cgltf_result_success)
-        FATAL("Could not load GLTF file %s %d\n", file_path, result);
+    upload_batch_submit(renderer, &batch);
+    cooked_close(&cooked);
 
-    result = cgltf_load_buffers(&options, data, file_path);
+    double elapsed_ms = (time_now_ns() - start_time) / 1e6;
+    LOG_V("Loaded cooked %s: %d meshes, %.1lf MB of geometry in %.1lf ms (%.1lf MB/s)\n", file_path,
+            *out_n, total_bytes / 1e6, elapsed_ms, total_bytes / 1e3 / elapsed_ms);
+
+    return meshes;
+}
 
-    Mesh* meshes = malloc(sizeof(Mesh) * data->meshes_count);
-    *out_n = data->meshes_count;
+Mesh* cooked_meshes_stage(Renderer* renderer, UploadBatch* batch, CookedFile* cooked)
+{
+    Mesh* meshes = malloc(sizeof(Mesh) * cooked->header->n_meshes);
 
-    for (int i = 0; i < data->meshes_count; ++i)
+    for (uint32_t i = 0; i < cooked->header->n_meshes; ++i)
     {
-        LOG_V("Loading mesh\n");
-        cgltf_mesh gltf_mesh = data->meshes[i];
+        const CookedMesh* cooked_mesh = cooked_get_mesh(cooked, i);
+        const CookedSurface* cooked_surfaces = cooked_get_surfaces(cooked, cooked_mesh);
+
         Mesh new_mesh = {0};
+        new_mesh.name = strdup(cooked_get_name(cooked, cooked_mesh));
+        new_mesh.n_surfaces = cooked_mesh->n_surfaces;
+        new_mesh.surfaces = malloc(sizeof(GeoSurface) * cooked_mesh->n_surfaces);
+
+        for (uint32_t j = 0; j < cooked_mesh->n_surfaces; ++j)
+        {
+            const CookedSurface* cooked_surface = &cooked_surfaces[j];
+            GeoSurface* surface = &new_mesh.surfaces[j];
+
+            *surface = (GeoSurface) {
+                .start_index = cooked_surface->start_index,
+                .count = cooked_surface->count,
+                .n_lods = cooked_surface->n_lods,
+            };
+            glm_vec3_copy((float*) cooked_surface->aabb_min, surface->aabb_min);
+            glm_vec3_copy((float*) cooked_surface->aabb_max, surface->aabb_max);
+
+            for (uint32_t k = 0; k < cooked_surface->n_lods; ++k)
+            {
+                const CookedLod* lod = &cooked_surface->lods[k];
+                surface->lods[k] = (GeoLod) { lod->start_index, lod->count, lod->error,
+                    lod->first_meshlet, lod->n_meshlets };
+            }
+        }
+
+        glm_vec4_copy((float*) cooked_mesh->bounds, new_mesh.bounds);
 
-        new_mesh.name = malloc(sizeof(char) * strlen(gltf_mesh.name));
-        memcpy(new_mesh.name, gltf_mesh.name, sizeof(char) * strlen(gltf_mesh.name));
-        // TODO: free this
-        printf("%s name it is\n", new_mesh.name);
-        new_mesh.surfaces = malloc(sizeof(GeoSurface) * gltf_mesh.primitives_count);
-        new_mesh.n_surfaces = gltf_mesh.primitives_count;
-
-        uint32_t index_count = 0;
-        uint32_t vertex_count = 0;
-        // temporary max size
-        uint32_t indices[29999];
-        Vertex vertices[29999];
-        int extra_vertices_found = 0;
-
-        for (int j = 0; j < gltf_mesh.primitives_count; ++j)
+        if (cooked_mesh->n_indices != 0 && cooked_mesh->n_vertices != 0)
         {
-            LOG_V("Loading primitive\n");
-            cgltf_primitive primitive = gltf_mesh.primitives[j];
+            size_t vertex_bytes = cooked_mesh->n_vertices * vertex_format_size(cooked_mesh->vertex_format);
+
+            MeshBuffers* mesh_buffers = &new_mesh.mesh_buffers;
+            if (!stage_mesh_data(renderer, batch, cooked_get_indices(cooked, cooked_mesh),
+                        cooked_mesh->n_indices, cooked_get_vertices(cooked, cooked_mesh),
+                        vertex_bytes, mesh_buffers))
+            {
+                meshes[i] = new_mesh;
+                meshes_release_staged(renderer, meshes, i + 1);
+                return NULL;
+            }
+
+            mesh_buffers->vertex_format = cooked_mesh->vertex_format;
+            glm_vec4_copy((float*) cooked_mesh->position_offset, mesh_buffers->position_offset);
+            glm_vec4_copy((float*) cooked_mesh->position_scale, mesh_buffers->position_scale);
+
+            if (cooked_mesh->n_meshlets != 0 && !stage_meshlets(renderer, batch, mesh_buffers,
+                        cooked_get_meshlets(cooked, cooked_mesh), cooked_mesh->n_meshlets))
+            {
+                meshes[i] = new_mesh;
+                meshes_release_staged(renderer, meshes, i + 1);
+                return NULL;
+            }
+        }
+
+        meshes[i] = new_mesh;
+    }
 
-            GeoSurface new_surface = {0};
+    return meshes;
+}
+
+size_t cooked_staging_size(CookedFile* cooked)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < cooked->header->n_meshes; ++i)
+    {
+        const CookedMesh* cooked_mesh = cooked_get_mesh(cooked, i);
+        if (cooked_mesh->n_indices == 0 || cooked_mesh->n_vertices == 0)
+            continue;
+
+        size += mesh_staging_size(cooked_mesh->n_indices,
+                cooked_mesh->n_vertices * vertex_format_size(cooked_mesh->vertex_format),
+                cooked_mesh->n_meshlets);
+    }
+
+    return size;
+}
+
+// one staging buffer and one submit for the lot
+Mesh* meshes_upload(Renderer* renderer, MeshData* mesh_datas, uint32_t n)
+{
+    UploadBatch batch = upload_batch_create(renderer, meshes_staging_size(mesh_datas, n), false);
+    Mesh* meshes = meshes_stage(renderer, &batch, mesh_datas, n);
+    if (meshes == NULL)
+        FATAL("Could not upload %d meshes\n", n);
+    upload_batch_submit(renderer, &batch);
+    defrag_track_meshes(renderer, meshes, n);
 
-            new_surface.start_index = index_count;
-            new_surface.count = primitive.indices->count;
+    return meshes;
+}
 
-            // uint32_t* new_indices = malloc(sizeof(uint32_t) * (index_count + primitive.indices->count));
-            // memcpy(new_indices, indices, sizeof(uint32_t) * index_count);
-            // free(indices);
-            // indices = new_indices;
+Mesh* meshes_stage(Renderer* renderer, UploadBatch* batch, MeshData* mesh_datas, uint32_t n)
+{
+    Mesh* meshes = malloc(sizeof(Mesh) * n);
 
-            // loading the indices
-            int primitive_index_count = cgltf_accessor_unpack_indices(primitive.indices, NULL, 4, 0);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        MeshData* mesh_data = &mesh_datas[i];
+        Mesh new_mesh = {0};
 
-            LOG_V("Loading indices %d\n", primitive_index_count);
-            cgltf_accessor_unpack_indices(primitive.indices, indices + index_count,
-                    4, primitive_index_count);
+        new_mesh.name = strdup(mesh_data->name);
+        new_mesh.n_surfaces = mesh_data->n_surfaces;
+        new_mesh.surfaces = malloc(sizeof(GeoSurface) * mesh_data->n_surfaces);
+        memcpy(new_mesh.surfaces, mesh_data->surfaces, sizeof(GeoSurface) * mesh_data->n_surfaces);
+        glm_vec4_copy(mesh_data->bounds, new_mesh.bounds);
 
-            for (int a = 0; a < primitive_index_count; ++a)
-                indices[index_count + a] += vertex_count;
+        // zero sized buffers aren't allowed, leave the handles null instead
+        if (mesh_data->n_indices != 0 && mesh_data->n_vertices != 0)
+        {
+            enum VertexFormat format = vertex_format_choose(mesh_data->vertices, mesh_data->n_vertices);
+            bool staged = stage_mesh(renderer, batch, mesh_data->indices, mesh_data->n_indices,
+                    mesh_data->vertices, mesh_data->n_vertices, format, &new_mesh.mesh_buffers);
 
-            index_count += primitive_index_count;
+            if (staged && mesh_data->n_meshlets != 0)
+                staged = stage_meshlets(renderer, batch, &new_mesh.mesh_buffers,
+                        mesh_data->meshlets, mesh_data->n_meshlets);
 
-            // loading the vertices
-            for (int a = 0; a < primitive.attributes_count; a++)
+            if (!staged)
             {
-                if (primitive.attributes[a].type == cgltf_attribute_type_position)
-                {
-                    LOG_V("Loading position attributes");
-                    cgltf_accessor* attribute = primitive.attributes[a].data;
-
-                    int primitive_vertex_count = cgltf_accessor_unpack_floats(attribute, NULL, 0);
-                    float raw_floats[primitive_vertex_count * 3 + 10];
-                    int success = cgltf_accessor_unpack_floats(attribute, raw_floats, primitive_vertex_count * 3);
-                    extra_vertices_found = success;
-
-                    LOG_B(" %d\n", success);
-                    for (int b = 0; b < primitive_vertex_count; ++b)
-                    {
-                        vertices[vertex_count + b].position[0] = raw_floats[b * 3];
-                        vertices[vertex_count + b].position[1] = raw_floats[b * 3 + 1];
-                        vertices[vertex_count + b].position[2] = raw_floats[b * 3 + 2];
-                        // LOG_V("%f\n", raw_floats[b*3+2]);
-                    }
-                }
-                if (primitive.attributes[a].type == cgltf_attribute_type_texcoord)
-                {
-                    LOG_V("Loading texcoord");
-                    cgltf_accessor* attribute = primitive.attributes[a].data;
-                    int primitive_uv_count = cgltf_accessor_unpack_floats(attribute, NULL, 0);
-                    float raw_floats[primitive_uv_count * 2 + 10];
-                    int success = cgltf_accessor_unpack_floats(attribute, raw_floats, primitive_uv_count * 2);
-                    LOG_B(" %d\n", success);
-                    for (int b = 0; b < primitive_uv_count; ++b)
-                    {
-                        vertices[vertex_count + b].uv_x = raw_floats[b * 2];
-                        vertices[vertex_count + b].uv_y = raw_floats[b * 2 + 1];
-                        vertices[vertex_count + b].colour[0] = raw_floats[b * 2];
-                        vertices[vertex_count + b].colour[1] = raw_floats[b * 2 + 1];
-                    }
-                }
-                if (primitive.attributes[a].type == cgltf_attribute_type_color)
-                {
-                    LOG_V("Loading colour data!");
-                    cgltf_accessor* attribute = primitive.attributes[a].data;
-                    int primitive_colour_count = cgltf_accessor_unpack_floats(attribute, NULL, 0);
-                    float raw_floats[primitive_colour_count * 3 + 10];
-                    int success = cgltf_accessor_unpack_floats(attribute, raw_floats, primitive_colour_count * 3);
-                    for (int b = 0; b < primitive_colour_count; ++b)
-                    {
-                        vertices[vertex_count + b].colour[0] = raw_floats[b * 3];
-                        vertices[vertex_count + b].colour[1] = raw_floats[b * 3 + 1];
-                        vertices[vertex_count + b].colour[2] = raw_floats[b * 3 + 2];
-                    }
-                }
-                if (primitive.attributes[a].type == cgltf_attribute_type_normal)
-                {
-                    LOG_V("Loading normal data!");
-                    cgltf_accessor* attribute = primitive.attributes[a].data;
-                    int primitive_normal_count = cgltf_accessor_unpack_floats(attribute, NULL, 0);
-                    float raw_floats[primitive_normal_count * 3 + 10];
-                    int success = cgltf_accessor_unpack_floats(attribute, raw_floats, primitive_normal_count * 3);
-                    for (int b = 0; b < primitive_normal_count; ++b)
-                    {
-                        vertices[vertex_count + b].normal[0] = raw_floats[b * 3];
-                        vertices[vertex_count + b].normal[1] = raw_floats[b * 3 + 1];
-                        vertices[vertex_count + b].normal[2] = raw_floats[b * 3 + 2];
-                    }
-                }
+                meshes[i] = new_mesh;
+                meshes_release_staged(renderer, meshes, i + 1);
+                return NULL;
             }
-            vertex_count += extra_vertices_found;
-            new_mesh.surfaces[j] = new_surface;
         }
 
-        new_mesh.mesh_buffers = upload_mesh(renderer, indices, index_count, vertices, vertex_count);
         meshes[i] = new_mesh;
+    }
 
-        // free(vertices);
-        // free(indices);
+    return meshes;
+}
+
+size_t meshes_staging_size(MeshData* mesh_datas, uint32_t n)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        MeshData* mesh_data = &mesh_datas[i];
+        if (mesh_data->n_indices == 0 || mesh_data->n_vertices == 0)
+            continue;
+
+        enum VertexFormat format = vertex_format_choose(mesh_data->vertices, mesh_data->n_vertices);
+        size += mesh_staging_size(mesh_data->n_indices, mesh_data->n_vertices * vertex_format_size(format),
+                mesh_data->n_meshlets);
     }
 
-    cgltf_free(data);
+    return size;
+}
 
-    return meshes;
+MaterialSet materials_upload(Renderer* renderer, ImportedMaterials* imported)
+{
+    MaterialSet materials = {0};
+
+    materials.n_images = imported->n_images;
+    materials.images = malloc(sizeof(Image) * imported->n_images);
+
+    TextureData* textures = malloc(sizeof(TextureData) * imported->n_images);
+    for (uint32_t i = 0; i < imported->n_images; ++i)
+        textures[i] = image_data_texture(&imported->images[i]);
+
+    images_create_textured(renderer, textures, imported->n_images, VK_IMAGE_USAGE_SAMPLED_BIT, true,
+            materials.images);
+    defrag_track_images(renderer, materials.images, materials.n_images);
+
+    free(textures);
+
+    materials.n_instances = imported->n_materials;
+    materials.instances = malloc(sizeof(MaterialInstance) * imported->n_materials);
+    materials_write_instances(renderer, &materials, imported->materials);
+
+    return materials;
 }
 
-Mesh load_obj_mesh(Renderer* renderer, char* file_path)
+// creates the images and stages their texels, ones that failed to decode or can't be sampled are
+// left null. with out_sources, textures big enough to stream only stage their tail and hand the
+// whole chain over in their slot, the rest get an empty one. a chain that is a ktx2 file as it
+// is gets handed over as its path, the levels are read from the file again when they're needed
+void materials_stage_images(Renderer* renderer, UploadBatch* batch, ImportedMaterials* imported,
+        MaterialSet* materials, StreamSource* out_sources)
 {
-    LOG_V("Loading OBJ %s\n", file_path);
+    materials->n_images = imported->n_images;
+    materials->images = malloc(sizeof(Image) * imported->n_images);
 
+    for (uint32_t i = 0; i < imported->n_images; ++i)
+    {
+        TextureData texture = image_data_texture(&imported->images[i]);
+        uint32_t tail_level = out_sources == NULL || texture.data == NULL ? 0
+            : streaming_tail_level(&texture);
 
-    Mesh mesh = {0};
-    mesh.name = "hi";
-    mesh.n_surfaces = 1;
-    GeoSurface* a = malloc(sizeof(GeoSurface));
-    mesh.surfaces = a;
-    fastObjMesh* obj_mesh = fast_obj_read("room.obj");
+        if (out_sources != NULL)
+            out_sources[i] = (StreamSource) {0};
+
+        if (tail_level == 0)
+        {
+            materials->images[i] = image_stage_texture(renderer, batch, &texture,
+                    VK_IMAGE_USAGE_SAMPLED_BIT, true);
+            continue;
+        }
+
+        TextureData tail = streaming_levels(&texture, tail_level);
+        materials->images[i] = image_stage_texture(renderer, batch, &tail,
+                VK_IMAGE_USAGE_SAMPLED_BIT, false);
+
+        ImageData* image = &imported->images[i];
+        if (image->ktx2_file)
+        {
+            texture.data = NULL;
+            out_sources[i] = (StreamSource) { texture, image->path };
+            image->path = NULL;
+            continue;
+        }
 
-    Vertex vertices[obj_mesh->position_count];
-    uint32_t indices[obj_mesh->index_count * 3];
-    LOG_V("Found %d positions\n", obj_mesh->position_count / 3);
+        out_sources[i] = (StreamSource) { texture, NULL };
+        image->pixels = NULL;
+    }
+}
 
-    for (int i = 1; i < obj_mesh->position_count / 3; ++i)
+size_t images_staging_size(ImportedMaterials* imported, bool streamed)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < imported->n_images; ++i)
     {
-        vertices[i].position[0] = obj_mesh->positions[i * 3 + 0];
-        vertices[i].position[1] = obj_mesh->positions[i * 3 + 1];
-        vertices[i].position[2] = obj_mesh->positions[i * 3 + 2];
+        TextureData texture = image_data_texture(&imported->images[i]);
+        uint32_t tail_level = !streamed || texture.data == NULL ? 0
+            : streaming_tail_level(&texture);
+
+        TextureData staged = tail_level == 0 ? texture : streaming_levels(&texture, tail_level);
+        size += upload_batch_aligned(image_staging_size(&staged));
     }
 
-    for (int i = 0; i < obj_mesh->index_count; ++i)
+    return size;
+}
+
+// streaming swaps levels in from the cpu, so single level images too big to be all tail get their
+// mips built up front. prebuilt chains are kept as they are
+void images_build_chains(JobPool* jobs, ImportedMaterials* imported)
+{
+    for (uint32_t i = 0; i < imported->n_images; ++i)
     {
-        indices[i * 3 + 0] = obj_mesh->indices[i].p;
-        indices[i * 3 + 1] = obj_mesh->indices[i].t;
-        indices[i * 3 + 2] = obj_mesh->indices[i].n;
+        ImageData* image = &imported->images[i];
+        if (image->pixels == NULL || image->n_levels != 1 || texture_format_compressed(image->format)
+                || (image->width <= STREAMING_TAIL_SIZE && image->height <= STREAMING_TAIL_SIZE))
+            continue;
+
+        uint32_t n_levels = texture_mip_count(image->width, image->height);
+        uint8_t* chain = bc_encode_chain(jobs, image->format, image->pixels, image->width,
+                image->height, n_levels);
+
+        free(image->pixels);
+        image->pixels = chain;
+        image->n_levels = n_levels;
     }
+}
 
-    mesh.mesh_buffers = upload_mesh(renderer, indices, obj_mesh->index_count * 3, vertices,
-            obj_mesh->position_count / 3);
+TextureData image_data_texture(ImageData* image)
+{
+    return (TextureData) {
+        .data = image->pixels,
+        .size = { image->width, image->height, 1 },
+        .format = image->format,
+        .n_levels = image->n_levels,
+    };
+}
+
+// fills in the already allocated instances, this is the part that needs the descriptor allocator
+void materials_write_instances(Renderer* renderer, MaterialSet* materials, MaterialData* material_datas)
+{
+    if (materials->n_instances == 0)
+        return;
 
-    a->count = obj_mesh->index_count * 3;
-    fast_obj_destroy(obj_mesh);
+    materials->constants = buffer_create(renderer->allocator,
+            sizeof(MaterialMetallicConstants) * materials->n_instances, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_UNIFORMS);
 
-    LOG_V("Finished loading\n");
-    return mesh;
+    MaterialMetallicConstants* constants;
+    vmaMapMemory(renderer->allocator, materials->constants.allocation, (void**) &constants);
+
+    for (uint32_t i = 0; i < materials->n_instances; ++i)
+    {
+        MaterialData* material = &material_datas[i];
+
+        constants[i] = (MaterialMetallicConstants) {
+            .colour_factors = VEC4_UNPACK(material->colour_factors),
+            .metal_rough_factors = VEC4_UNPACK(material->metal_rough_factors),
+        };
+
+        MaterialMetallicResources resources = {
+            .colour_image = materials_pick_image(renderer, materials, material->colour_image),
+            .colour_sampler = renderer->sampler_linear,
+            .metal_rough_image = materials_pick_image(renderer, materials, material->metal_rough_image),
+            .metal_rough_sampler = renderer->sampler_linear,
+            .data_buffer = materials->constants.buffer,
+            .data_buffer_offset = sizeof(MaterialMetallicConstants) * i,
+        };
+
+        materials->instances[i] = material_metallic_write_material(&renderer->metalic_material,
+                renderer->device, material->pass, &resources, &renderer->global_descriptor_allocator);
+        defrag_track_material(renderer, &materials->instances[i], &resources);
+
+        // the slots rather than the images, streaming swaps what's in them
+        Image* colour_slot = material->colour_image < 0 ? NULL
+            : &materials->images[material->colour_image];
+        Image* metal_rough_slot = material->metal_rough_image < 0 ? NULL
+            : &materials->images[material->metal_rough_image];
+        streaming_track_material(renderer, &materials->instances[i], colour_slot, metal_rough_slot);
+    }
+
+    vmaUnmapMemory(renderer->allocator, materials->constants.allocation);
 }
 
+// no texture samples as white so the factors come through unchanged, a broken one stands out
+Image materials_pick_image(Renderer* renderer, MaterialSet* materials, int32_t index)
+{
+    if (index < 0)
+        return renderer->white_image;
+
+    if (materials->images[index].image == VK_NULL_HANDLE)
+        return renderer->error_image;
+
+    return materials->images[index];
+}
 
-void meshes_destroy(Mesh* meshes, int n, VmaAllocator allocator)
+// surfaces without a material keep NULL and get the renderer's default
+void meshes_bind_materials(Mesh* meshes, MeshData* mesh_datas, uint32_t n, MaterialSet* materials)
 {
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (mesh_datas[i].surface_materials == NULL)
+            continue;
+
+        for (uint32_t j = 0; j < mesh_datas[i].n_surfaces; ++j)
+        {
+            int32_t index = mesh_datas[i].surface_materials[j];
+            meshes[i].surfaces[j].material = index < 0 ? NULL : &materials->instances[index];
+        }
+    }
+}
+
+// frames in flight can still be sampling the images, they go once those have finished
+void materials_destroy(MaterialSet* materials, Renderer* renderer)
+{
+    defrag_untrack_images(renderer, materials->images, materials->n_images);
+    defrag_untrack_materials(renderer, materials->instances, materials->n_instances);
+    streaming_untrack_materials(renderer, materials->instances, materials->n_instances);
+    streaming_untrack_images(renderer, materials->images, materials->n_images);
+
+    // images that failed to decode were left null, which destroys as a no-op
+    for (uint32_t i = 0; i < materials->n_images; ++i)
+        deletion_queue_image(renderer, materials->images[i]);
+
+    deletion_queue_buffer(renderer, materials->constants);
+
+    free(materials->images);
+    free(materials->instances);
+}
+
+// the last one can be half staged, its buffers are whatever got taken before the arenas filled up
+void meshes_release_staged(Renderer* renderer, Mesh* meshes, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        mesh_buffers_release(renderer, &meshes[i].mesh_buffers);
+
+        free(meshes[i].surfaces);
+        free(meshes[i].name);
+    }
+    free(meshes);
+}
+
+void meshes_destroy(Mesh* meshes, int n, Renderer* renderer)
+{
+    defrag_untrack_meshes(renderer, meshes, n);
+
     for (int i = 0; i < n; ++i)
     {
-        buffer_destroy(&meshes[i].mesh_buffers.index_buffer, allocator);
-        buffer_destroy(&meshes[i].mesh_buffers.vertex_buffer, allocator);
+        mesh_buffers_free(renderer, &meshes[i].mesh_buffers);
 
         free(meshes[i].surfaces);
         free(meshes[i].name);
@@ -1,9 +1,38 @@
 #pragma once
 
 #include "../renderer/renderer.h"
+#include "../jobs.h"
+#include "import.h"
+#include "cooked.h"
 
-Mesh load_obj_mesh(Renderer* renderer, char* file_path);
-Mesh* load_glft_meshes(Renderer* renderer, char* file_path, uint8_t* out_n);
+Mesh* load_glft_meshes(Renderer* renderer, JobPool* jobs, char* file_path, uint32_t* out_n,
+        MaterialSet* out_materials);
+Mesh* load_obj_meshes(Renderer* renderer, JobPool* jobs, char* file_path, uint32_t* out_n,
+        MaterialSet* out_materials);
+Mesh* load_cooked_meshes(Renderer* renderer, char* file_path, uint32_t* out_n);
 
-void meshes_destroy(Mesh* meshes, int n, VmaAllocator allocator);
+Mesh* meshes_upload(Renderer* renderer, MeshData* mesh_datas, uint32_t n);
+void meshes_destroy(Mesh* meshes, int n, Renderer* renderer);
+MaterialSet materials_upload(Renderer* renderer, ImportedMaterials* imported);
+void materials_destroy(MaterialSet* materials, Renderer* renderer);
 
+// the halves of the above that are safe off the main thread, nothing is on the gpu until the
+// batch gets recorded. the stages return NULL, keeping nothing, when the geometry doesn't fit
+Mesh* meshes_stage(Renderer* renderer, UploadBatch* batch, MeshData* mesh_datas, uint32_t n);
+size_t meshes_staging_size(MeshData* mesh_datas, uint32_t n);
+Mesh* cooked_meshes_stage(Renderer* renderer, UploadBatch* batch, CookedFile* cooked);
+size_t cooked_staging_size(CookedFile* cooked);
+void materials_stage_images(Renderer* renderer, UploadBatch* batch, ImportedMaterials* imported,
+        MaterialSet* materials, StreamSource* out_sources);
+size_t images_staging_size(ImportedMaterials* imported, bool streamed);
+void images_build_chains(JobPool* jobs, ImportedMaterials* imported);
+// main thread, instances has to hold n_instances already
+void materials_write_instances(Renderer* renderer, MaterialSet* materials, MaterialData* material_datas);
+
+// internal
+Mesh* meshes_load_imported(Renderer* renderer, JobPool* jobs, MeshData* mesh_datas, uint32_t n,
+        ImportedMaterials* imported, MaterialSet* out_materials);
+void meshes_release_staged(Renderer* renderer, Mesh* meshes, uint32_t n);
+void meshes_bind_materials(Mesh* meshes, MeshData* mesh_datas, uint32_t n, MaterialSet* materials);
+Image materials_pick_image(Renderer* renderer, MaterialSet* materials, int32_t index);
+TextureData image_data_texture(ImageData* image);
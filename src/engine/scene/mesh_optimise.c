@@ -0,0 +1,600 @@
+#include "mesh_optimise.h"
+#include "../utils.h"
+
+#include <math.h>
+#include <inttypes.h>
+
+// a 16KB direct mapped cache of 64 byte lines stands in for the gpu's vertex fetch cache
+#define FETCH_CACHE_LINE_SIZE 64
+#define FETCH_CACHE_LINES 256
+
+typedef struct OverdrawCluster {
+    float sort_key;
+    uint32_t start;
+    uint32_t end;
+} OverdrawCluster;
+
+void mesh_optimise(MeshData* mesh)
+{
+    MeshOptimiseJob job = { mesh };
+    mesh_optimise_begin(&job);
+
+    OptimiseRange* ranges = malloc(sizeof(OptimiseRange) * mesh_optimise_ranges(mesh, NULL));
+    uint32_t n_ranges = mesh_optimise_ranges(mesh, ranges);
+    for (uint32_t i = 0; i < n_ranges; ++i)
+        mesh_optimise_range(&ranges[i]);
+    free(ranges);
+
+    mesh_optimise_end(&job);
+}
+
+void meshes_optimise(JobPool* jobs, MeshData* meshes, uint32_t n)
+{
+    MeshOptimiseJob* mesh_jobs = malloc(sizeof(MeshOptimiseJob) * n);
+    uint32_t n_ranges = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        mesh_jobs[i] = (MeshOptimiseJob) { &meshes[i] };
+        n_ranges += mesh_optimise_ranges(&meshes[i], NULL);
+    }
+
+    OptimiseRange* ranges = malloc(sizeof(OptimiseRange) * n_ranges);
+    n_ranges = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        n_ranges += mesh_optimise_ranges(&meshes[i], ranges + n_ranges);
+
+    // ranges never share indices, and the vertices are only read until the fetch reorder
+    job_pool_parallel_for(jobs, mesh_optimise_begin_job, mesh_jobs, n);
+    job_pool_parallel_for(jobs, mesh_optimise_range_job, ranges, n_ranges);
+    job_pool_parallel_for(jobs, mesh_optimise_end_job, mesh_jobs, n);
+
+    free(ranges);
+    free(mesh_jobs);
+}
+
+// splits every surface into runs of at most OPTIMISE_RANGE_TRIANGLES, out_ranges may be NULL to
+// only count them
+uint32_t mesh_optimise_ranges(MeshData* mesh, OptimiseRange* out_ranges)
+{
+    uint32_t n_ranges = 0;
+
+    for (uint32_t i = 0; i < mesh->n_surfaces; ++i)
+    {
+        GeoSurface* surface = &mesh->surfaces[i];
+        if (surface->count < 3)
+            continue;
+
+        for (uint32_t start = 0; start < surface->count; start += OPTIMISE_RANGE_TRIANGLES * 3)
+        {
+            uint32_t count = surface->count - start;
+            if (count > OPTIMISE_RANGE_TRIANGLES * 3)
+                count = OPTIMISE_RANGE_TRIANGLES * 3;
+
+            if (out_ranges != NULL)
+                out_ranges[n_ranges] = (OptimiseRange) { mesh, surface->start_index + start, count };
+            n_ranges += 1;
+        }
+    }
+
+    return n_ranges;
+}
+
+void mesh_optimise_range(OptimiseRange* range)
+{
+    MeshData* mesh = range->mesh;
+    uint32_t* indices = mesh->indices + range->start_index;
+
+    // work on the range's own vertices so the per vertex tables stay small
+    uint32_t min_index = UINT32_MAX;
+    uint32_t max_index = 0;
+    for (uint32_t j = 0; j < range->count; ++j)
+    {
+        if (indices[j] < min_index) min_index = indices[j];
+        if (indices[j] > max_index) max_index = indices[j];
+    }
+
+    for (uint32_t j = 0; j < range->count; ++j)
+        indices[j] -= min_index;
+
+    uint32_t n_vertices = max_index - min_index + 1;
+    mesh_optimise_vertex_cache(indices, range->count, n_vertices);
+    mesh_optimise_overdraw(indices, range->count, mesh->vertices + min_index, n_vertices,
+            OVERDRAW_THRESHOLD);
+
+    for (uint32_t j = 0; j < range->count; ++j)
+        indices[j] += min_index;
+}
+
+void mesh_optimise_range_job(void* data, uint32_t index)
+{
+    mesh_optimise_range(&((OptimiseRange*) data)[index]);
+}
+
+void mesh_optimise_begin(MeshOptimiseJob* job)
+{
+    MeshData* mesh = job->mesh;
+    if (mesh->n_indices == 0)
+        return;
+
+    job->cache_before = mesh_analyse_vertex_cache(mesh->indices, mesh->n_indices,
+            mesh->n_vertices, VERTEX_CACHE_ANALYSIS_SIZE);
+    job->fetch_before = mesh_analyse_vertex_fetch(mesh->indices, mesh->n_indices,
+            mesh->n_vertices, sizeof(Vertex));
+}
+
+void mesh_optimise_begin_job(void* data, uint32_t index)
+{
+    mesh_optimise_begin(&((MeshOptimiseJob*) data)[index]);
+}
+
+// once every range has its triangle order
+void mesh_optimise_end(MeshOptimiseJob* job)
+{
+    MeshData* mesh = job->mesh;
+    if (mesh->n_indices == 0)
+        return;
+
+    // surfaces keep their own index ranges, so one remap over the whole mesh is enough
+    mesh_optimise_vertex_fetch(mesh->vertices, mesh->n_vertices, mesh->indices, mesh->n_indices);
+
+    VertexCacheStats cache_after = mesh_analyse_vertex_cache(mesh->indices, mesh->n_indices,
+            mesh->n_vertices, VERTEX_CACHE_ANALYSIS_SIZE);
+    VertexFetchStats fetch_after = mesh_analyse_vertex_fetch(mesh->indices, mesh->n_indices,
+            mesh->n_vertices, sizeof(Vertex));
+
+    LOG_V("Optimised %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.2f -> %.2f (%" PRIu64
+            " -> %" PRIu64 " bytes fetched)\n", mesh->name, job->cache_before.acmr, cache_after.acmr,
+            job->cache_before.atvr, cache_after.atvr, job->fetch_before.overfetch,
+            fetch_after.overfetch, job->fetch_before.bytes_fetched, fetch_after.bytes_fetched);
+}
+
+void mesh_optimise_end_job(void* data, uint32_t index)
+{
+    mesh_optimise_end(&((MeshOptimiseJob*) data)[index]);
+}
+
+// Tom Forsyth's linear speed vertex cache optimisation, greedily emits the triangle whose
+// vertices are most recently used and have the fewest triangles left
+void mesh_optimise_vertex_cache(uint32_t* indices, uint32_t n_indices, uint32_t n_vertices)
+{
+    uint32_t n_triangles = n_indices / 3;
+    if (n_triangles < 2)
+        return;
+
+    uint32_t* valence = calloc(n_vertices, sizeof(uint32_t));
+    uint32_t* adjacency_offsets = malloc(sizeof(uint32_t) * n_vertices);
+    uint32_t* adjacency = malloc(sizeof(uint32_t) * n_triangles * 3);
+    int* cache_position = malloc(sizeof(int) * n_vertices);
+    float* vertex_scores = malloc(sizeof(float) * n_vertices);
+    float* triangle_scores = malloc(sizeof(float) * n_triangles);
+    bool* emitted = calloc(n_triangles, sizeof(bool));
+    uint32_t* output = malloc(sizeof(uint32_t) * n_triangles * 3);
+
+    // vertex -> triangle adjacency, valence doubles as the fill cursor and then the remaining count
+    for (uint32_t i = 0; i < n_triangles * 3; ++i)
+        valence[indices[i]] += 1;
+
+    uint32_t offset = 0;
+    for (uint32_t v = 0; v < n_vertices; ++v)
+    {
+        adjacency_offsets[v] = offset;
+        offset += valence[v];
+        valence[v] = 0;
+    }
+
+    for (uint32_t t = 0; t < n_triangles; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = indices[t * 3 + k];
+            adjacency[adjacency_offsets[v] + valence[v]] = t;
+            valence[v] += 1;
+        }
+    }
+
+    for (uint32_t v = 0; v < n_vertices; ++v)
+    {
+        cache_position[v] = -1;
+        vertex_scores[v] = forsyth_vertex_score(-1, valence[v]);
+    }
+
+    int best = -1;
+    float best_score = -1;
+    for (uint32_t t = 0; t < n_triangles; ++t)
+    {
+        uint32_t* tri = &indices[t * 3];
+        triangle_scores[t] = vertex_scores[tri[0]] + vertex_scores[tri[1]] + vertex_scores[tri[2]];
+
+        if (triangle_scores[t] > best_score)
+        {
+            best_score = triangle_scores[t];
+            best = t;
+        }
+    }
+
+    uint32_t cache[VERTEX_CACHE_SIZE + 3];
+    uint32_t new_cache[VERTEX_CACHE_SIZE + 3];
+    int cache_count = 0;
+    uint32_t scan_cursor = 0;
+
+    for (uint32_t out = 0; out < n_triangles; ++out)
+    {
+        // nothing in the cache connects to anything left, start again from the next unused triangle
+        if (best < 0)
+        {
+            while (emitted[scan_cursor])
+                scan_cursor += 1;
+            best = scan_cursor;
+        }
+
+        uint32_t* tri = &indices[best * 3];
+        emitted[best] = true;
+        memcpy(&output[out * 3], tri, sizeof(uint32_t) * 3);
+
+        // take the triangle out of its vertices' remaining adjacency
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = tri[k];
+            uint32_t* list = &adjacency[adjacency_offsets[v]];
+
+            for (uint32_t j = 0; j < valence[v]; ++j)
+            {
+                if (list[j] == best)
+                {
+                    list[j] = list[valence[v] - 1];
+                    valence[v] -= 1;
+                    break;
+                }
+            }
+        }
+
+        // the triangle's vertices move to the front of the cache and push everything else back
+        int new_count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            bool duplicate = false;
+            for (int j = 0; j < new_count; ++j)
+                duplicate |= new_cache[j] == tri[k];
+
+            if (!duplicate)
+                new_cache[new_count++] = tri[k];
+        }
+
+        for (int j = 0; j < cache_count; ++j)
+        {
+            uint32_t v = cache[j];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                new_cache[new_count++] = v;
+        }
+
+        // rescore everything that moved, including whatever just fell out of the cache
+        for (int j = 0; j < new_count; ++j)
+        {
+            uint32_t v = new_cache[j];
+            cache_position[v] = j < VERTEX_CACHE_SIZE ? j : -1;
+
+            float new_score = forsyth_vertex_score(cache_position[v], valence[v]);
+            float delta = new_score - vertex_scores[v];
+            vertex_scores[v] = new_score;
+
+            uint32_t* list = &adjacency[adjacency_offsets[v]];
+            for (uint32_t a = 0; a < valence[v]; ++a)
+                triangle_scores[list[a]] += delta;
+        }
+
+        cache_count = new_count < VERTEX_CACHE_SIZE ? new_count : VERTEX_CACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(uint32_t) * cache_count);
+
+        // the next best triangle is always one touching the cache
+        best = -1;
+        best_score = -1;
+        for (int j = 0; j < cache_count; ++j)
+        {
+            uint32_t v = cache[j];
+            uint32_t* list = &adjacency[adjacency_offsets[v]];
+
+            for (uint32_t a = 0; a < valence[v]; ++a)
+            {
+                if (triangle_scores[list[a]] > best_score)
+                {
+                    best_score = triangle_scores[list[a]];
+                    best = list[a];
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output, sizeof(uint32_t) * n_triangles * 3);
+
+    free(output);
+    free(emitted);
+    free(triangle_scores);
+    free(vertex_scores);
+    free(cache_position);
+    free(adjacency);
+    free(adjacency_offsets);
+    free(valence);
+}
+
+// splits the cache optimised order into clusters where it costs little cache efficiency, then
+// draws outward facing clusters first so they occlude the rest (Sander et al. 2007)
+void mesh_optimise_overdraw(uint32_t* indices, uint32_t n_indices, const Vertex* vertices,
+        uint32_t n_vertices, float threshold)
+{
+    uint32_t n_triangles = n_indices / 3;
+    if (n_triangles < 2)
+        return;
+
+    const uint32_t cache_size = VERTEX_CACHE_ANALYSIS_SIZE;
+    uint32_t* timestamps = calloc(n_vertices, sizeof(uint32_t));
+    uint32_t time = cache_size + 1;
+
+    // hard boundaries are where the cache order already restarts, every vertex missing
+    uint32_t* hard_starts = malloc(sizeof(uint32_t) * (n_triangles + 1));
+    uint32_t n_hard = 0;
+
+    for (uint32_t t = 0; t < n_triangles; ++t)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k)
+            misses += fifo_cache_touch(timestamps, &time, indices[t * 3 + k], cache_size);
+
+        if (t == 0 || misses == 3)
+            hard_starts[n_hard++] = t;
+    }
+    hard_starts[n_hard] = n_triangles;
+
+    // soft boundaries split those further wherever the cluster so far is within the threshold
+    OverdrawCluster* clusters = malloc(sizeof(OverdrawCluster) * n_triangles);
+    uint32_t n_clusters = 0;
+
+    for (uint32_t h = 0; h < n_hard; ++h)
+    {
+        uint32_t start = hard_starts[h];
+        uint32_t end = hard_starts[h + 1];
+
+        time += cache_size + 1;
+        uint32_t cluster_misses = 0;
+        for (uint32_t i = start * 3; i < end * 3; ++i)
+            cluster_misses += fifo_cache_touch(timestamps, &time, indices[i], cache_size);
+
+        float cluster_threshold = threshold * cluster_misses / (end - start);
+
+        time += cache_size + 1;
+        uint32_t cluster_start = start;
+        uint32_t running_misses = 0;
+
+        for (uint32_t t = start; t < end; ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+                running_misses += fifo_cache_touch(timestamps, &time, indices[t * 3 + k], cache_size);
+
+            bool last = t + 1 == end;
+            if (last || running_misses <= cluster_threshold * (t - cluster_start + 1))
+            {
+                clusters[n_clusters++] = (OverdrawCluster) { 0, cluster_start, t + 1 };
+
+                time += cache_size + 1;
+                cluster_start = t + 1;
+                running_misses = 0;
+            }
+        }
+    }
+
+    // sort key is how far the cluster faces away from the middle of the mesh
+    vec3 mesh_centre = GLM_VEC3_ZERO_INIT;
+    for (uint32_t v = 0; v < n_vertices; ++v)
+        glm_vec3_add(mesh_centre, (float*) vertices[v].position, mesh_centre);
+    glm_vec3_scale(mesh_centre, 1.f / n_vertices, mesh_centre);
+
+    for (uint32_t c = 0; c < n_clusters; ++c)
+    {
+        vec3 centroid = GLM_VEC3_ZERO_INIT;
+        vec3 normal = GLM_VEC3_ZERO_INIT;
+        float total_area = 0;
+
+        for (uint32_t t = clusters[c].start; t < clusters[c].end; ++t)
+        {
+            const float* a = vertices[indices[t * 3 + 0]].position;
+            const float* b = vertices[indices[t * 3 + 1]].position;
+            const float* d = vertices[indices[t * 3 + 2]].position;
+
+            vec3 ab, ad, n;
+            glm_vec3_sub((float*) b, (float*) a, ab);
+            glm_vec3_sub((float*) d, (float*) a, ad);
+            glm_vec3_cross(ab, ad, n);
+
+            float area = glm_vec3_norm(n);
+            for (int k = 0; k < 3; ++k)
+                centroid[k] += (a[k] + b[k] + d[k]) / 3.f * area;
+
+            glm_vec3_add(normal, n, normal);
+            total_area += area;
+        }
+
+        if (total_area > 0)
+            glm_vec3_scale(centroid, 1.f / total_area, centroid);
+
+        glm_vec3_normalize(normal);
+        glm_vec3_sub(centroid, mesh_centre, centroid);
+        clusters[c].sort_key = glm_vec3_dot(centroid, normal);
+    }
+
+    // insertion sort, descending and stable. clusters come out of a cache optimised order so they
+    // are already mostly grouped and there are far fewer of them than triangles
+    for (uint32_t i = 1; i < n_clusters; ++i)
+    {
+        OverdrawCluster c = clusters[i];
+        uint32_t j = i;
+        while (j > 0 && clusters[j - 1].sort_key < c.sort_key)
+        {
+            clusters[j] = clusters[j - 1];
+            j -= 1;
+        }
+        clusters[j] = c;
+    }
+
+    uint32_t* output = malloc(sizeof(uint32_t) * n_triangles * 3);
+    uint32_t n_out = 0;
+    for (uint32_t c = 0; c < n_clusters; ++c)
+    {
+        uint32_t count = (clusters[c].end - clusters[c].start) * 3;
+        memcpy(&output[n_out], &indices[clusters[c].start * 3], sizeof(uint32_t) * count);
+        n_out += count;
+    }
+
+    memcpy(indices, output, sizeof(uint32_t) * n_out);
+
+    free(output);
+    free(clusters);
+    free(hard_starts);
+    free(timestamps);
+}
+
+// renumbers vertices in order of first use, unreferenced vertices end up at the back
+void mesh_optimise_vertex_fetch(Vertex* vertices, uint32_t n_vertices, uint32_t* indices,
+        uint32_t n_indices)
+{
+    uint32_t* remap = malloc(sizeof(uint32_t) * n_vertices);
+    memset(remap, 0xff, sizeof(uint32_t) * n_vertices);
+
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < n_indices; ++i)
+    {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX)
+            remap[v] = next++;
+
+        indices[i] = remap[v];
+    }
+
+    for (uint32_t v = 0; v < n_vertices; ++v)
+    {
+        if (remap[v] == UINT32_MAX)
+            remap[v] = next++;
+    }
+
+    Vertex* reordered = malloc(sizeof(Vertex) * n_vertices);
+    for (uint32_t v = 0; v < n_vertices; ++v)
+        reordered[remap[v]] = vertices[v];
+
+    memcpy(vertices, reordered, sizeof(Vertex) * n_vertices);
+
+    free(reordered);
+    free(remap);
+}
+
+VertexCacheStats mesh_analyse_vertex_cache(const uint32_t* indices, uint32_t n_indices,
+        uint32_t n_vertices, uint32_t cache_size)
+{
+    VertexCacheStats stats = {0};
+    if (n_indices < 3)
+        return stats;
+
+    uint32_t* timestamps = calloc(n_vertices, sizeof(uint32_t));
+    bool* seen = calloc(n_vertices, sizeof(bool));
+    uint32_t time = cache_size + 1;
+    uint32_t n_unique = 0;
+
+    for (uint32_t i = 0; i < n_indices; ++i)
+    {
+        stats.vertices_transformed += fifo_cache_touch(timestamps, &time, indices[i], cache_size);
+
+        if (!seen[indices[i]])
+        {
+            seen[indices[i]] = true;
+            n_unique += 1;
+        }
+    }
+
+    stats.acmr = (float) stats.vertices_transformed / (n_indices / 3);
+    stats.atvr = (float) stats.vertices_transformed / n_unique;
+
+    free(seen);
+    free(timestamps);
+
+    return stats;
+}
+
+VertexFetchStats mesh_analyse_vertex_fetch(const uint32_t* indices, uint32_t n_indices,
+        uint32_t n_vertices, uint32_t vertex_size)
+{
+    VertexFetchStats stats = {0};
+    if (n_indices == 0)
+        return stats;
+
+    uint64_t lines[FETCH_CACHE_LINES];
+    memset(lines, 0xff, sizeof(lines));
+
+    bool* seen = calloc(n_vertices, sizeof(bool));
+    uint32_t n_unique = 0;
+
+    for (uint32_t i = 0; i < n_indices; ++i)
+    {
+        uint64_t start = (uint64_t) indices[i] * vertex_size;
+        uint64_t end = start + vertex_size;
+
+        for (uint64_t line = start / FETCH_CACHE_LINE_SIZE; line <= (end - 1) / FETCH_CACHE_LINE_SIZE;
+                ++line)
+        {
+            uint64_t* slot = &lines[line % FETCH_CACHE_LINES];
+            if (*slot != line)
+            {
+                *slot = line;
+                stats.bytes_fetched += FETCH_CACHE_LINE_SIZE;
+            }
+        }
+
+        if (!seen[indices[i]])
+        {
+            seen[indices[i]] = true;
+            n_unique += 1;
+        }
+    }
+
+    stats.overfetch = (double) stats.bytes_fetched / ((uint64_t) n_unique * vertex_size);
+
+    free(seen);
+
+    return stats;
+}
+
+float forsyth_vertex_score(int cache_position, uint32_t remaining_valence)
+{
+    // no triangles left to draw with it
+    if (remaining_valence == 0)
+        return -1.f;
+
+    float score = 0;
+    if (cache_position >= 0)
+    {
+        // the last triangle's vertices get a fixed score so the order doesn't degrade into strips
+        if (cache_position < 3)
+        {
+            score = 0.75f;
+        }
+        else
+        {
+            float scale = 1.f / (VERTEX_CACHE_SIZE - 3);
+            score = powf(1.f - (cache_position - 3) * scale, 1.5f);
+        }
+    }
+
+    // finish off vertices with few triangles left so they can leave the cache for good
+    score += 2.f * powf(remaining_valence, -0.5f);
+
+    return score;
+}
+
+// fifo cache simulated with timestamps, returns whether the vertex missed
+bool fifo_cache_touch(uint32_t* timestamps, uint32_t* time, uint32_t vertex, uint32_t cache_size)
+{
+    if (*time - timestamps[vertex] > cache_size)
+    {
+        timestamps[vertex] = *time;
+        *time += 1;
+        return true;
+    }
+
+    return false;
+}
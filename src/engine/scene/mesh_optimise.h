@@ -0,0 +1,69 @@
+#pragma once
+
+#include "import.h"
+
+// size of the cache the triangle order is optimised for
+#define VERTEX_CACHE_SIZE 32
+// size of the fifo used to measure the result, roughly what current hardware behaves like
+#define VERTEX_CACHE_ANALYSIS_SIZE 16
+// how much worse than the cache optimal order a cluster may get to buy less overdraw
+#define OVERDRAW_THRESHOLD 1.05f
+// surfaces bigger than this have their triangle order optimised in separate runs, one job each.
+// only the few vertices shared across a seam get transformed twice
+#define OPTIMISE_RANGE_TRIANGLES (1 << 16)
+
+typedef struct VertexCacheStats {
+    uint32_t vertices_transformed;
+    // average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3 is worst)
+    float acmr;
+    // average transform to vertex ratio, transformed vertices per unique vertex (1 is ideal)
+    float atvr;
+} VertexCacheStats;
+
+typedef struct VertexFetchStats {
+    // 64 bit, a few million triangles of fat vertices are already past 4GB of cache lines
+    uint64_t bytes_fetched;
+    // bytes fetched over the size of the referenced vertices (1 is ideal)
+    float overfetch;
+} VertexFetchStats;
+
+// a run of one surface's triangles, reordered on its own
+typedef struct OptimiseRange {
+    MeshData* mesh;
+    uint32_t start_index;
+    uint32_t count;
+} OptimiseRange;
+
+// one mesh being optimised, what it measured before so the log can compare
+typedef struct MeshOptimiseJob {
+    MeshData* mesh;
+    VertexCacheStats cache_before;
+    VertexFetchStats fetch_before;
+} MeshOptimiseJob;
+
+// reorders triangles for cache reuse and overdraw and then vertices for fetch locality
+void mesh_optimise(MeshData* mesh);
+// the same for every mesh, big surfaces are split into ranges so one mesh still uses the pool
+void meshes_optimise(JobPool* jobs, MeshData* meshes, uint32_t n);
+
+void mesh_optimise_vertex_cache(uint32_t* indices, uint32_t n_indices, uint32_t n_vertices);
+void mesh_optimise_overdraw(uint32_t* indices, uint32_t n_indices, const Vertex* vertices,
+        uint32_t n_vertices, float threshold);
+void mesh_optimise_vertex_fetch(Vertex* vertices, uint32_t n_vertices, uint32_t* indices,
+        uint32_t n_indices);
+
+VertexCacheStats mesh_analyse_vertex_cache(const uint32_t* indices, uint32_t n_indices,
+        uint32_t n_vertices, uint32_t cache_size);
+VertexFetchStats mesh_analyse_vertex_fetch(const uint32_t* indices, uint32_t n_indices,
+        uint32_t n_vertices, uint32_t vertex_size);
+
+// internal
+uint32_t mesh_optimise_ranges(MeshData* mesh, OptimiseRange* out_ranges);
+void mesh_optimise_range(OptimiseRange* range);
+void mesh_optimise_range_job(void* data, uint32_t index);
+void mesh_optimise_begin(MeshOptimiseJob* job);
+void mesh_optimise_begin_job(void* data, uint32_t index);
+void mesh_optimise_end(MeshOptimiseJob* job);
+void mesh_optimise_end_job(void* data, uint32_t index);
+float forsyth_vertex_score(int cache_position, uint32_t remaining_valence);
+bool fifo_cache_touch(uint32_t* timestamps, uint32_t* time, uint32_t vertex, uint32_t cache_size);
@@ -0,0 +1,554 @@
+#include "mesh_simplify.h"
+#include "mesh_optimise.h"
+#include "../utils.h"
+
+#include <math.h>
+
+void mesh_generate_lods(MeshData* mesh)
+{
+    glm_vec4_zero(mesh->bounds);
+
+    if (mesh->n_vertices != 0)
+    {
+        vec3 min, max;
+        glm_vec3_copy(mesh->vertices[0].position, min);
+        glm_vec3_copy(mesh->vertices[0].position, max);
+        for (uint32_t i = 1; i < mesh->n_vertices; ++i)
+        {
+            glm_vec3_minv(min, mesh->vertices[i].position, min);
+            glm_vec3_maxv(max, mesh->vertices[i].position, max);
+        }
+
+        vec3 centre;
+        glm_vec3_center(min, max, centre);
+
+        float radius = 0;
+        for (uint32_t i = 0; i < mesh->n_vertices; ++i)
+            radius = fmaxf(radius, glm_vec3_distance(centre, mesh->vertices[i].position));
+
+        glm_vec3_copy(centre, mesh->bounds);
+        mesh->bounds[3] = radius;
+    }
+
+    // the simplified ranges go after all the original ones so nothing already there moves
+    uint32_t* extra = NULL;
+    uint32_t n_extra = 0;
+    uint32_t extra_capacity = 0;
+
+    for (uint32_t i = 0; i < mesh->n_surfaces; ++i)
+    {
+        GeoSurface* surface = &mesh->surfaces[i];
+        surface->lods[0] = (GeoLod) { surface->start_index, surface->count, 0 };
+        surface->n_lods = 1;
+        surface_compute_bounds(surface, mesh->indices, mesh->vertices);
+
+        if (surface->count / 3 < LOD_MIN_TRIANGLES)
+            continue;
+
+        // same trick as the optimiser, keep the per vertex tables to the surface's own range
+        const uint32_t* surface_indices = mesh->indices + surface->start_index;
+        uint32_t min_index = UINT32_MAX;
+        uint32_t max_index = 0;
+        for (uint32_t j = 0; j < surface->count; ++j)
+        {
+            if (surface_indices[j] < min_index) min_index = surface_indices[j];
+            if (surface_indices[j] > max_index) max_index = surface_indices[j];
+        }
+
+        uint32_t n_vertices = max_index - min_index + 1;
+        uint32_t* previous = malloc(sizeof(uint32_t) * surface->count);
+        for (uint32_t j = 0; j < surface->count; ++j)
+            previous[j] = surface_indices[j] - min_index;
+
+        uint32_t n_previous = surface->count;
+        float error = 0;
+
+        for (uint32_t level = 1; level < MAX_LODS; ++level)
+        {
+            uint32_t target = (uint32_t) (n_previous / 3 * LOD_REDUCTION) * 3;
+            uint32_t* lod = malloc(sizeof(uint32_t) * n_previous);
+
+            float level_error;
+            uint32_t n_lod = mesh_simplify(lod, previous, n_previous, mesh->vertices + min_index,
+                    n_vertices, target, LOD_MAX_ERROR, &level_error);
+
+            if (n_lod == 0 || n_lod > n_previous * LOD_MIN_REDUCTION)
+            {
+                free(lod);
+                break;
+            }
+
+            mesh_optimise_vertex_cache(lod, n_lod, n_vertices);
+
+            // errors are measured against the level before, so they add up down the chain
+            error += level_error;
+
+            if (n_extra + n_lod > extra_capacity)
+            {
+                extra_capacity = max(extra_capacity * 2, n_extra + n_lod);
+                extra = realloc(extra, sizeof(uint32_t) * extra_capacity);
+            }
+
+            surface->lods[level] = (GeoLod) { mesh->n_indices + n_extra, n_lod, error };
+            surface->n_lods += 1;
+
+            for (uint32_t j = 0; j < n_lod; ++j)
+                extra[n_extra + j] = lod[j] + min_index;
+            n_extra += n_lod;
+
+            free(previous);
+            previous = lod;
+            n_previous = n_lod;
+        }
+
+        free(previous);
+    }
+
+    if (n_extra == 0)
+        return;
+
+    mesh->indices = realloc(mesh->indices, sizeof(uint32_t) * (mesh->n_indices + n_extra));
+    memcpy(mesh->indices + mesh->n_indices, extra, sizeof(uint32_t) * n_extra);
+
+    LOG_V("Generated lods for %s: %d extra indices on top of %d\n", mesh->name, n_extra, mesh->n_indices);
+
+    mesh->n_indices += n_extra;
+    free(extra);
+}
+
+void mesh_generate_lods_job(void* data, uint32_t index)
+{
+    mesh_generate_lods(&((MeshData*) data)[index]);
+}
+
+// Garland and Heckbert's quadric error metric with the greedy passes meshoptimizer uses: every
+// pass sorts all the edges by cost and collapses the cheapest ones that don't touch each other.
+// vertices on a uv / normal seam or on an open border never move so no cracks open up, and
+// collapses that would flip a triangle over are skipped
+uint32_t mesh_simplify(uint32_t* destination, const uint32_t* indices, uint32_t n_indices,
+        const Vertex* vertices, uint32_t n_vertices, uint32_t target_n_indices, float max_error,
+        float* out_error)
+{
+    *out_error = 0;
+    memmove(destination, indices, sizeof(uint32_t) * n_indices);
+
+    if (n_indices <= target_n_indices || n_vertices == 0)
+        return n_indices;
+
+    // positions go into a unit cube so the float quadrics stay well conditioned
+    vec3 min, max;
+    glm_vec3_copy((float*) vertices[0].position, min);
+    glm_vec3_copy((float*) vertices[0].position, max);
+    for (uint32_t v = 1; v < n_vertices; ++v)
+    {
+        glm_vec3_minv(min, (float*) vertices[v].position, min);
+        glm_vec3_maxv(max, (float*) vertices[v].position, max);
+    }
+
+    float extent = fmaxf(max[0] - min[0], fmaxf(max[1] - min[1], max[2] - min[2]));
+    if (extent == 0)
+        return n_indices;
+
+    float (*positions)[3] = malloc(sizeof(float) * 3 * n_vertices);
+    for (uint32_t v = 0; v < n_vertices; ++v)
+    {
+        for (int k = 0; k < 3; ++k)
+            positions[v][k] = (vertices[v].position[k] - min[k]) / extent;
+    }
+
+    // vertices at the same position are one vertex as far as the topology is concerned
+    uint32_t* remap = malloc(sizeof(uint32_t) * n_vertices);
+    simplify_weld_positions(vertices, n_vertices, remap);
+
+    bool* referenced = calloc(n_vertices, sizeof(bool));
+    for (uint32_t i = 0; i < n_indices; ++i)
+        referenced[destination[i]] = true;
+
+    // how many distinct vertices share each position, more than one means a seam
+    uint32_t* n_wedges = calloc(n_vertices, sizeof(uint32_t));
+    uint32_t* wedge = malloc(sizeof(uint32_t) * n_vertices);
+    for (uint32_t v = 0; v < n_vertices; ++v)
+    {
+        if (!referenced[v])
+            continue;
+
+        n_wedges[remap[v]] += 1;
+        wedge[remap[v]] = v;
+    }
+
+    bool* locked = calloc(n_vertices, sizeof(bool));
+    simplify_find_borders(destination, n_indices, remap, locked);
+    for (uint32_t v = 0; v < n_vertices; ++v)
+        locked[v] |= n_wedges[v] > 1;
+
+    Quadric* quadrics = calloc(n_vertices, sizeof(Quadric));
+    for (uint32_t i = 0; i < n_indices; i += 3)
+    {
+        uint32_t a = remap[destination[i + 0]];
+        uint32_t b = remap[destination[i + 1]];
+        uint32_t c = remap[destination[i + 2]];
+
+        Quadric quadric;
+        quadric_from_triangle(&quadric, positions[a], positions[b], positions[c]);
+
+        quadric_add(&quadrics[a], &quadric);
+        quadric_add(&quadrics[b], &quadric);
+        quadric_add(&quadrics[c], &quadric);
+    }
+
+    uint32_t* collapse_remap = malloc(sizeof(uint32_t) * n_vertices);
+    bool* collapse_locked = malloc(sizeof(bool) * n_vertices);
+    uint32_t* adjacency_offsets = malloc(sizeof(uint32_t) * (n_vertices + 1));
+    uint32_t* adjacency = malloc(sizeof(uint32_t) * n_indices);
+    Collapse* candidates = malloc(sizeof(Collapse) * n_indices);
+
+    float max_error_squared = max_error * max_error;
+    float result_error = 0;
+    uint32_t count = n_indices;
+
+    while (count > target_n_indices)
+    {
+        uint32_t n_triangles = count / 3;
+
+        // position -> triangle adjacency for the flip checks and for locking one rings
+        memset(adjacency_offsets, 0, sizeof(uint32_t) * (n_vertices + 1));
+        for (uint32_t i = 0; i < count; ++i)
+            adjacency_offsets[remap[destination[i]] + 1] += 1;
+        for (uint32_t v = 0; v < n_vertices; ++v)
+            adjacency_offsets[v + 1] += adjacency_offsets[v];
+        for (uint32_t i = 0; i < count; ++i)
+            adjacency[adjacency_offsets[remap[destination[i]]]++] = i / 3;
+        // filling walked every offset forward by one list, walk them back
+        for (uint32_t v = n_vertices; v > 0; --v)
+            adjacency_offsets[v] = adjacency_offsets[v - 1];
+        adjacency_offsets[0] = 0;
+
+        // every interior edge shows up once with a < b, collapse it in its cheaper direction
+        uint32_t n_candidates = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t a = remap[destination[i]];
+            uint32_t b = remap[destination[i - i % 3 + (i + 1) % 3]];
+
+            if (a >= b)
+                continue;
+
+            bool can_ab = !locked[a] && n_wedges[b] == 1;
+            bool can_ba = !locked[b] && n_wedges[a] == 1;
+            if (!can_ab && !can_ba)
+                continue;
+
+            float weight = quadrics[a].weight + quadrics[b].weight;
+            float error_ab = (quadric_error(&quadrics[a], positions[b])
+                    + quadric_error(&quadrics[b], positions[b])) / weight;
+            float error_ba = (quadric_error(&quadrics[a], positions[a])
+                    + quadric_error(&quadrics[b], positions[a])) / weight;
+
+            if (can_ab && (!can_ba || error_ab <= error_ba))
+                candidates[n_candidates++] = (Collapse) { a, b, error_ab };
+            else
+                candidates[n_candidates++] = (Collapse) { b, a, error_ba };
+        }
+
+        if (n_candidates == 0)
+            break;
+
+        qsort(candidates, n_candidates, sizeof(Collapse), collapse_compare);
+
+        // a collapse usually takes two triangles with it
+        uint32_t goal = (count - target_n_indices) / 3 / 2;
+        if (goal == 0)
+            goal = 1;
+
+        // don't dig too far past the cheap end of the list in one pass, later passes see the
+        // updated quadrics
+        uint32_t limit_index = goal < n_candidates ? goal - 1 : n_candidates - 1;
+        float pass_limit = fminf(candidates[limit_index].error * 1.5f, max_error_squared);
+
+        for (uint32_t v = 0; v < n_vertices; ++v)
+        {
+            collapse_remap[v] = v;
+            collapse_locked[v] = false;
+        }
+
+        uint32_t n_collapses = 0;
+        for (uint32_t i = 0; i < n_candidates && n_collapses < goal; ++i)
+        {
+            Collapse collapse = candidates[i];
+            if (collapse.error > pass_limit)
+                break;
+
+            if (collapse_locked[collapse.from] || collapse_locked[collapse.to])
+                continue;
+
+            uint32_t* triangles = &adjacency[adjacency_offsets[collapse.from]];
+            uint32_t n_adjacent = adjacency_offsets[collapse.from + 1] - adjacency_offsets[collapse.from];
+
+            if (simplify_collapse_flips(destination, triangles, n_adjacent, remap, positions,
+                        collapse.from, collapse.to))
+                continue;
+
+            collapse_remap[collapse.from] = collapse.to;
+            quadric_add(&quadrics[collapse.to], &quadrics[collapse.from]);
+
+            // nothing touching the moved triangles can collapse again until they are rebuilt
+            for (uint32_t j = 0; j < n_adjacent; ++j)
+            {
+                for (int k = 0; k < 3; ++k)
+                    collapse_locked[remap[destination[triangles[j] * 3 + k]]] = true;
+            }
+
+            result_error = fmaxf(result_error, collapse.error);
+            n_collapses += 1;
+        }
+
+        if (n_collapses == 0)
+            break;
+
+        uint32_t new_count = 0;
+        for (uint32_t t = 0; t < n_triangles; ++t)
+        {
+            uint32_t triangle[3];
+            uint32_t corners[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t v = destination[t * 3 + k];
+                uint32_t position = collapse_remap[remap[v]];
+
+                // collapse targets only ever have the one vertex at their position
+                triangle[k] = position == remap[v] ? v : wedge[position];
+                corners[k] = position;
+            }
+
+            if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+                continue;
+
+            memcpy(&destination[new_count], triangle, sizeof(triangle));
+            new_count += 3;
+        }
+
+        count = new_count;
+    }
+
+    *out_error = sqrtf(result_error) * extent;
+
+    free(candidates);
+    free(adjacency);
+    free(adjacency_offsets);
+    free(collapse_locked);
+    free(collapse_remap);
+    free(quadrics);
+    free(locked);
+    free(wedge);
+    free(n_wedges);
+    free(referenced);
+    free(remap);
+    free(positions);
+
+    return count;
+}
+
+// plane of the triangle weighted by its area, so big flat triangles dominate small slivers
+void quadric_from_triangle(Quadric* quadric, const float* p0, const float* p1, const float* p2)
+{
+    vec3 e0 = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    vec3 e1 = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+    vec3 normal;
+    glm_vec3_cross(e0, e1, normal);
+    float length = glm_vec3_norm(normal);
+    float area = length * 0.5f;
+
+    if (length > 0)
+        glm_vec3_scale(normal, 1 / length, normal);
+
+    float d = -glm_vec3_dot(normal, (float*) p0);
+
+    *quadric = (Quadric) {
+        .a00 = normal[0] * normal[0] * area,
+        .a11 = normal[1] * normal[1] * area,
+        .a22 = normal[2] * normal[2] * area,
+        .a01 = normal[0] * normal[1] * area,
+        .a02 = normal[0] * normal[2] * area,
+        .a12 = normal[1] * normal[2] * area,
+        .b0 = normal[0] * d * area,
+        .b1 = normal[1] * d * area,
+        .b2 = normal[2] * d * area,
+        .c = d * d * area,
+        .weight = area,
+    };
+}
+
+void quadric_add(Quadric* quadric, const Quadric* other)
+{
+    quadric->a00 += other->a00;
+    quadric->a11 += other->a11;
+    quadric->a22 += other->a22;
+    quadric->a01 += other->a01;
+    quadric->a02 += other->a02;
+    quadric->a12 += other->a12;
+    quadric->b0 += other->b0;
+    quadric->b1 += other->b1;
+    quadric->b2 += other->b2;
+    quadric->c += other->c;
+    quadric->weight += other->weight;
+}
+
+// sum of the weighted squared distances from p to every plane in the quadric
+float quadric_error(const Quadric* q, const float* p)
+{
+    float rx = q->a00 * p[0] + q->a01 * p[1] + q->a02 * p[2] + q->b0;
+    float ry = q->a01 * p[0] + q->a11 * p[1] + q->a12 * p[2] + q->b1;
+    float rz = q->a02 * p[0] + q->a12 * p[1] + q->a22 * p[2] + q->b2;
+
+    float error = rx * p[0] + ry * p[1] + rz * p[2]
+        + q->b0 * p[0] + q->b1 * p[1] + q->b2 * p[2] + q->c;
+
+    return fabsf(error);
+}
+
+// maps every vertex to the first vertex with exactly the same position, returns how many there are
+uint32_t simplify_weld_positions(const Vertex* vertices, uint32_t n_vertices, uint32_t* remap)
+{
+    uint32_t table_size = 1;
+    while (table_size < n_vertices * 2)
+        table_size *= 2;
+
+    uint32_t* table = malloc(sizeof(uint32_t) * table_size);
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+
+    uint32_t n_unique = 0;
+    for (uint32_t v = 0; v < n_vertices; ++v)
+    {
+        uint32_t bits[3];
+        memcpy(bits, vertices[v].position, sizeof(bits));
+
+        uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        uint32_t slot = hash & (table_size - 1);
+
+        while (true)
+        {
+            uint32_t other = table[slot];
+
+            if (other == UINT32_MAX)
+            {
+                table[slot] = v;
+                remap[v] = v;
+                n_unique += 1;
+                break;
+            }
+
+            if (memcmp(vertices[other].position, vertices[v].position, sizeof(vec3)) == 0)
+            {
+                remap[v] = other;
+                break;
+            }
+
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    free(table);
+
+    return n_unique;
+}
+
+// an edge without its twin running the other way is on an open border
+void simplify_find_borders(const uint32_t* indices, uint32_t n_indices, const uint32_t* remap,
+        bool* border)
+{
+    uint32_t table_size = 1;
+    while (table_size < n_indices * 2)
+        table_size *= 2;
+
+    uint64_t* table = malloc(sizeof(uint64_t) * table_size);
+    memset(table, 0xff, sizeof(uint64_t) * table_size);
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (uint32_t i = 0; i < n_indices; ++i)
+        {
+            uint64_t a = remap[indices[i]];
+            uint64_t b = remap[indices[i - i % 3 + (i + 1) % 3]];
+
+            // first pass inserts every edge, the second looks for each one's twin
+            uint64_t key = pass == 0 ? a << 32 | b : b << 32 | a;
+            uint32_t slot = (uint32_t) ((key * 0x9e3779b97f4a7c15ull) >> 32) & (table_size - 1);
+
+            while (table[slot] != UINT64_MAX && table[slot] != key)
+                slot = (slot + 1) & (table_size - 1);
+
+            if (pass == 0)
+                table[slot] = key;
+            else if (table[slot] != key)
+                border[a] = border[b] = true;
+        }
+    }
+
+    free(table);
+}
+
+bool simplify_collapse_flips(const uint32_t* indices, const uint32_t* triangles, uint32_t n_triangles,
+        const uint32_t* remap, float (*positions)[3], uint32_t from, uint32_t to)
+{
+    for (uint32_t i = 0; i < n_triangles; ++i)
+    {
+        const uint32_t* triangle = &indices[triangles[i] * 3];
+        uint32_t corners[3] = { remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] };
+
+        // these are the triangles that disappear
+        if (corners[0] == to || corners[1] == to || corners[2] == to)
+            continue;
+
+        float* p[3];
+        float* moved[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            p[k] = positions[corners[k]];
+            moved[k] = corners[k] == from ? positions[to] : p[k];
+        }
+
+        vec3 e0, e1, before, after;
+        glm_vec3_sub(p[1], p[0], e0);
+        glm_vec3_sub(p[2], p[0], e1);
+        glm_vec3_cross(e0, e1, before);
+
+        glm_vec3_sub(moved[1], moved[0], e0);
+        glm_vec3_sub(moved[2], moved[0], e1);
+        glm_vec3_cross(e0, e1, after);
+
+        if (glm_vec3_dot(before, after) <= 0)
+            return true;
+    }
+
+    return false;
+}
+
+int collapse_compare(const void* a, const void* b)
+{
+    float error_a = ((const Collapse*) a)->error;
+    float error_b = ((const Collapse*) b)->error;
+
+    return (error_a > error_b) - (error_a < error_b);
+}
+
+void surface_compute_bounds(GeoSurface* surface, const uint32_t* indices, const Vertex* vertices)
+{
+    glm_vec3_zero(surface->aabb_min);
+    glm_vec3_zero(surface->aabb_max);
+
+    if (surface->count == 0)
+        return;
+
+    const uint32_t* surface_indices = indices + surface->start_index;
+    glm_vec3_copy((float*) vertices[surface_indices[0]].position, surface->aabb_min);
+    glm_vec3_copy((float*) vertices[surface_indices[0]].position, surface->aabb_max);
+
+    for (uint32_t i = 1; i < surface->count; ++i)
+    {
+        glm_vec3_minv(surface->aabb_min, (float*) vertices[surface_indices[i]].position,
+                surface->aabb_min);
+        glm_vec3_maxv(surface->aabb_max, (float*) vertices[surface_indices[i]].position,
+                surface->aabb_max);
+    }
+}
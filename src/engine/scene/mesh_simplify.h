@@ -0,0 +1,50 @@
+#pragma once
+
+#include "import.h"
+
+// each level aims for this fraction of the triangles of the one before it
+#define LOD_REDUCTION 0.5f
+// a level that keeps more than this fraction of the previous one isn't worth the indices
+#define LOD_MIN_REDUCTION 0.9f
+// surfaces smaller than this are drawn at full resolution whatever the distance
+#define LOD_MIN_TRIANGLES 32
+// largest error a single level may add, relative to the size of the surface
+#define LOD_MAX_ERROR 0.05f
+
+// error quadric of a set of planes, the symmetric matrix is stored as its upper triangle
+typedef struct Quadric {
+    float a00, a11, a22;
+    float a01, a02, a12;
+    float b0, b1, b2;
+    float c;
+    float weight;
+} Quadric;
+
+typedef struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    float error;
+} Collapse;
+
+// appends a chain of simplified index ranges to every surface and fills in the bounds
+void mesh_generate_lods(MeshData* mesh);
+void mesh_generate_lods_job(void* data, uint32_t index);
+
+// quadric error edge collapse down towards target_n_indices, vertices are only ever merged into
+// each other so the result indexes the same vertex buffer. returns the new index count and
+// writes the largest error it introduced, in mesh units
+uint32_t mesh_simplify(uint32_t* destination, const uint32_t* indices, uint32_t n_indices,
+        const Vertex* vertices, uint32_t n_vertices, uint32_t target_n_indices, float max_error,
+        float* out_error);
+
+// internal
+void quadric_from_triangle(Quadric* quadric, const float* p0, const float* p1, const float* p2);
+void quadric_add(Quadric* quadric, const Quadric* other);
+float quadric_error(const Quadric* quadric, const float* p);
+uint32_t simplify_weld_positions(const Vertex* vertices, uint32_t n_vertices, uint32_t* remap);
+void simplify_find_borders(const uint32_t* indices, uint32_t n_indices, const uint32_t* remap,
+        bool* border);
+bool simplify_collapse_flips(const uint32_t* indices, const uint32_t* triangles, uint32_t n_triangles,
+        const uint32_t* remap, float (*positions)[3], uint32_t from, uint32_t to);
+int collapse_compare(const void* a, const void* b);
+void surface_compute_bounds(GeoSurface* surface, const uint32_t* indices, const Vertex* vertices);
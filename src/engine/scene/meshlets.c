@@ -0,0 +1,272 @@
+#include "meshlets.h"
+#include "../utils.h"
+
+#include <math.h>
+
+void mesh_build_meshlets(MeshData* mesh)
+{
+    MeshletRange* ranges = malloc(sizeof(MeshletRange) * mesh_meshlet_ranges(mesh, NULL));
+    uint32_t n_ranges = mesh_meshlet_ranges(mesh, ranges);
+
+    for (uint32_t i = 0; i < n_ranges; ++i)
+        meshlet_range_build(&ranges[i]);
+
+    mesh_merge_meshlets(mesh, ranges, n_ranges);
+    free(ranges);
+}
+
+void meshes_build_meshlets(JobPool* jobs, MeshData* meshes, uint32_t n)
+{
+    uint32_t n_ranges = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        n_ranges += mesh_meshlet_ranges(&meshes[i], NULL);
+
+    MeshletRange* ranges = malloc(sizeof(MeshletRange) * n_ranges);
+    n_ranges = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        n_ranges += mesh_meshlet_ranges(&meshes[i], ranges + n_ranges);
+
+    job_pool_parallel_for(jobs, meshlet_range_build_job, ranges, n_ranges);
+
+    // ranges come in mesh order, each mesh's only get copied together
+    uint32_t first_range = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t n_mesh_ranges = mesh_meshlet_ranges(&meshes[i], NULL);
+        mesh_merge_meshlets(&meshes[i], ranges + first_range, n_mesh_ranges);
+        first_range += n_mesh_ranges;
+    }
+
+    free(ranges);
+}
+
+// every lod of every surface in order, cut into runs of at most MESHLET_RANGE_TRIANGLES.
+// out_ranges may be NULL to only count them
+uint32_t mesh_meshlet_ranges(MeshData* mesh, MeshletRange* out_ranges)
+{
+    uint32_t n_ranges = 0;
+
+    for (uint32_t i = 0; i < mesh->n_surfaces; ++i)
+    {
+        for (uint32_t j = 0; j < mesh->surfaces[i].n_lods; ++j)
+        {
+            GeoLod* lod = &mesh->surfaces[i].lods[j];
+
+            for (uint32_t start = 0; start < lod->count; start += MESHLET_RANGE_TRIANGLES * 3)
+            {
+                uint32_t count = lod->count - start;
+                if (count > MESHLET_RANGE_TRIANGLES * 3)
+                    count = MESHLET_RANGE_TRIANGLES * 3;
+
+                if (out_ranges != NULL)
+                    out_ranges[n_ranges] = (MeshletRange) {
+                        .mesh = mesh,
+                        .lod = lod,
+                        .start_index = lod->start_index + start,
+                        .count = count,
+                    };
+                n_ranges += 1;
+            }
+        }
+    }
+
+    return n_ranges;
+}
+
+void meshlet_range_build(MeshletRange* range)
+{
+    MeshData* mesh = range->mesh;
+
+    uint32_t* indices = mesh->indices + range->start_index;
+
+    range->meshlets = malloc(sizeof(Meshlet) * meshlets_max_count(range->count));
+
+    // work on the range's own vertices so the stamps stay small, the same as optimising does
+    uint32_t min_index = UINT32_MAX;
+    uint32_t max_index = 0;
+    for (uint32_t i = 0; i < range->count; ++i)
+    {
+        if (indices[i] < min_index) min_index = indices[i];
+        if (indices[i] > max_index) max_index = indices[i];
+    }
+
+    for (uint32_t i = 0; i < range->count; ++i)
+        indices[i] -= min_index;
+
+    uint32_t* vertex_stamps = calloc(max_index - min_index + 1, sizeof(uint32_t));
+    uint32_t stamp = 0;
+
+    range->n_meshlets = meshlets_build(range->meshlets, mesh->indices, range->start_index,
+            range->count, mesh->vertices + min_index, vertex_stamps, &stamp);
+
+    free(vertex_stamps);
+
+    for (uint32_t i = 0; i < range->count; ++i)
+        indices[i] += min_index;
+}
+
+void meshlet_range_build_job(void* data, uint32_t index)
+{
+    meshlet_range_build(&((MeshletRange*) data)[index]);
+}
+
+// copies the runs' meshlets out in order and points every lod at its own, frees the runs'
+void mesh_merge_meshlets(MeshData* mesh, MeshletRange* ranges, uint32_t n_ranges)
+{
+    uint32_t n_meshlets = 0;
+    for (uint32_t i = 0; i < n_ranges; ++i)
+        n_meshlets += ranges[i].n_meshlets;
+
+    mesh->meshlets = malloc(sizeof(Meshlet) * n_meshlets);
+    mesh->n_meshlets = 0;
+
+    uint32_t range = 0;
+    for (uint32_t i = 0; i < mesh->n_surfaces; ++i)
+    {
+        for (uint32_t j = 0; j < mesh->surfaces[i].n_lods; ++j)
+        {
+            GeoLod* lod = &mesh->surfaces[i].lods[j];
+            lod->first_meshlet = mesh->n_meshlets;
+            lod->n_meshlets = 0;
+
+            for (; range < n_ranges && ranges[range].lod == lod; ++range)
+            {
+                memcpy(mesh->meshlets + mesh->n_meshlets, ranges[range].meshlets,
+                        sizeof(Meshlet) * ranges[range].n_meshlets);
+                lod->n_meshlets += ranges[range].n_meshlets;
+                mesh->n_meshlets += ranges[range].n_meshlets;
+
+                free(ranges[range].meshlets);
+            }
+        }
+    }
+
+    if (mesh->n_meshlets != 0)
+        LOG_V("Built %d meshlets for %s\n", mesh->n_meshlets, mesh->name);
+}
+
+uint32_t meshlets_build(Meshlet* meshlets, const uint32_t* indices, uint32_t first_index,
+        uint32_t n_indices, const Vertex* vertices, uint32_t* vertex_stamps, uint32_t* stamp)
+{
+    uint32_t n_meshlets = 0;
+    uint32_t meshlet_start = first_index;
+    uint32_t n_triangles = 0;
+    uint32_t n_vertices = 0;
+
+    // a vertex is in the current meshlet when its stamp matches, so starting a new one is free
+    *stamp += 1;
+
+    for (uint32_t i = first_index; i + 2 < first_index + n_indices; i += 3)
+    {
+        uint32_t new_vertices = 0;
+        for (int k = 0; k < 3; ++k)
+            new_vertices += vertex_stamps[indices[i + k]] != *stamp;
+
+        if (n_vertices + new_vertices > MESHLET_MAX_VERTICES || n_triangles == MESHLET_MAX_TRIANGLES)
+        {
+            meshlets[n_meshlets++] = meshlet_compute_bounds(indices, meshlet_start, n_triangles,
+                    vertices);
+
+            meshlet_start = i;
+            n_triangles = 0;
+            n_vertices = 0;
+            *stamp += 1;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            if (vertex_stamps[indices[i + k]] != *stamp)
+            {
+                vertex_stamps[indices[i + k]] = *stamp;
+                n_vertices += 1;
+            }
+        }
+
+        n_triangles += 1;
+    }
+
+    if (n_triangles != 0)
+        meshlets[n_meshlets++] = meshlet_compute_bounds(indices, meshlet_start, n_triangles, vertices);
+
+    return n_meshlets;
+}
+
+Meshlet meshlet_compute_bounds(const uint32_t* indices, uint32_t first_index, uint32_t n_triangles,
+        const Vertex* vertices)
+{
+    const uint32_t* triangles = indices + first_index;
+
+    vec3 min, max;
+    glm_vec3_copy((float*) vertices[triangles[0]].position, min);
+    glm_vec3_copy((float*) vertices[triangles[0]].position, max);
+    for (uint32_t i = 1; i < n_triangles * 3; ++i)
+    {
+        glm_vec3_minv(min, (float*) vertices[triangles[i]].position, min);
+        glm_vec3_maxv(max, (float*) vertices[triangles[i]].position, max);
+    }
+
+    vec3 centre;
+    glm_vec3_center(min, max, centre);
+
+    float radius = 0;
+    for (uint32_t i = 0; i < n_triangles * 3; ++i)
+        radius = fmaxf(radius, glm_vec3_distance(centre, (float*) vertices[triangles[i]].position));
+
+    // the cone axis is the average facing, its width is set by the triangle furthest from it
+    vec3 normals[MESHLET_MAX_TRIANGLES];
+    vec3 axis = {0};
+    uint32_t n_normals = 0;
+
+    for (uint32_t t = 0; t < n_triangles; ++t)
+    {
+        float* p0 = (float*) vertices[triangles[t * 3 + 0]].position;
+        float* p1 = (float*) vertices[triangles[t * 3 + 1]].position;
+        float* p2 = (float*) vertices[triangles[t * 3 + 2]].position;
+
+        vec3 e0, e1, normal;
+        glm_vec3_sub(p1, p0, e0);
+        glm_vec3_sub(p2, p0, e1);
+        glm_vec3_cross(e0, e1, normal);
+
+        float length = glm_vec3_norm(normal);
+        if (length == 0)
+            continue;
+
+        glm_vec3_scale(normal, 1 / length, normals[n_normals]);
+        glm_vec3_add(axis, normals[n_normals], axis);
+        n_normals += 1;
+    }
+
+    Meshlet meshlet = {
+        .sphere = { centre[0], centre[1], centre[2], radius },
+        .cone = { 0, 0, 0, 1 },
+        .first_index = first_index,
+        .n_triangles = n_triangles,
+    };
+
+    float axis_length = glm_vec3_norm(axis);
+    if (n_normals == 0 || axis_length == 0)
+        return meshlet;
+
+    glm_vec3_scale(axis, 1 / axis_length, axis);
+
+    float min_dot = 1;
+    for (uint32_t i = 0; i < n_normals; ++i)
+        min_dot = fminf(min_dot, glm_vec3_dot(axis, normals[i]));
+
+    // wider than about 84 degrees either way and the test would almost never pass
+    if (min_dot <= 0.1f)
+        return meshlet;
+
+    glm_vec3_copy(axis, meshlet.cone);
+    meshlet.cone[3] = sqrtf(1 - min_dot * min_dot);
+
+    return meshlet;
+}
+
+// a meshlet only closes early once it holds more than 61 vertices or is full, either way it has
+// at least 20 triangles
+uint32_t meshlets_max_count(uint32_t n_indices)
+{
+    return n_indices / 3 / ((MESHLET_MAX_VERTICES - 2) / 3) + 1;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "import.h"
+
+// lods longer than this are built in separate runs, one job each. a run always starts a meshlet of
+// its own, so each costs at most one part filled meshlet
+#define MESHLET_RANGE_TRIANGLES (1 << 15)
+
+// a run of one lod's triangles, and its meshlets until they're merged into the mesh's
+typedef struct MeshletRange {
+    MeshData* mesh;
+    GeoLod* lod;
+    uint32_t start_index;
+    uint32_t count;
+    Meshlet* meshlets;
+    uint32_t n_meshlets;
+} MeshletRange;
+
+// splits every lod of every surface into meshlets, needs the final index order
+void mesh_build_meshlets(MeshData* mesh);
+// the same for every mesh, long lods are split into runs so one mesh still uses the pool
+void meshes_build_meshlets(JobPool* jobs, MeshData* meshes, uint32_t n);
+
+// greedy scan in index order, so meshlets are plain sub ranges of the index buffer and the
+// vertex cache order is kept. returns how many were written
+uint32_t meshlets_build(Meshlet* meshlets, const uint32_t* indices, uint32_t first_index,
+        uint32_t n_indices, const Vertex* vertices, uint32_t* vertex_stamps, uint32_t* stamp);
+Meshlet meshlet_compute_bounds(const uint32_t* indices, uint32_t first_index, uint32_t n_triangles,
+        const Vertex* vertices);
+
+// internal
+uint32_t meshlets_max_count(uint32_t n_indices);
+uint32_t mesh_meshlet_ranges(MeshData* mesh, MeshletRange* out_ranges);
+void meshlet_range_build(MeshletRange* range);
+void meshlet_range_build_job(void* data, uint32_t index);
+void mesh_merge_meshlets(MeshData* mesh, MeshletRange* ranges, uint32_t n_ranges);
@@ -1,5 +1,8 @@
 #include "scene.h"
 #include "../utils.h"
+#include "../renderer/indirect.h"
+
+#include <math.h>
 
 static const mat4 MAT4_IDENTITY = GLM_MAT4_IDENTITY_INIT;
 
@@ -12,12 +15,17 @@ void ecs_intitialise(ECS* ecs)
     ecs->render_components = calloc(ecs->capacity, sizeof(RenderComponent));
 
     ecs->count = 0;
+    ecs->boxes = (FrustumBoxes) {0};
+    ecs->n_unregistered = 0;
+    ecs->n_surfaces = 0;
+    ecs->feedback_cursor = 0;
 }
 
 void ecs_cleanup(ECS* ecs)
 {
     free(ecs->entities);
     free(ecs->render_components);
+    frustum_boxes_cleanup(&ecs->boxes);
 }
 
 void ecs_add_renderable(ECS* ecs, Mesh* mesh, mat4 transformation)
@@ -26,7 +34,45 @@ void ecs_add_renderable(ECS* ecs, Mesh* mesh, mat4 transformation)
     Entity e = ecs_add_entity(ecs);
     // set the component
     ecs->render_components[e.id].mesh = mesh;
+    ecs->render_components[e.id].asset = ASSET_HANDLE_NONE;
+    ecs->render_components[e.id].gpu_objects = false;
     memcpy(ecs->render_components[e.id].transformation, transformation, sizeof(mat4));
+    ecs->n_unregistered += 1;
+}
+
+void ecs_add_renderable_asset(ECS* ecs, AssetHandle asset, uint32_t mesh_index, mat4 transformation)
+{
+    Entity e = ecs_add_entity(ecs);
+
+    RenderComponent* component = &ecs->render_components[e.id];
+    component->mesh = NULL;
+    component->asset = asset;
+    component->mesh_index = mesh_index;
+    component->gpu_objects = false;
+    memcpy(component->transformation, transformation, sizeof(mat4));
+}
+
+void ecs_resolve_asset(ECS* ecs, AssetHandle handle, Asset* asset)
+{
+    // its components keep a NULL mesh and are never drawn
+    if (asset->state == ASSET_FAILED)
+        return;
+
+    for (size_t i = 0; i < ecs->count; ++i)
+    {
+        RenderComponent* component = &ecs->render_components[i];
+        if (component->asset != handle || component->mesh != NULL)
+            continue;
+
+        if (component->mesh_index >= asset->n_meshes)
+        {
+            LOG_W("%s has no mesh %d, entity %zu stays hidden\n", asset->path, component->mesh_index, i);
+            continue;
+        }
+
+        component->mesh = &asset->meshes[component->mesh_index];
+        ecs->n_unregistered += 1;
+    }
 }
 
 Entity ecs_add_entity(ECS* ecs)
@@ -40,36 +86,223 @@ Entity ecs_add_entity(ECS* ecs)
 
 void ecs_renderable_collect(ECS* ecs, Renderer* renderer, DrawContext* context_out)
 {
+    // how many pixels one unit covers at a distance of one unit
+    float pixels_per_unit = renderer->swapchain.extent.height
+        / (2 * tanf(glm_rad(renderer->fov) / 2));
+
+    ecs_register_gpu_objects(ecs, renderer);
+
+    // the gpu culls and picks lods for itself, the objects built here are only for streaming to
+    // look at, so it gets a slice of the scene each frame rather than all of it
+    size_t first = 0;
+    size_t end = ecs->count;
+    if (indirect_active(renderer))
+        ecs_feedback_window(ecs, &first, &end);
+
+    // every surface's box goes in first so the frustum test can take them all at once
+    FrustumBoxes* boxes = &ecs->boxes;
+    frustum_boxes_clear(boxes);
+
+    for (size_t i = first; i < end; ++i)
+    {
+        RenderComponent* component = &ecs->render_components[i];
+        if (component->mesh == NULL)
+            continue;
+
+        Mesh* mesh = component->mesh;
+
+        mat4 transform;
+        ecs_render_transform(component, transform);
+
+        for (int j = 0; j < mesh->n_surfaces; ++j)
+            frustum_boxes_push(boxes, transform, mesh->surfaces[j].aabb_min,
+                    mesh->surfaces[j].aabb_max);
+    }
+
+    renderer->surfaces_tested = 0;
+    renderer->surfaces_culled = 0;
+
+    if (renderer->frustum_culling)
+    {
+        mat4 view_projection;
+        vec4 planes[6];
+        glm_mat4_mul(renderer->projection, renderer->view, view_projection);
+        glm_frustum_planes(view_projection, planes);
+
+        renderer->surfaces_tested = boxes->n;
+        renderer->surfaces_culled = frustum_test(boxes, planes);
+    }
+    else
+    {
+        memset(boxes->visible, 1, boxes->n);
+    }
+
+    // every surface could be visible, so the list never has to be checked while filling it
+    draw_context_reserve(context_out, boxes->n);
+
+    // then the same walk again, building objects for what is left
     int counter = 0;
-    for (int i = 0; i < ecs->count; ++i)
+    uint32_t box = 0;
+    for (size_t i = first; i < end; ++i)
     {
-        if (ecs->render_components[i].mesh == NULL)
+        RenderComponent* component = &ecs->render_components[i];
+        if (component->mesh == NULL)
         {
             continue;
         }
 
-        Mesh* mesh = ecs->render_components[counter].mesh;
+        Mesh* mesh = component->mesh;
+        uint32_t first_box = box;
+        box += mesh->n_surfaces;
+
+        mat4 transform;
+        ecs_render_transform(component, transform);
+
+        // one lod distance per entity so its surfaces switch together
+        float scale;
+        float distance = ecs_lod_distance(transform, mesh->bounds, renderer->camera_position, &scale);
+        float error_to_pixels = scale * pixels_per_unit / distance;
+        float screen_size = 2 * mesh->bounds[3] * error_to_pixels;
+
         for (int j = 0; j < mesh->n_surfaces; ++j)
         {
+            if (!boxes->visible[first_box + j])
+                continue;
+
+            GeoSurface* surface = &mesh->surfaces[j];
+            GeoLod lod = { surface->start_index, surface->count };
+            if (surface->n_lods != 0)
+                lod = surface->lods[geo_surface_select_lod(surface, error_to_pixels,
+                        renderer->lod_error_pixels)];
+
             RenderObject object = {
-                .transform = MAT4_UNPACK(ecs->render_components[counter].transformation),
-                // .material = mesh->surfaces[j].material == NULL ?
-                //     &renderer->default_material_instance : mesh->surfaces[j].material,
-                .material = &renderer->default_material_instance,
+                .transform = MAT4_UNPACK(transform),
+                .material = surface->material == NULL ?
+                    &renderer->default_material_instance : surface->material,
 
                 .vertex_buffer_address = mesh->mesh_buffers.vertex_buffer_address,
-                .index_buffer = mesh->mesh_buffers.index_buffer.buffer,
-                .index_count = mesh->surfaces[j].count,
-                .first_index = mesh->surfaces[j].start_index,
-            };
+                .vertex_format = mesh->mesh_buffers.vertex_format,
+                .position_offset = VEC4_UNPACK(mesh->mesh_buffers.position_offset),
+                .position_scale = VEC4_UNPACK(mesh->mesh_buffers.position_scale),
+                .index_count = lod.count,
+                .first_index = mesh->mesh_buffers.first_index + lod.start_index,
 
+                .index_buffer_address = mesh->mesh_buffers.index_buffer_address,
+                .meshlet_buffer_address = mesh->mesh_buffers.meshlet_buffer_address,
+                .first_meshlet = lod.first_meshlet,
+                .n_meshlets = lod.n_meshlets,
+
+                .screen_size = screen_size,
+            };
 
-            glm_translate(object.transform, (vec4){0, 1, 1, 0});
             context_out->opaque_surfaces[counter] = object;
+            counter++;
         }
-
-        counter++;
     }
     context_out->n = counter;
 }
 
+// transforms never change once added, so the gpu copies only need making once. the walk only
+// happens on frames where some component got its mesh
+void ecs_register_gpu_objects(ECS* ecs, Renderer* renderer)
+{
+    if (ecs->n_unregistered == 0)
+        return;
+
+    for (size_t i = 0; i < ecs->count; ++i)
+    {
+        RenderComponent* component = &ecs->render_components[i];
+        if (component->mesh == NULL || component->gpu_objects)
+            continue;
+
+        Mesh* mesh = component->mesh;
+
+        mat4 transform;
+        ecs_render_transform(component, transform);
+
+        for (int j = 0; j < mesh->n_surfaces; ++j)
+            indirect_add_surface(renderer, mesh, &mesh->surfaces[j], transform);
+        component->gpu_objects = true;
+        ecs->n_surfaces += mesh->n_surfaces;
+    }
+
+    ecs->n_unregistered = 0;
+}
+
+// whole components from the cursor until the slice has its surfaces, stopping at the last one so
+// the next slice starts over from the first
+void ecs_feedback_window(ECS* ecs, size_t* out_first, size_t* out_end)
+{
+    size_t n_wanted = ecs->n_surfaces / ECS_FEEDBACK_SWEEP_FRAMES;
+    if (n_wanted < ECS_FEEDBACK_SURFACES)
+        n_wanted = ECS_FEEDBACK_SURFACES;
+
+    if (ecs->feedback_cursor >= ecs->count)
+        ecs->feedback_cursor = 0;
+
+    size_t end = ecs->feedback_cursor;
+    size_t n_surfaces = 0;
+    while (end < ecs->count && n_surfaces < n_wanted)
+    {
+        Mesh* mesh = ecs->render_components[end].mesh;
+        if (mesh != NULL)
+            n_surfaces += mesh->n_surfaces;
+        end++;
+    }
+
+    *out_first = ecs->feedback_cursor;
+    *out_end = end;
+    ecs->feedback_cursor = end;
+}
+
+void draw_context_reserve(DrawContext* context, int n)
+{
+    if (n <= context->capacity)
+        return;
+
+    int capacity = context->capacity == 0 ? 64 : context->capacity;
+    while (capacity < n)
+        capacity *= 2;
+
+    context->opaque_surfaces = realloc(context->opaque_surfaces, sizeof(RenderObject) * capacity);
+    context->capacity = capacity;
+}
+
+void draw_context_cleanup(DrawContext* context)
+{
+    free(context->opaque_surfaces);
+    *context = (DrawContext) {0};
+}
+
+// where the entity is drawn, collect and the gpu side objects both go through here
+void ecs_render_transform(RenderComponent* component, mat4 out_transform)
+{
+    glm_mat4_copy(component->transformation, out_transform);
+    glm_translate(out_transform, (vec4){0, 1, 1, 0});
+}
+
+// distance from the camera to the nearest point of the entity's bounding sphere
+float ecs_lod_distance(mat4 transform, vec4 bounds, vec3 camera_position, float* out_scale)
+{
+    vec3 centre;
+    glm_mat4_mulv3(transform, bounds, 1, centre);
+
+    // non uniform scales use the largest axis so the error never gets underestimated
+    *out_scale = fmaxf(glm_vec3_norm(transform[0]), fmaxf(glm_vec3_norm(transform[1]),
+                glm_vec3_norm(transform[2])));
+
+    float distance = glm_vec3_distance(centre, camera_position) - bounds[3] * *out_scale;
+
+    // inside the sphere, or close enough that anything but full detail would show
+    return fmaxf(distance, LOD_MIN_DISTANCE);
+}
+
+// the coarsest level whose error stays under the threshold once projected
+uint32_t geo_surface_select_lod(GeoSurface* surface, float error_to_pixels, float threshold)
+{
+    uint32_t lod = 0;
+    while (lod + 1 < surface->n_lods && surface->lods[lod + 1].error * error_to_pixels <= threshold)
+        lod += 1;
+
+    return lod;
+}
@@ -3,14 +3,29 @@
 #include <cglm/cglm.h>
 #include <vulkan/vulkan.h>
 #include <renderer/renderer.h>
+#include "asset_loader.h"
+#include "frustum.h"
+
+// nearer than this always counts as this far when picking lods
+#define LOD_MIN_DISTANCE 0.1f
+// while the gpu culls, this many surfaces a frame at least go through collect so streaming still
+// hears what's in view, enough more that a sweep of the scene never takes longer than this many
+// frames, well inside STREAMING_KEEP_FRAMES
+#define ECS_FEEDBACK_SURFACES 1024
+#define ECS_FEEDBACK_SWEEP_FRAMES 30
 
 typedef struct Entity {
     size_t id;
 } Entity;
 
 typedef struct RenderComponent {
+    // NULL, and so not drawn, until the asset it comes from is ready
     Mesh* mesh;
+    AssetHandle asset;
+    uint32_t mesh_index;
     mat4 transformation;
+    // its surfaces have gone to the renderer's gpu side object table
+    bool gpu_objects;
 } RenderComponent;
 
 typedef struct ECS {
@@ -19,6 +34,16 @@ typedef struct ECS {
 
     size_t count;
     size_t capacity;
+
+    // every surface's box from the last collect, in the order the entities come
+    FrustumBoxes boxes;
+
+    // components with a mesh whose surfaces haven't gone to the gpu side object table yet
+    size_t n_unregistered;
+    // surfaces that have, across every component
+    size_t n_surfaces;
+    // where the next slice of feedback starts while the gpu culls
+    size_t feedback_cursor;
 } ECS;
 
 
@@ -26,6 +51,18 @@ void ecs_intitialise(ECS* ecs);
 void ecs_cleanup(ECS* ecs);
 Entity ecs_add_entity(ECS* ecs);
 void ecs_add_renderable(ECS* ecs, Mesh* mesh, mat4 transformation);
+// the asset has to still be loading, its mesh gets filled in by ecs_resolve_asset
+void ecs_add_renderable_asset(ECS* ecs, AssetHandle asset, uint32_t mesh_index, mat4 transformation);
+void ecs_resolve_asset(ECS* ecs, AssetHandle handle, Asset* asset);
 void ecs_render_component_draw(ECS* ecs);
 void ecs_renderable_collect(ECS* ecs, Renderer* renderer, DrawContext* context_out);
+// room for at least n objects, what was already there is kept
+void draw_context_reserve(DrawContext* context, int n);
+void draw_context_cleanup(DrawContext* context);
 
+// internal
+void ecs_register_gpu_objects(ECS* ecs, Renderer* renderer);
+void ecs_feedback_window(ECS* ecs, size_t* out_first, size_t* out_end);
+void ecs_render_transform(RenderComponent* component, mat4 out_transform);
+float ecs_lod_distance(mat4 transform, vec4 bounds, vec3 camera_position, float* out_scale);
+uint32_t geo_surface_select_lod(GeoSurface* surface, float error_to_pixels, float threshold);
@@ -0,0 +1,5 @@
+#define STB_IMAGE_IMPLEMENTATION
+// gltf only allows png and jpeg
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#include <stb_image.h>
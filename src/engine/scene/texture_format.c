@@ -0,0 +1,102 @@
+#include "texture_format.h"
+
+#include <string.h>
+
+static const TextureFormatInfo TEXTURE_FORMATS[] = {
+    { VK_FORMAT_R8G8B8A8_UNORM, "rgba8", 4, false },
+    { VK_FORMAT_R8G8B8A8_SRGB, "rgba8_srgb", 4, false },
+    { VK_FORMAT_BC1_RGB_UNORM_BLOCK, "bc1", 8, true },
+    { VK_FORMAT_BC1_RGB_SRGB_BLOCK, "bc1_srgb", 8, true },
+    { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, "bc1a", 8, true },
+    { VK_FORMAT_BC1_RGBA_SRGB_BLOCK, "bc1a_srgb", 8, true },
+    { VK_FORMAT_BC3_UNORM_BLOCK, "bc3", 16, true },
+    { VK_FORMAT_BC3_SRGB_BLOCK, "bc3_srgb", 16, true },
+    { VK_FORMAT_BC4_UNORM_BLOCK, "bc4", 8, true },
+    { VK_FORMAT_BC5_UNORM_BLOCK, "bc5", 16, true },
+    { VK_FORMAT_BC7_UNORM_BLOCK, "bc7", 16, true },
+    { VK_FORMAT_BC7_SRGB_BLOCK, "bc7_srgb", 16, true },
+};
+
+#define N_TEXTURE_FORMATS (sizeof(TEXTURE_FORMATS) / sizeof(TEXTURE_FORMATS[0]))
+
+const TextureFormatInfo* texture_format_info(VkFormat format)
+{
+    for (size_t i = 0; i < N_TEXTURE_FORMATS; ++i)
+    {
+        if (TEXTURE_FORMATS[i].format == format)
+            return &TEXTURE_FORMATS[i];
+    }
+
+    return NULL;
+}
+
+size_t texture_format_block_size(VkFormat format)
+{
+    const TextureFormatInfo* info = texture_format_info(format);
+    return info == NULL ? 0 : info->block_size;
+}
+
+bool texture_format_compressed(VkFormat format)
+{
+    const TextureFormatInfo* info = texture_format_info(format);
+    return info != NULL && info->compressed;
+}
+
+const char* texture_format_name(VkFormat format)
+{
+    const TextureFormatInfo* info = texture_format_info(format);
+    return info == NULL ? "unknown" : info->name;
+}
+
+VkFormat texture_format_from_name(const char* name)
+{
+    for (size_t i = 0; i < N_TEXTURE_FORMATS; ++i)
+    {
+        if (strcmp(TEXTURE_FORMATS[i].name, name) == 0)
+            return TEXTURE_FORMATS[i].format;
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+size_t texture_level_size(VkFormat format, uint32_t width, uint32_t height)
+{
+    if (!texture_format_compressed(format))
+        return (size_t) width * height * texture_format_block_size(format);
+
+    size_t blocks_wide = (width + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT;
+    size_t blocks_high = (height + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT;
+    return blocks_wide * blocks_high * texture_format_block_size(format);
+}
+
+size_t texture_chain_size(VkFormat format, uint32_t width, uint32_t height, uint32_t n_levels)
+{
+    size_t size = 0;
+    for (uint32_t level = 0; level < n_levels; ++level)
+    {
+        size += texture_level_size(format, texture_mip_dimension(width, level),
+                texture_mip_dimension(height, level));
+    }
+
+    return size;
+}
+
+uint32_t texture_mip_count(uint32_t width, uint32_t height)
+{
+    uint32_t largest = width > height ? width : height;
+
+    uint32_t count = 1;
+    while (largest > 1)
+    {
+        largest >>= 1;
+        count++;
+    }
+
+    return count;
+}
+
+uint32_t texture_mip_dimension(uint32_t size, uint32_t level)
+{
+    size >>= level;
+    return size == 0 ? 1 : size;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// every block compressed format here works on 4x4 texel blocks
+#define TEXTURE_BLOCK_EXTENT 4
+
+typedef struct TextureFormatInfo {
+    VkFormat format;
+    const char* name;
+    // bytes per texel for plain formats, per 4x4 block for compressed ones
+    size_t block_size;
+    bool compressed;
+} TextureFormatInfo;
+
+// the formats textures can come in, 0 for anything else
+size_t texture_format_block_size(VkFormat format);
+bool texture_format_compressed(VkFormat format);
+// short lowercase names, the cooker takes these on its command line
+const char* texture_format_name(VkFormat format);
+VkFormat texture_format_from_name(const char* name);
+
+// bytes of one level, compressed levels are whole blocks however small they get
+size_t texture_level_size(VkFormat format, uint32_t width, uint32_t height);
+// levels back to back from the largest down, the way they're staged and stored
+size_t texture_chain_size(VkFormat format, uint32_t width, uint32_t height, uint32_t n_levels);
+uint32_t texture_mip_count(uint32_t width, uint32_t height);
+uint32_t texture_mip_dimension(uint32_t size, uint32_t level);
+
+// internal
+const TextureFormatInfo* texture_format_info(VkFormat format);
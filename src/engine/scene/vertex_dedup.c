@@ -0,0 +1,182 @@
+#include "vertex_dedup.h"
+#include "../utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t dedup_triples(JobPool* jobs, const uint32_t* keys, uint32_t n_keys, uint32_t* remap,
+        uint32_t* uniques)
+{
+    if (n_keys == 0)
+        return 0;
+
+    DedupContext* context = calloc(1, sizeof(DedupContext));
+    context->keys = keys;
+    context->n_keys = n_keys;
+    context->remap = remap;
+    context->uniques = uniques;
+
+    // a few chunks per thread, same as the pool's own batching
+    context->n_chunks = (jobs->n_threads + 1) * 4;
+    context->chunk_size = (n_keys + context->n_chunks - 1) / context->n_chunks;
+    context->n_chunks = (n_keys + context->chunk_size - 1) / context->chunk_size;
+
+    context->hashes = malloc(sizeof(uint32_t) * n_keys);
+    context->chunk_offsets = calloc(context->n_chunks * DEDUP_PARTITIONS, sizeof(uint32_t));
+    context->partitioned = malloc(sizeof(uint32_t) * n_keys);
+
+    job_pool_parallel_for(jobs, dedup_count_job, context, context->n_chunks);
+
+    // partition by partition, then chunk by chunk within each, so scattering keeps key order
+    uint32_t offset = 0;
+    for (uint32_t p = 0; p < DEDUP_PARTITIONS; ++p)
+    {
+        context->partition_offsets[p] = offset;
+        for (uint32_t c = 0; c < context->n_chunks; ++c)
+        {
+            uint32_t count = context->chunk_offsets[c * DEDUP_PARTITIONS + p];
+            context->chunk_offsets[c * DEDUP_PARTITIONS + p] = offset;
+            offset += count;
+        }
+    }
+    context->partition_offsets[DEDUP_PARTITIONS] = offset;
+
+    job_pool_parallel_for(jobs, dedup_scatter_job, context, context->n_chunks);
+    job_pool_parallel_for(jobs, dedup_partition_job, context, DEDUP_PARTITIONS);
+
+    uint32_t n_unique = 0;
+    for (uint32_t p = 0; p < DEDUP_PARTITIONS; ++p)
+    {
+        context->unique_offsets[p] = n_unique;
+        n_unique += context->partition_n_unique[p];
+    }
+    context->unique_offsets[DEDUP_PARTITIONS] = n_unique;
+
+    job_pool_parallel_for(jobs, dedup_gather_job, context, DEDUP_PARTITIONS);
+    job_pool_parallel_for(jobs, dedup_remap_job, context, context->n_chunks);
+
+    free(context->hashes);
+    free(context->chunk_offsets);
+    free(context->partitioned);
+    free(context);
+
+    return n_unique;
+}
+
+uint32_t dedup_hash(const uint32_t* key)
+{
+    uint32_t h = key[0] * 0x9e3779b1u ^ key[1] * 0x85ebca77u ^ key[2] * 0xc2b2ae3du;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return h;
+}
+
+void dedup_count_job(void* data, uint32_t chunk)
+{
+    DedupContext* context = data;
+    uint32_t* counts = &context->chunk_offsets[chunk * DEDUP_PARTITIONS];
+
+    uint32_t first = chunk * context->chunk_size;
+    uint32_t last = first + context->chunk_size < context->n_keys ? first + context->chunk_size
+        : context->n_keys;
+
+    for (uint32_t i = first; i < last; ++i)
+    {
+        context->hashes[i] = dedup_hash(&context->keys[i * 3]);
+        counts[context->hashes[i] >> (32 - DEDUP_PARTITION_BITS)] += 1;
+    }
+}
+
+void dedup_scatter_job(void* data, uint32_t chunk)
+{
+    DedupContext* context = data;
+    uint32_t* offsets = &context->chunk_offsets[chunk * DEDUP_PARTITIONS];
+
+    uint32_t first = chunk * context->chunk_size;
+    uint32_t last = first + context->chunk_size < context->n_keys ? first + context->chunk_size
+        : context->n_keys;
+
+    for (uint32_t i = first; i < last; ++i)
+        context->partitioned[offsets[context->hashes[i] >> (32 - DEDUP_PARTITION_BITS)]++] = i;
+}
+
+// open addressing over the partition's keys. ids are handed out in key order, and each one's
+// first key is written back over the start of the partition's list, which has been read by then
+void dedup_partition_job(void* data, uint32_t partition)
+{
+    DedupContext* context = data;
+    uint32_t* keys = &context->partitioned[context->partition_offsets[partition]];
+    uint32_t n_keys = context->partition_offsets[partition + 1] - context->partition_offsets[partition];
+
+    uint32_t table_size = 16;
+    while (table_size < n_keys * 2)
+        table_size *= 2;
+
+    // hash in the high half and local id in the low half, all ones when empty. comparing the
+    // hashes first keeps most probes from touching the keys at all
+    uint64_t* table = malloc(sizeof(uint64_t) * table_size);
+    memset(table, 0xff, sizeof(uint64_t) * table_size);
+
+    uint32_t n_unique = 0;
+    for (uint32_t i = 0; i < n_keys; ++i)
+    {
+        uint32_t key = keys[i];
+        uint32_t hash = context->hashes[key];
+        const uint32_t* triple = &context->keys[key * 3];
+        uint32_t slot = hash & (table_size - 1);
+
+        while (true)
+        {
+            if (table[slot] == UINT64_MAX)
+            {
+                table[slot] = (uint64_t) hash << 32 | n_unique;
+                keys[n_unique] = key;
+                context->remap[key] = n_unique;
+                n_unique += 1;
+                break;
+            }
+
+            uint32_t id = (uint32_t) table[slot];
+            if ((uint32_t) (table[slot] >> 32) == hash)
+            {
+                const uint32_t* other = &context->keys[keys[id] * 3];
+                if (other[0] == triple[0] && other[1] == triple[1] && other[2] == triple[2])
+                {
+                    context->remap[key] = id;
+                    break;
+                }
+            }
+
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    free(table);
+
+    context->partition_n_unique[partition] = n_unique;
+}
+
+void dedup_gather_job(void* data, uint32_t partition)
+{
+    DedupContext* context = data;
+
+    memcpy(&context->uniques[context->unique_offsets[partition]],
+            &context->partitioned[context->partition_offsets[partition]],
+            sizeof(uint32_t) * context->partition_n_unique[partition]);
+}
+
+// turns the per partition ids into global ones
+void dedup_remap_job(void* data, uint32_t chunk)
+{
+    DedupContext* context = data;
+
+    uint32_t first = chunk * context->chunk_size;
+    uint32_t last = first + context->chunk_size < context->n_keys ? first + context->chunk_size
+        : context->n_keys;
+
+    for (uint32_t i = first; i < last; ++i)
+        context->remap[i] += context->unique_offsets[context->hashes[i] >> (32 - DEDUP_PARTITION_BITS)];
+}
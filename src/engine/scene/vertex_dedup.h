@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../jobs.h"
+
+#include <stdint.h>
+
+// keys are spread over this many partitions by the top bits of their hash, each one is
+// deduplicated on its own so the partitions can go in parallel
+#define DEDUP_PARTITION_BITS 8
+#define DEDUP_PARTITIONS (1 << DEDUP_PARTITION_BITS)
+
+typedef struct DedupContext {
+    const uint32_t* keys;
+    uint32_t n_keys;
+
+    uint32_t n_chunks;
+    uint32_t chunk_size;
+
+    uint32_t* hashes;
+    // how many keys of every chunk land in every partition, then where they start
+    uint32_t* chunk_offsets;
+    // key indices grouped by partition, in key order within each
+    uint32_t* partitioned;
+    uint32_t partition_offsets[DEDUP_PARTITIONS + 1];
+    uint32_t partition_n_unique[DEDUP_PARTITIONS];
+    uint32_t unique_offsets[DEDUP_PARTITIONS + 1];
+
+    uint32_t* remap;
+    uint32_t* uniques;
+} DedupContext;
+
+// gives every distinct triple of keys[i * 3 .. i * 3 + 2] an id, written to remap. uniques gets
+// the index of one key with each id and both arrays need room for n_keys. returns how many
+// distinct triples there are, the result doesn't depend on the number of threads
+uint32_t dedup_triples(JobPool* jobs, const uint32_t* keys, uint32_t n_keys, uint32_t* remap,
+        uint32_t* uniques);
+
+// internal
+uint32_t dedup_hash(const uint32_t* key);
+void dedup_count_job(void* data, uint32_t chunk);
+void dedup_scatter_job(void* data, uint32_t chunk);
+void dedup_partition_job(void* data, uint32_t partition);
+void dedup_gather_job(void* data, uint32_t partition);
+void dedup_remap_job(void* data, uint32_t chunk);
@@ -0,0 +1,163 @@
+#include "vertex_packing.h"
+#include "../utils.h"
+
+#include <math.h>
+
+size_t vertex_format_size(enum VertexFormat format)
+{
+    switch (format)
+    {
+        case VERTEX_FORMAT_FULL:
+            return sizeof(Vertex);
+        case VERTEX_FORMAT_PACKED:
+            return sizeof(PackedVertex);
+    }
+
+    FATAL("Unknown vertex format %d\n", format);
+}
+
+enum VertexFormat vertex_format_choose(const Vertex* vertices, uint32_t n_vertices)
+{
+    if (n_vertices == 0)
+        return VERTEX_FORMAT_FULL;
+
+    vec3 min, max;
+    vertices_bounds(vertices, n_vertices, min, max);
+
+    float extent = glm_vec3_max((vec3) { max[0] - min[0], max[1] - min[1], max[2] - min[2] });
+    if (extent / 65535.0f > PACKED_POSITION_MAX_STEP)
+        return VERTEX_FORMAT_FULL;
+
+    for (uint32_t i = 0; i < n_vertices; ++i)
+    {
+        if (fabsf(vertices[i].uv_x) > PACKED_UV_MAX || fabsf(vertices[i].uv_y) > PACKED_UV_MAX)
+            return VERTEX_FORMAT_FULL;
+    }
+
+    return VERTEX_FORMAT_PACKED;
+}
+
+void vertices_pack(const Vertex* vertices, uint32_t n_vertices, PackedVertex* packed,
+        vec4 position_offset, vec4 position_scale)
+{
+    vec3 min = {0}, max = {0};
+    if (n_vertices != 0)
+        vertices_bounds(vertices, n_vertices, min, max);
+
+    vec3 inverse_scale;
+    for (int i = 0; i < 3; ++i)
+    {
+        float extent = max[i] - min[i];
+
+        position_offset[i] = min[i];
+        position_scale[i] = extent / 65535.0f;
+        // flat axes all quantise to 0
+        inverse_scale[i] = extent > 0 ? 65535.0f / extent : 0;
+    }
+    position_offset[3] = 0;
+    position_scale[3] = 0;
+
+    for (uint32_t i = 0; i < n_vertices; ++i)
+    {
+        const Vertex* vertex = &vertices[i];
+        PackedVertex* out = &packed[i];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            float q = (vertex->position[j] - min[j]) * inverse_scale[j] + 0.5f;
+            out->position[j] = q > 65535.0f ? 65535 : (uint16_t) q;
+        }
+        out->pad = 0;
+
+        octahedral_encode(vertex->normal, out->normal);
+
+        out->uv[0] = float_to_half(vertex->uv_x);
+        out->uv[1] = float_to_half(vertex->uv_y);
+
+        for (int j = 0; j < 4; ++j)
+            out->colour[j] = (uint8_t) (glm_clamp(vertex->colour[j], 0, 1) * 255.0f + 0.5f);
+    }
+}
+
+void vertices_bounds(const Vertex* vertices, uint32_t n_vertices, vec3 min, vec3 max)
+{
+    glm_vec3_copy((float*) vertices[0].position, min);
+    glm_vec3_copy((float*) vertices[0].position, max);
+
+    for (uint32_t i = 1; i < n_vertices; ++i)
+    {
+        glm_vec3_minv(min, (float*) vertices[i].position, min);
+        glm_vec3_maxv(max, (float*) vertices[i].position, max);
+    }
+}
+
+// projects onto the octahedron and folds the lower half over, decoded by oct_decode in the shader
+void octahedral_encode(const float* normal, int16_t* out)
+{
+    float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (l1 == 0)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    float x = normal[0] / l1;
+    float y = normal[1] / l1;
+
+    if (normal[2] < 0)
+    {
+        float folded_x = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+        float folded_y = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    out[0] = (int16_t) roundf(glm_clamp(x, -1, 1) * 32767.0f);
+    out[1] = (int16_t) roundf(glm_clamp(y, -1, 1) * 32767.0f);
+}
+
+// round to nearest even, matches what unpackHalf2x16 expects
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t float_exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    int32_t exponent = (int32_t) float_exponent - 127 + 15;
+
+    // inf and nan
+    if (float_exponent == 0xff)
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    if (exponent <= 0)
+    {
+        // too small even for a subnormal
+        if (exponent < -10)
+            return sign;
+
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half += 1;
+
+        return sign | half;
+    }
+
+    uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+
+    // a carry out of the mantissa bumps the exponent, and rounds up to inf at the top
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half += 1;
+
+    return sign | half;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../renderer/renderer.h"
+
+// largest step between two quantised positions before a mesh keeps full precision, a millimetre
+// at our scale, so packing stops being lossless enough at roughly 65m across
+#define PACKED_POSITION_MAX_STEP 0.001f
+// anything bigger loses too much in a half float
+#define PACKED_UV_MAX 2048.0f
+
+size_t vertex_format_size(enum VertexFormat format);
+enum VertexFormat vertex_format_choose(const Vertex* vertices, uint32_t n_vertices);
+
+// quantises positions over the bounding box of the vertices and fills in how to undo it
+void vertices_pack(const Vertex* vertices, uint32_t n_vertices, PackedVertex* packed,
+        vec4 position_offset, vec4 position_scale);
+
+// internal
+void vertices_bounds(const Vertex* vertices, uint32_t n_vertices, vec3 min, vec3 max);
+void octahedral_encode(const float* normal, int16_t* out);
+uint16_t float_to_half(float value);
@@ -1,5 +1,11 @@
 #include "utils.h"
 #include <execinfo.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
 // please free after :)
 File read_file(const char path[])
@@ -20,13 +26,78 @@ File read_file(const char path[])
     fread(buf, size, 1, fp);
 
     File f = {
-        size = size,
-        buf = buf,
+        .size = size,
+        .buf = buf,
     };
 
     return f;
 }
 
+// pages come straight from the page cache as they are touched, nothing is copied or allocated
+// up front. the mapping is private and read only, so writing through buf faults
+File file_map(const char path[], enum FileAccess access)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return (File) {0};
+
+    struct stat st;
+    void* data = MAP_FAILED;
+
+    // mmap refuses empty files, and pipes and the like have no size to map
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return read_file(path);
+
+    madvise(data, st.st_size, access == FILE_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+    madvise(data, st.st_size, MADV_WILLNEED);
+
+    File f = {
+        .size = st.st_size,
+        .buf = data,
+        .mapped = true,
+    };
+
+    return f;
+}
+
+void file_close(File* file)
+{
+    if (file->mapped)
+        munmap(file->buf, file->size);
+    else
+        free(file->buf);
+
+    file->buf = NULL;
+    file->size = 0;
+}
+
+uint64_t time_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * ONE_SEC + ts.tv_nsec;
+}
+
+// high water mark of the resident set, in kilobytes
+long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // macos reports bytes, linux reports kilobytes
+    #ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+    #else
+    return usage.ru_maxrss;
+    #endif
+}
+
 void print_string_list(const char* b[], int n)
 {
     for (int i = 0; i < n; ++i)
@@ -42,7 +113,7 @@ uint32_t clamp(uint32_t a, uint32_t min, uint32_t max)
 
 QueueFamilyIndices find_queue_families(VkPhysicalDevice* gpu, VkSurfaceKHR* surface)
 {
-    QueueFamilyIndices indices = {INVALID_IDX, INVALID_IDX};
+    QueueFamilyIndices indices = {INVALID_IDX, INVALID_IDX, INVALID_IDX};
 
     uint32_t queue_family_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(*gpu, &queue_family_count, NULL);
@@ -67,9 +138,31 @@ QueueFamilyIndices find_queue_families(VkPhysicalDevice* gpu, VkSurfaceKHR* surf
             break;
     }
 
+    indices.transfer_family = find_transfer_family(gpu);
+
     return indices;
 }
 
+// a family with transfers but no graphics or compute is the copy engine, which runs alongside
+// rendering instead of taking turns with it
+uint32_t find_transfer_family(VkPhysicalDevice* gpu)
+{
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(*gpu, &queue_family_count, NULL);
+
+    VkQueueFamilyProperties queue_families[queue_family_count];
+    vkGetPhysicalDeviceQueueFamilyProperties(*gpu, &queue_family_count, queue_families);
+
+    for (int i = 0; i < queue_family_count; ++i)
+    {
+        VkQueueFlags flags = queue_families[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            return i;
+    }
+
+    return INVALID_IDX;
+}
+
 bool indices_complete(QueueFamilyIndices* indices)
 {
     return indices->graphics_family != INVALID_IDX && indices->present_family != INVALID_IDX;
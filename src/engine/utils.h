@@ -73,6 +73,7 @@
     } while (0)
 
 #define MAT4_UNPACK(m) {{m[0][0], m[0][1], m[0][2], m[0][3]}, {m[1][0], m[1][1], m[1][2], m[1][3]}, {m[2][0], m[2][1], m[2][2], m[2][3]}, {m[3][0], m[3][1], m[3][2], m[3][3]}}
+#define VEC4_UNPACK(v) {v[0], v[1], v[2], v[3]}
 
 #define MAT4_FSTR(m) "%f\t%f\t%f\t%f\n%f\t%f\t%f\t%f\n%f\t%f\t%f\t%f\n%f\t%f\t%f\t%f\n", m[0][0], m[0][1], m[0][2], m[0][3], m[1][0], m[1][1], m[1][2], m[1][3], m[2][0], m[2][1], m[2][2], m[2][3], m[3][0], m[3][1], m[3][2], m[3][3]
 
@@ -81,20 +82,40 @@
 typedef struct {
     uint32_t graphics_family;
     uint32_t present_family;
+    // INVALID_IDX when no family is just for transfers, it isn't needed to be complete
+    uint32_t transfer_family;
 } QueueFamilyIndices;
 
 typedef struct {
     long size;
     char* buf;
+    // buf is a read only mapping of the file rather than a heap copy
+    bool mapped;
 } File;
 
+// how a mapped file is going to be read, passed on to the kernel as a readahead hint
+enum FileAccess {
+    // front to back, once
+    FILE_ACCESS_SEQUENTIAL,
+    // all of it, in no particular order
+    FILE_ACCESS_RANDOM,
+};
+
 File read_file(const char path[]);
+// zero copy where the file can be mapped, buf is NULL when it can't be opened
+File file_map(const char path[], enum FileAccess access);
+// for both read_file and file_map
+void file_close(File* file);
+
+uint64_t time_now_ns();
+long peak_rss_kb();
 
 void print_string_list(const char* b[], int n);
 uint32_t clamp(uint32_t a, uint32_t min, uint32_t max);
 
 QueueFamilyIndices find_queue_families(VkPhysicalDevice* gpu, VkSurfaceKHR* surface);
 bool indices_complete(QueueFamilyIndices* indeces);
+uint32_t find_transfer_family(VkPhysicalDevice* gpu);
 
 void* get_device_proc_adr(VkDevice device, char name[]);
 
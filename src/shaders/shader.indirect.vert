@@ -0,0 +1,112 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "input_structures.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+
+struct Vertex {
+    vec3 position;
+    float uv_x;
+    vec3 normal;
+    float uv_y;
+    vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+    Vertex vertices[];
+};
+
+// matches PackedVertex, 20 bytes
+struct PackedVertex {
+    uint position_xy;
+    uint position_z;
+    uint normal;
+    uint uv;
+    uint color;
+};
+
+layout(buffer_reference, std430) readonly buffer PackedVertexBuffer{
+    PackedVertex vertices[];
+};
+
+#define VERTEX_FORMAT_FULL 0
+#define VERTEX_FORMAT_PACKED 1
+
+// matches IndirectObject, 240 bytes
+struct Object {
+    mat4 transform;
+    vec4 sphere;
+    vec4 position_offset;
+    vec4 position_scale;
+    VertexBuffer vertex_buffer;
+    uint vertex_format;
+    uint bucket;
+    uint first_index[4];
+    uint index_count[4];
+    float lod_error[4];
+    uint n_lods;
+    float scale;
+    uvec2 meshlets;
+    uint first_meshlet[4];
+    uint n_meshlets[4];
+    uint mesh_first_index;
+    uint pad[3];
+};
+
+layout(buffer_reference, std430) readonly buffer ObjectBuffer{
+    Object objects[];
+};
+
+// every draw's firstInstance is its object, set by shader.indirect.comp
+layout( push_constant ) uniform constants
+{
+    mat4 view_projection;
+    ObjectBuffer objects;
+} PushConstants;
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+Vertex load_vertex(Object object, uint index)
+{
+    if (object.vertex_format == VERTEX_FORMAT_FULL)
+        return object.vertex_buffer.vertices[index];
+
+    PackedVertex p = PackedVertexBuffer(object.vertex_buffer).vertices[index];
+
+    vec3 quantised = vec3(p.position_xy & 0xffff, p.position_xy >> 16, p.position_z & 0xffff);
+    vec2 uv = unpackHalf2x16(p.uv);
+
+    Vertex v;
+    v.position = object.position_offset.xyz + quantised * object.position_scale.xyz;
+    v.normal = oct_decode(unpackSnorm2x16(p.normal));
+    v.uv_x = uv.x;
+    v.uv_y = uv.y;
+    v.color = unpackUnorm4x8(p.color);
+    return v;
+}
+
+void main()
+{
+    Object object = PushConstants.objects.objects[gl_InstanceIndex];
+    Vertex v = load_vertex(object, gl_VertexIndex);
+
+    mat4 mvp = PushConstants.view_projection * object.transform;
+
+    gl_Position = mvp * vec4(v.position, 1);
+
+    outNormal = (mvp * vec4(v.normal, 0.f)).xyz;
+    outColor = v.color.xyz * material_data.color_factors.xyz;
+    outUV.x = v.uv_x;
+    outUV.y = v.uv_y;
+}
@@ -15,7 +15,7 @@ layout(set = 0, binding = 0) uniform sampler2D displayTexture;
 void main()
 {
 	float light_value = max(dot(inNormal, scene_data.sunlight_direction.xyz), 0.1f);
-	vec3 color = texture(color_tex, inUV).xyz;
+	vec3 color = inColor * texture(color_tex, inUV).xyz;
 	vec3 ambient = color * scene_data.ambient_color.xyz;
 
 	outFragColor = vec4(color * light_value * scene_data.sunlight_direction.w + ambient, 1);
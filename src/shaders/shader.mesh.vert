@@ -20,16 +20,63 @@ layout(buffer_reference, std430) readonly buffer VertexBuffer{
     Vertex vertices[];
 };
 
+// matches PackedVertex, 20 bytes
+struct PackedVertex {
+    uint position_xy;
+    uint position_z;
+    uint normal;
+    uint uv;
+    uint color;
+};
+
+layout(buffer_reference, std430) readonly buffer PackedVertexBuffer{
+    PackedVertex vertices[];
+};
+
+#define VERTEX_FORMAT_FULL 0
+#define VERTEX_FORMAT_PACKED 1
+
 layout( push_constant ) uniform constants
 {
     mat4 mvp;
     VertexBuffer vertexBuffer;
+    uint vertexFormat;
+    vec4 positionOffset;
+    vec4 positionScale;
 } PushConstants;
 
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+Vertex load_vertex(uint index)
+{
+    if (PushConstants.vertexFormat == VERTEX_FORMAT_FULL)
+        return PushConstants.vertexBuffer.vertices[index];
+
+    PackedVertex p = PackedVertexBuffer(PushConstants.vertexBuffer).vertices[index];
+
+    vec3 quantised = vec3(p.position_xy & 0xffff, p.position_xy >> 16, p.position_z & 0xffff);
+    vec2 uv = unpackHalf2x16(p.uv);
+
+    Vertex v;
+    v.position = PushConstants.positionOffset.xyz + quantised * PushConstants.positionScale.xyz;
+    v.normal = oct_decode(unpackSnorm2x16(p.normal));
+    v.uv_x = uv.x;
+    v.uv_y = uv.y;
+    v.color = unpackUnorm4x8(p.color);
+    return v;
+}
+
 void main()
 {
     // load the vertex
-    Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+    Vertex v = load_vertex(gl_VertexIndex);
 
 
     vec4 pos = vec4(v.position, 1);
@@ -38,7 +85,7 @@ void main()
     gl_Position = PushConstants.mvp * pos;
 
     outNormal = (PushConstants.mvp * vec4(v.normal, 0.f)).xyz;
-    outColor = material_data.color_factors.xyz;
+    outColor = v.color.xyz * material_data.color_factors.xyz;
     outUV.x = v.uv_x;
     outUV.y = v.uv_y;
 }
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../engine/utils.h"
+#include "../engine/jobs.h"
+#include "../engine/scene/import.h"
+#include "../engine/scene/cooked.h"
+#include "../engine/scene/image_decode.h"
+#include "../engine/scene/bc_encode.h"
+#include "../engine/scene/ktx2.h"
+
+// offline converter from gltf / obj into the engine's memory mappable mesh format, and from png /
+// jpeg into block compressed ktx2 textures with their whole mip chain
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "usage: %s <input.glb|input.gltf|input.obj> <output.nagm>\n", argv[0]);
+        fprintf(stderr, "       %s <input.png|input.jpg> <output.ktx2> [format, bc7 by default]\n",
+                argv[0]);
+        return 1;
+    }
+
+    char* input_path = argv[1];
+    char* output_path = argv[2];
+
+    uint64_t start_time = time_now_ns();
+
+    JobPool jobs;
+    job_pool_initialise(&jobs, 0);
+
+    const char* extension = strrchr(input_path, '.');
+    const char* output_extension = strrchr(output_path, '.');
+
+    if (output_extension != NULL && strcmp(output_extension, ".ktx2") == 0)
+    {
+        const char* format_name = argc == 4 ? argv[3] : "bc7";
+        VkFormat format = texture_format_from_name(format_name);
+        if (format == VK_FORMAT_UNDEFINED)
+            FATAL("Unknown texture format %s\n", format_name);
+
+        ImageData image = { .name = input_path, .path = input_path };
+        image_data_decode(&image);
+        if (image.pixels == NULL)
+            FATAL("Could not cook %s\n", input_path);
+        if (image.format != VK_FORMAT_R8G8B8A8_UNORM || image.n_levels != 1)
+            FATAL("%s is already a %s texture\n", input_path, texture_format_name(image.format));
+
+        Ktx2Texture texture = {
+            .format = format,
+            .width = image.width,
+            .height = image.height,
+            .n_levels = texture_mip_count(image.width, image.height),
+        };
+        texture.data = bc_encode_chain(&jobs, format, image.pixels, image.width, image.height,
+                texture.n_levels);
+
+        ktx2_write(output_path, &texture);
+
+        free(texture.data);
+        free(image.pixels);
+    }
+    else if (argc == 3)
+    {
+        uint32_t n_meshes = 0;
+        MeshData* meshes = NULL;
+        // only imported so the cook can record that it leaves them out, see cooked_is_current
+        ImportedMaterials materials = {0};
+
+        if (extension != NULL && strcmp(extension, ".obj") == 0)
+            meshes = import_obj(&jobs, input_path, &n_meshes, &materials);
+        else if (extension != NULL
+                && (strcmp(extension, ".glb") == 0 || strcmp(extension, ".gltf") == 0))
+            meshes = import_gltf(&jobs, input_path, &n_meshes, &materials);
+        else
+            FATAL("Don't know how to cook %s\n", input_path);
+
+        if (meshes == NULL)
+            FATAL("Could not import %s\n", input_path);
+
+        cooked_write(output_path, meshes, n_meshes, materials.n_materials);
+        if (materials.n_materials != 0)
+            LOG_W("%s has %u materials that aren't cooked, the engine will load it instead\n",
+                    input_path, materials.n_materials);
+        imported_materials_free(&materials);
+
+        mesh_datas_free(meshes, n_meshes);
+    }
+    else
+        FATAL("Only textures take a format\n");
+
+    job_pool_cleanup(&jobs);
+
+    LOG_V("Cooking took %.1lf ms\n", (time_now_ns() - start_time) / 1e6);
+
+    return 0;
+}
@@ -0,0 +1 @@
+../stb/stb_image.h
\ No newline at end of file